@@ -91,15 +91,34 @@ uint32_t filter(uint32_t ui32_new_value, uint32_t ui32_old_value, uint8_t ui8_al
  * @param[in/out]       : ui16_crc   - Anlik CRC degeri
  * @How to use          : First initial data has to be 0xFFFF.
  */
+// CRC-16 (Modbus, polynomial 0xA001 reflected) of each 4 bit value
+static const uint16_t ui16_crc16_table[16] =
+{
+  0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+  0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
 void crc16(uint8_t ui8_data, uint16_t* ui16_crc)
 {
-  unsigned int i;
+  uint16_t ui16_crc_temp = *ui16_crc ^ (uint16_t) ui8_data;
+  
+  // process low and high 4 bits, same result as shifting the 8 bits one by one
+  ui16_crc_temp = (ui16_crc_temp >> 4) ^ ui16_crc16_table[ui16_crc_temp & 0x0f];
+  ui16_crc_temp = (ui16_crc_temp >> 4) ^ ui16_crc16_table[ui16_crc_temp & 0x0f];
+  
+  *ui16_crc = ui16_crc_temp;
+}
 
-  *ui16_crc = *ui16_crc ^(uint16_t) ui8_data;
+uint16_t crc16_buf(const uint8_t *p_data, uint8_t ui8_length)
+{
+  uint16_t ui16_crc = 0xffff;
   
-  for (i = 8; i > 0; i--)
+  while (ui8_length--)
   {
-    if (*ui16_crc & 0x0001) { *ui16_crc = (*ui16_crc >> 1) ^ 0xA001; }
-    else { *ui16_crc >>= 1; }
+    ui16_crc ^= (uint16_t) *p_data++;
+    ui16_crc = (ui16_crc >> 4) ^ ui16_crc16_table[ui16_crc & 0x0f];
+    ui16_crc = (ui16_crc >> 4) ^ ui16_crc16_table[ui16_crc & 0x0f];
   }
+  
+  return ui16_crc;
 }
\ No newline at end of file
@@ -9,6 +9,8 @@
 #ifndef COMMON_COMMON_H_
 #define COMMON_COMMON_H_
 
+#include <stdint.h>
+
 
 // riding modes
 #define OFF_MODE                                  0
@@ -19,6 +21,7 @@
 #define WALK_ASSIST_MODE                          5
 #define CRUISE_MODE                               6
 #define CADENCE_SENSOR_CALIBRATION_MODE           7
+#define ASSIST_MAP_MODE                           8
 
 
 // error codes
@@ -30,6 +33,8 @@
 #define ERROR_NO_SPEED_SENSOR_DETECTED            5
 #define ERROR_LOW_CONTROLLER_VOLTAGE              6   // controller works with no less than 15 V so give error code if voltage is too low
 #define ERROR_CADENCE_SENSOR_CALIBRATION          7
+#define ERROR_HALL_SENSORS                        8
+#define ERROR_OVERCURRENT                         9
 
 
 // walk assist
@@ -52,6 +57,71 @@
 #define CALIBRATION_MODE                          2
 
 
+// telemetry data IDs, one data set of 4 bytes is sent on each package from the motor controller
+#define TELEMETRY_SCHEDULER_TASK_0                0   // run counter, late counter and max overrun of scheduler task 0
+#define TELEMETRY_SCHEDULER_TASK_1                1
+#define TELEMETRY_SCHEDULER_TASK_2                2
+#define TELEMETRY_STARTUP_TIMELINE_0              3   // startup timeline steps 0 and 1 in ms
+#define TELEMETRY_STARTUP_TIMELINE_1              4   // startup timeline steps 2 and 3 in ms
+#define TELEMETRY_STARTUP_TIMELINE_2              5   // startup timeline step 4 in ms
+#define TELEMETRY_BATTERY_CHARGE                  6   // battery charge since power on in mAs, 32 bits counter
+#define TELEMETRY_BATTERY_ENERGY                  7   // battery energy since power on in mWs, 32 bits counter
+#define TELEMETRY_BATTERY_MODEL                   8   // estimated battery internal resistance in milliohms and open circuit voltage x1000
+#define TELEMETRY_GEAR_SHIFTS                     9   // number of gear shifts detected since power on
+#define TELEMETRY_FAULT_0                         10  // latched state, latch counter and timestamp in 0.1 s of motor fault 0
+#define TELEMETRY_FAULT_1                         11
+#define TELEMETRY_FAULT_2                         12
+#define TELEMETRY_FAULT_3                         13
+#define TELEMETRY_UART_RX                         14  // number of frames received, CRC errors and bytes lost by UART overruns
+#define TELEMETRY_UART_RX_DROPPED                 15  // number of frames dropped because the last one was not processed yet
+#define TELEMETRY_NUMBER_OF_IDS                   16
+
+// flag on the telemetry data ID, set for the first telemetry cycles after the motor controller power on so the display knows its counters started again from zero
+#define TELEMETRY_RESTARTED                       0x80
+#define TELEMETRY_RESTARTED_CYCLES                10
+
+// motor controller startup timeline steps sent with the telemetry data
+#define STARTUP_TIMELINE_STEPS                    5
+
+
+// assist map
+#define ASSIST_MAP_TORQUE_POINTS                  6
+#define ASSIST_MAP_AXIS_POINTS                    4
+#define ASSIST_MAP_AXIS_TYPE_INDEX                0
+#define ASSIST_MAP_TORQUE_INDEX                   1
+#define ASSIST_MAP_AXIS_INDEX                     (ASSIST_MAP_TORQUE_INDEX + ASSIST_MAP_TORQUE_POINTS)
+#define ASSIST_MAP_CURRENT_INDEX                  (ASSIST_MAP_AXIS_INDEX + ASSIST_MAP_AXIS_POINTS)
+#define ASSIST_MAP_BYTES                          (ASSIST_MAP_CURRENT_INDEX + (ASSIST_MAP_TORQUE_POINTS * ASSIST_MAP_AXIS_POINTS))
+#define ASSIST_MAP_CHUNK_BYTES                    2
+#define ASSIST_MAP_CHUNKS                         ((ASSIST_MAP_BYTES + ASSIST_MAP_CHUNK_BYTES - 1) / ASSIST_MAP_CHUNK_BYTES)
+
+#define ASSIST_MAP_AXIS_CADENCE                   0
+#define ASSIST_MAP_AXIS_WHEEL_SPEED               1
+
+// default map: axis type, torque points (ADC steps), cadence points (RPM), then target current (ADC steps) for each cadence point
+#define ASSIST_MAP_DEFAULT_VALUES \
+  ASSIST_MAP_AXIS_CADENCE, \
+  0, 10, 30, 60, 100, 160, \
+  0, 30, 60, 90, \
+  0, 5, 10, 15, 20, 25, \
+  0, 8, 16, 26, 38, 50, \
+  0, 10, 20, 32, 48, 64, \
+  0, 10, 22, 36, 54, 72
+
+/*---------------------------------------------------------
+  NOTE: regarding the assist map
+
+  The assist map is a 2D table of battery current targets
+  in ADC steps (0.2 A per step). One axis is the pedal
+  torque in ADC steps, the other is either the cadence in
+  RPM or the wheel speed in km/h (axis type). Breakpoints
+  must be strictly increasing.
+
+  The display sends the map to the motor controller in
+  chunks of ASSIST_MAP_CHUNK_BYTES, chunk index first.
+---------------------------------------------------------*/
+
+
 int32_t map (int32_t x, int32_t in_min, int32_t in_max, int32_t out_min, int32_t out_max);
 int32_t map_inverse (int32_t x, int32_t in_min, int32_t in_max, int32_t out_min, int32_t out_max);
 uint8_t ui8_max (uint8_t value_a, uint8_t value_b);
@@ -59,6 +129,7 @@ uint8_t ui8_min (uint8_t value_a, uint8_t value_b);
 uint32_t filter(uint32_t ui32_new_value, uint32_t ui32_old_value, uint8_t ui8_alpha);
 void ui8_limit_max (uint8_t *ui8_p_value, uint8_t ui8_max_value);
 void crc16(uint8_t ui8_data, uint16_t* ui16_crc);
+uint16_t crc16_buf(const uint8_t *p_data, uint8_t ui8_length);   // CRC of a full frame, starting from 0xffff
 
 
 #endif /* COMMON_COMMON_H_ */
@@ -0,0 +1,70 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "uart_rx.h"
+
+
+void uart_rx_byte (struct_uart_rx *p_uart_rx, uint8_t ui8_byte, uint8_t ui8_overrun)
+{
+  // a byte was lost before this one, drop the frame being received as it can not be valid and look for a new start byte
+  if (ui8_overrun)
+  {
+    if (p_uart_rx->ui8_overruns < 255) { ++p_uart_rx->ui8_overruns; }
+    p_uart_rx->ui8_counter = 0;
+  }
+  
+  // wait for the start byte
+  if ((p_uart_rx->ui8_counter == 0) && (ui8_byte != p_uart_rx->ui8_start_byte)) { return; }
+  
+  p_uart_rx->p_buffer[p_uart_rx->ui8_write_buffer][p_uart_rx->ui8_counter] = ui8_byte;
+  
+  // continue if it is not the last byte of the frame
+  if (++p_uart_rx->ui8_counter < p_uart_rx->ui8_frame_length) { return; }
+  
+  p_uart_rx->ui8_counter = 0;
+  
+  // hand the frame to the main loop and continue in the other buffer, drop the frame if the last one was not processed yet
+  if (!p_uart_rx->ui8_frame_ready)
+  {
+    p_uart_rx->ui8_ready_buffer = p_uart_rx->ui8_write_buffer;
+    p_uart_rx->ui8_write_buffer ^= 1;
+    p_uart_rx->ui8_frame_ready = 1;
+  }
+  else if (p_uart_rx->ui8_frames_dropped < 255) { ++p_uart_rx->ui8_frames_dropped; }
+}
+
+
+
+volatile uint8_t* uart_rx_get_frame (struct_uart_rx *p_uart_rx)
+{
+  if (!p_uart_rx->ui8_frame_ready) { return 0; }
+  
+  return p_uart_rx->p_buffer[p_uart_rx->ui8_ready_buffer];
+}
+
+
+
+void uart_rx_frame_done (struct_uart_rx *p_uart_rx)
+{
+  p_uart_rx->ui8_frame_ready = 0;
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the UART receive counters
+
+  Overruns count bytes lost by the UART receiver, when the
+  receive interrupt did not read a byte before the next
+  one arrived. Frames dropped count complete frames lost
+  because the main loop did not process the last frame
+  before the next one was received. They have different
+  causes, interrupt latency and main loop latency, so they
+  are counted apart.
+---------------------------------------------------------*/
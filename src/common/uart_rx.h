@@ -0,0 +1,35 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef COMMON_UART_RX_H_
+#define COMMON_UART_RX_H_
+
+#include <stdint.h>
+
+// receive frame parser of one UART, frames are a start byte followed by a fixed number of bytes, set the start byte,
+// frame length and buffers with the initializer, all other members start at 0
+typedef struct _uart_rx
+{
+  uint8_t ui8_start_byte;
+  uint8_t ui8_frame_length;                 // start byte, data bytes and the two CRC bytes
+  volatile uint8_t *p_buffer[2];            // ping-pong buffers, the receive interrupt writes one while the main loop processes the other
+  volatile uint8_t ui8_write_buffer;
+  volatile uint8_t ui8_ready_buffer;
+  volatile uint8_t ui8_counter;
+  volatile uint8_t ui8_frame_ready;
+  volatile uint8_t ui8_overruns;            // bytes lost by the UART receiver, hardware overrun flag
+  volatile uint8_t ui8_frames_dropped;      // frames received before the last one was processed
+} struct_uart_rx;
+
+
+void uart_rx_byte (struct_uart_rx *p_uart_rx, uint8_t ui8_byte, uint8_t ui8_overrun);   // called by the UART receive interrupt
+volatile uint8_t* uart_rx_get_frame (struct_uart_rx *p_uart_rx);                          // received frame or 0 if there is none
+void uart_rx_frame_done (struct_uart_rx *p_uart_rx);                                        // frame processed, its buffer can be written again
+
+
+#endif /* COMMON_UART_RX_H_ */
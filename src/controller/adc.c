@@ -43,8 +43,7 @@ void adc_init (void)
   ADC1_Cmd(ENABLE);
 
   
-  #define ADC_CALIBRATION_TIME                    300 // 300 -> around 3.0 seconds
-  #define ADC_TORQUE_SENSOR_CALIBRATION_OFFSET    6
+  #define ADC_CALIBRATION_TIME                    10 // 10 -> around 0.1 seconds, the saved offset is used when valid and the offset is tracked while riding
   
   for (ui16_i = 0; ui16_i < ADC_CALIBRATION_TIME; ++ui16_i)
   {
@@ -24,6 +24,11 @@
 #define UI16_ADC_10_BIT_TORQUE_SENSOR     (((*(uint8_t*)(0x53E8)) << 2) | (*(uint8_t*)(0x53E9)))
 
 
+#define ADC_TORQUE_SENSOR_CALIBRATION_OFFSET    6
+#define ADC_TORQUE_SENSOR_OFFSET_MIN            5
+#define ADC_TORQUE_SENSOR_OFFSET_MAX            300
+
+
 extern volatile uint16_t ui16_adc_pedal_torque_offset;
 
 
@@ -0,0 +1,229 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "main.h"
+#include "common.h"
+#include "assist_map.h"
+
+
+static const uint8_t ui8_assist_map_default[ASSIST_MAP_BYTES] = { ASSIST_MAP_DEFAULT_VALUES };
+
+// active map and the precomputed segment slopes used by the control loop
+static uint8_t    ui8_assist_map[ASSIST_MAP_BYTES];
+static int16_t    i16_assist_map_torque_slope_x128[ASSIST_MAP_AXIS_POINTS][ASSIST_MAP_TORQUE_POINTS - 1];
+static uint16_t   ui16_assist_map_axis_inverse_width_x65535[ASSIST_MAP_AXIS_POINTS - 1];
+
+// map being received from the display
+static uint8_t    ui8_assist_map_received[ASSIST_MAP_BYTES];
+static uint32_t   ui32_assist_map_chunks_received = 0;
+
+static uint8_t assist_map_is_valid (uint8_t *ui8_p_map);
+static void assist_map_calc_slopes (void);
+
+
+
+void assist_map_init (void)
+{
+  uint8_t ui8_i;
+
+  // use the default map if the one read from EEPROM is not valid
+  if (!assist_map_is_valid(ui8_assist_map))
+  {
+    for (ui8_i = 0; ui8_i < ASSIST_MAP_BYTES; ui8_i++) { ui8_assist_map[ui8_i] = ui8_assist_map_default[ui8_i]; }
+  }
+
+  assist_map_calc_slopes();
+}
+
+
+
+uint8_t* assist_map_get_data (void)
+{
+  return ui8_assist_map;
+}
+
+
+
+uint8_t assist_map_receive_chunk (uint8_t ui8_chunk_index, uint8_t ui8_data_0, uint8_t ui8_data_1)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_map_changed = 0;
+  uint8_t ui8_index = ui8_chunk_index * ASSIST_MAP_CHUNK_BYTES;
+
+  // discard invalid chunk index
+  if (ui8_chunk_index >= ASSIST_MAP_CHUNKS) { return 0; }
+
+  // save chunk data, last chunk may be only partially used
+  ui8_assist_map_received[ui8_index] = ui8_data_0;
+  if ((ui8_index + 1) < ASSIST_MAP_BYTES) { ui8_assist_map_received[ui8_index + 1] = ui8_data_1; }
+
+  // flag chunk as received
+  ui32_assist_map_chunks_received |= ((uint32_t) 1) << ui8_chunk_index;
+
+  // check if all chunks were received
+  if (ui32_assist_map_chunks_received == ((((uint32_t) 1) << ASSIST_MAP_CHUNKS) - 1))
+  {
+    // start receiving a new map
+    ui32_assist_map_chunks_received = 0;
+
+    if (assist_map_is_valid(ui8_assist_map_received))
+    {
+      // check if received map is different from the active map
+      for (ui8_i = 0; ui8_i < ASSIST_MAP_BYTES; ui8_i++)
+      {
+        if (ui8_assist_map[ui8_i] != ui8_assist_map_received[ui8_i])
+        {
+          ui8_assist_map[ui8_i] = ui8_assist_map_received[ui8_i];
+          ui8_map_changed = 1;
+        }
+      }
+
+      if (ui8_map_changed) { assist_map_calc_slopes(); }
+    }
+  }
+
+  // signal if the active map changed so it can be saved
+  return ui8_map_changed;
+}
+
+
+
+uint8_t assist_map_get_target (uint16_t ui16_pedal_torque, uint8_t ui8_pedal_cadence_RPM, uint16_t ui16_wheel_speed_x10)
+{
+  uint8_t *ui8_p_torque = &ui8_assist_map[ASSIST_MAP_TORQUE_INDEX];
+  uint8_t *ui8_p_axis = &ui8_assist_map[ASSIST_MAP_AXIS_INDEX];
+  uint8_t *ui8_p_current_row_0;
+  uint8_t *ui8_p_current_row_1;
+  uint8_t ui8_torque;
+  uint8_t ui8_axis;
+  uint8_t ui8_torque_segment = 0;
+  uint8_t ui8_axis_segment = 0;
+  uint8_t ui8_i;
+  uint16_t ui16_axis_fraction_x256;
+  int16_t i16_current_row_0;
+  int16_t i16_current_row_1;
+
+  // get torque value and limit it to the map range
+  if (ui16_pedal_torque > 255) { ui8_torque = 255; }
+  else { ui8_torque = ui16_pedal_torque; }
+
+  if (ui8_torque < ui8_p_torque[0]) { ui8_torque = ui8_p_torque[0]; }
+  if (ui8_torque > ui8_p_torque[ASSIST_MAP_TORQUE_POINTS - 1]) { ui8_torque = ui8_p_torque[ASSIST_MAP_TORQUE_POINTS - 1]; }
+
+  // get second axis value and limit it to the map range
+  if (ui8_assist_map[ASSIST_MAP_AXIS_TYPE_INDEX] == ASSIST_MAP_AXIS_WHEEL_SPEED)
+  {
+    if (ui16_wheel_speed_x10 > 2550) { ui8_axis = 255; }
+    else { ui8_axis = ui16_wheel_speed_x10 / 10; }
+  }
+  else
+  {
+    ui8_axis = ui8_pedal_cadence_RPM;
+  }
+
+  if (ui8_axis < ui8_p_axis[0]) { ui8_axis = ui8_p_axis[0]; }
+  if (ui8_axis > ui8_p_axis[ASSIST_MAP_AXIS_POINTS - 1]) { ui8_axis = ui8_p_axis[ASSIST_MAP_AXIS_POINTS - 1]; }
+
+  // find segments, always loop over all breakpoints so execution time is constant
+  for (ui8_i = 1; ui8_i < (ASSIST_MAP_TORQUE_POINTS - 1); ui8_i++)
+  {
+    if (ui8_torque >= ui8_p_torque[ui8_i]) { ui8_torque_segment = ui8_i; }
+  }
+
+  for (ui8_i = 1; ui8_i < (ASSIST_MAP_AXIS_POINTS - 1); ui8_i++)
+  {
+    if (ui8_axis >= ui8_p_axis[ui8_i]) { ui8_axis_segment = ui8_i; }
+  }
+
+  // interpolate along the torque axis on both rows of the second axis segment
+  ui8_p_current_row_0 = &ui8_assist_map[ASSIST_MAP_CURRENT_INDEX + (ui8_axis_segment * ASSIST_MAP_TORQUE_POINTS)];
+  ui8_p_current_row_1 = ui8_p_current_row_0 + ASSIST_MAP_TORQUE_POINTS;
+
+  ui8_torque -= ui8_p_torque[ui8_torque_segment];
+
+  i16_current_row_0 = ui8_p_current_row_0[ui8_torque_segment] + (int16_t) ((((int32_t) i16_assist_map_torque_slope_x128[ui8_axis_segment][ui8_torque_segment] * ui8_torque) + 64) >> 7);
+  i16_current_row_1 = ui8_p_current_row_1[ui8_torque_segment] + (int16_t) ((((int32_t) i16_assist_map_torque_slope_x128[ui8_axis_segment + 1][ui8_torque_segment] * ui8_torque) + 64) >> 7);
+
+  // interpolate along the second axis
+  ui8_axis -= ui8_p_axis[ui8_axis_segment];
+
+  if (ui8_axis == (ui8_p_axis[ui8_axis_segment + 1] - ui8_p_axis[ui8_axis_segment])) { ui16_axis_fraction_x256 = 256; }
+  else { ui16_axis_fraction_x256 = (((uint32_t) ui8_axis * ui16_assist_map_axis_inverse_width_x65535[ui8_axis_segment]) + 128) >> 8; }
+
+  i16_current_row_0 += (int16_t) ((((int32_t) (i16_current_row_1 - i16_current_row_0) * ui16_axis_fraction_x256) + 128) >> 8);
+
+  // limit to the ADC current range
+  if (i16_current_row_0 < 0) { return 0; }
+  else if (i16_current_row_0 > 255) { return 255; }
+  else { return (uint8_t) i16_current_row_0; }
+}
+
+
+
+static uint8_t assist_map_is_valid (uint8_t *ui8_p_map)
+{
+  uint8_t ui8_i;
+
+  // check axis type
+  if (ui8_p_map[ASSIST_MAP_AXIS_TYPE_INDEX] > ASSIST_MAP_AXIS_WHEEL_SPEED) { return 0; }
+
+  // breakpoints must be strictly increasing
+  for (ui8_i = 1; ui8_i < ASSIST_MAP_TORQUE_POINTS; ui8_i++)
+  {
+    if (ui8_p_map[ASSIST_MAP_TORQUE_INDEX + ui8_i] <= ui8_p_map[ASSIST_MAP_TORQUE_INDEX + ui8_i - 1]) { return 0; }
+  }
+
+  for (ui8_i = 1; ui8_i < ASSIST_MAP_AXIS_POINTS; ui8_i++)
+  {
+    if (ui8_p_map[ASSIST_MAP_AXIS_INDEX + ui8_i] <= ui8_p_map[ASSIST_MAP_AXIS_INDEX + ui8_i - 1]) { return 0; }
+  }
+
+  return 1;
+}
+
+
+
+static void assist_map_calc_slopes (void)
+{
+  uint8_t ui8_row;
+  uint8_t ui8_i;
+  uint8_t ui8_width;
+  int16_t i16_delta;
+
+  // torque segment slopes for every row, current ADC steps per torque ADC step x128
+  for (ui8_row = 0; ui8_row < ASSIST_MAP_AXIS_POINTS; ui8_row++)
+  {
+    for (ui8_i = 0; ui8_i < (ASSIST_MAP_TORQUE_POINTS - 1); ui8_i++)
+    {
+      ui8_width = ui8_assist_map[ASSIST_MAP_TORQUE_INDEX + ui8_i + 1] - ui8_assist_map[ASSIST_MAP_TORQUE_INDEX + ui8_i];
+      i16_delta = (int16_t) ui8_assist_map[ASSIST_MAP_CURRENT_INDEX + (ui8_row * ASSIST_MAP_TORQUE_POINTS) + ui8_i + 1] -
+                  (int16_t) ui8_assist_map[ASSIST_MAP_CURRENT_INDEX + (ui8_row * ASSIST_MAP_TORQUE_POINTS) + ui8_i];
+
+      // round to nearest
+      if (i16_delta < 0) { i16_assist_map_torque_slope_x128[ui8_row][ui8_i] = (int16_t) ((((int32_t) i16_delta << 7) - (ui8_width >> 1)) / ui8_width); }
+      else { i16_assist_map_torque_slope_x128[ui8_row][ui8_i] = (int16_t) ((((int32_t) i16_delta << 7) + (ui8_width >> 1)) / ui8_width); }
+    }
+  }
+
+  // second axis inverse segment widths
+  for (ui8_i = 0; ui8_i < (ASSIST_MAP_AXIS_POINTS - 1); ui8_i++)
+  {
+    ui8_width = ui8_assist_map[ASSIST_MAP_AXIS_INDEX + ui8_i + 1] - ui8_assist_map[ASSIST_MAP_AXIS_INDEX + ui8_i];
+    ui16_assist_map_axis_inverse_width_x65535[ui8_i] = 65535 / ui8_width;
+  }
+
+  /*---------------------------------------------------------
+    NOTE: regarding the assist map evaluation
+
+    Slopes are only calculated when a new map is set so the
+    evaluation on the control loop has no divisions and a
+    constant execution time.
+  ---------------------------------------------------------*/
+}
@@ -0,0 +1,21 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _ASSIST_MAP_H_
+#define _ASSIST_MAP_H_
+
+#include <stdint.h>
+#include "main.h"
+#include "common.h"
+
+void assist_map_init (void);
+uint8_t* assist_map_get_data (void);
+uint8_t assist_map_receive_chunk (uint8_t ui8_chunk_index, uint8_t ui8_data_0, uint8_t ui8_data_1);
+uint8_t assist_map_get_target (uint16_t ui16_pedal_torque, uint8_t ui8_pedal_cadence_RPM, uint16_t ui16_wheel_speed_x10);
+
+#endif /* _ASSIST_MAP_H_ */
@@ -0,0 +1,284 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "common.h"
+#include "battery.h"
+
+
+// last (V, I) pair in 10 bit ADC steps, current with x4 resolution
+static uint16_t ui16_battery_model_adc_voltage = 0;
+static uint16_t ui16_battery_model_adc_current_x4 = 0;
+
+// slow baseline of voltage and current, x256
+static int32_t i32_battery_model_voltage_baseline_x256 = 0;
+static int32_t i32_battery_model_current_baseline_x256 = 0;
+
+// filtered covariance of voltage and current and variance of current around the baseline
+static int32_t i32_battery_model_covariance = 0;
+static int32_t i32_battery_model_variance = 0;
+
+static uint16_t ui16_battery_resistance_mohm = BATTERY_RESISTANCE_MOHM_DEFAULT;
+static uint16_t ui16_battery_open_circuit_voltage_x1000 = 0;
+
+// battery charge and energy counters since power on and fixed point remainders
+static uint32_t ui32_battery_charge_mAs = 0;
+static uint32_t ui32_battery_energy_mWs = 0;
+static uint16_t ui16_battery_charge_remainder_x8192 = 0;
+static uint16_t ui16_battery_energy_remainder_x8192 = 0;
+
+
+static uint16_t battery_model_open_circuit_voltage_x1000 (void);
+
+
+
+// happens every MOTOR_CONTROLLER_PERIOD_MS after read_battery_voltage() and read_battery_current()
+void battery_model_update (uint16_t ui16_adc_battery_voltage, uint16_t ui16_adc_battery_current_x4)
+{
+  #define BATTERY_MODEL_BASELINE_FILTER_SHIFT       8   // ~1 s
+  #define BATTERY_MODEL_COVARIANCE_FILTER_SHIFT     8   // ~1 s
+  
+  static uint8_t ui8_baseline_initialized = 0;
+  
+  int32_t i32_voltage_x256 = (int32_t) ui16_adc_battery_voltage << 8;
+  int32_t i32_current_x256 = (int32_t) ui16_adc_battery_current_x4 << 8;
+  int32_t i32_delta_voltage_x16;
+  int32_t i32_delta_current_x16;
+  
+  // no voltage reading yet
+  if (!ui16_adc_battery_voltage) { return; }
+  
+  ui16_battery_model_adc_voltage = ui16_adc_battery_voltage;
+  ui16_battery_model_adc_current_x4 = ui16_adc_battery_current_x4;
+  
+  // start baseline and open circuit voltage from first values, so current is not limited while they settle after power on
+  if (!ui8_baseline_initialized)
+  {
+    ui8_baseline_initialized = 1;
+    i32_battery_model_voltage_baseline_x256 = i32_voltage_x256;
+    i32_battery_model_current_baseline_x256 = i32_current_x256;
+    ui16_battery_open_circuit_voltage_x1000 = battery_model_open_circuit_voltage_x1000();
+  }
+  
+  // update baseline
+  i32_battery_model_voltage_baseline_x256 += (i32_voltage_x256 - i32_battery_model_voltage_baseline_x256) >> BATTERY_MODEL_BASELINE_FILTER_SHIFT;
+  i32_battery_model_current_baseline_x256 += (i32_current_x256 - i32_battery_model_current_baseline_x256) >> BATTERY_MODEL_BASELINE_FILTER_SHIFT;
+  
+  // deviation from baseline, voltage in 1/16 of a 10 bit ADC step and current in 1/16 of a 10 bit ADC step
+  i32_delta_voltage_x16 = (i32_voltage_x256 - i32_battery_model_voltage_baseline_x256) >> 4;
+  i32_delta_current_x16 = (i32_current_x256 - i32_battery_model_current_baseline_x256) >> 6;
+  
+  // update covariance and variance
+  i32_battery_model_covariance += ((i32_delta_voltage_x16 * i32_delta_current_x16) - i32_battery_model_covariance) >> BATTERY_MODEL_COVARIANCE_FILTER_SHIFT;
+  i32_battery_model_variance += ((i32_delta_current_x16 * i32_delta_current_x16) - i32_battery_model_variance) >> BATTERY_MODEL_COVARIANCE_FILTER_SHIFT;
+}
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS
+void battery_model_calc (void)
+{
+  #define BATTERY_MODEL_VARIANCE_MIN                6400  // current deviation of 1 amp
+  #define BATTERY_MODEL_RESISTANCE_FILTER_SHIFT     4
+  #define BATTERY_MODEL_VOLTAGE_FILTER_COEFFICIENT  80
+  #define BATTERY_RESISTANCE_PER_ADC_RATIO_MOHM     433   // 10 bit ADC voltage step / 10 bit ADC current step = 0.0863 V / 0.1992 A
+  
+  int32_t i32_covariance = -i32_battery_model_covariance;
+  int32_t i32_variance = i32_battery_model_variance;
+  int16_t i16_resistance_mohm;
+  
+  // only estimate resistance when current changes enough
+  if (i32_variance >= BATTERY_MODEL_VARIANCE_MIN)
+  {
+    // voltage drops when current rises so the covariance is negative, otherwise it is noise
+    if (i32_covariance <= 0)
+    {
+      i16_resistance_mohm = BATTERY_RESISTANCE_MOHM_MIN;
+    }
+    else if ((i32_covariance / BATTERY_RESISTANCE_MOHM_MAX) >= (i32_variance / BATTERY_RESISTANCE_PER_ADC_RATIO_MOHM))
+    {
+      i16_resistance_mohm = BATTERY_RESISTANCE_MOHM_MAX;
+    }
+    else
+    {
+      // scale down to avoid overflow
+      while (i32_covariance > 1000000) { i32_covariance >>= 1; i32_variance >>= 1; }
+      
+      i16_resistance_mohm = (i32_covariance * BATTERY_RESISTANCE_PER_ADC_RATIO_MOHM) / i32_variance;
+      
+      if (i16_resistance_mohm < BATTERY_RESISTANCE_MOHM_MIN) { i16_resistance_mohm = BATTERY_RESISTANCE_MOHM_MIN; }
+    }
+    
+    // low pass filter the resistance
+    ui16_battery_resistance_mohm += (i16_resistance_mohm - (int16_t) ui16_battery_resistance_mohm) >> BATTERY_MODEL_RESISTANCE_FILTER_SHIFT;
+  }
+  
+  // low pass filter the open circuit voltage, it was started from the first value in battery_model_update()
+  if (ui16_battery_open_circuit_voltage_x1000)
+  {
+    ui16_battery_open_circuit_voltage_x1000 = filter(battery_model_open_circuit_voltage_x1000(), ui16_battery_open_circuit_voltage_x1000, BATTERY_MODEL_VOLTAGE_FILTER_COEFFICIENT);
+  }
+}
+
+
+
+// open circuit voltage = loaded voltage + current * resistance, from the last (V, I) pair
+static uint16_t battery_model_open_circuit_voltage_x1000 (void)
+{
+  uint32_t ui32_voltage_x1000 = ((uint32_t) ui16_battery_model_adc_voltage * BATTERY_VOLTAGE_PER_10_BIT_ADC_STEP_X10000) / 10;
+  uint32_t ui32_current_x1000 = ((uint32_t) ui16_battery_model_adc_current_x4 * BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X512 * 1000) >> 11;
+  uint32_t ui32_open_circuit_voltage_x1000 = ui32_voltage_x1000 + ((ui32_current_x1000 * ui16_battery_resistance_mohm) / 1000);
+  
+  if (ui32_open_circuit_voltage_x1000 > 65535) { ui32_open_circuit_voltage_x1000 = 65535; }
+  
+  return (uint16_t) ui32_open_circuit_voltage_x1000;
+}
+
+
+
+uint16_t battery_get_resistance_mohm (void)
+{
+  return ui16_battery_resistance_mohm;
+}
+
+
+
+uint16_t battery_get_open_circuit_voltage_x1000 (void)
+{
+  return ui16_battery_open_circuit_voltage_x1000;
+}
+
+
+
+uint8_t battery_get_adc_current_max (uint8_t ui8_power_max_div25, uint16_t ui16_voltage_cut_off_x10)
+{
+  #define BATTERY_POWER_LIMIT_ITERATIONS            3
+  
+  uint32_t ui32_open_circuit_voltage_x1000 = ui16_battery_open_circuit_voltage_x1000;
+  uint32_t ui32_voltage_min_x1000 = ((uint32_t) ui16_voltage_cut_off_x10 * 100) + BATTERY_SOFT_LVC_MARGIN_X1000;
+  uint32_t ui32_loaded_voltage_x1000;
+  uint32_t ui32_current_power_max_x10;
+  uint32_t ui32_current_lvc_max_x10;
+  uint32_t ui32_adc_current_max;
+  uint8_t ui8_i;
+  
+  // no current until the open circuit voltage is known or when it is below the soft low voltage cut off
+  if (ui32_open_circuit_voltage_x1000 <= ui32_voltage_min_x1000) { return 0; }
+  
+  // max current that keeps the predicted loaded voltage above the soft low voltage cut off
+  ui32_current_lvc_max_x10 = ((ui32_open_circuit_voltage_x1000 - ui32_voltage_min_x1000) * 10) / ui16_battery_resistance_mohm;
+  
+  // max current from power limit, solve power = (open circuit voltage - current * resistance) * current by iteration
+  ui32_current_power_max_x10 = ((uint32_t) ui8_power_max_div25 * 250000) / ui32_open_circuit_voltage_x1000;
+  
+  for (ui8_i = 0; ui8_i < BATTERY_POWER_LIMIT_ITERATIONS; ui8_i++)
+  {
+    // stop if the current would take the voltage below the soft low voltage cut off, that limit is lower anyway
+    if (ui32_current_power_max_x10 >= ui32_current_lvc_max_x10) { break; }
+    
+    ui32_loaded_voltage_x1000 = ui32_open_circuit_voltage_x1000 - ((ui32_current_power_max_x10 * ui16_battery_resistance_mohm) / 10);
+    ui32_current_power_max_x10 = ((uint32_t) ui8_power_max_div25 * 250000) / ui32_loaded_voltage_x1000;
+  }
+  
+  // use the lower limit
+  if (ui32_current_lvc_max_x10 < ui32_current_power_max_x10) { ui32_current_power_max_x10 = ui32_current_lvc_max_x10; }
+  
+  ui32_adc_current_max = ui32_current_power_max_x10 / BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10;
+  if (ui32_adc_current_max > 255) { ui32_adc_current_max = 255; }
+  
+  return (uint8_t) ui32_adc_current_max;
+}
+
+
+
+// happens every MOTOR_CONTROLLER_PERIOD_MS with the TIM3 ticks since the last run
+void battery_calc_charge_and_energy (uint16_t ui16_adc_battery_voltage, uint16_t ui16_adc_battery_current, uint16_t ui16_ticks)
+{
+  #define BATTERY_CHARGE_PER_TICK_X8192     1671  // mAs for each battery current ADC step and TIM3 tick (~1 ms): 0.204 * 8192
+  #define BATTERY_ENERGY_PER_TICK_X8192     577   // mWs for each 4 battery voltage ADC steps * battery current ADC steps and TIM3 tick (~1 ms): 0.0704 * 8192
+  #define BATTERY_ENERGY_TICKS_MAX          20    // limit time since last run so calculations do not overflow
+  
+  uint32_t ui32_temp;
+  
+  // limit time since last run
+  if (ui16_ticks > BATTERY_ENERGY_TICKS_MAX) { ui16_ticks = BATTERY_ENERGY_TICKS_MAX; }
+  
+  // charge
+  ui32_temp = ((uint32_t) ui16_adc_battery_current * BATTERY_CHARGE_PER_TICK_X8192 * ui16_ticks) + ui16_battery_charge_remainder_x8192;
+  ui32_battery_charge_mAs += ui32_temp >> 13;
+  ui16_battery_charge_remainder_x8192 = ui32_temp & 8191;
+  
+  // energy: battery voltage times battery current
+  ui32_temp = ((((uint32_t) ui16_adc_battery_voltage * ui16_adc_battery_current) >> 2) * BATTERY_ENERGY_PER_TICK_X8192 * ui16_ticks) + ui16_battery_energy_remainder_x8192;
+  ui32_battery_energy_mWs += ui32_temp >> 13;
+  ui16_battery_energy_remainder_x8192 = ui32_temp & 8191;
+}
+
+
+
+uint32_t battery_get_charge_mAs (void)
+{
+  return ui32_battery_charge_mAs;
+}
+
+
+
+uint32_t battery_get_energy_mWs (void)
+{
+  return ui32_battery_energy_mWs;
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the battery model
+
+  The battery is modeled as an open circuit voltage with an
+  internal resistance in series. Resistance is estimated
+  from how much voltage drops when current changes:
+  deviations of voltage and current from a slow baseline
+  are correlated and resistance is their covariance
+  divided by the current variance. It is only updated when
+  current changes enough, so while cruising at constant
+  current the last estimate is kept.
+
+  Open circuit voltage is the measured voltage plus the
+  voltage drop on the internal resistance. It starts from
+  the first voltage reading, so current is available right
+  after power on instead of after the filter settles.
+
+  Current limits use the predicted loaded voltage, so the
+  power limit is kept when voltage sags under load and
+  current is tapered before the low voltage cut off is
+  reached instead of hitting it.
+---------------------------------------------------------*/
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding battery charge and energy
+
+  Battery current is the last 10 bit ADC value and each
+  step is 102 / 512 amps. TIM3 tick is 1.024 ms.
+
+  charge per tick = 102 / 512 * 1.024 = 0.204 mAs
+
+  Each 10 bit battery voltage ADC step is 0.0863 volts.
+
+  energy per tick = 0.0863 * 0.204 * 4 = 0.0704 mWs
+
+  The filtered battery current of read_battery_current() is
+  not used: its filter truncates and so reads on average
+  3 / 8 of an ADC step, 0.075 amps, too high. Summing the
+  unfiltered value already averages the ADC noise.
+
+  Counters are sent to the display which uses the
+  difference between received values so they can
+  overflow.
+---------------------------------------------------------*/
@@ -0,0 +1,32 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _BATTERY_H_
+#define _BATTERY_H_
+
+#include <stdint.h>
+#include "main.h"
+
+// battery internal resistance limits and value used until it is estimated
+#define BATTERY_RESISTANCE_MOHM_MIN               20
+#define BATTERY_RESISTANCE_MOHM_MAX               1000
+#define BATTERY_RESISTANCE_MOHM_DEFAULT           200
+
+// current is limited so the predicted loaded voltage stays this much above the low voltage cut off
+#define BATTERY_SOFT_LVC_MARGIN_X1000             500
+
+void battery_model_update (uint16_t ui16_adc_battery_voltage, uint16_t ui16_adc_battery_current_x4);
+void battery_model_calc (void);
+uint16_t battery_get_resistance_mohm (void);
+uint16_t battery_get_open_circuit_voltage_x1000 (void);
+uint8_t battery_get_adc_current_max (uint8_t ui8_power_max_div25, uint16_t ui16_voltage_cut_off_x10);
+void battery_calc_charge_and_energy (uint16_t ui16_adc_battery_voltage, uint16_t ui16_adc_battery_current, uint16_t ui16_ticks);
+uint32_t battery_get_charge_mAs (void);
+uint32_t battery_get_energy_mWs (void);
+
+#endif /* _BATTERY_H_ */
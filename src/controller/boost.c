@@ -0,0 +1,202 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "boost.h"
+
+
+static uint8_t    ui8_startup_boost_state = BOOST_STATE_BOOST_DISABLED;
+static uint8_t    ui8_startup_boost_adc_current_target = 0;
+static uint16_t   ui16_startup_boost_timer = 0;
+static uint16_t   ui16_startup_boost_fade_steps = 0;
+static uint16_t   ui16_startup_boost_fade_steps_total = 0;
+
+static uint8_t boost (const struct_boost_inputs *p_inputs);
+static void boost_run_statemachine (const struct_boost_inputs *p_inputs);
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS after the riding mode set the current and duty cycle targets
+void boost_controller (const struct_boost_inputs *p_inputs, uint8_t *p_adc_battery_current_target, uint8_t *p_duty_cycle_target)
+{
+  // run boost state machine also when there is no assist so it can restart
+  boost_run_statemachine(p_inputs);
+  
+  // boost only in the riding modes that assist with pedal torque and when assist is enabled
+  if (!p_inputs->ui8_assist_enabled) { return; }
+  
+  switch (ui8_startup_boost_state)
+  {
+    case BOOST_STATE_BOOST:
+    
+      // set boost current target
+      ui8_startup_boost_adc_current_target = boost(p_inputs);
+      
+      // use boost current target if higher than current target of the riding mode, only while pedaling
+      if ((p_inputs->ui8_pedal_cadence_RPM) && (ui8_startup_boost_adc_current_target > *p_adc_battery_current_target))
+      {
+        *p_adc_battery_current_target = ui8_startup_boost_adc_current_target;
+        
+        // the riding mode sets no duty cycle target when its current target is zero
+        *p_duty_cycle_target = PWM_DUTY_CYCLE_MAX;
+      }
+      
+    break;
+    
+    case BOOST_STATE_FADE:
+    
+      // fade linearly from the boost current target at the end of boost to the current target of the riding mode
+      if ((p_inputs->ui8_pedal_cadence_RPM) &&
+          (ui8_startup_boost_adc_current_target > *p_adc_battery_current_target) &&
+          (ui16_startup_boost_fade_steps_total))
+      {
+        *p_adc_battery_current_target += ((uint16_t) (ui8_startup_boost_adc_current_target - *p_adc_battery_current_target) * ui16_startup_boost_fade_steps) / ui16_startup_boost_fade_steps_total;
+        *p_duty_cycle_target = PWM_DUTY_CYCLE_MAX;
+      }
+      
+    break;
+  }
+}
+
+
+
+uint8_t boost_get_state (void)
+{
+  return ui8_startup_boost_state;
+}
+
+
+
+static uint8_t boost (const struct_boost_inputs *p_inputs)
+{
+  uint32_t ui32_boost_power;
+  uint32_t ui32_adc_battery_current_target_boost;
+  
+  // boost with max current
+  if (p_inputs->ui8_limit_to_max_power) { return p_inputs->ui8_adc_battery_current_max; }
+  
+  // avoid division by zero
+  if (!p_inputs->ui16_battery_voltage_x1000) { return 0; }
+  
+  // boost power in watts = pedal torque in Nm * boost assist level
+  ui32_boost_power = ((uint32_t) p_inputs->ui16_pedal_torque_x100 * p_inputs->ui8_assist_level) / 100;
+  
+  // boost current in ADC steps
+  ui32_adc_battery_current_target_boost = ((ui32_boost_power * 10000) / p_inputs->ui16_battery_voltage_x1000) / BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10;
+  
+  if (ui32_adc_battery_current_target_boost > 255) { ui32_adc_battery_current_target_boost = 255; }
+  
+  return (uint8_t) ui32_adc_battery_current_target_boost;
+}
+
+
+
+static void boost_run_statemachine (const struct_boost_inputs *p_inputs)
+{
+  uint8_t ui8_pedal_torque_applied = (p_inputs->ui16_adc_pedal_torque_delta > BOOST_PEDAL_TORQUE_ADC_DELTA_MIN);
+  
+  // boost disabled
+  if ((!p_inputs->ui8_feature_enabled) || (!p_inputs->ui8_time_x10))
+  {
+    ui8_startup_boost_state = BOOST_STATE_BOOST_DISABLED;
+    return;
+  }
+  
+  switch (ui8_startup_boost_state)
+  {
+    // wait for pedal torque while pedaling to start boost, standing on the pedals at stop does not start it
+    case BOOST_STATE_BOOST_DISABLED:
+    
+      if (ui8_pedal_torque_applied && p_inputs->ui8_pedal_cadence_RPM && !p_inputs->ui8_brakes_enabled)
+      {
+        ui16_startup_boost_timer = (uint16_t) p_inputs->ui8_time_x10 * BOOST_TIME_STEPS_PER_UNIT;
+        ui8_startup_boost_state = BOOST_STATE_BOOST;
+      }
+      
+    break;
+    
+    case BOOST_STATE_BOOST:
+    
+      // braking resets boost
+      if (p_inputs->ui8_brakes_enabled)
+      {
+        ui8_startup_boost_state = BOOST_STATE_BOOST_DISABLED;
+      }
+      // end boost if no pedal torque
+      else if (!ui8_pedal_torque_applied)
+      {
+        ui8_startup_boost_state = BOOST_STATE_BOOST_WAIT_TO_RESTART;
+      }
+      // end boost and start fade when boost time is over
+      else if (--ui16_startup_boost_timer == 0)
+      {
+        ui16_startup_boost_fade_steps_total = (uint16_t) p_inputs->ui8_fade_time_x10 * BOOST_TIME_STEPS_PER_UNIT;
+        ui16_startup_boost_fade_steps = ui16_startup_boost_fade_steps_total;
+        
+        if (ui16_startup_boost_fade_steps) { ui8_startup_boost_state = BOOST_STATE_FADE; }
+        else { ui8_startup_boost_state = BOOST_STATE_BOOST_WAIT_TO_RESTART; }
+      }
+      
+    break;
+    
+    case BOOST_STATE_FADE:
+    
+      // braking resets boost
+      if (p_inputs->ui8_brakes_enabled)
+      {
+        ui8_startup_boost_state = BOOST_STATE_BOOST_DISABLED;
+      }
+      // end fade if no pedal torque or when fade time is over
+      else if ((!ui8_pedal_torque_applied) || (--ui16_startup_boost_fade_steps == 0))
+      {
+        ui8_startup_boost_state = BOOST_STATE_BOOST_WAIT_TO_RESTART;
+      }
+      
+    break;
+    
+    case BOOST_STATE_BOOST_WAIT_TO_RESTART:
+    
+      if (p_inputs->ui8_restart_mode & 1)
+      {
+        // boost again after pedaling stops
+        if ((!ui8_pedal_torque_applied) || (!p_inputs->ui8_pedal_cadence_RPM)) { ui8_startup_boost_state = BOOST_STATE_BOOST_DISABLED; }
+      }
+      else
+      {
+        // boost again after the wheel stops and there is no pedal torque
+        if ((!p_inputs->ui16_wheel_speed_x10) && (!ui8_pedal_torque_applied)) { ui8_startup_boost_state = BOOST_STATE_BOOST_DISABLED; }
+      }
+      
+    break;
+    
+    default:
+    
+      ui8_startup_boost_state = BOOST_STATE_BOOST_DISABLED;
+      
+    break;
+  }
+}
+
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the startup power boost
+
+  When pedal torque is applied while pedaling the boost
+  current target is used for the configured boost time,
+  if higher than the current target of the riding mode.
+  Then it fades out linearly to the current target of the
+  riding mode over the configured fade time. The duty
+  cycle target is set to max while boost current is used.
+
+  Boost starts again after the wheel stops or, if set in
+  ui8_startup_motor_power_boost_state, after pedaling
+  stops. Braking resets boost at any time.
+---------------------------------------------------------*/
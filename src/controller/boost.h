@@ -0,0 +1,49 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _BOOST_H_
+#define _BOOST_H_
+
+#include <stdint.h>
+#include "main.h"
+
+// startup power boost states
+#define BOOST_STATE_BOOST_DISABLED          0
+#define BOOST_STATE_BOOST                   1
+#define BOOST_STATE_FADE                    2
+#define BOOST_STATE_BOOST_WAIT_TO_RESTART   3
+
+#define BOOST_PEDAL_TORQUE_ADC_DELTA_MIN    12
+#define BOOST_TIME_STEPS_PER_UNIT           (100 / EBIKE_APP_CONTROLLER_PERIOD_MS)  // boost and fade times are in 0.1 s
+
+// inputs of the startup power boost, set by the app on every run
+typedef struct _boost_inputs
+{
+  // configuration
+  uint8_t ui8_feature_enabled;
+  uint8_t ui8_restart_mode;             // bit 0: boost again after pedaling stops instead of after the wheel stops
+  uint8_t ui8_limit_to_max_power;
+  uint8_t ui8_assist_level;             // boost power in watts per Nm of pedal torque
+  uint8_t ui8_time_x10;                 // 0.1 s
+  uint8_t ui8_fade_time_x10;            // 0.1 s
+  
+  // riding state
+  uint8_t ui8_assist_enabled;           // riding mode assists with pedal torque and assist level is not zero
+  uint16_t ui16_adc_pedal_torque_delta;
+  uint16_t ui16_pedal_torque_x100;
+  uint8_t ui8_pedal_cadence_RPM;
+  uint8_t ui8_brakes_enabled;
+  uint16_t ui16_wheel_speed_x10;
+  uint16_t ui16_battery_voltage_x1000;
+  uint8_t ui8_adc_battery_current_max;
+} struct_boost_inputs;
+
+void boost_controller (const struct_boost_inputs *p_inputs, uint8_t *p_adc_battery_current_target, uint8_t *p_duty_cycle_target);
+uint8_t boost_get_state (void);
+
+#endif /* _BOOST_H_ */
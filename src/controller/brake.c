@@ -16,27 +16,94 @@
 #include "motor.h"
 
 
+volatile uint8_t ui8_g_brake_latched = 0;
+volatile uint8_t ui8_g_brake_cut = 0;
+
+// motor state when the brake interrupt cut power, restored if the brake pin was a glitch
+static uint8_t ui8_brake_cut_counter;
+static uint8_t ui8_brake_cut_pwm_enabled;
+static uint8_t ui8_brake_cut_duty_cycle;
+static uint8_t ui8_brake_cut_duty_cycle_target;
+static uint8_t ui8_brake_cut_adc_battery_current_target;
+
+#define BRAKE_PWM_OUTPUTS_CCER1   (TIM1_CCER1_CC1E | TIM1_CCER1_CC1NE | TIM1_CCER1_CC2E | TIM1_CCER1_CC2NE)
+#define BRAKE_PWM_OUTPUTS_CCER2   (TIM1_CCER2_CC3E | TIM1_CCER2_CC3NE)
+
+
 void brake_init (void)
 {
   // brake pin as external input pin interrupt
   GPIO_Init(BRAKE__PORT, BRAKE__PIN, GPIO_MODE_IN_FL_IT); // with external interrupt
 
-  // initialize the interrupt operation
-  EXTI_SetExtIntSensitivity(EXTI_PORT_GPIOC, EXTI_SENSITIVITY_RISE_FALL);
+  // interrupt when the brake is applied, brake pin goes low, release is seen by the PWM interrupt and the app
+  EXTI_SetExtIntSensitivity(EXTI_PORT_GPIOC, EXTI_SENSITIVITY_FALL_ONLY);
 }
 
 
-// brake signal interrupt
+// brake signal interrupt, cuts motor power on the brake edge and brake_qualify() on the next PWM cycles latches it or
+// restores power if it was a glitch
 void EXTI_PORTC_IRQHandler(void) __interrupt(EXTI_PORTC_IRQHANDLER)
 {
-/*   if (brake_is_set())
+  if ((!(BRAKE__PORT->IDR & BRAKE__PIN)) && (!ui8_g_brake_cut) && (!ui8_g_brake_latched))
   {
+    // disable PWM outputs of all phases first
+    ui8_brake_cut_pwm_enabled = (TIM1->CCER1 & TIM1_CCER1_CC1E) ? 1 : 0;
+    TIM1->CCER1 &= (uint8_t) ~BRAKE_PWM_OUTPUTS_CCER1;
+    TIM1->CCER2 &= (uint8_t) ~BRAKE_PWM_OUTPUTS_CCER2;
+    
+    // zero duty cycle and targets, keep them to restore after a glitch
+    ui8_brake_cut_duty_cycle = ui8_g_duty_cycle;
+    ui8_brake_cut_duty_cycle_target = ui8_controller_duty_cycle_target;
+    ui8_brake_cut_adc_battery_current_target = ui8_controller_adc_battery_current_target;
+    ui8_g_duty_cycle = 0;
+    ui8_controller_duty_cycle_target = 0;
+    ui8_controller_adc_battery_current_target = 0;
+    
+    ui8_brake_cut_counter = 0;
+    ui8_g_brake_cut = 1;
+  }
+}
+
+
 
+// happens on every PWM cycle while the brake interrupt cut power
+void brake_qualify (void)
+{
+  if (!(BRAKE__PORT->IDR & BRAKE__PIN))
+  {
+    // brake applied for BRAKE_CUT_PWM_CYCLES: latch, the app set targets while the cut was not latched are dropped
+    if (++ui8_brake_cut_counter >= BRAKE_CUT_PWM_CYCLES)
+    {
+      ui8_g_duty_cycle = 0;
+      ui8_controller_duty_cycle_target = 0;
+      ui8_controller_adc_battery_current_target = 0;
+      ui8_g_brake_latched = 1;
+      ui8_g_brake_cut = 0;
+    }
   }
   else
   {
+    // glitch, restore motor power as it was, motor speed did not change in the few PWM cycles
+    ui8_g_duty_cycle = ui8_brake_cut_duty_cycle;
+    ui8_controller_duty_cycle_target = ui8_brake_cut_duty_cycle_target;
+    ui8_controller_adc_battery_current_target = ui8_brake_cut_adc_battery_current_target;
+    
+    if (ui8_brake_cut_pwm_enabled)
+    {
+      TIM1->CCER1 |= BRAKE_PWM_OUTPUTS_CCER1;
+      TIM1->CCER2 |= BRAKE_PWM_OUTPUTS_CCER2;
+    }
+    
+    ui8_g_brake_cut = 0;
+  }
+}
+
 
-  } */
+
+// PWM output state to restore if the cut was a glitch, motor_enable_pwm() and motor_disable_pwm() call it with interrupts disabled
+void brake_cut_set_pwm (uint8_t ui8_enabled)
+{
+  ui8_brake_cut_pwm_enabled = ui8_enabled;
 }
 
 
@@ -46,3 +113,28 @@ BitStatus brake_is_set(void)
   else { return 0; }
 }
 
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the brake power cut
+
+  The brake interrupt cuts motor power on the brake edge,
+  the app only notices brakes on its next run. A single
+  edge is not enough to keep power cut: a glitch on the
+  brake wire would stop the motor, and the motor is enabled
+  again only when stopped. So the PWM interrupt checks the
+  brake pin on the next PWM cycles: if it is active for
+  BRAKE_CUT_PWM_CYCLES the cut is latched, if it was
+  released the duty cycle, targets and PWM outputs are
+  restored as they were. The latch keeps the brakes enabled
+  for the app even if the brake was released before it was
+  polled, so a short brake press also restarts the motor as
+  on a normal start.
+
+  Interrupts write the PWM output enable bits while
+  motor_enable_pwm() and motor_disable_pwm() read and write
+  the same registers, so those disable interrupts. PWM is
+  not enabled while the brakes are latched, and while the
+  cut is not latched yet only the state to restore is set.
+---------------------------------------------------------*/
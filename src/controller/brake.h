@@ -11,7 +11,18 @@
 
 #include "main.h"
 
+// brake pin active PWM cycles after the brake interrupt cut motor power to latch the cut, power is restored after shorter glitches
+#define BRAKE_CUT_PWM_CYCLES    4   // 4 * 64 us = 256 us
+
+// set by the brake interrupt when it cut motor power, cleared by the PWM interrupt when it latched the cut or restored power
+extern volatile uint8_t ui8_g_brake_cut;
+
+// set by the PWM interrupt when it latched the cut, cleared by the app when brakes are released
+extern volatile uint8_t ui8_g_brake_latched;
+
 void brake_init (void);
 BitStatus brake_is_set (void);
+void brake_qualify (void);
+void brake_cut_set_pwm (uint8_t ui8_enabled);
 
 #endif /* _BRAKE_H */
@@ -0,0 +1,124 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "common.h"
+#include "pid.h"
+#include "cruise.h"
+
+
+static uint8_t ui8_cruise_PID_initialize = 1;
+static uint16_t ui16_cruise_speed_target_x10 = 0;
+static struct_pid_controller cruise_PID;
+
+// cruise PID gain table for each motor type: Kp x10, Ki x100, Kd x10
+static const uint8_t ui8_cruise_PID_gains[4][3] =
+{
+  { 120, 100, 0 },    // 48 V motor
+  { 140, 70, 0 },     // 36 V motor
+  { 120, 100, 0 },    // experimental high cadence mode for 48 V motor
+  { 140, 70, 0 }      // experimental high cadence mode for 36 V motor
+};
+
+// nominal voltage x10 the cruise PID gains are set for, for each motor type
+static const uint16_t ui16_cruise_PID_gains_voltage_x10[4] = { 480, 360, 480, 360 };
+
+
+
+void cruise_set_gains (struct_pid_controller *p_pid, const struct_cruise_inputs *p_inputs)
+{
+  uint8_t ui8_kp_x10;
+  uint8_t ui8_ki_x100;
+  uint8_t ui8_kd_x10;
+  uint8_t ui8_motor_type = p_inputs->ui8_motor_type;
+  uint16_t ui16_voltage_scale_x256;
+  
+  // get gains, use gains received from display if set or else from the gain table for the motor type
+  if (ui8_motor_type > 3) { ui8_motor_type = 0; }
+  
+  if (p_inputs->ui8_kp_x10 || p_inputs->ui8_ki_x100 || p_inputs->ui8_kd_x10)
+  {
+    ui8_kp_x10 = p_inputs->ui8_kp_x10;
+    ui8_ki_x100 = p_inputs->ui8_ki_x100;
+    ui8_kd_x10 = p_inputs->ui8_kd_x10;
+  }
+  else
+  {
+    ui8_kp_x10 = ui8_cruise_PID_gains[ui8_motor_type][0];
+    ui8_ki_x100 = ui8_cruise_PID_gains[ui8_motor_type][1];
+    ui8_kd_x10 = ui8_cruise_PID_gains[ui8_motor_type][2];
+  }
+  
+  // scale gains with nominal voltage over battery voltage as the same duty cycle gives more speed with a higher voltage
+  if (p_inputs->ui16_battery_voltage_x1000 > 0)
+  {
+    ui16_voltage_scale_x256 = ((uint32_t) ui16_cruise_PID_gains_voltage_x10[ui8_motor_type] * 25600) / p_inputs->ui16_battery_voltage_x1000;
+  }
+  else
+  {
+    ui16_voltage_scale_x256 = 256;
+  }
+  
+  if (ui16_voltage_scale_x256 < CRUISE_PID_VOLTAGE_SCALE_MIN_X256) { ui16_voltage_scale_x256 = CRUISE_PID_VOLTAGE_SCALE_MIN_X256; }
+  else if (ui16_voltage_scale_x256 > CRUISE_PID_VOLTAGE_SCALE_MAX_X256) { ui16_voltage_scale_x256 = CRUISE_PID_VOLTAGE_SCALE_MAX_X256; }
+  
+  // set gains in Q8 format, gains are set for 100 ms so integral and derivative gains are scaled to the control loop period
+  p_pid->ui16_kp_x256 = ((uint32_t) ui8_kp_x10 * ui16_voltage_scale_x256) / 10;
+  p_pid->ui16_ki_x256 = ((uint32_t) ui8_ki_x100 * ui16_voltage_scale_x256 * EBIKE_APP_CONTROLLER_PERIOD_MS) / (100 * 100);
+  p_pid->ui16_kd_x256 = ((uint32_t) ui8_kd_x10 * ui16_voltage_scale_x256 * 100) / (10 * EBIKE_APP_CONTROLLER_PERIOD_MS);
+  p_pid->i16_output_min = 0;
+  p_pid->i16_output_max = CRUISE_PID_OUTPUT_MAX;
+}
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS while cruise is on and over the cruise threshold speed, returns the duty cycle target
+uint8_t cruise_controller (const struct_cruise_inputs *p_inputs)
+{
+  int16_t i16_error;
+  int16_t i16_control_output;
+  
+  cruise_set_gains(&cruise_PID, p_inputs);
+  
+  // initialize cruise PID controller
+  if (ui8_cruise_PID_initialize)
+  {
+    ui8_cruise_PID_initialize = 0;
+    
+    // use the received target wheel speed or else keep the current wheel speed
+    if (p_inputs->ui8_speed_target) { ui16_cruise_speed_target_x10 = (uint16_t) p_inputs->ui8_speed_target * 10; }
+    else { ui16_cruise_speed_target_x10 = p_inputs->ui16_wheel_speed_x10; }
+    
+    // start from the current duty cycle so the motor does not start from zero (feed forward)
+    pid_init(&cruise_PID,
+             (int16_t) (ui16_cruise_speed_target_x10 - p_inputs->ui16_wheel_speed_x10),
+             (int16_t) (((uint16_t) p_inputs->ui8_duty_cycle * CRUISE_PID_OUTPUT_MAX) / PWM_DUTY_CYCLE_MAX));
+  }
+  
+  // calculate error
+  i16_error = (ui16_cruise_speed_target_x10 - p_inputs->ui16_wheel_speed_x10);
+  
+  // calculate control output
+  i16_control_output = pid_run(&cruise_PID, i16_error);
+  
+  // map the control output to the duty cycle target
+  return map((uint32_t) i16_control_output,
+             (uint32_t) 0,                       // minimum control output from PID
+             (uint32_t) CRUISE_PID_OUTPUT_MAX,   // maximum control output from PID
+             (uint32_t) 0,                       // minimum duty cycle
+             (uint32_t) PWM_DUTY_CYCLE_MAX);     // maximum duty cycle
+}
+
+
+
+// cruise starts again from the current wheel speed and duty cycle
+void cruise_reset (void)
+{
+  ui8_cruise_PID_initialize = 1;
+}
@@ -0,0 +1,40 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _CRUISE_H_
+#define _CRUISE_H_
+
+#include <stdint.h>
+#include "main.h"
+#include "pid.h"
+
+#define CRUISE_PID_OUTPUT_MAX                     1000
+#define CRUISE_PID_VOLTAGE_SCALE_MIN_X256         128   // 0.5
+#define CRUISE_PID_VOLTAGE_SCALE_MAX_X256         512   // 2.0
+#define CRUISE_DUTY_CYCLE_RAMP_UP_INVERSE_STEP    80
+
+// inputs of cruise, set by the app on every run
+typedef struct _cruise_inputs
+{
+  // PID gains received from the display, all zero to use the gain table of the motor type, gains are set for 100 ms
+  uint8_t ui8_kp_x10;
+  uint8_t ui8_ki_x100;
+  uint8_t ui8_kd_x10;
+  uint8_t ui8_motor_type;
+  
+  uint8_t ui8_speed_target;             // km/h, 0 to keep the wheel speed when cruise starts
+  uint16_t ui16_wheel_speed_x10;
+  uint16_t ui16_battery_voltage_x1000;
+  uint8_t ui8_duty_cycle;               // duty cycle of the motor, the PID output starts from it
+} struct_cruise_inputs;
+
+void cruise_set_gains (struct_pid_controller *p_pid, const struct_cruise_inputs *p_inputs);
+uint8_t cruise_controller (const struct_cruise_inputs *p_inputs);
+void cruise_reset (void);
+
+#endif /* _CRUISE_H_ */
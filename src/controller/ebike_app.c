@@ -21,6 +21,23 @@
 #include "eeprom.h"
 #include "lights.h"
 #include "common.h"
+#include "assist_map.h"
+#include "scheduler.h"
+#include "torque_sensor.h"
+#include "battery.h"
+#include "motor_thermal.h"
+#include "flight_recorder.h"
+#include "gear_shift.h"
+#include "walk_assist.h"
+#include "boost.h"
+#include "hill_hold.h"
+#include "cruise.h"
+#include "speed_limit.h"
+#include "foc_angle_tracker.h"
+#include "fault.h"
+#include "throttle.h"
+#include "pas.h"
+#include "uart_rx.h"
 
 volatile struct_configuration_variables m_configuration_variables;
 
@@ -33,6 +50,7 @@ static uint8_t    ui8_motor_enabled = 1;
 static uint8_t    ui8_assist_without_pedal_rotation_threshold = 0;
 static uint8_t    ui8_lights_configuration = 10;
 static uint8_t    ui8_lights_state = 0;
+static uint8_t    ui8_configuration_save_pending = 0;
 
 
 // power control
@@ -44,6 +62,7 @@ static uint16_t   ui16_battery_voltage_filtered_x1000 = 0;
 static uint8_t    ui8_battery_current_filtered_x10 = 0;
 static uint8_t    ui8_adc_battery_current_max = ADC_10_BIT_BATTERY_CURRENT_MAX;
 static uint8_t    ui8_adc_battery_current_target = 0;
+static uint8_t    ui8_adc_battery_current_throttle_max = 0;
 static uint8_t    ui8_duty_cycle_target = 0;
 
 
@@ -52,6 +71,7 @@ volatile uint8_t ui8_cadence_sensor_mode = STANDARD_MODE;
 volatile uint16_t ui16_cadence_sensor_ticks_counter_min_speed_adjusted = CADENCE_SENSOR_TICKS_COUNTER_MIN;
 static uint16_t ui16_cadence_sensor_pulse_high_percentage_x10 = CADENCE_SENSOR_PULSE_PERCENTAGE_X10_DEFAULT;
 static uint8_t ui8_pedal_cadence_RPM = 0;
+static uint16_t ui16_pedal_cadence_RPM_x10 = 0;
 
 
 // torque sensor
@@ -59,10 +79,13 @@ volatile uint16_t ui16_adc_pedal_torque = 0;
 static uint16_t   ui16_adc_pedal_torque_delta = 0;
 static uint16_t   ui16_human_power_x10 = 0;
 static uint16_t   ui16_pedal_torque_x100 = 0;
+static uint16_t   ui16_pedal_torque_half_stroke_x100 = 0;
 
 
 // wheel speed sensor
 static uint16_t   ui16_wheel_speed_x10 = 0;
+static int16_t    i16_wheel_acceleration_x10 = 0;   // 0.1 km/h per second
+static uint8_t    ui8_wheel_speed_new_measurement = 0;
 
 
 // throttle control
@@ -101,40 +124,37 @@ static const uint8_t ui8_eMTB_power_function_250[eMTB_POWER_FUNCTION_ARRAY_SIZE]
 static const uint8_t ui8_eMTB_power_function_255[eMTB_POWER_FUNCTION_ARRAY_SIZE] = { 0, 0, 0, 0, 0, 1, 1, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 18, 21, 24, 26, 30, 33, 37, 41, 45, 49, 54, 58, 64, 69, 75, 80, 87, 93, 100, 107, 114, 122, 130, 138, 146, 155, 164, 174, 184, 194, 204, 215, 226, 238, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240, 240 };
 
 
-// cruise
-static uint8_t ui8_cruise_PID_initialize = 1;
+// cruise PID gains received from the display, all zero to use the default gains for the motor type
+static uint8_t ui8_cruise_PID_kp_x10 = 0;
+static uint8_t ui8_cruise_PID_ki_x100 = 0;
+static uint8_t ui8_cruise_PID_kd_x10 = 0;
 
 
-// boost
-uint8_t   ui8_startup_boost_enable = 0;
-uint8_t   ui8_startup_boost_fade_enable = 0;
-uint8_t   ui8_m_startup_boost_state_machine = 0;
-uint8_t   ui8_startup_boost_no_torque = 0;
-uint8_t   ui8_startup_boost_timer = 0;
-uint8_t   ui8_startup_boost_fade_steps = 0;
-uint16_t  ui16_startup_boost_fade_variable_x256;
-uint16_t  ui16_startup_boost_fade_variable_step_amount_x256;
-static void     boost_run_statemachine (void);
-static uint8_t  boost(uint8_t ui8_max_current_boost_state);
-static void     apply_boost_fade_out();
-uint8_t ui8_boost_enabled_and_applied = 0;
+// startup power boost
 static void apply_boost();
 
 
+// hill hold
+static void apply_hill_hold();
+
+
 // UART
 #define UART_NUMBER_DATA_BYTES_TO_RECEIVE   7   // change this value depending on how many data bytes there are to receive ( Package = one start byte + data bytes + two bytes 16 bit CRC )
-#define UART_NUMBER_DATA_BYTES_TO_SEND      26  // change this value depending on how many data bytes there are to send ( Package = one start byte + data bytes + two bytes 16 bit CRC )
+#define UART_NUMBER_DATA_BYTES_TO_SEND      31  // change this value depending on how many data bytes there are to send ( Package = one start byte + data bytes + two bytes 16 bit CRC )
+
+#define UART_RX_START_BYTE                  0x59
 
-volatile uint8_t ui8_received_package_flag = 0;
-volatile uint8_t ui8_rx_buffer[UART_NUMBER_DATA_BYTES_TO_RECEIVE + 3];
-volatile uint8_t ui8_rx_counter = 0;
-volatile uint8_t ui8_tx_buffer[UART_NUMBER_DATA_BYTES_TO_SEND + 3];
+volatile uint8_t ui8_rx_buffer[2][UART_NUMBER_DATA_BYTES_TO_RECEIVE + 3];   // ping-pong buffers, the UART receive interrupt writes one while the other is processed
+static struct_uart_rx m_uart_rx = { UART_RX_START_BYTE, UART_NUMBER_DATA_BYTES_TO_RECEIVE + 3, { ui8_rx_buffer[0], ui8_rx_buffer[1] } };
+uint8_t ui8_tx_buffer[UART_NUMBER_DATA_BYTES_TO_SEND + 3];
 volatile uint8_t ui8_i;
-volatile uint8_t ui8_byte_received;
-volatile uint8_t ui8_state_machine = 0;
+static uint16_t  ui16_uart_rx_frames_ok = 0;
+static uint8_t   ui8_uart_rx_crc_errors = 0;
 static uint16_t  ui16_crc_rx;
 static uint16_t  ui16_crc_tx;
 volatile uint8_t ui8_message_ID = 0;
+static uint8_t   ui8_telemetry_ID = 0;
+static uint8_t   ui8_telemetry_cycles = 0;
 
 static void communications_controller (void);
 static void uart_receive_package (void);
@@ -144,6 +164,7 @@ static void uart_send_package (void);
 // system functions
 static void get_battery_voltage_filtered(void);
 static void get_battery_current_filtered(void);
+static void get_battery_current_max(void);
 static void get_pedal_torque(void);
 static void calc_wheel_speed(void);
 static void calc_cadence(void);
@@ -151,36 +172,71 @@ static void calc_cadence(void);
 static void ebike_control_lights(void);
 static void ebike_control_motor(void);
 static void check_system(void);
+static void save_configuration(void);
 static void check_brakes(void);
+static void check_motor_faults(void);
 
 static void apply_power_assist();
 static void apply_torque_assist();
 static void apply_cadence_assist();
 static void apply_emtb_assist();
+static void apply_assist_map();
 static void apply_walk_assist();
+static void apply_walk_assist_stop();
 static void apply_cruise();
 static void apply_cadence_sensor_calibration();
 static void apply_throttle();
 static void apply_temperature_limiting();
+static void apply_thermal_model_limiting();
 static void apply_speed_limit();
 
 
 
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS
 void ebike_app_controller (void)
 { 
   calc_wheel_speed();               // calculate the wheel speed
   calc_cadence();                   // calculate the cadence and set limits from wheel speed
+  pas_controller();                 // calculate crank position and velocity and detect backpedaling
   
   get_battery_voltage_filtered();   // get filtered voltage from FOC calculations
   get_battery_current_filtered();   // get filtered current from FOC calculations
+  get_battery_current_max();        // get max current from battery limits and battery model
   get_pedal_torque();               // get pedal torque
   
-  check_system();                   // check if there are any errors for motor control 
+  gear_shift_update(ui16_pedal_cadence_RPM_x10, ui16_wheel_speed_x10, ui16_pedal_torque_half_stroke_x100);   // detect gear shifts
+  
   check_brakes();                   // check if brakes are enabled for motor control
+  check_motor_faults();             // check motor faults detected in the PWM interrupt
+  
+  foc_angle_tracker_controller(ui16_motor_get_motor_speed_erps(), ui8_adc_battery_current_filtered,
+                               ui8_motor_enabled && !ui8_brakes_enabled && (ui8_system_state == NO_ERROR));   // learn FOC angle offset
+  
+  ebike_control_motor();            // use received data and sensor input to control motor 
+}
+
+
+
+// happens every EBIKE_APP_HOUSEKEEPING_PERIOD_MS
+void ebike_app_housekeeping (void)
+{
+  motor_thermal_controller();       // update motor thermal model
+  check_system();                   // check if there are any errors for motor control 
+  save_configuration();             // save changed configuration to EEPROM when the motor is stopped
+  flight_recorder_set_system_state(ui8_system_state);   // record system state with the motor signals
   
   communications_controller();      // get data to use for motor control and also send new data
   ebike_control_lights();           // use received data and sensor input to control external lights
-  ebike_control_motor();            // use received data and sensor input to control motor 
+  
+  /*---------------------------------------------------------
+    NOTE: regarding the control loop periods
+
+    The assist path runs every EBIKE_APP_CONTROLLER_PERIOD_MS
+    so pedal torque changes reach the current target fast.
+    Everything that is not needed for that runs here, at a
+    slower rate. Time constants of filters and controllers
+    in the assist path are set for the faster period.
+  ---------------------------------------------------------*/
 }
 
 
@@ -191,10 +247,14 @@ static void ebike_control_motor (void)
   ui16_duty_cycle_ramp_up_inverse_step = PWM_DUTY_CYCLE_RAMP_UP_INVERSE_STEP_DEFAULT;
   ui16_duty_cycle_ramp_down_inverse_step = PWM_DUTY_CYCLE_RAMP_DOWN_INVERSE_STEP_DEFAULT;
   ui8_adc_battery_current_target = 0;
+  ui8_adc_battery_current_throttle_max = 0;
   ui8_duty_cycle_target = 0;
 
   // reset initialization of Cruise PID controller
-  if (ui8_riding_mode != CRUISE_MODE) { ui8_cruise_PID_initialize = 1; }
+  if (ui8_riding_mode != CRUISE_MODE) { cruise_reset(); }
+  
+  // reset initialization of walk assist PID controller and ramp down walk assist current
+  if (ui8_riding_mode != WALK_ASSIST_MODE) { apply_walk_assist_stop(); }
   
   // select riding mode
   switch (ui8_riding_mode)
@@ -207,6 +267,8 @@ static void ebike_control_motor (void)
     
     case eMTB_ASSIST_MODE: apply_emtb_assist(); break;
     
+    case ASSIST_MAP_MODE: apply_assist_map(); break;
+    
     case WALK_ASSIST_MODE: apply_walk_assist(); break;
     
     case CRUISE_MODE: apply_cruise(); break;
@@ -214,6 +276,15 @@ static void ebike_control_motor (void)
     case CADENCE_SENSOR_CALIBRATION_MODE: apply_cadence_sensor_calibration(); break;
   }
   
+  // startup power boost
+  apply_boost();
+  
+  // no assist while backpedaling
+  if (pas_is_backpedaling()) { ui8_adc_battery_current_target = 0; }
+  
+  // hold the bike on a slope when it rolls back at standstill
+  apply_hill_hold();
+  
   // select optional ADC function
   switch (m_configuration_variables.ui8_optional_ADC_function)
   {
@@ -222,16 +293,45 @@ static void ebike_control_motor (void)
     case TEMPERATURE_CONTROL: apply_temperature_limiting(); break;
   }
   
+  // reduce current while shifting gears
+  ui8_adc_battery_current_target = gear_shift_apply_dip(ui8_adc_battery_current_target);
+  ui8_adc_battery_current_throttle_max = gear_shift_apply_dip(ui8_adc_battery_current_throttle_max);
+  
+  // limit current with the motor thermal model if there is no motor temperature sensor
+  if (m_configuration_variables.ui8_optional_ADC_function != TEMPERATURE_CONTROL) { apply_thermal_model_limiting(); }
+  
   // speed limit
   apply_speed_limit();
 
   // force target current to 0 if brakes are enabled or if there are errors
-  if (ui8_brakes_enabled || ui8_system_state != NO_ERROR) { ui8_adc_battery_current_target = 0; }
+  if (ui8_brakes_enabled || ui8_system_state != NO_ERROR)
+  {
+    ui8_adc_battery_current_target = 0;
+    ui8_adc_battery_current_throttle_max = 0;
+  }
+  
+  // throttle fast path sets the current target between runs
+  uint8_t ui8_throttle_applied = ui8_adc_battery_current_throttle_max && throttle_get_value();
+
+  // disable the motor when braking, the PWM interrupt already disabled PWM and the motor is enabled again as on a normal start
+  if ((ui8_motor_enabled) && (ui8_brakes_enabled))
+  {
+    ui8_motor_enabled = 0;
+    motor_disable_pwm();
+  }
+
+  // the motor may be enabled while rolling back slowly only to hold the bike, with the bounded hill hold current and duty cycle
+  uint8_t ui8_hill_hold_motor_enable = (hill_hold_is_active()) &&
+                                       (ui16_motor_get_motor_speed_erps() < HILL_HOLD_MOTOR_ENABLE_ERPS_MAX) &&
+                                       (ui8_adc_battery_current_target <= HILL_HOLD_ADC_BATTERY_CURRENT_MAX) &&
+                                       (ui8_duty_cycle_target <= HILL_HOLD_DUTY_CYCLE_MAX) &&
+                                       (!ui8_throttle_applied);
 
   // check if to enable the motor
   if ((!ui8_motor_enabled) &&
-      (ui16_motor_get_motor_speed_erps() == 0) && // only enable motor if stopped, other way something bad can happen due to high currents/regen or similar
-      (ui8_adc_battery_current_target))
+      ((ui16_motor_get_motor_speed_erps() == 0) || // only enable motor if stopped, other way something bad can happen due to high currents/regen or similar
+       (ui8_hill_hold_motor_enable)) && // or to hold the bike while rolling back slowly
+      (ui8_adc_battery_current_target || ui8_throttle_applied))
   {
     ui8_motor_enabled = 1;
     ui8_g_duty_cycle = 0;
@@ -242,6 +342,7 @@ static void ebike_control_motor (void)
   if ((ui8_motor_enabled) &&
       (ui16_motor_get_motor_speed_erps() == 0) &&
       (!ui8_adc_battery_current_target) &&
+      (!ui8_throttle_applied) &&
       (!ui8_g_duty_cycle))
   {
     ui8_motor_enabled = 0;
@@ -257,6 +358,13 @@ static void ebike_control_motor (void)
     // limit target current if higher than max value (safety)
     if (ui8_adc_battery_current_target > ui8_adc_battery_current_max) { ui8_adc_battery_current_target = ui8_adc_battery_current_max; }
     
+    // limit max throttle current if higher than max value (safety)
+    if (ui8_adc_battery_current_throttle_max > ui8_adc_battery_current_max) { ui8_adc_battery_current_throttle_max = ui8_adc_battery_current_max; }
+    
+    // set throttle currents for the throttle fast path and add throttle current to target current
+    throttle_set_adc_battery_current(ui8_adc_battery_current_target, ui8_adc_battery_current_throttle_max);
+    ui8_adc_battery_current_target = throttle_get_adc_battery_current_target();
+    
     // limit target duty cycle if higher than max value
     if (ui8_duty_cycle_target > PWM_DUTY_CYCLE_MAX) { ui8_duty_cycle_target = PWM_DUTY_CYCLE_MAX; }
     
@@ -285,6 +393,9 @@ static void ebike_control_motor (void)
     ui16_controller_duty_cycle_ramp_down_inverse_step = PWM_DUTY_CYCLE_RAMP_DOWN_INVERSE_STEP_MIN;
     ui8_controller_adc_battery_current_target = 0;
     ui8_controller_duty_cycle_target = 0;
+    
+    // throttle must not drive the motor
+    throttle_set_adc_battery_current(0, 0);
   }
 }
 
@@ -297,11 +408,11 @@ static void apply_power_assist()
   // check for assist without pedal rotation threshold when there is no pedal rotation and standing still
   if (ui8_assist_without_pedal_rotation_threshold && !ui8_pedal_cadence_RPM && !ui16_wheel_speed_x10)
   {
-    if (ui16_adc_pedal_torque_delta > (110 - ui8_assist_without_pedal_rotation_threshold)) { ui8_pedal_cadence_RPM = 4; }
+    if (ui16_adc_pedal_torque_delta > (110 - ui8_assist_without_pedal_rotation_threshold)) { ui8_pedal_cadence_RPM = 4; ui16_pedal_cadence_RPM_x10 = 40; }
   }
   
   // calculate power assist by multiplying human power with the power assist multiplier
-  uint32_t ui32_power_assist_x100 = ((uint32_t) ui16_pedal_torque_x100 * ui8_pedal_cadence_RPM * ui8_power_assist_multiplier_x10) / 96; // see note below
+  uint32_t ui32_power_assist_x100 = ((((uint32_t) ui16_pedal_torque_x100 * ui16_pedal_cadence_RPM_x10) / 96) * ui8_power_assist_multiplier_x10) / 10; // see note below
   
   /*------------------------------------------------------------------------
 
@@ -313,6 +424,7 @@ static void apply_power_assist()
     (4) Formula: power = torque * 100 * rotations per minute * 0.001047
     (5) Formula: power = torque * 100 * rotations per minute / 955
     (6) Formula: power * 10  =  torque * 100 * rotations per minute / 96
+    (7) Formula: power * 10  =  torque * 100 * rotations per minute * 10 / 960
     
   ------------------------------------------------------------------------*/
   
@@ -491,109 +603,101 @@ static void apply_emtb_assist()
 }
 
 
+static void apply_assist_map()
+{
+  // check for assist without pedal rotation threshold when there is no pedal rotation and standing still
+  if (ui8_assist_without_pedal_rotation_threshold && !ui8_pedal_cadence_RPM && !ui16_wheel_speed_x10)
+  {
+    if (ui16_adc_pedal_torque_delta > (110 - ui8_assist_without_pedal_rotation_threshold)) { ui8_pedal_cadence_RPM = 1; }
+  }
+  
+  if (ui16_adc_pedal_torque_delta && ui8_pedal_cadence_RPM)
+  {
+    // get the assist map target current and scale it with the assist level percentage
+    uint16_t ui16_adc_battery_current_target_assist_map = ((uint16_t) assist_map_get_target(ui16_adc_pedal_torque_delta, ui8_pedal_cadence_RPM, ui16_wheel_speed_x10) * ui8_riding_mode_parameter) / 100;
+    
+    // set motor acceleration
+    ui16_duty_cycle_ramp_up_inverse_step = map((uint32_t) ui16_wheel_speed_x10,
+                                               (uint32_t) 40, // 40 -> 4 kph
+                                               (uint32_t) 200, // 200 -> 20 kph
+                                               (uint32_t) ui16_duty_cycle_ramp_up_inverse_step_default,
+                                               (uint32_t) PWM_DUTY_CYCLE_RAMP_UP_INVERSE_STEP_MIN);
+                                               
+    ui16_duty_cycle_ramp_down_inverse_step = map((uint32_t) ui16_wheel_speed_x10,
+                                                 (uint32_t) 40, // 40 -> 4 kph
+                                                 (uint32_t) 200, // 200 -> 20 kph
+                                                 (uint32_t) PWM_DUTY_CYCLE_RAMP_DOWN_INVERSE_STEP_DEFAULT,
+                                                 (uint32_t) PWM_DUTY_CYCLE_RAMP_DOWN_INVERSE_STEP_MIN);
+                                                 
+    // set battery current target
+    if (ui16_adc_battery_current_target_assist_map > ui8_adc_battery_current_max) { ui8_adc_battery_current_target = ui8_adc_battery_current_max; }
+    else { ui8_adc_battery_current_target = ui16_adc_battery_current_target_assist_map; }
+
+    // set duty cycle target
+    if (ui8_adc_battery_current_target) { ui8_duty_cycle_target = PWM_DUTY_CYCLE_MAX; }
+    else { ui8_duty_cycle_target = 0; }
+  }
+}
+
+
 
 static void apply_walk_assist()
 {
   #define WALK_ASSIST_DUTY_CYCLE_RAMP_UP_INVERSE_STEP     200
-  #define WALK_ASSIST_DUTY_CYCLE_MAX                      80
-  #define WALK_ASSIST_ADC_BATTERY_CURRENT_MAX             80
+  #define WALK_ASSIST_DUTY_CYCLE_MAX                      120
+  
+  uint16_t ui16_walk_assist_speed_x10 = walk_assist_calc_speed(ui16_wheel_speed_x10, ui8_wheel_speed_new_measurement, ui16_motor_get_motor_speed_erps());
   
-  if (ui16_wheel_speed_x10 < WALK_ASSIST_THRESHOLD_SPEED_X10)
+  if ((ui16_wheel_speed_x10 < WALK_ASSIST_THRESHOLD_SPEED_X10) && (ui16_walk_assist_speed_x10 < WALK_ASSIST_THRESHOLD_SPEED_X10))
   {
-    // get the walk assist duty cycle target
-    uint8_t ui8_walk_assist_duty_cycle_target = ui8_riding_mode_parameter;
-    
-    // check so that walk assist level factor is not too large (too powerful), if it is -> limit the value
-    if (ui8_walk_assist_duty_cycle_target > WALK_ASSIST_DUTY_CYCLE_MAX) { ui8_walk_assist_duty_cycle_target = WALK_ASSIST_DUTY_CYCLE_MAX; }
-    
     // set motor acceleration
     ui16_duty_cycle_ramp_up_inverse_step = WALK_ASSIST_DUTY_CYCLE_RAMP_UP_INVERSE_STEP;
     ui16_duty_cycle_ramp_down_inverse_step = PWM_DUTY_CYCLE_RAMP_DOWN_INVERSE_STEP_DEFAULT;
     
-    // set battery current target
-    ui8_adc_battery_current_target = ui8_min(WALK_ASSIST_ADC_BATTERY_CURRENT_MAX, ui8_adc_battery_current_max);
+    // set battery current target from the walk assist target speed
+    ui8_adc_battery_current_target = walk_assist_controller(ui8_riding_mode_parameter, ui16_walk_assist_speed_x10, ui8_adc_battery_current_max);
     
     // set duty cycle target
-    ui8_duty_cycle_target = ui8_walk_assist_duty_cycle_target;
+    ui8_duty_cycle_target = WALK_ASSIST_DUTY_CYCLE_MAX;
+  }
+  else
+  {
+    // stop walk assist over the threshold speed, restart from the current speed when back under it
+    walk_assist_reset();
   }
 }
 
 
 
-static void apply_cruise()
+static void apply_walk_assist_stop()
 {
-  #define CRUISE_PID_KP                             12    // 48 volt motor: 12, 36 volt motor: 14
-  #define CRUISE_PID_KI                             0.7   // 48 volt motor: 1, 36 volt motor: 0.7
-  #define CRUISE_PID_INTEGRAL_LIMIT                 1000
-  #define CRUISE_PID_KD                             0
-  #define CRUISE_DUTY_CYCLE_RAMP_UP_INVERSE_STEP    80
+  // ramp down walk assist current (smooth stop)
+  uint8_t ui8_walk_assist_adc_battery_current_target = walk_assist_stop();
   
-  if (ui16_wheel_speed_x10 > CRUISE_THRESHOLD_SPEED_X10)
+  if (ui8_walk_assist_adc_battery_current_target)
   {
-    static int16_t i16_error;
-    static int16_t i16_last_error;
-    static int16_t i16_integral;
-    static int16_t i16_derivative;
-    static int16_t i16_control_output;
-    static uint16_t ui16_wheel_speed_target_x10;
-    
-    // initialize cruise PID controller
-    if (ui8_cruise_PID_initialize)
-    {
-      ui8_cruise_PID_initialize = 0;
-      
-      // reset PID variables
-      i16_error = 0;
-      i16_last_error = 0;
-      i16_integral = 300; // initialize integral to a value so the motor does not start from zero
-      i16_derivative = 0;
-      i16_control_output = 0;
-      
-      // check what target wheel speed to use (received or current)
-      uint16_t ui16_wheel_speed_target_received_x10 = (uint16_t) ui8_riding_mode_parameter * 10;
-      
-      if (ui16_wheel_speed_target_received_x10 > 0)
-      {
-        // set received target wheel speed to target wheel speed
-        ui16_wheel_speed_target_x10 = ui16_wheel_speed_target_received_x10;
-      }
-      else
-      {
-        // set current wheel speed to maintain
-        ui16_wheel_speed_target_x10 = ui16_wheel_speed_x10;
-      }
-    }
-    
-    // calculate error
-    i16_error = (ui16_wheel_speed_target_x10 - ui16_wheel_speed_x10);
-    
-    // calculate integral
-    i16_integral = i16_integral + i16_error;
-    
-    // limit integral
-    if (i16_integral > CRUISE_PID_INTEGRAL_LIMIT)
-    {
-      i16_integral = CRUISE_PID_INTEGRAL_LIMIT; 
-    }
-    else if (i16_integral < 0)
-    {
-      i16_integral = 0;
-    }
-    
-    // calculate derivative
-    i16_derivative = i16_error - i16_last_error;
+    // set battery current target and duty cycle target
+    ui8_adc_battery_current_target = ui8_walk_assist_adc_battery_current_target;
+    ui8_duty_cycle_target = WALK_ASSIST_DUTY_CYCLE_MAX;
+  }
+}
 
-    // save error to last error
-    i16_last_error = i16_error;
-    
-    // calculate control output ( output =  P I D )
-    i16_control_output = (CRUISE_PID_KP * i16_error) + (CRUISE_PID_KI * i16_integral) + (CRUISE_PID_KD * i16_derivative);
-    
-    // limit control output to just positive values
-    if (i16_control_output < 0) { i16_control_output = 0; }
+
+
+static void apply_cruise()
+{
+  if (ui16_wheel_speed_x10 > CRUISE_THRESHOLD_SPEED_X10)
+  {
+    struct_cruise_inputs m_cruise_inputs;
     
-    // limit control output to the maximum value
-    if (i16_control_output > 1000) { i16_control_output = 1000; }
+    m_cruise_inputs.ui8_kp_x10 = ui8_cruise_PID_kp_x10;
+    m_cruise_inputs.ui8_ki_x100 = ui8_cruise_PID_ki_x100;
+    m_cruise_inputs.ui8_kd_x10 = ui8_cruise_PID_kd_x10;
+    m_cruise_inputs.ui8_motor_type = m_configuration_variables.ui8_motor_type;
+    m_cruise_inputs.ui8_speed_target = ui8_riding_mode_parameter;
+    m_cruise_inputs.ui16_wheel_speed_x10 = ui16_wheel_speed_x10;
+    m_cruise_inputs.ui16_battery_voltage_x1000 = ui16_battery_voltage_filtered_x1000;
+    m_cruise_inputs.ui8_duty_cycle = ui8_g_duty_cycle;
     
     // set motor acceleration
     ui16_duty_cycle_ramp_up_inverse_step = CRUISE_DUTY_CYCLE_RAMP_UP_INVERSE_STEP;
@@ -602,12 +706,8 @@ static void apply_cruise()
     // set battery current target
     ui8_adc_battery_current_target = ui8_adc_battery_current_max;
     
-    // set duty cycle target  |  map the control output to an appropriate target PWM value
-    ui8_duty_cycle_target = map((uint32_t) i16_control_output,
-                                (uint32_t) 0,                     // minimum control output from PID
-                                (uint32_t) 1000,                  // maximum control output from PID
-                                (uint32_t) 0,                     // minimum duty cycle
-                                (uint32_t) PWM_DUTY_CYCLE_MAX);   // maximum duty cycle
+    // set duty cycle target
+    ui8_duty_cycle_target = cruise_controller(&m_cruise_inputs);
   }
 }
 
@@ -634,7 +734,7 @@ static void apply_cadence_sensor_calibration()
     if (ui16_cadence_sensor_pulse_high_percentage_x10_temp < CADENCE_SENSOR_PULSE_PERCENTAGE_X10_MIN) { ui16_cadence_sensor_pulse_high_percentage_x10_temp = CADENCE_SENSOR_PULSE_PERCENTAGE_X10_MIN; }
     
     // filter the cadence sensor pulse high percentage
-    ui16_cadence_sensor_pulse_high_percentage_x10 = filter(ui16_cadence_sensor_pulse_high_percentage_x10_temp, ui16_cadence_sensor_pulse_high_percentage_x10, 90);
+    ui16_cadence_sensor_pulse_high_percentage_x10 = filter(ui16_cadence_sensor_pulse_high_percentage_x10_temp, ui16_cadence_sensor_pulse_high_percentage_x10, 98); // 98 -> about 1 second time constant at 20 ms
   }
   
   // set motor acceleration
@@ -655,13 +755,12 @@ static void apply_throttle()
   #define THROTTLE_DUTY_CYCLE_RAMP_UP_INVERSE_STEP_DEFAULT    80
   #define THROTTLE_DUTY_CYCLE_RAMP_UP_INVERSE_STEP_MIN        40
   
-  // map value from 0 to 255
-  ui8_adc_throttle = map((uint8_t) UI8_ADC_THROTTLE,
-                         (uint8_t) ADC_THROTTLE_MIN_VALUE,
-                         (uint8_t) ADC_THROTTLE_MAX_VALUE,
-                         (uint8_t) 0,
-                         (uint8_t) 255);
-                         
+  // get throttle value from 0 to 255, sampled every MOTOR_CONTROLLER_PERIOD_MS by the throttle fast path
+  ui8_adc_throttle = throttle_get_value();
+  
+  // allow throttle current up to max battery current, current target is set in ebike_control_motor() after all limits
+  ui8_adc_battery_current_throttle_max = ui8_adc_battery_current_max;
+  
   // map ADC throttle value from 0 to max battery current
   uint8_t ui8_adc_battery_current_target_throttle = map((uint8_t) ui8_adc_throttle,
                                                         (uint8_t) 0,
@@ -684,9 +783,6 @@ static void apply_throttle()
                                                  (uint32_t) PWM_DUTY_CYCLE_RAMP_DOWN_INVERSE_STEP_DEFAULT,
                                                  (uint32_t) PWM_DUTY_CYCLE_RAMP_DOWN_INVERSE_STEP_MIN);
                                                  
-    // set battery current target
-    ui8_adc_battery_current_target = ui8_adc_battery_current_target_throttle;
-    
     // set duty cycle target
     ui8_duty_cycle_target = PWM_DUTY_CYCLE_MAX;
   }
@@ -702,7 +798,7 @@ static void apply_temperature_limiting()
   volatile uint16_t ui16_temp = UI16_ADC_10_BIT_THROTTLE;
   
   // filter ADC measurement to motor temperature variable
-  ui16_adc_motor_temperature_filtered = filter(ui16_temp, ui16_adc_motor_temperature_filtered, 80);
+  ui16_adc_motor_temperature_filtered = filter(ui16_temp, ui16_adc_motor_temperature_filtered, 96); // 96 -> about 0.5 second time constant at 20 ms
   
   // convert ADC value
   ui16_motor_temperature_filtered_x10 = ((uint32_t) ui16_adc_motor_temperature_filtered * 10000) / 2048;
@@ -733,33 +829,81 @@ static void apply_temperature_limiting()
 
 
 
+static void apply_thermal_model_limiting()
+{
+  // get motor winding temperature from the motor thermal model
+  ui16_motor_temperature_filtered_x10 = motor_thermal_get_winding_temperature_x10();
+  
+  // adjust target current if motor over temperature limit
+  ui8_adc_battery_current_target = map((uint32_t) ui16_motor_temperature_filtered_x10,
+                                       (uint32_t) MOTOR_THERMAL_TEMPERATURE_MIN_VALUE_TO_LIMIT * 10,
+                                       (uint32_t) MOTOR_THERMAL_TEMPERATURE_MAX_VALUE_TO_LIMIT * 10,
+                                       (uint32_t) ui8_adc_battery_current_target,
+                                       (uint32_t) 0);
+  
+  // adjust max throttle current the same way
+  ui8_adc_battery_current_throttle_max = map((uint32_t) ui16_motor_temperature_filtered_x10,
+                                             (uint32_t) MOTOR_THERMAL_TEMPERATURE_MIN_VALUE_TO_LIMIT * 10,
+                                             (uint32_t) MOTOR_THERMAL_TEMPERATURE_MAX_VALUE_TO_LIMIT * 10,
+                                             (uint32_t) ui8_adc_battery_current_throttle_max,
+                                             (uint32_t) 0);
+}
+
+
+
 static void apply_speed_limit()
 {
-  if (m_configuration_variables.ui8_wheel_speed_max > 0)
-  {
-    // set battery current target 
-    ui8_adc_battery_current_target = map((uint32_t) ui16_wheel_speed_x10,
-                                         (uint32_t) ((m_configuration_variables.ui8_wheel_speed_max * 10) - 20),
-                                         (uint32_t) ((m_configuration_variables.ui8_wheel_speed_max * 10) + 20),
-                                         (uint32_t) ui8_adc_battery_current_target,
-                                         (uint32_t) 0);
-  }
+  ui8_adc_battery_current_target = speed_limit_apply(ui8_adc_battery_current_target, ui16_wheel_speed_x10, i16_wheel_acceleration_x10, m_configuration_variables.ui8_wheel_speed_max);
+  ui8_adc_battery_current_throttle_max = speed_limit_apply(ui8_adc_battery_current_throttle_max, ui16_wheel_speed_x10, i16_wheel_acceleration_x10, m_configuration_variables.ui8_wheel_speed_max);
 }
 
 
 
 static void calc_wheel_speed(void)
 { 
+  static uint8_t ui8_wheel_speed_sensor_ticks_total_old;
+  static uint16_t ui16_wheel_speed_sensor_ticks_old;
+  static uint16_t ui16_wheel_speed_x10_old;
+  
+  // get wheel speed sensor transitions counter, only the low byte is needed to detect a new measurement
+  uint8_t ui8_wheel_speed_sensor_ticks_total = (uint8_t) ui32_wheel_speed_sensor_ticks_total;
+  
+  // get wheel speed sensor ticks
+  uint16_t ui16_wheel_speed_sensor_ticks_temp = ui16_wheel_speed_sensor_ticks;
+  
+  ui8_wheel_speed_new_measurement = 0;
+  
   // calc wheel speed in km/h
-  if (ui16_wheel_speed_sensor_ticks)
+  if (ui16_wheel_speed_sensor_ticks_temp)
   {
-    float f_wheel_speed_x10 = (float) PWM_CYCLES_SECOND / ui16_wheel_speed_sensor_ticks; // rps
-    ui16_wheel_speed_x10 = f_wheel_speed_x10 * m_configuration_variables.ui16_wheel_perimeter * 0.036; // rps * millimeters per second * ((3600 / (1000 * 1000)) * 10) kms per hour * 10
+    // rps * millimeters per second * ((3600 / (1000 * 1000)) * 10) kms per hour * 10, in integer math as this runs on the fast control loop
+    ui16_wheel_speed_x10 = ((uint32_t) m_configuration_variables.ui16_wheel_perimeter * ((uint32_t) PWM_CYCLES_SECOND * 36)) / ((uint32_t) ui16_wheel_speed_sensor_ticks_temp * 1000);
   }
   else
   {
     ui16_wheel_speed_x10 = 0;
   }
+  
+  // calc wheel acceleration on every new wheel speed sensor measurement
+  if (!ui16_wheel_speed_x10)
+  {
+    i16_wheel_acceleration_x10 = 0;
+    ui16_wheel_speed_sensor_ticks_old = 0;
+  }
+  else if (ui8_wheel_speed_sensor_ticks_total != ui8_wheel_speed_sensor_ticks_total_old)
+  {
+    if (ui16_wheel_speed_sensor_ticks_old)
+    {
+      i16_wheel_acceleration_x10 = speed_limit_calc_acceleration(i16_wheel_acceleration_x10, ui16_wheel_speed_x10, ui16_wheel_speed_x10_old,
+                                                                 ui16_wheel_speed_sensor_ticks_temp, ui16_wheel_speed_sensor_ticks_old);
+    }
+    
+    ui16_wheel_speed_sensor_ticks_old = ui16_wheel_speed_sensor_ticks_temp;
+    ui16_wheel_speed_x10_old = ui16_wheel_speed_x10;
+    ui8_wheel_speed_new_measurement = 1;
+  }
+  
+  ui8_wheel_speed_sensor_ticks_total_old = ui8_wheel_speed_sensor_ticks_total;
 }
 
 
@@ -768,11 +912,24 @@ static void calc_cadence(void)
 {
   #define CADENCE_SENSOR_TICKS_COUNTER_MIN_AT_SPEED       800
   
-  // get the cadence sensor ticks
-  uint16_t ui16_cadence_sensor_ticks_temp = ui16_cadence_sensor_ticks;
+  static uint8_t ui8_cadence_sensor_edge_counter_old;
   
-  // get the cadence sensor pulse state
-  uint8_t ui8_cadence_sensor_pulse_state_temp = ui8_cadence_sensor_pulse_state;
+  uint16_t ui16_cadence_sensor_ticks_temp;
+  uint8_t ui8_cadence_sensor_pulse_state_temp;
+  uint8_t ui8_cadence_sensor_edge_counter_temp;
+  uint16_t ui16_cadence_sensor_ticks_since_edge;
+  
+  // get the cadence sensor ticks, pulse state, edge counter and ticks since the last transition, all from the same transition
+  disableInterrupts();
+  ui16_cadence_sensor_ticks_temp = ui16_cadence_sensor_ticks;
+  ui8_cadence_sensor_pulse_state_temp = ui8_cadence_sensor_pulse_state;
+  ui8_cadence_sensor_edge_counter_temp = ui8_cadence_sensor_edge_counter;
+  ui16_cadence_sensor_ticks_since_edge = ui16_cadence_sensor_ticks_counter;
+  enableInterrupts();
+  
+  // cadence x10 = factor / ticks, for the measured transitions and for the transitions in progress
+  uint32_t ui32_cadence_measured_factor = 468750;
+  uint32_t ui32_cadence_in_progress_factor = 468750;
   
   // adjust cadence sensor ticks counter min depending on wheel speed
   ui16_cadence_sensor_ticks_counter_min_speed_adjusted = map((uint32_t) ui16_wheel_speed_x10,
@@ -780,27 +937,17 @@ static void calc_cadence(void)
                                                              (uint32_t) 400,
                                                              (uint32_t) CADENCE_SENSOR_TICKS_COUNTER_MIN,
                                                              (uint32_t) CADENCE_SENSOR_TICKS_COUNTER_MIN_AT_SPEED);
-                                                             
+  
   // select cadence sensor mode
   switch (ui8_cadence_sensor_mode)
   {
     case STANDARD_MODE:
-    
-      // calculate cadence in RPM and avoid zero division
-      if (ui16_cadence_sensor_ticks_temp)
-      {
-        ui8_pedal_cadence_RPM = 46875 / ui16_cadence_sensor_ticks_temp;
-      }
-      else
-      {
-        ui8_pedal_cadence_RPM = 0;
-      }
       
       /*-------------------------------------------------------------------------------------------------
-      
+        
         NOTE: regarding the cadence calculation
         
-        Cadence in standard mode is calculated by counting how many ticks there are between two 
+        Cadence in standard mode is calculated by counting how many ticks there are between two
         transitions of LOW to HIGH.
         
         Formula for calculating the cadence in RPM:
@@ -811,75 +958,85 @@ static void calc_cadence(void)
         
         (3) Cadence in RPM = 46875 / ticks
         
+        (4) Cadence in RPM * 10 = 468750 / ticks
+      
       -------------------------------------------------------------------------------------------------*/
     
     break;
     
     case ADVANCED_MODE:
-    
+      
       // set the pulse duty cycle in ticks
       ui16_cadence_sensor_ticks_counter_min_high = ((uint32_t) ui16_cadence_sensor_pulse_high_percentage_x10 * ui16_cadence_sensor_ticks_counter_min_speed_adjusted) / 1000;
       ui16_cadence_sensor_ticks_counter_min_low = ((uint32_t) (1000 - ui16_cadence_sensor_pulse_high_percentage_x10) * ui16_cadence_sensor_ticks_counter_min_speed_adjusted) / 1000;
       
-      // calculate cadence in RPM and avoid zero division
-      if (ui16_cadence_sensor_ticks_temp)
+      // adjust cadence calculation depending on pulse state, pulse state is the pin state after the measured transitions
+      if (ui8_cadence_sensor_pulse_state_temp)
       {
-        // adjust cadence calculation depending on pulse state
-        if (ui8_cadence_sensor_pulse_state_temp)
-        {
-          ui8_pedal_cadence_RPM = ((uint32_t) (1000 - ui16_cadence_sensor_pulse_high_percentage_x10) * 46875) / ((uint32_t) ui16_cadence_sensor_ticks_temp * 1000);
-        }
-        else
-        {
-          ui8_pedal_cadence_RPM = ((uint32_t) ui16_cadence_sensor_pulse_high_percentage_x10 * 46875) / ((uint32_t) ui16_cadence_sensor_ticks_temp * 1000);
-        }
+        ui32_cadence_measured_factor = ((uint32_t) (1000 - ui16_cadence_sensor_pulse_high_percentage_x10) * 46875) / 100;
+        ui32_cadence_in_progress_factor = ((uint32_t) ui16_cadence_sensor_pulse_high_percentage_x10 * 46875) / 100;
       }
       else
       {
-        ui8_pedal_cadence_RPM = 0;
+        ui32_cadence_measured_factor = ((uint32_t) ui16_cadence_sensor_pulse_high_percentage_x10 * 46875) / 100;
+        ui32_cadence_in_progress_factor = ((uint32_t) (1000 - ui16_cadence_sensor_pulse_high_percentage_x10) * 46875) / 100;
       }
       
       /*-------------------------------------------------------------------------------------------------
-      
+        
         NOTE: regarding the cadence calculation
         
-        Cadence in advanced mode is calculated by counting how many ticks there are between all 
-        transitions of any kind. 
+        Cadence in advanced mode is calculated by counting how many ticks there are between all
+        transitions of any kind.
         
-        By measuring all transitions it is possible to double the cadence 
-        resolution or to half the response time. 
+        By measuring all transitions it is possible to double the cadence
+        resolution or to half the response time.
         
-        When using the advanced mode it is important to adjust for the different spacings between 
+        When using the advanced mode it is important to adjust for the different spacings between
         different kind of transitions. This is why there is a conversion factor.
         
-        Formula for calculating the cadence in RPM using the advanced mode with 
+        Formula for calculating the cadence in RPM using the advanced mode with
         double the transitions:
         
         (1) Cadence in RPM = 6000 / (ticks * pulse_duty_cycle * CADENCE_SENSOR_NUMBER_MAGNETS * 0.000064)
-
+        
         (2) Cadence in RPM = 6000 / (ticks * pulse_duty_cycle * 0.00128)
         
         (3) Cadence in RPM = 4687500 / (ticks * pulse_duty_cycle)
-
-
+        
+        (4) Cadence in RPM * 10 = (pulse_duty_cycle_x10 * 46875 / 100) / ticks
+        
+        
         (1) Cadence in RPM * 2 = 60 / (ticks * CADENCE_SENSOR_NUMBER_MAGNETS * 0.000064)
         
         (2) Cadence in RPM * 2 = 60 / (ticks * 0.00128)
         
         (3) Cadence in RPM * 2 = 4687500 / ticks
-
-        
+      
+      
       -------------------------------------------------------------------------------------------------*/
-  
+    
     break;
     
     case CALIBRATION_MODE:
       
       // set the pedal cadence to zero because calibration is taking place
-      ui8_pedal_cadence_RPM = 0;
+      ui16_cadence_sensor_ticks_temp = 0;
     
     break;
   }
+  
+  // estimate cadence, no pedal rotation when ticks are 0: the ticks counter timed out or the pedals rotate backwards
+  ui16_pedal_cadence_RPM_x10 = pas_cadence_estimator(ui16_cadence_sensor_ticks_temp,
+                                                     (uint8_t) (ui8_cadence_sensor_edge_counter_temp - ui8_cadence_sensor_edge_counter_old),
+                                                     ui16_cadence_sensor_ticks_since_edge,
+                                                     ui32_cadence_measured_factor,
+                                                     ui32_cadence_in_progress_factor);
+  
+  ui8_cadence_sensor_edge_counter_old = ui8_cadence_sensor_edge_counter_temp;
+  
+  // set pedal cadence
+  ui8_pedal_cadence_RPM = (ui16_pedal_cadence_RPM_x10 + 5) / 10;
 }
 
 
@@ -898,15 +1055,41 @@ static void get_battery_current_filtered(void)
 
 
 
+static void get_battery_current_max(void)
+{
+  // update battery resistance and open circuit voltage estimation
+  battery_model_calc();
+  
+  // calculate max battery current in ADC steps from the received battery current limit
+  uint8_t ui8_adc_battery_current_max_temp_1 = ((ui8_battery_current_max * 10) / BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10);
+  
+  // calculate max battery current in ADC steps from the received power limit and low voltage cut off, using predicted loaded voltage
+  uint8_t ui8_adc_battery_current_max_temp_2 = battery_get_adc_current_max(m_configuration_variables.ui8_target_battery_max_power_div25,
+                                                                           m_configuration_variables.ui16_battery_low_voltage_cut_off_x10);
+  
+  // set max battery current
+  ui8_adc_battery_current_max = ui8_min(ui8_adc_battery_current_max_temp_1, ui8_adc_battery_current_max_temp_2);
+}
+
+
+
 static void get_pedal_torque(void)
 {
   // get adc pedal torque
   ui16_adc_pedal_torque = UI16_ADC_10_BIT_TORQUE_SENSOR;
   
+  // when pedaling use the adc pedal torque of the last pedal revolution or half revolution, a single sample depends on the crank angle
+  uint16_t ui16_adc_pedal_torque_temp = ui16_adc_pedal_torque;
+  uint8_t ui8_torque_sensor_samples_available = torque_sensor_calc();
+  if (ui8_pedal_cadence_RPM && ui8_torque_sensor_samples_available) { ui16_adc_pedal_torque_temp = torque_sensor_get_adc(); }
+  
+  // track torque sensor offset when the pedals are unloaded
+  torque_sensor_offset_track(ui16_adc_pedal_torque, ui8_pedal_cadence_RPM);
+  
   // calculate the delta value of adc pedal torque and the adc pedal torque offset from calibration
-  if (ui16_adc_pedal_torque > ui16_adc_pedal_torque_offset)
+  if (ui16_adc_pedal_torque_temp > ui16_adc_pedal_torque_offset)
   {
-    ui16_adc_pedal_torque_delta = ui16_adc_pedal_torque - ui16_adc_pedal_torque_offset;
+    ui16_adc_pedal_torque_delta = ui16_adc_pedal_torque_temp - ui16_adc_pedal_torque_offset;
   }
   else
   {
@@ -915,9 +1098,22 @@ static void get_pedal_torque(void)
   
   // calculate torque on pedals
   ui16_pedal_torque_x100 = ui16_adc_pedal_torque_delta * m_configuration_variables.ui8_pedal_torque_per_10_bit_ADC_step_x100;
+  
+  // torque of the last half stroke only, for the gear shift detection
+  ui16_adc_pedal_torque_temp = ui16_adc_pedal_torque;
+  if (ui8_pedal_cadence_RPM && ui8_torque_sensor_samples_available) { ui16_adc_pedal_torque_temp = torque_sensor_get_adc_half_stroke(); }
+  
+  if (ui16_adc_pedal_torque_temp > ui16_adc_pedal_torque_offset)
+  {
+    ui16_pedal_torque_half_stroke_x100 = (ui16_adc_pedal_torque_temp - ui16_adc_pedal_torque_offset) * m_configuration_variables.ui8_pedal_torque_per_10_bit_ADC_step_x100;
+  }
+  else
+  {
+    ui16_pedal_torque_half_stroke_x100 = 0;
+  }
 
   // calculate human power
-  ui16_human_power_x10 = ((uint32_t) ui16_pedal_torque_x100 * ui8_pedal_cadence_RPM) / 96; // see note below
+  ui16_human_power_x10 = ((uint32_t) ui16_pedal_torque_x100 * ui16_pedal_cadence_RPM_x10) / 960; // see note below
   
   /*------------------------------------------------------------------------
 
@@ -929,6 +1125,7 @@ static void get_pedal_torque(void)
     (4) Formula: power = torque * 100 * rotations per minute * 0.001047
     (5) Formula: power = torque * 100 * rotations per minute / 955
     (6) Formula: power * 10  =  torque * 100 * rotations per minute / 96
+    (7) Formula: power * 10  =  torque * 100 * rotations per minute * 10 / 960
     
   ------------------------------------------------------------------------*/
 }
@@ -944,71 +1141,54 @@ struct_configuration_variables* get_configuration_variables (void)
 
 static void check_brakes()
 {
+  #define BRAKE_RELEASE_DEBOUNCE_RUNS   3   // 60 ms
+  
+  static uint8_t ui8_brake_release_counter;
+  
   // check if brakes are installed
   
+  // clear brake latch when brakes are released for the debounce time
+  if (brake_is_set()) { ui8_brake_release_counter = 0; }
+  else if ((ui8_g_brake_latched) && (++ui8_brake_release_counter >= BRAKE_RELEASE_DEBOUNCE_RUNS))
+  {
+    ui8_g_brake_latched = 0;
+    ui8_brake_release_counter = 0;
+  }
+  
   // set brake state
-  ui8_brakes_enabled = brake_is_set();
+  ui8_brakes_enabled = brake_is_set() || ui8_g_brake_latched;
 }
 
 
 
-static void check_system()
+static void check_motor_faults()
 {
-  #define MOTOR_BLOCKED_COUNTER_THRESHOLD               10    // 10  =>  1.0 second
-  #define MOTOR_BLOCKED_BATTERY_CURRENT_THRESHOLD_X10   50    // 50  =>  5.0 amps
-  #define MOTOR_BLOCKED_ERPS_THRESHOLD                  10    // 10 ERPS
-  #define MOTOR_BLOCKED_RESET_COUNTER_THRESHOLD         100   // 100  =>  10 seconds
+  static uint8_t ui8_fault_error_code_old;
   
-  static uint8_t ui8_motor_blocked_counter;
-  static uint8_t ui8_motor_blocked_reset_counter;
-
-  // if the motor blocked error is enabled start resetting it
-  if (ui8_system_state == ERROR_MOTOR_BLOCKED)
+  // latch and clear motor faults
+  fault_controller();
+  
+  // set error code of latched fault, reset it when the fault is cleared
+  uint8_t ui8_fault_error_code = fault_get_error_code();
+  
+  if (ui8_fault_error_code != NO_ERROR)
   {
-    // increment motor blocked reset counter with 100 milliseconds
-    ui8_motor_blocked_reset_counter++;
-    
-    // check if the counter has counted to the set threshold for reset
-    if (ui8_motor_blocked_reset_counter > MOTOR_BLOCKED_RESET_COUNTER_THRESHOLD)
-    {
-      // reset motor blocked error code
-      if (ui8_system_state == ERROR_MOTOR_BLOCKED) { ui8_system_state = NO_ERROR; }
-      
-      // reset the counter that clears the motor blocked error
-      ui8_motor_blocked_reset_counter = 0;
-    }
+    ui8_system_state = ui8_fault_error_code;
   }
-  else
+  else if ((ui8_fault_error_code_old != NO_ERROR) && (ui8_system_state == ui8_fault_error_code_old))
   {
-    // if battery current is over the current threshold and the motor ERPS is below threshold start setting motor blocked error code
-    if ((ui8_battery_current_filtered_x10 > MOTOR_BLOCKED_BATTERY_CURRENT_THRESHOLD_X10) && (ui16_motor_get_motor_speed_erps() < MOTOR_BLOCKED_ERPS_THRESHOLD))
-    {
-      // increment motor blocked counter with 100 milliseconds
-      ++ui8_motor_blocked_counter;
-      
-      // check if motor is blocked for more than some safe threshold
-      if (ui8_motor_blocked_counter > MOTOR_BLOCKED_COUNTER_THRESHOLD)
-      {
-        // set error code
-        ui8_system_state = ERROR_MOTOR_BLOCKED;
-        
-        // reset motor blocked counter as the error code is set
-        ui8_motor_blocked_counter = 0;
-      }
-    }
-    else
-    {
-      // current is below the threshold and/or motor ERPS is above the threshold so reset the counter
-      ui8_motor_blocked_counter = 0;
-    }
+    ui8_system_state = NO_ERROR;
   }
   
-  
-  ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-  
-  
+  ui8_fault_error_code_old = ui8_fault_error_code;
+}
+
+
+
+static void check_system()
+{
   // check torque sensor
-  if (((ui16_adc_pedal_torque_offset > 300) || (ui16_adc_pedal_torque_offset < 5)) &&
+  if (((ui16_adc_pedal_torque_offset > ADC_TORQUE_SENSOR_OFFSET_MAX) || (ui16_adc_pedal_torque_offset < ADC_TORQUE_SENSOR_OFFSET_MIN)) &&
       ((ui8_riding_mode == POWER_ASSIST_MODE) || (ui8_riding_mode == TORQUE_ASSIST_MODE) || (ui8_riding_mode == eMTB_ASSIST_MODE)))
   {
     // set error code
@@ -1042,6 +1222,49 @@ static void check_system()
 
 
 
+static void save_configuration(void)
+{
+  #define TORQUE_SENSOR_OFFSET_SAVE_THRESHOLD   3   // save offset when it changed at least 3 ADC steps from the saved offset
+  
+  // save tracked torque sensor offset so it is used on next power on
+  if ((ui16_adc_pedal_torque_offset >= ADC_TORQUE_SENSOR_OFFSET_MIN) &&
+      (ui16_adc_pedal_torque_offset <= ADC_TORQUE_SENSOR_OFFSET_MAX) &&
+      (((ui16_adc_pedal_torque_offset + TORQUE_SENSOR_OFFSET_SAVE_THRESHOLD) <= m_configuration_variables.ui16_adc_pedal_torque_offset) ||
+       (ui16_adc_pedal_torque_offset >= (m_configuration_variables.ui16_adc_pedal_torque_offset + TORQUE_SENSOR_OFFSET_SAVE_THRESHOLD))))
+  {
+    m_configuration_variables.ui16_adc_pedal_torque_offset = ui16_adc_pedal_torque_offset;
+    ui8_configuration_save_pending = 1;
+  }
+  
+  #define MOTOR_THERMAL_SAVE_THRESHOLD          5   // save motor temperatures when winding temperature changed at least 5 degrees Celsius from the saved temperature
+  
+  // save motor thermal model state so it is used on next power on, power off can not be detected so it is saved after each ride
+  uint8_t ui8_motor_winding_temperature = motor_thermal_get_winding_temperature();
+  
+  if (((ui8_motor_winding_temperature + MOTOR_THERMAL_SAVE_THRESHOLD) <= m_configuration_variables.ui8_motor_winding_temperature) ||
+      (ui8_motor_winding_temperature >= (m_configuration_variables.ui8_motor_winding_temperature + MOTOR_THERMAL_SAVE_THRESHOLD)))
+  {
+    m_configuration_variables.ui8_motor_winding_temperature = ui8_motor_winding_temperature;
+    m_configuration_variables.ui8_motor_case_temperature = motor_thermal_get_case_temperature();
+    ui8_configuration_save_pending = 1;
+  }
+  
+  // save learned FOC angle offsets
+  if (foc_angle_tracker_save_needed()) { ui8_configuration_save_pending = 1; }
+  
+  // save at the end of a ride, when the motor is stopped
+  if (ui8_configuration_save_pending && (ui16_motor_get_motor_speed_erps() == 0))
+  {
+    ui8_configuration_save_pending = 0;
+    EEPROM_controller(WRITE_TO_MEMORY);
+  }
+  
+  // program one changed byte per run, programming does not block the main loop
+  EEPROM_write_step();
+}
+
+
+
 void ebike_control_lights(void)
 {
   #define DEFAULT_FLASH_ON_COUNTER_MAX      3
@@ -1299,51 +1522,20 @@ void ebike_control_lights(void)
 
 
 // This is the interrupt that happens when UART2 receives data. We need it to be the fastest possible and so
-// we do: receive every byte and assembly as a package, finally, signal that we have a package to process (on main slow loop)
-// and disable the interrupt. The interrupt should be enable again on main loop, after the package being processed
+// we do: receive every byte and assembly as a package in one of two buffers with uart_rx_byte(), that signals
+// the package to the main slow loop and continues receiving in the other buffer, so the interrupt is never disabled
 void UART2_IRQHandler(void) __interrupt(UART2_IRQHANDLER)
 {
+  uint8_t ui8_overrun;
+  
   if (UART2_GetFlagStatus(UART2_FLAG_RXNE) == SET)
   {
+    // bytes lost by the UART2 receiver, the overrun flag is cleared by reading the data register
+    ui8_overrun = (UART2->SR & UART2_SR_OR) ? 1 : 0;
+    
     UART2->SR &= (uint8_t)~(UART2_FLAG_RXNE); // this may be redundant
-
-    ui8_byte_received = UART2_ReceiveData8 ();
-
-    switch (ui8_state_machine)
-    {
-      case 0:
-      if (ui8_byte_received == 0x59) // see if we get start package byte
-      {
-        ui8_rx_buffer [ui8_rx_counter] = ui8_byte_received;
-        ui8_rx_counter++;
-        ui8_state_machine = 1;
-      }
-      else
-      {
-        ui8_rx_counter = 0;
-        ui8_state_machine = 0;
-      }
-      break;
-
-      case 1:
-      ui8_rx_buffer [ui8_rx_counter] = ui8_byte_received;
-      
-      // increment index for next byte
-      ui8_rx_counter++;
-
-      // reset if it is the last byte of the package and index is out of bounds
-      if (ui8_rx_counter >= UART_NUMBER_DATA_BYTES_TO_RECEIVE + 3)
-      {
-        ui8_rx_counter = 0;
-        ui8_state_machine = 0;
-        ui8_received_package_flag = 1; // signal that we have a full package to be processed
-        UART2->CR2 &= ~(1 << 5); // disable UART2 receive interrupt
-      }
-      break;
-
-      default:
-      break;
-    }
+    
+    uart_rx_byte(&m_uart_rx, UART2_ReceiveData8(), ui8_overrun);
   }
 }
 
@@ -1356,99 +1548,99 @@ static void communications_controller (void)
   
   uart_receive_package ();
 
-  uart_send_package ();
+  // send flight recorder dump instead of the package to the display while there is a dump to send
+  if (!flight_recorder_send_dump ()) { uart_send_package (); }
 
 #endif
 }
 
 static void uart_receive_package(void)
 {
-  if (ui8_received_package_flag)
+  volatile uint8_t *p_rx_buffer = uart_rx_get_frame(&m_uart_rx);
+  
+  if (p_rx_buffer)
   {
     // validation of the package data
-    ui16_crc_rx = 0xffff;
-    
-    for (ui8_i = 0; ui8_i <= UART_NUMBER_DATA_BYTES_TO_RECEIVE; ui8_i++)
-    {
-      crc16 (ui8_rx_buffer[ui8_i], &ui16_crc_rx);
-    }
+    ui16_crc_rx = crc16_buf((const uint8_t *) p_rx_buffer, UART_NUMBER_DATA_BYTES_TO_RECEIVE + 1);
 
     // if CRC is correct read the package (16 bit value and therefore last two bytes)
-    if (((((uint16_t) ui8_rx_buffer [UART_NUMBER_DATA_BYTES_TO_RECEIVE + 2]) << 8) + ((uint16_t) ui8_rx_buffer [UART_NUMBER_DATA_BYTES_TO_RECEIVE + 1])) == ui16_crc_rx)
+    if (((((uint16_t) p_rx_buffer [UART_NUMBER_DATA_BYTES_TO_RECEIVE + 2]) << 8) + ((uint16_t) p_rx_buffer [UART_NUMBER_DATA_BYTES_TO_RECEIVE + 1])) == ui16_crc_rx)
     {
+      ++ui16_uart_rx_frames_ok;
+      
       // message ID
-      ui8_message_ID = ui8_rx_buffer [1];
+      ui8_message_ID = p_rx_buffer [1];
       
       // riding mode
-      ui8_riding_mode = ui8_rx_buffer [2];
+      ui8_riding_mode = p_rx_buffer [2];
       
       // riding mode parameter
-      ui8_riding_mode_parameter = ui8_rx_buffer [3];
+      ui8_riding_mode_parameter = p_rx_buffer [3];
       
       // lights state
-      ui8_lights_state = ui8_rx_buffer [4];
+      ui8_lights_state = p_rx_buffer [4];
 
       switch (ui8_message_ID)
       {
         case 0:
         
           // battery low voltage cut off x10
-          m_configuration_variables.ui16_battery_low_voltage_cut_off_x10 = (((uint16_t) ui8_rx_buffer [6]) << 8) + ((uint16_t) ui8_rx_buffer [5]);
+          m_configuration_variables.ui16_battery_low_voltage_cut_off_x10 = (((uint16_t) p_rx_buffer [6]) << 8) + ((uint16_t) p_rx_buffer [5]);
           
           // set low voltage cut off
           ui8_adc_battery_voltage_cut_off = (uint8_t) (((uint32_t) m_configuration_variables.ui16_battery_low_voltage_cut_off_x10 << 8) / (BATTERY_VOLTAGE_PER_8_BIT_ADC_STEP_X256 * 10));
           
+          // set battery undervoltage fault threshold 1/8 under the low voltage cut off
+          ui8_g_fault_adc_battery_voltage_min = ui8_adc_battery_voltage_cut_off - (ui8_adc_battery_voltage_cut_off >> 3);
+          
           // wheel max speed
-          m_configuration_variables.ui8_wheel_speed_max = ui8_rx_buffer [7];
+          m_configuration_variables.ui8_wheel_speed_max = p_rx_buffer [7];
           
         break;
 
         case 1:
         
           // wheel perimeter
-          m_configuration_variables.ui16_wheel_perimeter = (((uint16_t) ui8_rx_buffer [6]) << 8) + ((uint16_t) ui8_rx_buffer [5]);
+          m_configuration_variables.ui16_wheel_perimeter = (((uint16_t) p_rx_buffer [6]) << 8) + ((uint16_t) p_rx_buffer [5]);
           
           // motor temperature limit function or throttle
-          m_configuration_variables.ui8_optional_ADC_function = ui8_rx_buffer [7];
+          m_configuration_variables.ui8_optional_ADC_function = p_rx_buffer [7];
 
         break;
 
         case 2:
         
           // type of motor (36 volt, 48 volt or some experimental type)
-          m_configuration_variables.ui8_motor_type = ui8_rx_buffer[5];
+          m_configuration_variables.ui8_motor_type = p_rx_buffer[5];
           
           // motor over temperature min value limit
-          ui8_motor_temperature_min_value_to_limit = ui8_rx_buffer[6];
+          ui8_motor_temperature_min_value_to_limit = p_rx_buffer[6];
           
           // motor over temperature max value limit
-          ui8_motor_temperature_max_value_to_limit = ui8_rx_buffer[7];
+          ui8_motor_temperature_max_value_to_limit = p_rx_buffer[7];
 
         break;
 
         case 3:
         
-          // = ui8_rx_buffer[5];
-          
-          // = ui8_rx_buffer[6];
-          
-          // = ui8_rx_buffer[7];
+          // assist map chunk: chunk index and two bytes of map data, save map to EEPROM if it changed
+          if (assist_map_receive_chunk(p_rx_buffer[5], p_rx_buffer[6], p_rx_buffer[7])) { ui8_configuration_save_pending = 1; }
           
         break;
 
         case 4:
           
           // lights configuration
-          ui8_lights_configuration = ui8_rx_buffer[5];
+          ui8_lights_configuration = p_rx_buffer[5];
           
           // assist without pedal rotation threshold
-          ui8_assist_without_pedal_rotation_threshold = ui8_rx_buffer[6];
+          ui8_assist_without_pedal_rotation_threshold = p_rx_buffer[6];
           
           // check if assist without pedal rotation threshold is valid (safety)
           if (ui8_assist_without_pedal_rotation_threshold > 100) { ui8_assist_without_pedal_rotation_threshold = 0; }
           
           // motor acceleration adjustment
-          uint8_t ui8_motor_acceleration_adjustment = ui8_rx_buffer[7];
+          uint8_t ui8_motor_acceleration_adjustment = p_rx_buffer[7];
           
           // set duty cycle ramp up inverse step
           ui16_duty_cycle_ramp_up_inverse_step_default = map((uint32_t) ui8_motor_acceleration_adjustment,
@@ -1462,35 +1654,27 @@ static void uart_receive_package(void)
         case 5:
         
           // pedal torque conversion
-          m_configuration_variables.ui8_pedal_torque_per_10_bit_ADC_step_x100 = ui8_rx_buffer[5];
+          m_configuration_variables.ui8_pedal_torque_per_10_bit_ADC_step_x100 = p_rx_buffer[5];
           
           // max battery current
-          ui8_battery_current_max = ui8_rx_buffer[6];
+          ui8_battery_current_max = p_rx_buffer[6];
           
           // battery power limit
-          m_configuration_variables.ui8_target_battery_max_power_div25 = ui8_rx_buffer[7];
-          
-          // calculate max battery current in ADC steps from the received battery current limit
-          uint8_t ui8_adc_battery_current_max_temp_1 = ((ui8_battery_current_max * 10) / BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10);
-          
-          // calculate max battery current in ADC steps from the received power limit
-          uint32_t ui32_battery_current_max_x10 = ((uint32_t) m_configuration_variables.ui8_target_battery_max_power_div25 * 250000) / ui16_battery_voltage_filtered_x1000;
-          uint8_t ui8_adc_battery_current_max_temp_2 = ui32_battery_current_max_x10 / BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10;
+          m_configuration_variables.ui8_target_battery_max_power_div25 = p_rx_buffer[7];
           
-          // set max battery current
-          ui8_adc_battery_current_max = ui8_min(ui8_adc_battery_current_max_temp_1, ui8_adc_battery_current_max_temp_2);
+          // max battery current is calculated in get_battery_current_max()
         
         break;
         
         case 6:
           
           // cadence sensor mode
-          ui8_cadence_sensor_mode = ui8_rx_buffer[5];
+          ui8_cadence_sensor_mode = p_rx_buffer[5];
           
           // cadence sensor pulse high percentage
           if (ui8_cadence_sensor_mode == ADVANCED_MODE)
           {
-            ui16_cadence_sensor_pulse_high_percentage_x10 = (((uint16_t) ui8_rx_buffer[7]) << 8) + ((uint16_t) ui8_rx_buffer[6]);
+            ui16_cadence_sensor_pulse_high_percentage_x10 = (((uint16_t) p_rx_buffer[7]) << 8) + ((uint16_t) p_rx_buffer[6]);
           }
           
           /*-------------------------------------------------------------------------------------------------
@@ -1504,23 +1688,60 @@ static void uart_receive_package(void)
 
         break;
 
+        case 7:
+          
+          // cruise PID gains, all zero to use the default gains for the motor type
+          ui8_cruise_PID_kp_x10 = p_rx_buffer[5];
+          ui8_cruise_PID_ki_x100 = p_rx_buffer[6];
+          ui8_cruise_PID_kd_x10 = p_rx_buffer[7];
+          
+        break;
+        
+        case 8:
+          
+          // startup power boost enabled, restart state and boost with max power
+          m_configuration_variables.ui8_startup_motor_power_boost_feature_enabled = p_rx_buffer[5];
+          m_configuration_variables.ui8_startup_motor_power_boost_state = p_rx_buffer[6];
+          m_configuration_variables.ui8_startup_motor_power_boost_limit_to_max_power = p_rx_buffer[7];
+          
+        break;
+        
+        case 9:
+          
+          // startup power boost assist level, boost time and fade time in 0.1 s
+          m_configuration_variables.ui8_startup_motor_power_boost_assist_level = p_rx_buffer[5];
+          m_configuration_variables.ui8_startup_motor_power_boost_time = p_rx_buffer[6];
+          m_configuration_variables.ui8_startup_motor_power_boost_fade_time = p_rx_buffer[7];
+          
+        break;
+        
+        case FLIGHT_RECORDER_MESSAGE_ID:
+          
+          // flight recorder command, decimation in PWM cycles and trigger mask
+          flight_recorder_command(p_rx_buffer[5], p_rx_buffer[6], p_rx_buffer[7]);
+          
+        break;
+
         default:
           // nothing, should display error code
         break;
       }
     }
+    else if (ui8_uart_rx_crc_errors < 255)
+    {
+      ++ui8_uart_rx_crc_errors;
+    }
     
     // signal that we processed the full package
-    ui8_received_package_flag = 0;
-
-    // enable UART2 receive interrupt as we are now ready to receive a new package
-    UART2->CR2 |= (1 << 5);
+    uart_rx_frame_done(&m_uart_rx);
   }
 }
 
 static void uart_send_package(void)
 {
+  uint32_t ui32_temp;
   uint16_t ui16_temp;
+  uint8_t ui8_temp;
 
   // start up byte
   ui8_tx_buffer[0] = 0x43;
@@ -1604,195 +1825,218 @@ static void uart_send_package(void)
   ui16_temp = ui16_cadence_sensor_pulse_high_percentage_x10;
   ui8_tx_buffer[25] = (uint8_t) (ui16_temp & 0xff);
   ui8_tx_buffer[26] = (uint8_t) (ui16_temp >> 8);
-
-  // prepare crc of the package
-  ui16_crc_tx = 0xffff;
   
-  for (ui8_i = 0; ui8_i <= UART_NUMBER_DATA_BYTES_TO_SEND; ui8_i++)
+  // telemetry data ID, a different data set is sent on each package, flag the first cycles after power on
+  ui8_tx_buffer[27] = ui8_telemetry_ID;
+  if (ui8_telemetry_cycles < TELEMETRY_RESTARTED_CYCLES) { ui8_tx_buffer[27] |= TELEMETRY_RESTARTED; }
+  
+  switch (ui8_telemetry_ID)
+  {
+    case TELEMETRY_SCHEDULER_TASK_0:
+    case TELEMETRY_SCHEDULER_TASK_1:
+    case TELEMETRY_SCHEDULER_TASK_2:
+    {
+      struct_scheduler_task *p_task = scheduler_get_task(ui8_telemetry_ID - TELEMETRY_SCHEDULER_TASK_0);
+      
+      // run counter
+      ui8_tx_buffer[28] = (uint8_t) (p_task->ui16_run_counter & 0xff);
+      ui8_tx_buffer[29] = (uint8_t) (p_task->ui16_run_counter >> 8);
+      
+      // late counter
+      ui8_tx_buffer[30] = p_task->ui8_late_counter;
+      
+      // max overrun
+      ui8_tx_buffer[31] = p_task->ui8_max_overrun;
+    }
+    break;
+    
+    case TELEMETRY_STARTUP_TIMELINE_0:
+    case TELEMETRY_STARTUP_TIMELINE_1:
+    case TELEMETRY_STARTUP_TIMELINE_2:
+    
+      // two startup timeline steps, last data set has only one
+      ui8_temp = (ui8_telemetry_ID - TELEMETRY_STARTUP_TIMELINE_0) << 1;
+      ui8_tx_buffer[28] = (uint8_t) (ui16_startup_timeline[ui8_temp] & 0xff);
+      ui8_tx_buffer[29] = (uint8_t) (ui16_startup_timeline[ui8_temp] >> 8);
+      
+      if ((ui8_temp + 1) < STARTUP_TIMELINE_STEPS)
+      {
+        ui8_tx_buffer[30] = (uint8_t) (ui16_startup_timeline[ui8_temp + 1] & 0xff);
+        ui8_tx_buffer[31] = (uint8_t) (ui16_startup_timeline[ui8_temp + 1] >> 8);
+      }
+      else
+      {
+        ui8_tx_buffer[30] = 0;
+        ui8_tx_buffer[31] = 0;
+      }
+      
+    break;
+    
+    case TELEMETRY_BATTERY_CHARGE:
+    
+      ui32_temp = battery_get_charge_mAs();
+      ui8_tx_buffer[28] = (uint8_t) (ui32_temp & 0xff);
+      ui8_tx_buffer[29] = (uint8_t) ((ui32_temp >> 8) & 0xff);
+      ui8_tx_buffer[30] = (uint8_t) ((ui32_temp >> 16) & 0xff);
+      ui8_tx_buffer[31] = (uint8_t) (ui32_temp >> 24);
+      
+    break;
+    
+    case TELEMETRY_BATTERY_ENERGY:
+    
+      ui32_temp = battery_get_energy_mWs();
+      ui8_tx_buffer[28] = (uint8_t) (ui32_temp & 0xff);
+      ui8_tx_buffer[29] = (uint8_t) ((ui32_temp >> 8) & 0xff);
+      ui8_tx_buffer[30] = (uint8_t) ((ui32_temp >> 16) & 0xff);
+      ui8_tx_buffer[31] = (uint8_t) (ui32_temp >> 24);
+      
+    break;
+    
+    case TELEMETRY_BATTERY_MODEL:
+    
+      ui16_temp = battery_get_resistance_mohm();
+      ui8_tx_buffer[28] = (uint8_t) (ui16_temp & 0xff);
+      ui8_tx_buffer[29] = (uint8_t) (ui16_temp >> 8);
+      
+      ui16_temp = battery_get_open_circuit_voltage_x1000();
+      ui8_tx_buffer[30] = (uint8_t) (ui16_temp & 0xff);
+      ui8_tx_buffer[31] = (uint8_t) (ui16_temp >> 8);
+      
+    break;
+    
+    case TELEMETRY_UART_RX:
+    
+      // UART receive statistics
+      ui8_tx_buffer[28] = (uint8_t) (ui16_uart_rx_frames_ok & 0xff);
+      ui8_tx_buffer[29] = (uint8_t) (ui16_uart_rx_frames_ok >> 8);
+      ui8_tx_buffer[30] = ui8_uart_rx_crc_errors;
+      ui8_tx_buffer[31] = m_uart_rx.ui8_overruns;
+      
+    break;
+    
+    case TELEMETRY_UART_RX_DROPPED:
+    
+      // frames received before the last one was processed
+      ui8_tx_buffer[28] = m_uart_rx.ui8_frames_dropped;
+      ui8_tx_buffer[29] = 0;
+      ui8_tx_buffer[30] = 0;
+      ui8_tx_buffer[31] = 0;
+      
+    break;
+    
+    case TELEMETRY_FAULT_0:
+    case TELEMETRY_FAULT_1:
+    case TELEMETRY_FAULT_2:
+    case TELEMETRY_FAULT_3:
+    
+      ui8_temp = ui8_telemetry_ID - TELEMETRY_FAULT_0;
+      
+      ui8_tx_buffer[28] = (fault_get_latched() >> ui8_temp) & 1;
+      ui8_tx_buffer[29] = fault_get_latch_counter(ui8_temp);
+      
+      ui16_temp = fault_get_timestamp_x10(ui8_temp);
+      ui8_tx_buffer[30] = (uint8_t) (ui16_temp & 0xff);
+      ui8_tx_buffer[31] = (uint8_t) (ui16_temp >> 8);
+      
+    break;
+    
+    case TELEMETRY_GEAR_SHIFTS:
+    
+      ui16_temp = gear_shift_get_counter();
+      ui8_tx_buffer[28] = (uint8_t) (ui16_temp & 0xff);
+      ui8_tx_buffer[29] = (uint8_t) (ui16_temp >> 8);
+      ui8_tx_buffer[30] = 0;
+      ui8_tx_buffer[31] = 0;
+      
+    break;
+  }
+  
+  // send next telemetry data set on next package
+  if (++ui8_telemetry_ID >= TELEMETRY_NUMBER_OF_IDS)
   {
-    crc16 (ui8_tx_buffer[ui8_i], &ui16_crc_tx);
+    ui8_telemetry_ID = 0;
+    if (ui8_telemetry_cycles < TELEMETRY_RESTARTED_CYCLES) { ++ui8_telemetry_cycles; }
   }
+
+  // prepare crc of the package
+  ui16_crc_tx = crc16_buf(ui8_tx_buffer, UART_NUMBER_DATA_BYTES_TO_SEND + 1);
   
   ui8_tx_buffer[UART_NUMBER_DATA_BYTES_TO_SEND + 1] = (uint8_t) (ui16_crc_tx & 0xff);
   ui8_tx_buffer[UART_NUMBER_DATA_BYTES_TO_SEND + 2] = (uint8_t) (ui16_crc_tx >> 8) & 0xff;
 
   // send the full package to UART
-  for (ui8_i = 0; ui8_i <= UART_NUMBER_DATA_BYTES_TO_SEND + 2; ui8_i++)
-  {
-    putchar (ui8_tx_buffer[ui8_i]);
-  }
+  uart_send_frame(ui8_tx_buffer, UART_NUMBER_DATA_BYTES_TO_SEND + 3);
 }
 
 
 
 
 
-/* static void apply_boost()
+static void apply_boost()
 {
-  ui8_boost_enabled_and_applied = 0;
-  uint8_t ui8_adc_max_battery_current_boost_state = 0;
-
-  // 1.6 = 1 / 0.625 (each adc step for current)
-  // 25 * 1.6 = 40
-  // 40 * 4 = 160
-  if(m_configuration_variables.ui8_startup_motor_power_boost_assist_level > 0)
-  {
-    uint32_t ui32_temp;
-    ui32_temp = (uint32_t) ui16_pedal_torque_x100 * (uint32_t) m_configuration_variables.ui8_startup_motor_power_boost_assist_level;
-    ui32_temp /= 100;
-
-    // 1.6 = 1 / 0.625 (each adc step for current)
-    // 1.6 * 8 = ~13
-    ui32_temp = (ui32_temp * 13000) / ((uint32_t) ui16_battery_voltage_filtered_x1000);
-    ui8_adc_max_battery_current_boost_state = ui32_temp >> 3;
-    ui8_limit_max(&ui8_adc_max_battery_current_boost_state, 255);
-  }
-  
-  // apply boost and boost fade out
-  if(m_configuration_variables.ui8_startup_motor_power_boost_feature_enabled)
-  {
-    boost_run_statemachine();
-    ui8_boost_enabled_and_applied = boost(ui8_adc_max_battery_current_boost_state);
-    apply_boost_fade_out();
-  }
+  struct_boost_inputs m_boost_inputs;
+  
+  m_boost_inputs.ui8_feature_enabled = m_configuration_variables.ui8_startup_motor_power_boost_feature_enabled;
+  m_boost_inputs.ui8_restart_mode = m_configuration_variables.ui8_startup_motor_power_boost_state;
+  m_boost_inputs.ui8_limit_to_max_power = m_configuration_variables.ui8_startup_motor_power_boost_limit_to_max_power;
+  m_boost_inputs.ui8_assist_level = m_configuration_variables.ui8_startup_motor_power_boost_assist_level;
+  m_boost_inputs.ui8_time_x10 = m_configuration_variables.ui8_startup_motor_power_boost_time;
+  m_boost_inputs.ui8_fade_time_x10 = m_configuration_variables.ui8_startup_motor_power_boost_fade_time;
+  
+  // boost only in the riding modes that assist with pedal torque and when assist is enabled
+  m_boost_inputs.ui8_assist_enabled = (ui8_riding_mode_parameter) &&
+                                      ((ui8_riding_mode == POWER_ASSIST_MODE) ||
+                                       (ui8_riding_mode == TORQUE_ASSIST_MODE) ||
+                                       (ui8_riding_mode == eMTB_ASSIST_MODE) ||
+                                       (ui8_riding_mode == ASSIST_MAP_MODE));
+  
+  m_boost_inputs.ui16_adc_pedal_torque_delta = ui16_adc_pedal_torque_delta;
+  m_boost_inputs.ui16_pedal_torque_x100 = ui16_pedal_torque_x100;
+  m_boost_inputs.ui8_pedal_cadence_RPM = ui8_pedal_cadence_RPM;
+  m_boost_inputs.ui8_brakes_enabled = ui8_brakes_enabled;
+  m_boost_inputs.ui16_wheel_speed_x10 = ui16_wheel_speed_x10;
+  m_boost_inputs.ui16_battery_voltage_x1000 = ui16_battery_voltage_filtered_x1000;
+  m_boost_inputs.ui8_adc_battery_current_max = ui8_adc_battery_current_max;
+  
+  boost_controller(&m_boost_inputs, &ui8_adc_battery_current_target, &ui8_duty_cycle_target);
 }
 
 
-static uint8_t boost(uint8_t ui8_max_current_boost_state)
-{
-  uint8_t ui8_boost_enable = ui8_startup_boost_enable && ui8_riding_mode_parameter && ui8_pedal_cadence_RPM > 0 ? 1 : 0;
-
-  if (ui8_boost_enable)
-  {
-    ui8_adc_battery_current_target = ui8_max_current_boost_state;
-  }
-
-  return ui8_boost_enable;
-}
-
 
-static void apply_boost_fade_out()
+static void apply_hill_hold()
 {
-  if (ui8_startup_boost_fade_enable)
-  {
-    // here we try to converge to the regular value, ramping down or up step by step
-    uint16_t ui16_adc_battery_target_current_x256 = ((uint16_t) ui8_adc_battery_current_target) << 8;
-    if (ui16_startup_boost_fade_variable_x256 > ui16_adc_battery_target_current_x256)
-    {
-      ui16_startup_boost_fade_variable_x256 -= ui16_startup_boost_fade_variable_step_amount_x256;
-    }
-    else if (ui16_startup_boost_fade_variable_x256 < ui16_adc_battery_target_current_x256)
-    {
-      ui16_startup_boost_fade_variable_x256 += ui16_startup_boost_fade_variable_step_amount_x256;
-    }
-
-    ui8_adc_battery_current_target = (uint8_t) (ui16_startup_boost_fade_variable_x256 >> 8);
-  }
-}
-
-static void boost_run_statemachine(void)
-{
-  #define BOOST_STATE_BOOST_DISABLED        0
-  #define BOOST_STATE_BOOST                 1
-  #define BOOST_STATE_FADE                  2
-  #define BOOST_STATE_BOOST_WAIT_TO_RESTART 3
-  
-  uint8_t ui8_torque_sensor = ui16_adc_pedal_torque_delta;
-
-  if(m_configuration_variables.ui8_startup_motor_power_boost_time > 0)
-  {
-    switch(ui8_m_startup_boost_state_machine)
-    {
-      // ebike is stopped, wait for throttle signal to startup boost
-      case BOOST_STATE_BOOST_DISABLED:
-      
-        if (ui8_torque_sensor > 12 && (ui8_brakes_enabled == 0))
-        {
-          ui8_startup_boost_enable = 1;
-          ui8_startup_boost_timer = m_configuration_variables.ui8_startup_motor_power_boost_time;
-          ui8_m_startup_boost_state_machine = BOOST_STATE_BOOST;
-        }
-        
-      break;
-
-      case BOOST_STATE_BOOST:
-      
-        // braking means reseting
-        if(ui8_brakes_enabled)
-        {
-          ui8_startup_boost_enable = 0;
-          ui8_m_startup_boost_state_machine = BOOST_STATE_BOOST_DISABLED;
-        }
-
-        // end boost if
-        if(ui8_torque_sensor < 12)
-        {
-          ui8_startup_boost_enable = 0;
-          ui8_m_startup_boost_state_machine = BOOST_STATE_BOOST_WAIT_TO_RESTART;
-        }
-
-        // decrement timer
-        if(ui8_startup_boost_timer > 0) { ui8_startup_boost_timer--; }
-
-        // end boost and start fade if
-        if(ui8_startup_boost_timer == 0)
-        {
-          ui8_m_startup_boost_state_machine = BOOST_STATE_FADE;
-          ui8_startup_boost_enable = 0;
-
-          // setup variables for fade
-          ui8_startup_boost_fade_steps = m_configuration_variables.ui8_startup_motor_power_boost_fade_time;
-          ui16_startup_boost_fade_variable_x256 = ((uint16_t) ui8_adc_battery_current_target << 8);
-          ui16_startup_boost_fade_variable_step_amount_x256 = (ui16_startup_boost_fade_variable_x256 / ((uint16_t) ui8_startup_boost_fade_steps));
-          ui8_startup_boost_fade_enable = 1;
-        }
-      break;
-
-      case BOOST_STATE_FADE:
-        // braking means reseting
-        if(ui8_brakes_enabled)
-        {
-          ui8_startup_boost_fade_enable = 0;
-          ui8_startup_boost_fade_steps = 0;
-          ui8_m_startup_boost_state_machine = BOOST_STATE_BOOST_DISABLED;
-        }
-
-        if(ui8_startup_boost_fade_steps > 0) { ui8_startup_boost_fade_steps--; }
-
-        // disable fade if
-        if(ui8_torque_sensor < 12 ||
-            ui8_startup_boost_fade_steps == 0)
-        {
-          ui8_startup_boost_fade_enable = 0;
-          ui8_startup_boost_fade_steps = 0;
-          ui8_m_startup_boost_state_machine = BOOST_STATE_BOOST_WAIT_TO_RESTART;
-        }
-      break;
-
-      // restart when user is not pressing the pedals AND/OR wheel speed = 0
-      case BOOST_STATE_BOOST_WAIT_TO_RESTART:
-        // wheel speed must be 0 as also torque sensor
-        if((m_configuration_variables.ui8_startup_motor_power_boost_state & 1) == 0)
-        {
-          if(ui16_wheel_speed_x10 == 0 &&
-              ui8_torque_sensor < 12)
-          {
-            ui8_m_startup_boost_state_machine = BOOST_STATE_BOOST_DISABLED;
-          }
-        }
-        // torque sensor must be 0
-        if((m_configuration_variables.ui8_startup_motor_power_boost_state & 1) > 0)
-        {
-          if(ui8_torque_sensor < 12 ||
-              ui8_pedal_cadence_RPM == 0)
-          {
-            ui8_m_startup_boost_state_machine = BOOST_STATE_BOOST_DISABLED;
-          }
-        }
-      break;
-
-      default:
-      break;
-    }
-  }
-} */
\ No newline at end of file
+  static uint8_t ui8_motor_hall_steps_old;
+  static int16_t i16_crank_position_old;
+  
+  struct_hill_hold_inputs m_hill_hold_inputs;
+  uint8_t ui8_motor_hall_steps = ui8_motor_get_hall_steps();
+  int16_t i16_crank_position = pas_get_position();
+  int16_t i16_crank_counts_delta = i16_crank_position - i16_crank_position_old;
+  
+  i16_crank_position_old = i16_crank_position;
+  if (i16_crank_counts_delta < -127) { i16_crank_counts_delta = -127; }
+  else if (i16_crank_counts_delta > 127) { i16_crank_counts_delta = 127; }
+  
+  // hill hold only in the riding modes that assist with pedaling and when assist is enabled
+  m_hill_hold_inputs.ui8_assist_enabled = (ui8_riding_mode_parameter) &&
+                                          ((ui8_riding_mode == POWER_ASSIST_MODE) ||
+                                           (ui8_riding_mode == TORQUE_ASSIST_MODE) ||
+                                           (ui8_riding_mode == CADENCE_ASSIST_MODE) ||
+                                           (ui8_riding_mode == eMTB_ASSIST_MODE) ||
+                                           (ui8_riding_mode == ASSIST_MAP_MODE));
+  
+  m_hill_hold_inputs.ui8_brakes_enabled = ui8_brakes_enabled;
+  m_hill_hold_inputs.ui8_pedal_cadence_RPM = ui8_pedal_cadence_RPM;
+  m_hill_hold_inputs.ui16_wheel_speed_x10 = ui16_wheel_speed_x10;
+  m_hill_hold_inputs.ui8_error = (ui8_system_state != NO_ERROR);
+  m_hill_hold_inputs.i8_crank_counts_delta = (int8_t) i16_crank_counts_delta;
+  m_hill_hold_inputs.i8_motor_hall_steps_delta = (int8_t) (ui8_motor_hall_steps - ui8_motor_hall_steps_old);
+  m_hill_hold_inputs.ui8_adc_battery_current_max = ui8_adc_battery_current_max;
+  
+  ui8_motor_hall_steps_old = ui8_motor_hall_steps;
+  
+  hill_hold_controller(&m_hill_hold_inputs, &ui8_adc_battery_current_target, &ui8_duty_cycle_target);
+  
+  // holding current is over the stall threshold with the motor barely rotating, do not detect stall while holding
+  ui8_g_fault_stall_inhibit = hill_hold_is_active();
+}
\ No newline at end of file
@@ -12,6 +12,9 @@
 #include <stdint.h>
 #include "main.h"
 
+// startup timeline
+extern uint16_t ui16_startup_timeline[];
+
 // cadence sensor
 extern volatile uint8_t ui8_cadence_sensor_mode;
 extern volatile uint16_t ui16_cadence_sensor_ticks_counter_min_speed_adjusted;
@@ -33,10 +36,14 @@ typedef struct _configuration_variables
   uint8_t ui8_startup_motor_power_boost_time;
   uint8_t ui8_startup_motor_power_boost_fade_time;
   uint8_t ui8_optional_ADC_function;
+  uint16_t ui16_adc_pedal_torque_offset;
+  uint8_t ui8_motor_winding_temperature;
+  uint8_t ui8_motor_case_temperature;
 } struct_configuration_variables;
 
 
 void ebike_app_controller (void);
+void ebike_app_housekeeping (void);
 struct_configuration_variables* get_configuration_variables (void);
 
 #endif /* _EBIKE_APP_H_ */
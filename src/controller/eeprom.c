@@ -11,6 +11,8 @@
 #include "stm8s_flash.h"
 #include "eeprom.h"
 #include "ebike_app.h"
+#include "assist_map.h"
+#include "foc_angle_tracker.h"
 
 
 static const uint8_t ui8_default_array[EEPROM_BYTES_STORED] = 
@@ -23,39 +25,50 @@ static const uint8_t ui8_default_array[EEPROM_BYTES_STORED] =
   DEFAULT_VALUE_WHEEL_PERIMETER_1,                            // 5 + EEPROM_BASE_ADDRESS
   DEFAULT_VALUE_WHEEL_SPEED_MAX,                              // 6 + EEPROM_BASE_ADDRESS
   DEFAULT_VALUE_MOTOR_TYPE,                                   // 7 + EEPROM_BASE_ADDRESS
-  DEFAULT_VALUE_PEDAL_TORQUE_PER_10_BIT_ADC_STEP_X100         // 8 + EEPROM_BASE_ADDRESS
+  DEFAULT_VALUE_PEDAL_TORQUE_PER_10_BIT_ADC_STEP_X100,        // 8 + EEPROM_BASE_ADDRESS
+  DEFAULT_VALUE_PEDAL_TORQUE_OFFSET_0,                        // 9 + EEPROM_BASE_ADDRESS
+  DEFAULT_VALUE_PEDAL_TORQUE_OFFSET_1,                        // 10 + EEPROM_BASE_ADDRESS
+  DEFAULT_VALUE_MOTOR_WINDING_TEMPERATURE,                    // 11 + EEPROM_BASE_ADDRESS
+  DEFAULT_VALUE_MOTOR_CASE_TEMPERATURE,                       // 12 + EEPROM_BASE_ADDRESS
+  ASSIST_MAP_DEFAULT_VALUES,                                  // 13 + EEPROM_BASE_ADDRESS to (13 + ASSIST_MAP_BYTES - 1) + EEPROM_BASE_ADDRESS
+  FOC_ANGLE_TRACKER_DEFAULT_VALUES                            // (13 + ASSIST_MAP_BYTES) + EEPROM_BASE_ADDRESS to (EEPROM_BYTES_STORED - 1) + EEPROM_BASE_ADDRESS
 };
 
+// stored bytes as read or to write, written one at a time by EEPROM_write_step()
+static uint8_t ui8_eeprom_write_array[EEPROM_BYTES_STORED];
+static uint8_t ui8_eeprom_write_index = 0;
+static uint8_t ui8_eeprom_write_active = 0;
+static uint8_t ui8_eeprom_write_busy = 0;
+static uint8_t ui8_eeprom_write_busy_index;
+static uint8_t ui8_eeprom_write_busy_value;
+
+
+static void EEPROM_read_configuration(void);
+
 
 void EEPROM_init(void)
 {
-  volatile uint32_t ui32_delay_counter = 0;
-  
   // deinitialize EEPROM
   FLASH_DeInit();
   
-  // time delay
-  for (ui32_delay_counter = 0; ui32_delay_counter < 160000; ++ui32_delay_counter) {}
-  
-  // select and set programming time mode
+  // select and set programming time mode, no delay is needed as EEPROM_controller() waits for the unlocked flag before any access
   FLASH_SetProgrammingTime(FLASH_PROGRAMTIME_STANDARD); // standard programming (erase and write) time mode
   //FLASH_SetProgrammingTime(FLASH_PROGRAMTIME_TPROG); // fast programming (write only) time mode
   
-  // time delay
-  for (ui32_delay_counter = 0; ui32_delay_counter < 160000; ++ui32_delay_counter) {}
-  
   // read key
   volatile uint8_t ui8_saved_key = FLASH_ReadByte(ADDRESS_KEY);
   
-  // check if key is valid
+  // check if key is valid, it is not after a write that was interrupted
   if (ui8_saved_key != DEFAULT_VALUE_KEY)
   {
-    // set to default values
+    // use default values, they are written to EEPROM by EEPROM_write_step()
     EEPROM_controller(SET_TO_DEFAULT);
   }
-  
-  // read from EEPROM
-  EEPROM_controller(READ_FROM_MEMORY);
+  else
+  {
+    // read from EEPROM
+    EEPROM_controller(READ_FROM_MEMORY);
+  }
 }
 
 
@@ -65,9 +78,9 @@ void EEPROM_controller(uint8_t ui8_operation)
   struct_configuration_variables *p_configuration_variables;
   p_configuration_variables = get_configuration_variables();
   
-  uint8_t ui8_array[EEPROM_BYTES_STORED];
+  uint8_t *ui8_p_assist_map = assist_map_get_data();
+  uint8_t *ui8_p_foc_angle_offsets = foc_angle_tracker_get_offsets();
   uint8_t ui8_temp;
-  uint16_t ui16_temp;
   uint8_t ui8_i;
 
   // unlock memory
@@ -86,29 +99,16 @@ void EEPROM_controller(uint8_t ui8_operation)
     
     case SET_TO_DEFAULT:
     
-      // write array of variables to EEPROM, write key last
-      for (ui8_i = EEPROM_BYTES_STORED; ui8_i > 0; ui8_i--)
-      {
-        // get address
-        uint32_t ui32_default_address = (uint32_t) ui8_i - 1 + EEPROM_BASE_ADDRESS;
-        
-        // get value
-        uint8_t ui8_default_variable_value = ui8_default_array[ui8_i - 1];
-        
-        // write variable value to EEPROM
-        FLASH_ProgramByte(ui32_default_address, ui8_default_variable_value);
-        
-        // wait until end of programming (write or erase operation) flag is set
-        while (FLASH_GetFlagStatus(FLASH_FLAG_EOP) == RESET) {}
-        
-        // read value from EEPROM for validation
-        volatile uint8_t ui8_saved_default_value = FLASH_ReadByte(ui32_default_address);
-        
-        // if write was not successful, rewrite
-        if (ui8_saved_default_value != ui8_default_variable_value) { ui8_i = EEPROM_BYTES_STORED; }
-      }
+      for (ui8_i = 0; ui8_i < EEPROM_BYTES_STORED; ui8_i++) { ui8_eeprom_write_array[ui8_i] = ui8_default_array[ui8_i]; }
       
-    break;
+      EEPROM_read_configuration();
+      
+      // write default values with EEPROM_write_step(), key last
+      ui8_eeprom_write_index = EEPROM_BYTES_STORED;
+      ui8_eeprom_write_active = 1;
+      
+      // memory stays unlocked until the write is finished
+      return;
     
     
     /********************************************************************************************************************************************************/
@@ -116,23 +116,9 @@ void EEPROM_controller(uint8_t ui8_operation)
     
     case READ_FROM_MEMORY:
       
-      p_configuration_variables->ui8_motor_power_x10 = FLASH_ReadByte(ADDRESS_MOTOR_POWER_X10);
-      
-      ui16_temp = FLASH_ReadByte(ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_0);
-      ui8_temp = FLASH_ReadByte(ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_1);
-      ui16_temp += (((uint16_t) ui8_temp << 8) & 0xff00);
-      p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 = ui16_temp;
+      for (ui8_i = 0; ui8_i < EEPROM_BYTES_STORED; ui8_i++) { ui8_eeprom_write_array[ui8_i] = FLASH_ReadByte((uint32_t) ui8_i + EEPROM_BASE_ADDRESS); }
       
-      ui16_temp = FLASH_ReadByte(ADDRESS_WHEEL_PERIMETER_0);
-      ui8_temp = FLASH_ReadByte(ADDRESS_WHEEL_PERIMETER_1);
-      ui16_temp += (((uint16_t) ui8_temp << 8) & 0xff00);
-      p_configuration_variables->ui16_wheel_perimeter = ui16_temp;
-
-      p_configuration_variables->ui8_wheel_speed_max = FLASH_ReadByte(ADDRESS_WHEEL_SPEED_MAX);
-
-      p_configuration_variables->ui8_motor_type = FLASH_ReadByte(ADDRESS_MOTOR_TYPE);
-      
-      p_configuration_variables->ui8_pedal_torque_per_10_bit_ADC_step_x100 = FLASH_ReadByte(ADDRESS_PEDAL_TORQUE_PER_10_BIT_ADC_STEP_X100);
+      EEPROM_read_configuration();
       
     break;
     
@@ -142,47 +128,180 @@ void EEPROM_controller(uint8_t ui8_operation)
     
     case WRITE_TO_MEMORY:
     
-      ui8_array[0] = DEFAULT_VALUE_KEY;
+      ui8_eeprom_write_array[0] = DEFAULT_VALUE_KEY;
+      
+      ui8_eeprom_write_array[ADDRESS_MOTOR_POWER_X10 - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_motor_power_x10;
+      
+      ui8_eeprom_write_array[ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_0 - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 & 255;
+      ui8_eeprom_write_array[ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_1 - EEPROM_BASE_ADDRESS] = (p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 >> 8) & 255;
       
-      ui8_array[ADDRESS_MOTOR_POWER_X10 - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_motor_power_x10;
+      ui8_eeprom_write_array[ADDRESS_WHEEL_PERIMETER_0 - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui16_wheel_perimeter & 255;
+      ui8_eeprom_write_array[ADDRESS_WHEEL_PERIMETER_1 - EEPROM_BASE_ADDRESS] = (p_configuration_variables->ui16_wheel_perimeter >> 8) & 255;
       
-      ui8_array[ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_0 - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 & 255;
-      ui8_array[ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_1 - EEPROM_BASE_ADDRESS] = (p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 >> 8) & 255;
+      ui8_eeprom_write_array[ADDRESS_WHEEL_SPEED_MAX - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_wheel_speed_max;
       
-      ui8_array[ADDRESS_WHEEL_PERIMETER_0 - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui16_wheel_perimeter & 255;
-      ui8_array[ADDRESS_WHEEL_PERIMETER_1 - EEPROM_BASE_ADDRESS] = (p_configuration_variables->ui16_wheel_perimeter >> 8) & 255;
+      ui8_eeprom_write_array[ADDRESS_MOTOR_TYPE - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_motor_type;
       
-      ui8_array[ADDRESS_WHEEL_SPEED_MAX - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_wheel_speed_max;
+      ui8_eeprom_write_array[ADDRESS_PEDAL_TORQUE_PER_10_BIT_ADC_STEP_X100 - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_pedal_torque_per_10_bit_ADC_step_x100;
       
-      ui8_array[ADDRESS_MOTOR_TYPE - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_motor_type;
+      ui8_eeprom_write_array[ADDRESS_PEDAL_TORQUE_OFFSET_0 - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui16_adc_pedal_torque_offset & 255;
+      ui8_eeprom_write_array[ADDRESS_PEDAL_TORQUE_OFFSET_1 - EEPROM_BASE_ADDRESS] = (p_configuration_variables->ui16_adc_pedal_torque_offset >> 8) & 255;
       
-      ui8_array[ADDRESS_PEDAL_TORQUE_PER_10_BIT_ADC_STEP_X100 - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_pedal_torque_per_10_bit_ADC_step_x100;
+      ui8_eeprom_write_array[ADDRESS_MOTOR_WINDING_TEMPERATURE - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_motor_winding_temperature;
+      ui8_eeprom_write_array[ADDRESS_MOTOR_CASE_TEMPERATURE - EEPROM_BASE_ADDRESS] = p_configuration_variables->ui8_motor_case_temperature;
       
-      // write array of variables to EEPROM
-      for (ui8_i = EEPROM_BYTES_STORED; ui8_i > 0; ui8_i--)
+      for (ui8_temp = 0; ui8_temp < ASSIST_MAP_BYTES; ui8_temp++)
       {
-        // get address
-        uint32_t ui32_address = (uint32_t) ui8_i - 1 + EEPROM_BASE_ADDRESS;
-        
-        // get value
-        uint8_t ui8_variable_value = ui8_array[ui8_i - 1];
-        
-        // write variable value to EEPROM
-        FLASH_ProgramByte(ui32_address, ui8_variable_value);
-        
-        // wait until end of programming (write or erase operation) flag is set
-        while (FLASH_GetFlagStatus(FLASH_FLAG_EOP) == RESET) {}
-        
-        // read value from EEPROM for validation
-        volatile uint8_t ui8_saved_value = FLASH_ReadByte(ui32_address);
-        
-        // if write was not successful, rewrite
-        if (ui8_saved_value != ui8_variable_value) { ui8_i = EEPROM_BYTES_STORED; }
+        ui8_eeprom_write_array[ADDRESS_ASSIST_MAP - EEPROM_BASE_ADDRESS + ui8_temp] = ui8_p_assist_map[ui8_temp];
       }
       
-    break;
+      for (ui8_temp = 0; ui8_temp < FOC_ANGLE_TRACKER_BINS; ui8_temp++)
+      {
+        ui8_eeprom_write_array[ADDRESS_FOC_ANGLE_OFFSETS - EEPROM_BASE_ADDRESS + ui8_temp] = ui8_p_foc_angle_offsets[ui8_temp];
+      }
+      
+      // write changed bytes with EEPROM_write_step(), key last
+      ui8_eeprom_write_index = EEPROM_BYTES_STORED;
+      ui8_eeprom_write_active = 1;
+      
+      // memory stays unlocked until the write is finished
+      return;
   }
   
   // lock memory
   FLASH_Lock(FLASH_MEMTYPE_DATA);
-}
\ No newline at end of file
+}
+
+
+
+// sets the configuration from the stored bytes
+static void EEPROM_read_configuration(void)
+{
+  struct_configuration_variables *p_configuration_variables;
+  p_configuration_variables = get_configuration_variables();
+  
+  uint8_t *ui8_p_assist_map = assist_map_get_data();
+  uint8_t *ui8_p_foc_angle_offsets = foc_angle_tracker_get_offsets();
+  uint8_t ui8_temp;
+  uint16_t ui16_temp;
+  uint8_t ui8_i;
+  
+  p_configuration_variables->ui8_motor_power_x10 = ui8_eeprom_write_array[ADDRESS_MOTOR_POWER_X10 - EEPROM_BASE_ADDRESS];
+  
+  ui16_temp = ui8_eeprom_write_array[ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_0 - EEPROM_BASE_ADDRESS];
+  ui8_temp = ui8_eeprom_write_array[ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_1 - EEPROM_BASE_ADDRESS];
+  ui16_temp += (((uint16_t) ui8_temp << 8) & 0xff00);
+  p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 = ui16_temp;
+  
+  ui16_temp = ui8_eeprom_write_array[ADDRESS_WHEEL_PERIMETER_0 - EEPROM_BASE_ADDRESS];
+  ui8_temp = ui8_eeprom_write_array[ADDRESS_WHEEL_PERIMETER_1 - EEPROM_BASE_ADDRESS];
+  ui16_temp += (((uint16_t) ui8_temp << 8) & 0xff00);
+  p_configuration_variables->ui16_wheel_perimeter = ui16_temp;
+
+  p_configuration_variables->ui8_wheel_speed_max = ui8_eeprom_write_array[ADDRESS_WHEEL_SPEED_MAX - EEPROM_BASE_ADDRESS];
+
+  p_configuration_variables->ui8_motor_type = ui8_eeprom_write_array[ADDRESS_MOTOR_TYPE - EEPROM_BASE_ADDRESS];
+  
+  p_configuration_variables->ui8_pedal_torque_per_10_bit_ADC_step_x100 = ui8_eeprom_write_array[ADDRESS_PEDAL_TORQUE_PER_10_BIT_ADC_STEP_X100 - EEPROM_BASE_ADDRESS];
+  
+  ui16_temp = ui8_eeprom_write_array[ADDRESS_PEDAL_TORQUE_OFFSET_0 - EEPROM_BASE_ADDRESS];
+  ui8_temp = ui8_eeprom_write_array[ADDRESS_PEDAL_TORQUE_OFFSET_1 - EEPROM_BASE_ADDRESS];
+  ui16_temp += (((uint16_t) ui8_temp << 8) & 0xff00);
+  p_configuration_variables->ui16_adc_pedal_torque_offset = ui16_temp;
+  
+  p_configuration_variables->ui8_motor_winding_temperature = ui8_eeprom_write_array[ADDRESS_MOTOR_WINDING_TEMPERATURE - EEPROM_BASE_ADDRESS];
+  p_configuration_variables->ui8_motor_case_temperature = ui8_eeprom_write_array[ADDRESS_MOTOR_CASE_TEMPERATURE - EEPROM_BASE_ADDRESS];
+  
+  for (ui8_i = 0; ui8_i < ASSIST_MAP_BYTES; ui8_i++)
+  {
+    ui8_p_assist_map[ui8_i] = ui8_eeprom_write_array[ADDRESS_ASSIST_MAP - EEPROM_BASE_ADDRESS + ui8_i];
+  }
+  
+  for (ui8_i = 0; ui8_i < FOC_ANGLE_TRACKER_BINS; ui8_i++)
+  {
+    ui8_p_foc_angle_offsets[ui8_i] = ui8_eeprom_write_array[ADDRESS_FOC_ANGLE_OFFSETS - EEPROM_BASE_ADDRESS + ui8_i];
+  }
+}
+
+
+
+// happens every EBIKE_APP_HOUSEKEEPING_PERIOD_MS, programs at most one changed byte and does not wait for it, returns 1 while writing
+uint8_t EEPROM_write_step(void)
+{
+  uint32_t ui32_address;
+  
+  if (!ui8_eeprom_write_active) { return 0; }
+  
+  // byte programming in progress
+  if (ui8_eeprom_write_busy)
+  {
+    // wait for the end of programming flag on the next run
+    if (FLASH_GetFlagStatus(FLASH_FLAG_EOP) == RESET) { return 1; }
+    
+    ui8_eeprom_write_busy = 0;
+    
+    // read value from EEPROM for validation, if write was not successful, rewrite
+    if (FLASH_ReadByte((uint32_t) ui8_eeprom_write_busy_index + EEPROM_BASE_ADDRESS) != ui8_eeprom_write_busy_value) { ui8_eeprom_write_index = EEPROM_BYTES_STORED; }
+  }
+  
+  // write the next changed byte
+  while (ui8_eeprom_write_index)
+  {
+    --ui8_eeprom_write_index;
+    ui32_address = (uint32_t) ui8_eeprom_write_index + EEPROM_BASE_ADDRESS;
+    
+    // skip unchanged values to save time and EEPROM write cycles
+    if (FLASH_ReadByte(ui32_address) != ui8_eeprom_write_array[ui8_eeprom_write_index])
+    {
+      // invalidate the key before the first other byte is changed, the byte is written on the next run
+      if (ui8_eeprom_write_index && (FLASH_ReadByte(ADDRESS_KEY) == DEFAULT_VALUE_KEY))
+      {
+        ++ui8_eeprom_write_index;
+        ui8_eeprom_write_busy_index = 0;
+        ui8_eeprom_write_busy_value = INVALID_VALUE_KEY;
+      }
+      else
+      {
+        ui8_eeprom_write_busy_index = ui8_eeprom_write_index;
+        ui8_eeprom_write_busy_value = ui8_eeprom_write_array[ui8_eeprom_write_index];
+      }
+      
+      ui8_eeprom_write_busy = 1;
+      FLASH_ProgramByte((uint32_t) ui8_eeprom_write_busy_index + EEPROM_BASE_ADDRESS, ui8_eeprom_write_busy_value);
+      
+      return 1;
+    }
+  }
+  
+  // all bytes written
+  ui8_eeprom_write_active = 0;
+  FLASH_Lock(FLASH_MEMTYPE_DATA);
+  
+  return 0;
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding EEPROM writes
+
+  Programming one data EEPROM byte takes a few
+  milliseconds. Writing all changed bytes at once blocked
+  the main loop for that time per byte. The STM8S105 data
+  EEPROM can be read while write, so the CPU keeps running
+  while a byte is programmed: EEPROM_write_step() starts
+  programming one byte and checks the end of programming
+  flag on its next run, so a write of n changed bytes
+  takes about n housekeeping runs and never blocks.
+
+  The key is the commit byte of a write: it is invalidated
+  before the first other byte is changed and written last,
+  so if power is lost during a write the key is not valid at
+  next power on and the default values are used instead of
+  a mix of old and new bytes, like a wheel perimeter or a
+  torque sensor offset with one old and one new byte.
+
+  Default values are used right away at power on and are
+  written to EEPROM the same way, one byte per housekeeping
+  run, so startup does not wait for them.
+---------------------------------------------------------*/
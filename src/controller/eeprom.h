@@ -10,6 +10,8 @@
 #define _EEPROM_H_
 
 #include "main.h"
+#include "common.h"
+#include "foc_angle_tracker.h"
 
 
 #define EEPROM_BASE_ADDRESS                                 0x4000
@@ -23,10 +25,17 @@
 #define ADDRESS_WHEEL_SPEED_MAX                             6 + EEPROM_BASE_ADDRESS
 #define ADDRESS_MOTOR_TYPE                                  7 + EEPROM_BASE_ADDRESS
 #define ADDRESS_PEDAL_TORQUE_PER_10_BIT_ADC_STEP_X100       8 + EEPROM_BASE_ADDRESS
-#define EEPROM_BYTES_STORED                                 9
+#define ADDRESS_PEDAL_TORQUE_OFFSET_0                       9 + EEPROM_BASE_ADDRESS
+#define ADDRESS_PEDAL_TORQUE_OFFSET_1                       10 + EEPROM_BASE_ADDRESS
+#define ADDRESS_MOTOR_WINDING_TEMPERATURE                   11 + EEPROM_BASE_ADDRESS
+#define ADDRESS_MOTOR_CASE_TEMPERATURE                      12 + EEPROM_BASE_ADDRESS
+#define ADDRESS_ASSIST_MAP                                  13 + EEPROM_BASE_ADDRESS
+#define ADDRESS_FOC_ANGLE_OFFSETS                           (13 + ASSIST_MAP_BYTES) + EEPROM_BASE_ADDRESS
+#define EEPROM_BYTES_STORED                                 (13 + ASSIST_MAP_BYTES + FOC_ANGLE_TRACKER_BINS)
 
 
-#define DEFAULT_VALUE_KEY     204
+#define DEFAULT_VALUE_KEY     208
+#define INVALID_VALUE_KEY     0
 #define SET_TO_DEFAULT        0
 #define READ_FROM_MEMORY      1
 #define WRITE_TO_MEMORY       2
@@ -34,5 +43,6 @@
 
 void EEPROM_init(void);
 void EEPROM_controller(uint8_t ui8_operation);
+uint8_t EEPROM_write_step(void);
 
 #endif /* _EEPROM_H_ */
@@ -0,0 +1,215 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "common.h"
+#include "fault.h"
+
+
+volatile uint8_t ui8_g_fault_detected[FAULT_NUMBER] = { 0, 0, 0, 0 };
+volatile uint8_t ui8_g_fault_adc_battery_voltage_min = 0;
+volatile uint8_t ui8_g_fault_stall_inhibit = 0;
+
+// error code and clear time of each fault
+static const uint8_t ui8_fault_error_code[FAULT_NUMBER] =
+{
+  ERROR_MOTOR_BLOCKED,
+  ERROR_HALL_SENSORS,
+  ERROR_OVERCURRENT,
+  ERROR_LOW_CONTROLLER_VOLTAGE
+};
+
+static const uint8_t ui8_fault_clear_time_x10[FAULT_NUMBER] =
+{
+  FAULT_STALL_CLEAR_TIME_X10,
+  FAULT_HALL_SENSORS_CLEAR_TIME_X10,
+  FAULT_OVERCURRENT_CLEAR_TIME_X10,
+  FAULT_UNDERVOLTAGE_CLEAR_TIME_X10
+};
+
+static uint8_t ui8_fault_latched = 0;
+static uint8_t ui8_fault_clear_counter[FAULT_NUMBER];
+static uint8_t ui8_fault_latch_counter[FAULT_NUMBER];
+static uint16_t ui16_fault_timestamp_x10[FAULT_NUMBER];
+
+static uint16_t ui16_fault_time_x10 = 0;
+
+// debounce counters of fault_detect()
+static uint16_t ui16_fault_stall_counter = 0;
+static uint8_t ui8_fault_hall_sensors_counter = 0;
+static uint8_t ui8_fault_overcurrent_counter = 0;
+static uint16_t ui16_fault_undervoltage_counter = 0;
+static uint8_t ui8_fault_hall_sensors_state_old = 0;
+
+
+
+// happens every PWM cycle, called from the PWM interrupt
+void fault_detect (uint8_t ui8_hall_sensors_state, uint16_t ui16_adc_battery_current, uint8_t ui8_adc_battery_voltage)
+{
+  // fault: invalid hall sensors state
+  if ((ui8_hall_sensors_state == 0) || (ui8_hall_sensors_state == 7))
+  {
+    if (ui8_fault_hall_sensors_counter < FAULT_HALL_SENSORS_DEBOUNCE) { ++ui8_fault_hall_sensors_counter; }
+    else { ui8_g_fault_detected[FAULT_HALL_SENSORS] = 1; }
+  }
+  else
+  {
+    ui8_fault_hall_sensors_counter = 0;
+    
+    // motor is rotating, reset stall fault debounce
+    if (ui8_hall_sensors_state != ui8_fault_hall_sensors_state_old)
+    {
+      ui8_fault_hall_sensors_state_old = ui8_hall_sensors_state;
+      ui16_fault_stall_counter = 0;
+    }
+  }
+  
+  // fault: stall, battery current over the stall threshold without hall sensors transitions
+  if ((ui16_adc_battery_current > FAULT_STALL_ADC_BATTERY_CURRENT) && (!ui8_g_fault_stall_inhibit))
+  {
+    if (ui16_fault_stall_counter < FAULT_STALL_DEBOUNCE) { ++ui16_fault_stall_counter; }
+    else { ui8_g_fault_detected[FAULT_STALL] = 1; }
+  }
+  else
+  {
+    ui16_fault_stall_counter = 0;
+  }
+  
+  // fault: battery overcurrent
+  if (ui16_adc_battery_current > FAULT_OVERCURRENT_ADC_BATTERY_CURRENT)
+  {
+    if (ui8_fault_overcurrent_counter < FAULT_OVERCURRENT_DEBOUNCE) { ++ui8_fault_overcurrent_counter; }
+    else { ui8_g_fault_detected[FAULT_OVERCURRENT] = 1; }
+  }
+  else
+  {
+    ui8_fault_overcurrent_counter = 0;
+  }
+  
+  // fault: battery undervoltage
+  if (ui8_adc_battery_voltage < ui8_g_fault_adc_battery_voltage_min)
+  {
+    if (ui16_fault_undervoltage_counter < FAULT_UNDERVOLTAGE_DEBOUNCE) { ++ui16_fault_undervoltage_counter; }
+    else { ui8_g_fault_detected[FAULT_UNDERVOLTAGE] = 1; }
+  }
+  else
+  {
+    ui16_fault_undervoltage_counter = 0;
+  }
+}
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS
+void fault_controller (void)
+{
+  #define FAULT_TIME_RUNS_PER_100_MS    (100 / EBIKE_APP_CONTROLLER_PERIOD_MS)
+  
+  static uint8_t ui8_time_counter;
+  
+  uint8_t ui8_i;
+  uint8_t ui8_mask;
+  uint8_t ui8_time_tick = 0;
+  
+  // time since power on in 0.1 s
+  if (++ui8_time_counter >= FAULT_TIME_RUNS_PER_100_MS)
+  {
+    ui8_time_counter = 0;
+    ui8_time_tick = 1;
+    ++ui16_fault_time_x10;
+  }
+  
+  for (ui8_i = 0, ui8_mask = 1; ui8_i < FAULT_NUMBER; ui8_i++, ui8_mask <<= 1)
+  {
+    if (ui8_g_fault_detected[ui8_i])
+    {
+      // clear detected flag, the PWM interrupt sets it again while the fault is still there
+      ui8_g_fault_detected[ui8_i] = 0;
+      
+      // latch fault with timestamp
+      if (!(ui8_fault_latched & ui8_mask))
+      {
+        ui8_fault_latched |= ui8_mask;
+        ui16_fault_timestamp_x10[ui8_i] = ui16_fault_time_x10;
+        if (ui8_fault_latch_counter[ui8_i] < 255) { ++ui8_fault_latch_counter[ui8_i]; }
+      }
+      
+      ui8_fault_clear_counter[ui8_i] = 0;
+    }
+    else if ((ui8_fault_latched & ui8_mask) && (ui8_time_tick))
+    {
+      // clear latched fault when it was not detected for its clear time
+      if (++ui8_fault_clear_counter[ui8_i] >= ui8_fault_clear_time_x10[ui8_i])
+      {
+        ui8_fault_latched &= ~ui8_mask;
+        ui8_fault_clear_counter[ui8_i] = 0;
+      }
+    }
+  }
+}
+
+
+
+uint8_t fault_get_latched (void)
+{
+  return ui8_fault_latched;
+}
+
+
+
+// returns the error code of the latched fault with the lowest index
+uint8_t fault_get_error_code (void)
+{
+  uint8_t ui8_i;
+  
+  for (ui8_i = 0; ui8_i < FAULT_NUMBER; ui8_i++)
+  {
+    if (ui8_fault_latched & (1 << ui8_i)) { return ui8_fault_error_code[ui8_i]; }
+  }
+  
+  return NO_ERROR;
+}
+
+
+
+uint8_t fault_get_latch_counter (uint8_t ui8_fault)
+{
+  return ui8_fault_latch_counter[ui8_fault];
+}
+
+
+
+uint16_t fault_get_timestamp_x10 (uint8_t ui8_fault)
+{
+  return ui16_fault_timestamp_x10[ui8_fault];
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding motor faults
+
+  Faults are detected by fault_detect() in the PWM
+  interrupt, each with its own debounce in PWM cycles, so a
+  blocked motor is detected after FAULT_STALL_DEBOUNCE
+  instead of after seconds. A flag is set on every cycle
+  the fault is there after its debounce.
+
+  Hill hold runs the motor with up to 6 A, over the stall
+  threshold, while the motor barely rotates. It sets
+  ui8_g_fault_stall_inhibit while active, its own current
+  limit and timeout bound the motor current instead.
+
+  Here every fault is latched with the time it happened
+  and the number of times it happened since power on. All
+  faults are cleared the same way: after the fault was not
+  detected for its clear time. While a fault is latched its
+  error code is the system state and the motor current
+  target is 0.
+---------------------------------------------------------*/
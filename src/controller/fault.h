@@ -0,0 +1,54 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _FAULT_H_
+#define _FAULT_H_
+
+#include <stdint.h>
+#include "main.h"
+
+// motor faults detected in the PWM interrupt
+#define FAULT_STALL                               0
+#define FAULT_HALL_SENSORS                        1
+#define FAULT_OVERCURRENT                         2
+#define FAULT_UNDERVOLTAGE                        3
+#define FAULT_NUMBER                              4
+
+// fault debounce in PWM cycles (64 us)
+#define FAULT_STALL_DEBOUNCE                      1563  // 100 ms with stall current and no hall sensors transition
+#define FAULT_HALL_SENSORS_DEBOUNCE               16    // 1 ms with an invalid hall sensors state
+#define FAULT_OVERCURRENT_DEBOUNCE                8     // 0.5 ms over the overcurrent threshold
+#define FAULT_UNDERVOLTAGE_DEBOUNCE               1563  // 100 ms under the undervoltage threshold
+
+// fault thresholds
+#define FAULT_STALL_ADC_BATTERY_CURRENT           25    // 5 A (0.2 amps per 10 bit ADC step)
+#define FAULT_OVERCURRENT_ADC_BATTERY_CURRENT     (ADC_10_BIT_BATTERY_CURRENT_MAX + (ADC_10_BIT_BATTERY_CURRENT_MAX >> 2))   // 125% of battery current max
+
+// time in 0.1 s a fault must not be detected before the latched fault is cleared
+#define FAULT_STALL_CLEAR_TIME_X10                100   // 10 s
+#define FAULT_HALL_SENSORS_CLEAR_TIME_X10         10    // 1 s
+#define FAULT_OVERCURRENT_CLEAR_TIME_X10          10    // 1 s
+#define FAULT_UNDERVOLTAGE_CLEAR_TIME_X10         30    // 3 s
+
+// undervoltage threshold in 8 bit ADC steps, 0 until the low voltage cut off is received
+extern volatile uint8_t ui8_g_fault_adc_battery_voltage_min;
+
+// set while hill hold is active, its current is over the stall threshold with the motor barely rotating
+extern volatile uint8_t ui8_g_fault_stall_inhibit;
+
+// set by the PWM interrupt on every PWM cycle a fault is detected after its debounce, cleared by fault_controller()
+extern volatile uint8_t ui8_g_fault_detected[FAULT_NUMBER];
+
+void fault_detect (uint8_t ui8_hall_sensors_state, uint16_t ui16_adc_battery_current, uint8_t ui8_adc_battery_voltage);
+void fault_controller (void);
+uint8_t fault_get_latched (void);
+uint8_t fault_get_error_code (void);
+uint8_t fault_get_latch_counter (uint8_t ui8_fault);
+uint16_t fault_get_timestamp_x10 (uint8_t ui8_fault);
+
+#endif /* _FAULT_H_ */
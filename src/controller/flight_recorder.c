@@ -0,0 +1,227 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "main.h"
+#include "common.h"
+#include "uart.h"
+#include "flight_recorder.h"
+
+
+// flight recorder states
+#define FLIGHT_RECORDER_RECORDING       0
+#define FLIGHT_RECORDER_TRIGGERED       1
+#define FLIGHT_RECORDER_FROZEN          2
+
+typedef struct _flight_recorder_record
+{
+  uint8_t ui8_duty_cycle;
+  uint8_t ui8_foc_angle;
+  uint16_t ui16_adc_battery_current;
+  uint16_t ui16_motor_speed_erps;
+  uint8_t ui8_hall_sensors_state;
+  uint8_t ui8_system_state;
+} struct_flight_recorder_record;
+
+static struct_flight_recorder_record flight_recorder_records[FLIGHT_RECORDER_RECORDS];
+
+volatile uint8_t ui8_flight_recorder_decimation_counter = FLIGHT_RECORDER_DECIMATION_DEFAULT;
+static volatile uint8_t ui8_flight_recorder_decimation = FLIGHT_RECORDER_DECIMATION_DEFAULT;
+static volatile uint8_t ui8_flight_recorder_trigger_mask = FLIGHT_RECORDER_TRIGGER_MASK_DEFAULT;
+static volatile uint8_t ui8_flight_recorder_state = FLIGHT_RECORDER_RECORDING;
+static volatile uint8_t ui8_flight_recorder_index = 0;
+static volatile uint8_t ui8_flight_recorder_records_number = 0;
+static volatile uint8_t ui8_flight_recorder_post_trigger_counter = 0;
+static volatile uint8_t ui8_flight_recorder_triggered = 0;
+static volatile uint8_t ui8_flight_recorder_system_state = NO_ERROR;
+
+// dump
+static uint8_t ui8_flight_recorder_dump_chunk = FLIGHT_RECORDER_CHUNKS;
+
+
+
+// happens in the PWM interrupt every ui8_flight_recorder_decimation PWM cycles
+void flight_recorder_record (uint8_t ui8_duty_cycle, uint16_t ui16_adc_battery_current, uint16_t ui16_motor_speed_erps, uint8_t ui8_foc_angle, uint8_t ui8_hall_sensors_state)
+{
+  struct_flight_recorder_record *p_record;
+  
+  // reload decimation counter
+  ui8_flight_recorder_decimation_counter = ui8_flight_recorder_decimation;
+  
+  // keep records after the trigger
+  if (ui8_flight_recorder_state == FLIGHT_RECORDER_FROZEN) { return; }
+  
+  // set record
+  p_record = &flight_recorder_records[ui8_flight_recorder_index];
+  p_record->ui8_duty_cycle = ui8_duty_cycle;
+  p_record->ui8_foc_angle = ui8_foc_angle;
+  p_record->ui16_adc_battery_current = ui16_adc_battery_current;
+  p_record->ui16_motor_speed_erps = ui16_motor_speed_erps;
+  p_record->ui8_hall_sensors_state = ui8_hall_sensors_state;
+  p_record->ui8_system_state = ui8_flight_recorder_system_state;
+  
+  if (++ui8_flight_recorder_index >= FLIGHT_RECORDER_RECORDS) { ui8_flight_recorder_index = 0; }
+  if (ui8_flight_recorder_records_number < FLIGHT_RECORDER_RECORDS) { ++ui8_flight_recorder_records_number; }
+  
+  if (ui8_flight_recorder_state == FLIGHT_RECORDER_RECORDING)
+  {
+    // check trigger conditions
+    if (((ui8_flight_recorder_trigger_mask & FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR) && (ui8_flight_recorder_system_state != NO_ERROR)) ||
+        ((ui8_flight_recorder_trigger_mask & FLIGHT_RECORDER_TRIGGER_BATTERY_CURRENT) && (ui16_adc_battery_current >= ADC_10_BIT_BATTERY_CURRENT_MAX)))
+    {
+      ui8_flight_recorder_post_trigger_counter = FLIGHT_RECORDER_POST_TRIGGER_RECORDS;
+      ui8_flight_recorder_triggered = 1;
+      ui8_flight_recorder_state = FLIGHT_RECORDER_TRIGGERED;
+    }
+  }
+  else
+  {
+    // freeze after the post trigger records
+    if (--ui8_flight_recorder_post_trigger_counter == 0) { ui8_flight_recorder_state = FLIGHT_RECORDER_FROZEN; }
+  }
+}
+
+
+
+void flight_recorder_set_system_state (uint8_t ui8_system_state)
+{
+  ui8_flight_recorder_system_state = ui8_system_state;
+}
+
+
+
+void flight_recorder_command (uint8_t ui8_command, uint8_t ui8_decimation, uint8_t ui8_trigger_mask)
+{
+  switch (ui8_command)
+  {
+    case FLIGHT_RECORDER_COMMAND_ARM:
+    
+      // stop recording while changing the state
+      ui8_flight_recorder_state = FLIGHT_RECORDER_FROZEN;
+      
+      // set decimation and trigger conditions, decimation can not be 0
+      if (!ui8_decimation) { ui8_decimation = 1; }
+      ui8_flight_recorder_decimation = ui8_decimation;
+      ui8_flight_recorder_trigger_mask = ui8_trigger_mask;
+      
+      // clear records and start recording
+      ui8_flight_recorder_index = 0;
+      ui8_flight_recorder_records_number = 0;
+      ui8_flight_recorder_triggered = 0;
+      ui8_flight_recorder_dump_chunk = FLIGHT_RECORDER_CHUNKS;
+      ui8_flight_recorder_decimation_counter = ui8_decimation;
+      ui8_flight_recorder_state = FLIGHT_RECORDER_RECORDING;
+      
+    break;
+    
+    case FLIGHT_RECORDER_COMMAND_TRIGGER:
+    
+      if (ui8_flight_recorder_state == FLIGHT_RECORDER_RECORDING)
+      {
+        ui8_flight_recorder_post_trigger_counter = FLIGHT_RECORDER_POST_TRIGGER_RECORDS;
+        ui8_flight_recorder_triggered = 1;
+        ui8_flight_recorder_state = FLIGHT_RECORDER_TRIGGERED;
+      }
+      
+    break;
+    
+    case FLIGHT_RECORDER_COMMAND_DUMP:
+    
+      // freeze so records do not change while sending and start sending from the first chunk
+      ui8_flight_recorder_state = FLIGHT_RECORDER_FROZEN;
+      ui8_flight_recorder_dump_chunk = 0;
+      
+    break;
+  }
+}
+
+
+
+// happens every EBIKE_APP_HOUSEKEEPING_PERIOD_MS, returns 1 if a dump package was sent
+uint8_t flight_recorder_send_dump (void)
+{
+  uint8_t ui8_tx_buffer[FLIGHT_RECORDER_DUMP_HEADER_BYTES + (FLIGHT_RECORDER_RECORDS_PER_CHUNK * FLIGHT_RECORDER_RECORD_BYTES) + 2];
+  uint8_t ui8_records_number = ui8_flight_recorder_records_number;
+  uint8_t ui8_oldest_index;
+  uint8_t ui8_record_index;
+  uint8_t ui8_i;
+  uint8_t ui8_j = FLIGHT_RECORDER_DUMP_HEADER_BYTES;
+  uint16_t ui16_crc_tx;
+  struct_flight_recorder_record *p_record;
+  
+  // check if there is a dump to send
+  if (ui8_flight_recorder_dump_chunk >= FLIGHT_RECORDER_CHUNKS) { return 0; }
+  
+  // records are sent from the oldest to the newest
+  if (ui8_records_number < FLIGHT_RECORDER_RECORDS) { ui8_oldest_index = 0; }
+  else { ui8_oldest_index = ui8_flight_recorder_index; }
+  
+  ui8_tx_buffer[0] = FLIGHT_RECORDER_DUMP_START_BYTE;
+  ui8_tx_buffer[1] = ui8_flight_recorder_dump_chunk;
+  ui8_tx_buffer[2] = FLIGHT_RECORDER_CHUNKS;
+  ui8_tx_buffer[3] = ui8_flight_recorder_decimation;
+  ui8_tx_buffer[4] = ui8_records_number;
+  
+  // trigger record index, counted from the oldest record
+  if (ui8_flight_recorder_triggered)
+  {
+    ui8_tx_buffer[5] = ui8_records_number - 1 - (FLIGHT_RECORDER_POST_TRIGGER_RECORDS - ui8_flight_recorder_post_trigger_counter);
+  }
+  else
+  {
+    ui8_tx_buffer[5] = FLIGHT_RECORDER_NO_TRIGGER;
+  }
+  
+  // set records of this chunk
+  for (ui8_i = 0; ui8_i < FLIGHT_RECORDER_RECORDS_PER_CHUNK; ui8_i++)
+  {
+    ui8_record_index = ui8_oldest_index + (ui8_flight_recorder_dump_chunk * FLIGHT_RECORDER_RECORDS_PER_CHUNK) + ui8_i;
+    if (ui8_record_index >= FLIGHT_RECORDER_RECORDS) { ui8_record_index -= FLIGHT_RECORDER_RECORDS; }
+    
+    p_record = &flight_recorder_records[ui8_record_index];
+    
+    ui8_tx_buffer[ui8_j++] = p_record->ui8_duty_cycle;
+    ui8_tx_buffer[ui8_j++] = p_record->ui8_foc_angle;
+    ui8_tx_buffer[ui8_j++] = (uint8_t) (p_record->ui16_adc_battery_current & 0xff);
+    ui8_tx_buffer[ui8_j++] = (uint8_t) (p_record->ui16_adc_battery_current >> 8);
+    ui8_tx_buffer[ui8_j++] = (uint8_t) (p_record->ui16_motor_speed_erps & 0xff);
+    ui8_tx_buffer[ui8_j++] = (uint8_t) (p_record->ui16_motor_speed_erps >> 8);
+    ui8_tx_buffer[ui8_j++] = p_record->ui8_hall_sensors_state;
+    ui8_tx_buffer[ui8_j++] = p_record->ui8_system_state;
+  }
+  
+  // prepare crc of the package
+  ui16_crc_tx = crc16_buf(ui8_tx_buffer, ui8_j);
+  
+  ui8_tx_buffer[ui8_j++] = (uint8_t) (ui16_crc_tx & 0xff);
+  ui8_tx_buffer[ui8_j++] = (uint8_t) (ui16_crc_tx >> 8);
+  
+  // send the full package to UART, send the same chunk again next time if the UART transmit buffer is full
+  if (uart_send_frame(ui8_tx_buffer, ui8_j)) { ++ui8_flight_recorder_dump_chunk; }
+  
+  return 1;
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the flight recorder
+
+  Motor signals are recorded in a RAM ring buffer in the
+  PWM interrupt. When a trigger condition happens recording
+  continues for FLIGHT_RECORDER_POST_TRIGGER_RECORDS and
+  then the records are frozen, so the buffer holds what
+  happened before and after the trigger.
+
+  The records are kept until the flight recorder is armed
+  again. A dump command sends them, one chunk on every
+  communications period instead of the package to the
+  display. tools/flight_recorder_to_csv.py
+  converts a captured dump to CSV.
+---------------------------------------------------------*/
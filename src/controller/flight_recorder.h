@@ -0,0 +1,46 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _FLIGHT_RECORDER_H_
+#define _FLIGHT_RECORDER_H_
+
+#include <stdint.h>
+#include "main.h"
+
+// RAM use is FLIGHT_RECORDER_RECORDS * 8 bytes, must be a multiple of FLIGHT_RECORDER_RECORDS_PER_CHUNK
+#define FLIGHT_RECORDER_RECORDS                   32
+#define FLIGHT_RECORDER_RECORDS_PER_CHUNK         4
+#define FLIGHT_RECORDER_CHUNKS                    (FLIGHT_RECORDER_RECORDS / FLIGHT_RECORDER_RECORDS_PER_CHUNK)
+#define FLIGHT_RECORDER_POST_TRIGGER_RECORDS      (FLIGHT_RECORDER_RECORDS / 2)   // records after the trigger, the others are before the trigger
+#define FLIGHT_RECORDER_DECIMATION_DEFAULT        16    // record every 16 PWM cycles -> about 1 ms
+
+// trigger conditions, bit mask
+#define FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR      1     // system state is an error
+#define FLIGHT_RECORDER_TRIGGER_BATTERY_CURRENT   2     // battery current at the hardware limit
+#define FLIGHT_RECORDER_TRIGGER_MASK_DEFAULT      FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR
+
+// commands received with UART message ID FLIGHT_RECORDER_MESSAGE_ID: command, decimation, trigger mask
+#define FLIGHT_RECORDER_MESSAGE_ID                10
+#define FLIGHT_RECORDER_COMMAND_ARM               1     // clear records and record until triggered
+#define FLIGHT_RECORDER_COMMAND_TRIGGER           2     // trigger now
+#define FLIGHT_RECORDER_COMMAND_DUMP              3     // send records
+
+// dump package: start byte, chunk index, number of chunks, decimation, number of records, trigger record index, records, two bytes 16 bit CRC
+#define FLIGHT_RECORDER_DUMP_START_BYTE           0x44
+#define FLIGHT_RECORDER_DUMP_HEADER_BYTES         6
+#define FLIGHT_RECORDER_RECORD_BYTES              8
+#define FLIGHT_RECORDER_NO_TRIGGER                0xff
+
+extern volatile uint8_t ui8_flight_recorder_decimation_counter;
+
+void flight_recorder_record (uint8_t ui8_duty_cycle, uint16_t ui16_adc_battery_current, uint16_t ui16_motor_speed_erps, uint8_t ui8_foc_angle, uint8_t ui8_hall_sensors_state);
+void flight_recorder_set_system_state (uint8_t ui8_system_state);
+void flight_recorder_command (uint8_t ui8_command, uint8_t ui8_decimation, uint8_t ui8_trigger_mask);
+uint8_t flight_recorder_send_dump (void);
+
+#endif /* _FLIGHT_RECORDER_H_ */
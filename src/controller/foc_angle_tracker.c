@@ -0,0 +1,209 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "common.h"
+#include "foc_angle_tracker.h"
+
+
+// tracker states
+#define FOC_ANGLE_TRACKER_IDLE              0
+#define FOC_ANGLE_TRACKER_MEASURE           1
+
+// offset dither of each measurement window, minus, plus, plus, minus so a linear change of the load cancels out
+#define FOC_ANGLE_TRACKER_WINDOWS           4
+static const int8_t i8_foc_angle_tracker_dither[FOC_ANGLE_TRACKER_WINDOWS] = { -1, 1, 1, -1 };
+
+// learned offsets, signed values stored as bytes so they can be saved to EEPROM
+static uint8_t ui8_foc_angle_tracker_offsets[FOC_ANGLE_TRACKER_BINS] = { FOC_ANGLE_TRACKER_DEFAULT_VALUES };
+
+static int8_t i8_foc_angle_tracker_offset = 0;
+static uint8_t ui8_foc_angle_tracker_save_needed = 0;
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS
+void foc_angle_tracker_controller (uint16_t ui16_motor_speed_erps, uint8_t ui8_adc_battery_current_filtered, uint8_t ui8_enabled)
+{
+  #define FOC_ANGLE_TRACKER_SETTLE_RUNS           4     // runs to wait after changing the offset, 4 * 20 ms = 80 ms
+  #define FOC_ANGLE_TRACKER_MEASURE_RUNS          8     // runs to measure each offset, 8 * 20 ms = 160 ms
+  #define FOC_ANGLE_TRACKER_ERPS_STEADY_SHIFT     4     // motor speed must stay within 1/16 of the speed at start of measurement
+  #define FOC_ANGLE_TRACKER_ERPS_GAIN_MARGIN      2     // noise margin of the motor speed gain difference, in ERPS
+  
+  static uint8_t ui8_state = FOC_ANGLE_TRACKER_IDLE;
+  static uint8_t ui8_run_counter;
+  static uint8_t ui8_window;
+  static uint8_t ui8_bin_measured;
+  static uint16_t ui16_motor_speed_erps_start;
+  static uint16_t ui16_motor_speed_erps_window_start;
+  static int16_t i16_erps_gain_per_current_minus_x256;
+  static int16_t i16_erps_gain_per_current_plus_x256;
+  
+  uint8_t ui8_erps_bin;
+  uint8_t ui8_current_bin;
+  uint8_t ui8_bin;
+  int8_t i8_offset;
+  int8_t i8_dither = 0;
+  int16_t i16_erps_gain_per_current_x256;
+  int16_t i16_margin_x256;
+  
+  // find bin of operating point
+  ui8_erps_bin = ui16_motor_speed_erps >> 7;
+  if (ui8_erps_bin >= FOC_ANGLE_TRACKER_ERPS_BINS) { ui8_erps_bin = FOC_ANGLE_TRACKER_ERPS_BINS - 1; }
+  
+  ui8_current_bin = ui8_adc_battery_current_filtered >> 5;
+  if (ui8_current_bin >= FOC_ANGLE_TRACKER_CURRENT_BINS) { ui8_current_bin = FOC_ANGLE_TRACKER_CURRENT_BINS - 1; }
+  
+  ui8_bin = (ui8_erps_bin * FOC_ANGLE_TRACKER_CURRENT_BINS) + ui8_current_bin;
+  
+  // get learned offset, limit values read from EEPROM
+  i8_offset = (int8_t) ui8_foc_angle_tracker_offsets[ui8_bin];
+  if (i8_offset > FOC_ANGLE_TRACKER_OFFSET_MAX) { i8_offset = FOC_ANGLE_TRACKER_OFFSET_MAX; }
+  else if (i8_offset < -FOC_ANGLE_TRACKER_OFFSET_MAX) { i8_offset = -FOC_ANGLE_TRACKER_OFFSET_MAX; }
+  
+  // track only at steady operating points: same bin and about the same motor speed while measuring
+  if ((!ui8_enabled) ||
+      (ui16_motor_speed_erps < FOC_ANGLE_TRACKER_ERPS_MIN) ||
+      (ui8_adc_battery_current_filtered < FOC_ANGLE_TRACKER_ADC_CURRENT_MIN) ||
+      ((ui8_state != FOC_ANGLE_TRACKER_IDLE) &&
+       ((ui8_bin != ui8_bin_measured) ||
+        (ui16_motor_speed_erps > ui16_motor_speed_erps_start + (ui16_motor_speed_erps_start >> FOC_ANGLE_TRACKER_ERPS_STEADY_SHIFT)) ||
+        (ui16_motor_speed_erps < ui16_motor_speed_erps_start - (ui16_motor_speed_erps_start >> FOC_ANGLE_TRACKER_ERPS_STEADY_SHIFT)))))
+  {
+    ui8_state = FOC_ANGLE_TRACKER_IDLE;
+  }
+  else
+  {
+    switch (ui8_state)
+    {
+      case FOC_ANGLE_TRACKER_IDLE:
+      
+        // start measuring with the dither of the first window
+        ui8_bin_measured = ui8_bin;
+        ui16_motor_speed_erps_start = ui16_motor_speed_erps;
+        i16_erps_gain_per_current_minus_x256 = 0;
+        i16_erps_gain_per_current_plus_x256 = 0;
+        ui8_run_counter = 0;
+        ui8_window = 0;
+        ui8_state = FOC_ANGLE_TRACKER_MEASURE;
+        i8_dither = i8_foc_angle_tracker_dither[0];
+        
+      break;
+      
+      case FOC_ANGLE_TRACKER_MEASURE:
+      
+        i8_dither = i8_foc_angle_tracker_dither[ui8_window];
+        
+        // measure the motor speed gain after the settle time
+        if (++ui8_run_counter == FOC_ANGLE_TRACKER_SETTLE_RUNS) { ui16_motor_speed_erps_window_start = ui16_motor_speed_erps; }
+        
+        if (ui8_run_counter >= (FOC_ANGLE_TRACKER_SETTLE_RUNS + FOC_ANGLE_TRACKER_MEASURE_RUNS))
+        {
+          // motor speed gain per battery current, the speed changes at most 1/8 of 1023 ERPS in a window so it fits 16 bits
+          i16_erps_gain_per_current_x256 = ((int16_t) (ui16_motor_speed_erps - ui16_motor_speed_erps_window_start) << 8) / ui8_adc_battery_current_filtered;
+          
+          if (i8_dither < 0) { i16_erps_gain_per_current_minus_x256 += i16_erps_gain_per_current_x256; }
+          else { i16_erps_gain_per_current_plus_x256 += i16_erps_gain_per_current_x256; }
+          
+          // continue with the next window
+          ui8_run_counter = 0;
+          
+          if (++ui8_window < FOC_ANGLE_TRACKER_WINDOWS)
+          {
+            i8_dither = i8_foc_angle_tracker_dither[ui8_window];
+            break;
+          }
+          
+          // move learned offset one step to the side with higher motor speed gain, only if the difference is over the noise margin
+          i16_margin_x256 = ((int16_t) FOC_ANGLE_TRACKER_ERPS_GAIN_MARGIN << 8) / ui8_adc_battery_current_filtered;
+          
+          if ((i16_erps_gain_per_current_minus_x256 > i16_erps_gain_per_current_plus_x256 + i16_margin_x256) && (i8_offset > -FOC_ANGLE_TRACKER_OFFSET_MAX))
+          {
+            --i8_offset;
+            ui8_foc_angle_tracker_save_needed = 1;
+          }
+          else if ((i16_erps_gain_per_current_plus_x256 > i16_erps_gain_per_current_minus_x256 + i16_margin_x256) && (i8_offset < FOC_ANGLE_TRACKER_OFFSET_MAX))
+          {
+            ++i8_offset;
+            ui8_foc_angle_tracker_save_needed = 1;
+          }
+          
+          ui8_foc_angle_tracker_offsets[ui8_bin] = (uint8_t) i8_offset;
+          
+          // start again
+          ui8_state = FOC_ANGLE_TRACKER_IDLE;
+          i8_dither = 0;
+        }
+        
+      break;
+    }
+  }
+  
+  // set offset to apply
+  i8_foc_angle_tracker_offset = i8_offset + i8_dither;
+}
+
+
+
+// happens every MOTOR_CONTROLLER_PERIOD_MS
+uint8_t foc_angle_tracker_apply (uint8_t ui8_foc_angle)
+{
+  int16_t i16_foc_angle = (int16_t) ui8_foc_angle + i8_foc_angle_tracker_offset;
+  
+  if (i16_foc_angle < 0) { return 0; }
+  else if (i16_foc_angle > 255) { return 255; }
+  else { return (uint8_t) i16_foc_angle; }
+}
+
+
+
+uint8_t* foc_angle_tracker_get_offsets (void)
+{
+  return ui8_foc_angle_tracker_offsets;
+}
+
+
+
+uint8_t foc_angle_tracker_save_needed (void)
+{
+  uint8_t ui8_save_needed = ui8_foc_angle_tracker_save_needed;
+  
+  ui8_foc_angle_tracker_save_needed = 0;
+  
+  return ui8_save_needed;
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the FOC angle tracker
+
+  The FOC angle calculated from the motor inductance is
+  corrected with a learned offset for each motor speed and
+  battery current bin. At a steady operating point the
+  offset is dithered one step lower and one step higher, in
+  four windows in the order minus, plus, plus, minus, so a
+  load that changes linearly over the measurement adds the
+  same to both sides. For each window the motor speed gain
+  per battery current is measured. The learned offset moves
+  one step to the side with the higher gain, so over time
+  it converges to the angle with the most torque for the
+  battery current, the angle the MOTOR_ROTOR_OFFSET_ANGLE
+  note asks to tune for.
+
+  Battery current per motor speed is not used: the motor is
+  mostly under current control, so current is the same with
+  either offset and only the motor speed shows the change.
+  Duty cycle is not used either: it falls steadily as the
+  angle advances, it has no minimum at the best angle.
+
+  Measurements are dropped when the operating point
+  changes, so only steady riding is used. Learned offsets
+  are saved to EEPROM when the motor is stopped.
+---------------------------------------------------------*/
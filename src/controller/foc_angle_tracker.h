@@ -0,0 +1,33 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _FOC_ANGLE_TRACKER_H_
+#define _FOC_ANGLE_TRACKER_H_
+
+#include <stdint.h>
+#include "main.h"
+
+// learned FOC angle offset table, one signed offset for each motor speed bin and battery current bin
+#define FOC_ANGLE_TRACKER_ERPS_BINS               4     // bins of 128 ERPS, last bin for higher speed
+#define FOC_ANGLE_TRACKER_CURRENT_BINS            3     // bins of 32 ADC steps (5 A), last bin for higher current
+#define FOC_ANGLE_TRACKER_BINS                    (FOC_ANGLE_TRACKER_ERPS_BINS * FOC_ANGLE_TRACKER_CURRENT_BINS)
+#define FOC_ANGLE_TRACKER_DEFAULT_VALUES          0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+
+// learned offset limit in angle steps, 256 steps = 360 electrical degrees
+#define FOC_ANGLE_TRACKER_OFFSET_MAX              8
+
+// tracking is only done at steady operating points over these values
+#define FOC_ANGLE_TRACKER_ERPS_MIN                60
+#define FOC_ANGLE_TRACKER_ADC_CURRENT_MIN         10
+
+void foc_angle_tracker_controller (uint16_t ui16_motor_speed_erps, uint8_t ui8_adc_battery_current_filtered, uint8_t ui8_enabled);
+uint8_t foc_angle_tracker_apply (uint8_t ui8_foc_angle);
+uint8_t* foc_angle_tracker_get_offsets (void);
+uint8_t foc_angle_tracker_save_needed (void);
+
+#endif /* _FOC_ANGLE_TRACKER_H_ */
@@ -0,0 +1,148 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "common.h"
+#include "gear_shift.h"
+
+
+// filtered cadence to wheel speed ratio and pedal torque, x256
+static uint32_t ui32_gear_shift_ratio_filtered_x256 = 0;
+static uint32_t ui32_gear_shift_torque_filtered_x256 = 0;
+
+static uint8_t ui8_gear_shift_torque_drop_counter = 0;
+static uint8_t ui8_gear_shift_dip_counter = 0;
+static uint8_t ui8_gear_shift_lockout_counter = 0;
+static uint16_t ui16_gear_shift_counter = 0;
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS
+void gear_shift_update (uint16_t ui16_pedal_cadence_RPM_x10, uint16_t ui16_wheel_speed_x10, uint16_t ui16_pedal_torque_x100)
+{
+  #define GEAR_SHIFT_RATIO_FILTER_SHIFT         3   // ~160 ms
+  #define GEAR_SHIFT_TORQUE_FILTER_SHIFT        5   // ~640 ms
+  
+  uint32_t ui32_ratio_x256;
+  uint32_t ui32_torque_x256 = (uint32_t) ui16_pedal_torque_x100 << 8;
+  uint32_t ui32_ratio_jump_x256;
+  
+  // count down dip and lockout
+  if (ui8_gear_shift_dip_counter) { --ui8_gear_shift_dip_counter; }
+  if (ui8_gear_shift_lockout_counter) { --ui8_gear_shift_lockout_counter; }
+  if (ui8_gear_shift_torque_drop_counter) { --ui8_gear_shift_torque_drop_counter; }
+  
+  // no detection at low cadence or low wheel speed, restart filters when back above
+  if ((ui16_pedal_cadence_RPM_x10 < GEAR_SHIFT_CADENCE_RPM_X10_MIN) || (ui16_wheel_speed_x10 < GEAR_SHIFT_WHEEL_SPEED_X10_MIN))
+  {
+    ui32_gear_shift_ratio_filtered_x256 = 0;
+    ui8_gear_shift_torque_drop_counter = 0;
+    return;
+  }
+  
+  // cadence to wheel speed ratio, changes with the gear
+  ui32_ratio_x256 = ((uint32_t) ui16_pedal_cadence_RPM_x10 << 8) / ui16_wheel_speed_x10;
+  
+  // start filters from the first values
+  if (!ui32_gear_shift_ratio_filtered_x256)
+  {
+    ui32_gear_shift_ratio_filtered_x256 = ui32_ratio_x256;
+    ui32_gear_shift_torque_filtered_x256 = ui32_torque_x256;
+    ui8_gear_shift_lockout_counter = GEAR_SHIFT_LOCKOUT;
+    return;
+  }
+  
+  // check for a pedal torque drop
+  if (ui32_torque_x256 < ((ui32_gear_shift_torque_filtered_x256 * (100 - GEAR_SHIFT_TORQUE_DROP_PERCENT)) / 100))
+  {
+    ui8_gear_shift_torque_drop_counter = GEAR_SHIFT_TORQUE_DROP_WINDOW;
+  }
+  
+  // check for a ratio jump
+  if (ui32_ratio_x256 > ui32_gear_shift_ratio_filtered_x256) { ui32_ratio_jump_x256 = ui32_ratio_x256 - ui32_gear_shift_ratio_filtered_x256; }
+  else { ui32_ratio_jump_x256 = ui32_gear_shift_ratio_filtered_x256 - ui32_ratio_x256; }
+  
+  if ((!ui8_gear_shift_lockout_counter) &&
+      (ui8_gear_shift_torque_drop_counter) &&
+      ((ui32_ratio_jump_x256 * 100) > (ui32_gear_shift_ratio_filtered_x256 * GEAR_SHIFT_RATIO_JUMP_PERCENT)))
+  {
+    // shift detected, start current dip
+    ui8_gear_shift_dip_counter = GEAR_SHIFT_DIP_HOLD + GEAR_SHIFT_DIP_RAMP;
+    ui8_gear_shift_lockout_counter = GEAR_SHIFT_LOCKOUT;
+    ui8_gear_shift_torque_drop_counter = 0;
+    ++ui16_gear_shift_counter;
+    
+    // continue from the new gear
+    ui32_gear_shift_ratio_filtered_x256 = ui32_ratio_x256;
+  }
+  else
+  {
+    ui32_gear_shift_ratio_filtered_x256 += ((int32_t) ui32_ratio_x256 - (int32_t) ui32_gear_shift_ratio_filtered_x256) >> GEAR_SHIFT_RATIO_FILTER_SHIFT;
+  }
+  
+  // filter pedal torque, not during the dip as the rider eases off while shifting
+  if (!ui8_gear_shift_dip_counter)
+  {
+    ui32_gear_shift_torque_filtered_x256 += ((int32_t) ui32_torque_x256 - (int32_t) ui32_gear_shift_torque_filtered_x256) >> GEAR_SHIFT_TORQUE_FILTER_SHIFT;
+  }
+}
+
+
+
+uint8_t gear_shift_apply_dip (uint8_t ui8_adc_battery_current_target)
+{
+  uint8_t ui8_current_percent;
+  
+  // no dip
+  if (!ui8_gear_shift_dip_counter) { return ui8_adc_battery_current_target; }
+  
+  // hold dip current and then ramp back to full current
+  if (ui8_gear_shift_dip_counter > GEAR_SHIFT_DIP_RAMP)
+  {
+    ui8_current_percent = GEAR_SHIFT_DIP_CURRENT_PERCENT;
+  }
+  else
+  {
+    ui8_current_percent = map((uint32_t) ui8_gear_shift_dip_counter,
+                              (uint32_t) 0,
+                              (uint32_t) GEAR_SHIFT_DIP_RAMP,
+                              (uint32_t) 100,
+                              (uint32_t) GEAR_SHIFT_DIP_CURRENT_PERCENT);
+  }
+  
+  return ((uint16_t) ui8_adc_battery_current_target * ui8_current_percent) / 100;
+}
+
+
+
+uint16_t gear_shift_get_counter (void)
+{
+  return ui16_gear_shift_counter;
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the gear shift detection
+
+  While pedaling, the ratio of cadence to wheel speed only
+  changes when the gear changes. A gear shift is detected
+  when this ratio jumps away from its filtered value and
+  the pedal torque dropped shortly before, as riders ease
+  off to shift. The pedal torque of the last half stroke is
+  used, the mean of a full revolution drops too late. Requiring both avoids detecting a shift
+  when cadence changes on a bump or when the wheel slips.
+
+  After a detected shift the motor current is reduced to
+  GEAR_SHIFT_DIP_CURRENT_PERCENT and then ramped back, so
+  the chain does not move over the cassette under full
+  motor load. The cadence estimator needs a few cadence
+  sensor transitions to follow the new gear, so the dip
+  also covers the end of the shift.
+---------------------------------------------------------*/
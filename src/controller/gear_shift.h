@@ -0,0 +1,34 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _GEAR_SHIFT_H_
+#define _GEAR_SHIFT_H_
+
+#include <stdint.h>
+#include "main.h"
+
+// detection is only done above these values, cadence and wheel speed are not reliable below them
+#define GEAR_SHIFT_CADENCE_RPM_X10_MIN            300   // 30 RPM
+#define GEAR_SHIFT_WHEEL_SPEED_X10_MIN            50    // 5 km/h
+
+// a shift is detected when the cadence to wheel speed ratio jumps and pedal torque dropped shortly before or at the same time
+#define GEAR_SHIFT_RATIO_JUMP_PERCENT             12    // ratio change from the filtered ratio
+#define GEAR_SHIFT_TORQUE_DROP_PERCENT            25    // pedal torque drop from the filtered pedal torque
+#define GEAR_SHIFT_TORQUE_DROP_WINDOW             25    // number of runs a torque drop is valid, 25 * 20 ms = 500 ms
+
+// motor current dip after a detected shift
+#define GEAR_SHIFT_DIP_CURRENT_PERCENT            20    // motor current during the dip
+#define GEAR_SHIFT_DIP_HOLD                       8     // number of runs at dip current, 8 * 20 ms = 160 ms
+#define GEAR_SHIFT_DIP_RAMP                       15    // number of runs to ramp back to full current, 15 * 20 ms = 300 ms
+#define GEAR_SHIFT_LOCKOUT                        50    // number of runs before the next shift can be detected, 50 * 20 ms = 1 s
+
+void gear_shift_update (uint16_t ui16_pedal_cadence_RPM_x10, uint16_t ui16_wheel_speed_x10, uint16_t ui16_pedal_torque_x100);
+uint8_t gear_shift_apply_dip (uint8_t ui8_adc_battery_current_target);
+uint16_t gear_shift_get_counter (void);
+
+#endif /* _GEAR_SHIFT_H_ */
@@ -0,0 +1,169 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "common.h"
+#include "hill_hold.h"
+
+
+static uint8_t ui8_hill_hold_state = HILL_HOLD_ARMED;
+static uint8_t ui8_hill_hold_adc_battery_current_target = 0;
+static uint8_t ui8_hill_hold_backward_steps = 0;
+static uint8_t ui8_hill_hold_rollback_window_counter = 0;
+static uint8_t ui8_hill_hold_timeout_counter = 0;
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS after the riding mode set the current and duty cycle targets
+void hill_hold_controller (const struct_hill_hold_inputs *p_inputs, uint8_t *p_adc_battery_current_target, uint8_t *p_duty_cycle_target)
+{
+  int16_t i16_steps_delta;
+  uint8_t ui8_temp;
+  
+  // the cranks turn backwards with the chainring when the bike rolls back, the motor only if it is coupled to the chainring
+  i16_steps_delta = (int16_t) p_inputs->i8_crank_counts_delta + p_inputs->i8_motor_hall_steps_delta;
+  if (i16_steps_delta < -127) { i16_steps_delta = -127; }
+  else if (i16_steps_delta > 127) { i16_steps_delta = 127; }
+  
+  switch (ui8_hill_hold_state)
+  {
+    case HILL_HOLD_ARMED:
+    
+      // detect rollback with the brakes released and no pedaling
+      if ((p_inputs->ui8_assist_enabled) &&
+          (!p_inputs->ui8_brakes_enabled) &&
+          (!p_inputs->ui8_pedal_cadence_RPM) &&
+          (p_inputs->ui16_wheel_speed_x10 < HILL_HOLD_WHEEL_SPEED_X10_MAX) &&
+          (!p_inputs->ui8_error))
+      {
+        if (i16_steps_delta < 0)
+        {
+          ui8_temp = -i16_steps_delta;
+          if (ui8_hill_hold_backward_steps < (255 - ui8_temp)) { ui8_hill_hold_backward_steps += ui8_temp; }
+          ui8_hill_hold_rollback_window_counter = HILL_HOLD_ROLLBACK_WINDOW;
+        }
+        else if (i16_steps_delta > 0)
+        {
+          ui8_hill_hold_backward_steps = 0;
+        }
+        else if (ui8_hill_hold_rollback_window_counter)
+        {
+          --ui8_hill_hold_rollback_window_counter;
+        }
+        else
+        {
+          ui8_hill_hold_backward_steps = 0;
+        }
+        
+        // start holding
+        if (ui8_hill_hold_backward_steps >= HILL_HOLD_ROLLBACK_STEPS)
+        {
+          ui8_hill_hold_state = HILL_HOLD_ACTIVE;
+          ui8_hill_hold_adc_battery_current_target = ui8_min(ui8_hill_hold_backward_steps, HILL_HOLD_ADC_BATTERY_CURRENT_MAX / HILL_HOLD_ADC_BATTERY_CURRENT_STEP) * HILL_HOLD_ADC_BATTERY_CURRENT_STEP;
+          ui8_hill_hold_timeout_counter = HILL_HOLD_TIMEOUT;
+          ui8_hill_hold_backward_steps = 0;
+        }
+      }
+      else
+      {
+        ui8_hill_hold_backward_steps = 0;
+      }
+      
+    break;
+    
+    case HILL_HOLD_ACTIVE:
+    
+      // stop holding when the rider pedals or brakes, on timeout or on errors
+      if ((!p_inputs->ui8_assist_enabled) ||
+          (p_inputs->ui8_brakes_enabled) ||
+          (p_inputs->ui8_pedal_cadence_RPM) ||
+          (p_inputs->ui8_error) ||
+          (!--ui8_hill_hold_timeout_counter))
+      {
+        ui8_hill_hold_state = HILL_HOLD_WAIT_TO_REARM;
+        ui8_hill_hold_adc_battery_current_target = 0;
+        break;
+      }
+      
+      // increase holding current while rolling back, decrease it when moving forward
+      if (i16_steps_delta < 0)
+      {
+        ui8_temp = ui8_min(-i16_steps_delta, HILL_HOLD_ADC_BATTERY_CURRENT_MAX / HILL_HOLD_ADC_BATTERY_CURRENT_STEP) * HILL_HOLD_ADC_BATTERY_CURRENT_STEP;
+        ui8_hill_hold_adc_battery_current_target = ui8_min(ui8_hill_hold_adc_battery_current_target + ui8_temp, HILL_HOLD_ADC_BATTERY_CURRENT_MAX);
+      }
+      else if (i16_steps_delta > 0)
+      {
+        ui8_temp = ui8_min(i16_steps_delta, HILL_HOLD_ADC_BATTERY_CURRENT_MAX / HILL_HOLD_ADC_BATTERY_CURRENT_STEP) * HILL_HOLD_ADC_BATTERY_CURRENT_STEP;
+        
+        if (ui8_hill_hold_adc_battery_current_target > ui8_temp) { ui8_hill_hold_adc_battery_current_target -= ui8_temp; }
+        else { ui8_hill_hold_adc_battery_current_target = 0; }
+      }
+      
+      // set battery current target and duty cycle target, limit to battery current max
+      if (*p_adc_battery_current_target < ui8_hill_hold_adc_battery_current_target)
+      {
+        *p_adc_battery_current_target = ui8_min(ui8_hill_hold_adc_battery_current_target, p_inputs->ui8_adc_battery_current_max);
+        *p_duty_cycle_target = HILL_HOLD_DUTY_CYCLE_MAX;
+      }
+      
+    break;
+    
+    case HILL_HOLD_WAIT_TO_REARM:
+    
+      // after holding, rearm when the rider brakes or pedals so the bike does not hold again on its own
+      if ((p_inputs->ui8_brakes_enabled) || (p_inputs->ui8_pedal_cadence_RPM)) { ui8_hill_hold_state = HILL_HOLD_ARMED; }
+      
+    break;
+  }
+}
+
+
+
+uint8_t hill_hold_is_active (void)
+{
+  return (ui8_hill_hold_state == HILL_HOLD_ACTIVE);
+}
+
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding hill hold
+
+  The motor drives the chainring through a freewheel, so
+  when the bike rolls back the wheel pulls the chain, the
+  chainring and the cranks backwards but not the motor
+  rotor. Rollback is detected on the cadence sensor
+  quadrature counts, that pas_decode() counts in both
+  directions, after HILL_HOLD_ROLLBACK_STEPS backward
+  counts: 3 / 80 crank revolution, long before the wheel
+  speed sensor sees it. Backward hall sensor steps are
+  added as they only happen once the motor holds against
+  the chainring and is pushed back.
+
+  Backpedaling at a stop can not be told apart from
+  rollback, so holding uses a low current and duty cycle
+  and it does not start again until the rider brakes or
+  pedals.
+
+  The holding current increases while the bike still
+  rolls back and decreases when it moves forward. It stays
+  under HILL_HOLD_ADC_BATTERY_CURRENT_MAX and the battery
+  current max. Holding stops when the rider pedals, brakes
+  or after HILL_HOLD_TIMEOUT.
+
+  The motor is normally only enabled when stopped. While
+  holding it is also enabled under
+  HILL_HOLD_MOTOR_ENABLE_ERPS_MAX, but only with current
+  and duty cycle targets within the hill hold limits.
+
+  HILL_HOLD_ADC_BATTERY_CURRENT_MAX is over the stall
+  fault threshold and the motor barely rotates while
+  holding, so the stall fault is inhibited while holding.
+---------------------------------------------------------*/
@@ -0,0 +1,45 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _HILL_HOLD_H_
+#define _HILL_HOLD_H_
+
+#include <stdint.h>
+#include "main.h"
+
+// hill hold states
+#define HILL_HOLD_ARMED                         0
+#define HILL_HOLD_ACTIVE                        1
+#define HILL_HOLD_WAIT_TO_REARM                 2
+
+#define HILL_HOLD_ROLLBACK_STEPS                3     // backward crank counts or hall sensor steps to detect rollback, 3 / 80 crank revolution
+#define HILL_HOLD_ROLLBACK_WINDOW               25    // backward steps are cleared after this number of runs without rotation, 25 * 20 ms = 500 ms
+#define HILL_HOLD_WHEEL_SPEED_X10_MAX           20    // 2 km/h
+#define HILL_HOLD_ADC_BATTERY_CURRENT_STEP      2     // current change per backward or forward step
+#define HILL_HOLD_ADC_BATTERY_CURRENT_MAX       30    // 6 A
+#define HILL_HOLD_DUTY_CYCLE_MAX                40    // low duty cycle, holding does not need speed
+#define HILL_HOLD_MOTOR_ENABLE_ERPS_MAX         10    // back EMF is low enough to enable the motor while rolling back
+#define HILL_HOLD_TIMEOUT                       150   // 150 * 20 ms = 3 s
+
+// inputs of hill hold, set by the app on every run
+typedef struct _hill_hold_inputs
+{
+  uint8_t ui8_assist_enabled;           // riding mode assists with pedaling and assist level is not zero
+  uint8_t ui8_brakes_enabled;
+  uint8_t ui8_pedal_cadence_RPM;
+  uint16_t ui16_wheel_speed_x10;
+  uint8_t ui8_error;                    // system state is not NO_ERROR
+  int8_t i8_crank_counts_delta;         // cadence sensor quadrature counts since the last run, negative backward
+  int8_t i8_motor_hall_steps_delta;     // hall sensor steps since the last run, negative backward
+  uint8_t ui8_adc_battery_current_max;
+} struct_hill_hold_inputs;
+
+void hill_hold_controller (const struct_hill_hold_inputs *p_inputs, uint8_t *p_adc_battery_current_target, uint8_t *p_duty_cycle_target);
+uint8_t hill_hold_is_active (void);
+
+#endif /* _HILL_HOLD_H_ */
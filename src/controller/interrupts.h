@@ -14,6 +14,7 @@
 #define EXTI_PORTE_IRQHANDLER 7
 #define TIM1_CAP_COM_IRQHANDLER 	12
 #define TIM2_UPD_OVF_TRG_BRK_IRQHANDLER 13
+#define UART2_TX_IRQHANDLER 20
 #define UART2_IRQHANDLER 21
 #define ADC1_IRQHANDLER 22
 
@@ -21,8 +21,12 @@
 #include "timers.h"
 #include "ebike_app.h"
 #include "torque_sensor.h"
+#include "motor_thermal.h"
 #include "eeprom.h"
 #include "lights.h"
+#include "assist_map.h"
+#include "scheduler.h"
+#include "common.h"
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 //// Functions prototypes
@@ -50,77 +54,102 @@ int main (void);
 // PWM cycle interrupt
 void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER);
 void EXTI_PORTC_IRQHandler(void) __interrupt(EXTI_PORTC_IRQHANDLER);
+void UART2_TX_IRQHandler(void) __interrupt(UART2_TX_IRQHANDLER);
 void UART2_IRQHandler(void) __interrupt(UART2_IRQHANDLER);
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////
 
-int main (void)
+#ifdef DEBUG_UART
+static void debug_uart (void)
+{
+  // sugestion: no more than 6 variables printed (takes about 3ms to printf 6 variables)
+  printf ("%d,%d,%d,%d\n",
+  ui16_motor_get_motor_speed_erps(),
+  ui8_duty_cycle,
+  ui8_adc_battery_current,
+  ui8_foc_angle
+  );
+}
+#endif
+
+// scheduler tasks: function, priority, period, budget
+static struct_scheduler_task tasks[] =
 {
-  uint16_t ui16_TIM3_counter = 0;
-  uint16_t ui16_ebike_app_controller_counter = 0;
-  uint16_t ui16_motor_controller_counter = 0;
-  uint16_t ui16_debug_uart_counter = 0;
+  { motor_controller, 0, MOTOR_CONTROLLER_PERIOD_MS, MOTOR_CONTROLLER_BUDGET_MS },
+  { ebike_app_controller, 1, EBIKE_APP_CONTROLLER_PERIOD_MS, EBIKE_APP_CONTROLLER_BUDGET_MS },
+  { ebike_app_housekeeping, 2, EBIKE_APP_HOUSEKEEPING_PERIOD_MS, EBIKE_APP_HOUSEKEEPING_BUDGET_MS },
+#ifdef DEBUG_UART
+  { debug_uart, 3, 50, 5 },
+#endif
+};
 
-  uint16_t ui16_temp = 0, ui16_throttle_value_filtered = 0;
+// startup timeline in TIM3 ticks (~1 ms), sent to the display
+uint16_t ui16_startup_timeline[STARTUP_TIMELINE_STEPS];
 
+int main (void)
+{
   // set clock at the max 16 MHz
   CLK_HSIPrescalerConfig(CLK_PRESCALER_HSIDIV1);
 
+  timer3_init(); // first so the startup timeline can be measured
+  timer2_init();
   brake_init();
-  while (brake_is_set()) ; // hold here while brake is pressed -- this is a protection for development
+  while (brake_is_set()) ; // hold here while brake is pressed -- this is a protection for development, a brake held at power on has no edge for the brake interrupt
   lights_init();
   uart2_init();
-  timer2_init();
-  timer3_init();
+  ui16_startup_timeline[STARTUP_TIMELINE_TIMERS] = TIM3_GetCounter();
+  
   adc_init();
+  ui16_startup_timeline[STARTUP_TIMELINE_ADC] = TIM3_GetCounter();
+  
   torque_sensor_init();
   pas_init();
   wheel_speed_sensor_init();
   hall_sensor_init();
+  ui16_startup_timeline[STARTUP_TIMELINE_SENSORS] = TIM3_GetCounter();
+  
   EEPROM_init(); // needed for pwm_init_bipolar_4q
+  assist_map_init(); // needs the assist map read from EEPROM
+  torque_sensor_offset_init(); // needs the torque sensor offset read from EEPROM
+  motor_thermal_init(); // needs the motor temperatures read from EEPROM
+  ui16_startup_timeline[STARTUP_TIMELINE_EEPROM] = TIM3_GetCounter();
+  
   pwm_init_bipolar_4q();
   enableInterrupts();
+  ui16_startup_timeline[STARTUP_TIMELINE_PWM] = TIM3_GetCounter();
+
+  scheduler_init(tasks, sizeof(tasks) / sizeof(tasks[0]));
 
   while (1)
   {
-    // because of continue; at the end of each if code block that will stop the while (1) loop there,
-    // the first if block code will have the higher priority over any others
-    ui16_TIM3_counter = TIM3_GetCounter();
-    if((ui16_TIM3_counter - ui16_motor_controller_counter) > 4) // every 4ms
-    {
-      ui16_motor_controller_counter = ui16_TIM3_counter;
-      motor_controller();
-      continue;
-    }
-
-    ui16_TIM3_counter = TIM3_GetCounter();
-    if((ui16_TIM3_counter - ui16_ebike_app_controller_counter) > 100) // every 100ms
-    {
-      ui16_ebike_app_controller_counter = ui16_TIM3_counter;
-      ebike_app_controller();
-      continue;
-    }
-
-    #ifdef DEBUG_UART
-    
-    ui16_TIM3_counter = TIM3_GetCounter();
-    
-    if((ui16_TIM3_counter - ui16_debug_uart_counter) > 50)
-    {
-      ui16_debug_uart_counter = ui16_TIM3_counter;
-
-      // sugestion: no more than 6 variables printed (takes about 3ms to printf 6 variables)
-      printf "%d,%d,%d,%d\n",
-      ui16_motor_get_motor_speed_erps(),
-      ui8_duty_cycle,
-      ui8_adc_battery_current,
-      ui8_foc_angle
-      );
-    }
-    
-    #endif
+    // run the released task with the highest priority or wait for interrupt if there is nothing to do
+    scheduler_clock();
   }
 
   return 0;
-}
\ No newline at end of file
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the startup timeline
+
+  Estimates from the code, not measured on a motor yet, the
+  measured values are ui16_startup_timeline[] sent to the
+  display, TIM3 ticks of ~1 ms from the end of the reset:
+
+  - timers, brake, lights and UART: < 1 ms, plus the time
+    the brake is held at power on
+  - ADC: ~100 ms, ADC_CALIBRATION_TIME samples 10 ms apart
+  - sensors: < 1 ms
+  - EEPROM, assist map, torque sensor offset and motor
+    thermal model: ~1 ms, defaults are written in the
+    background by EEPROM_write_step() and not here
+  - PWM and interrupts: < 1 ms
+
+  So assist should be available about 105 ms after the
+  reset, well below the 500 ms goal. The supply ramp and the
+  reset of the microcontroller before main() are not in the
+  timeline. The ADC calibration is the only long step.
+---------------------------------------------------------*/
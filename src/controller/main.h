@@ -14,6 +14,25 @@
 
 
 
+// main loop scheduler tasks, periods and budgets in TIM3 ticks of ~1 ms
+#define MOTOR_CONTROLLER_PERIOD_MS                                4       // 4 ms
+#define MOTOR_CONTROLLER_BUDGET_MS                                1
+#define EBIKE_APP_CONTROLLER_PERIOD_MS                            20      // 20 ms, assist control
+#define EBIKE_APP_CONTROLLER_BUDGET_MS                            3
+#define EBIKE_APP_HOUSEKEEPING_PERIOD_MS                          100     // 100 ms, communications, lights and system checks
+#define EBIKE_APP_HOUSEKEEPING_BUDGET_MS                          2       // the UART package is sent by the UART transmit interrupt and EEPROM bytes are programmed one per run
+
+
+
+// startup timeline, TIM3 ticks (~1 ms) from power on at the end of each init step
+#define STARTUP_TIMELINE_TIMERS                                   0       // timers, brake, lights and UART
+#define STARTUP_TIMELINE_ADC                                      1       // ADC and torque sensor power on calibration
+#define STARTUP_TIMELINE_SENSORS                                  2       // torque, cadence, wheel speed and hall sensors
+#define STARTUP_TIMELINE_EEPROM                                   3       // EEPROM, assist map and torque sensor offset
+#define STARTUP_TIMELINE_PWM                                      4       // PWM and interrupts, assist is available, STARTUP_TIMELINE_STEPS is in common.h
+
+
+
 // motor 
 #define PWM_CYCLES_COUNTER_MAX                                    3125    // 5 erps minimum speed -> 1/5 = 200 ms; 200 ms / 64 us = 3125
 #define PWM_CYCLES_SECOND                                         15625   // 1 / 64us(PWM period)
@@ -91,11 +110,22 @@
 #define ADC_THROTTLE_MIN_VALUE                                    47
 #define ADC_THROTTLE_MAX_VALUE                                    176
 
+// throttle response curve and deadband in ADC 8 bits steps
+#define THROTTLE_CURVE_LINEAR                                     0
+#define THROTTLE_CURVE_PROGRESSIVE                                1
+#define THROTTLE_CURVE_LUT                                        2
+#define THROTTLE_RESPONSE_CURVE                                   THROTTLE_CURVE_LINEAR
+#define THROTTLE_DEADBAND                                         2
+
 /*---------------------------------------------------------
   NOTE: regarding throttle ADC values
 
   Max voltage value for throttle, in ADC 8 bits step, 
   each ADC 8 bits step = (5 V / 256) = 0.0195
+  
+  Throttle changes smaller than the deadband are ignored.
+  The response curve is linear, progressive (quadratic)
+  or the custom curve in throttle.c.
 
 ---------------------------------------------------------*/
 
@@ -166,6 +196,10 @@
 #define DEFAULT_VALUE_WHEEL_SPEED_MAX                             50  // 50 km/h
 #define DEFAULT_VALUE_MOTOR_TYPE                                  0
 #define DEFAULT_VALUE_PEDAL_TORQUE_PER_10_BIT_ADC_STEP_X100       67
+#define DEFAULT_VALUE_PEDAL_TORQUE_OFFSET_0                       0   // 0 -> no saved offset, use the offset measured at power on
+#define DEFAULT_VALUE_PEDAL_TORQUE_OFFSET_1                       0
+#define DEFAULT_VALUE_MOTOR_WINDING_TEMPERATURE                   0   // 0 -> no saved temperature, start from ambient temperature
+#define DEFAULT_VALUE_MOTOR_CASE_TEMPERATURE                      0
 
 /*---------------------------------------------------------
 
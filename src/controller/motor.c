@@ -12,6 +12,7 @@
 #include "interrupts.h"
 #include "stm8s_gpio.h"
 #include "stm8s_tim1.h"
+#include "stm8s_tim3.h"
 #include "ebike_app.h"
 #include "pins.h"
 #include "pwm.h"
@@ -21,6 +22,14 @@
 #include "watchdog.h"
 #include "math.h"
 #include "common.h"
+#include "torque_sensor.h"
+#include "battery.h"
+#include "flight_recorder.h"
+#include "foc_angle_tracker.h"
+#include "fault.h"
+#include "throttle.h"
+#include "brake.h"
+#include "pas.h"
 
 #define SVM_TABLE_LEN   256
 #define SIN_TABLE_LEN   60
@@ -358,6 +367,11 @@ uint8_t ui8_motor_commutation_type = BLOCK_COMMUTATION;
 uint8_t ui8_hall_sensors_state = 0;
 uint8_t ui8_hall_sensors_state_last = 0;
 uint8_t ui8_half_erps_flag = 0;
+static volatile uint8_t ui8_motor_hall_steps = 0;
+static uint8_t ui8_hall_sensors_state_previous = 0;
+
+// next hall sensors state with motor forward rotation, indexed by hall sensors state
+static const uint8_t ui8_hall_sensors_next_state[8] = { 0, 5, 3, 1, 6, 4, 2, 0 };
 
 
 // power variables
@@ -369,6 +383,7 @@ volatile uint16_t ui16_adc_battery_current = 0;
 volatile uint8_t ui8_adc_battery_current_filtered = 0;
 volatile uint8_t ui8_controller_adc_battery_current = 0;
 volatile uint8_t ui8_controller_adc_battery_current_target = 0;
+static uint16_t ui16_adc_battery_current_accumulated = 0;
 volatile uint8_t ui8_g_duty_cycle = 0;
 volatile uint8_t ui8_controller_duty_cycle_target = 0;
 volatile uint8_t ui8_g_foc_angle = 0;
@@ -376,11 +391,19 @@ volatile uint8_t ui8_g_foc_angle = 0;
 
 // cadence sensor
 volatile uint16_t ui16_cadence_sensor_ticks = 0;
+volatile uint16_t ui16_cadence_sensor_ticks_counter = 0;
+volatile uint8_t ui8_cadence_sensor_edge_counter = 0;
 volatile uint16_t ui16_cadence_sensor_ticks_counter_min_high = CADENCE_SENSOR_TICKS_COUNTER_MIN;
 volatile uint16_t ui16_cadence_sensor_ticks_counter_min_low = CADENCE_SENSOR_TICKS_COUNTER_MIN;
 volatile uint8_t ui8_cadence_sensor_pulse_state = 0;
 
 
+// torque sensor samples at every cadence sensor LOW to HIGH transition
+volatile uint16_t ui16_torque_sensor_samples[TORQUE_SENSOR_SAMPLES_PER_REVOLUTION];
+volatile uint8_t ui8_torque_sensor_sample_index = 0;
+volatile uint8_t ui8_torque_sensor_samples_number = 0;
+
+
 // wheel speed sensor
 volatile uint16_t ui16_wheel_speed_sensor_ticks = 0;
 volatile uint32_t ui32_wheel_speed_sensor_ticks_total = 0;
@@ -394,9 +417,16 @@ uint8_t asin_table(uint8_t ui8_inverted_angle_x128);
 
 void motor_controller(void)
 {
+  static uint16_t ui16_TIM3_counter_old;
+  uint16_t ui16_TIM3_counter = TIM3_GetCounter();
+  
   read_battery_voltage();
   read_battery_current();
+  battery_model_update(ui16_adc_battery_voltage_filtered, ui16_adc_battery_current_accumulated);
+  battery_calc_charge_and_energy(ui16_adc_battery_voltage_filtered, ui16_adc_battery_current, ui16_TIM3_counter - ui16_TIM3_counter_old);
+  ui16_TIM3_counter_old = ui16_TIM3_counter;
   calc_foc_angle();
+  throttle_controller(UI8_ADC_THROTTLE);
 }
 
 
@@ -458,6 +488,12 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
   ui8_hall_sensors_state = ((HALL_SENSOR_A__PORT->IDR & HALL_SENSOR_A__PIN) >> 5) |
                            ((HALL_SENSOR_B__PORT->IDR & HALL_SENSOR_B__PIN) >> 1) |
                            ((HALL_SENSOR_C__PORT->IDR & HALL_SENSOR_C__PIN) >> 3);
+  
+  // detect motor faults: hall sensors, stall, overcurrent and undervoltage
+  fault_detect(ui8_hall_sensors_state, ui16_adc_battery_current, UI8_ADC_BATTERY_VOLTAGE);
+  
+  // brakes: the brake interrupt cut motor power, latch the cut or restore power if it was a glitch
+  if (ui8_g_brake_cut) { brake_qualify(); }
                            
   // make sure we run next code only when there is a change on the hall sensors signal
   if (ui8_hall_sensors_state != ui8_hall_sensors_state_last)
@@ -535,6 +571,12 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
     }
 
     ui16_PWM_cycles_counter_6 = 1;
+    
+    // count motor rotation in hall sensor steps, counts down on backward rotation
+    if (ui8_hall_sensors_state == ui8_hall_sensors_next_state[ui8_hall_sensors_state_previous]) { ++ui8_motor_hall_steps; }
+    else if (ui8_hall_sensors_state_previous == ui8_hall_sensors_next_state[ui8_hall_sensors_state]) { --ui8_motor_hall_steps; }
+    
+    ui8_hall_sensors_state_previous = ui8_hall_sensors_state;
   }
 
 
@@ -590,7 +632,6 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
   /****************************************************************************/
 
 
-
   // PWM duty_cycle controller:
   // - limit battery undervoltage
   // - limit battery max current
@@ -719,7 +760,6 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
   
   
   
-  static uint16_t ui16_cadence_sensor_ticks_counter;
   static uint16_t ui16_cadence_sensor_ticks_counter_min;
   static uint8_t ui8_cadence_sensor_ticks_counter_started;
   static uint8_t ui8_cadence_sensor_pin_state_old;
@@ -744,6 +784,11 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
         // only consider the 0 -> 1 transition
         if (ui8_cadence_sensor_pin_1_state)
         {
+          // sample torque sensor at this crank angle
+          ui16_torque_sensor_samples[ui8_torque_sensor_sample_index] = UI16_ADC_10_BIT_TORQUE_SENSOR;
+          if (++ui8_torque_sensor_sample_index >= TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ui8_torque_sensor_sample_index = 0; }
+          if (ui8_torque_sensor_samples_number < TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ++ui8_torque_sensor_samples_number; }
+          
           // set the ticks counter limit depending on current wheel speed
           ui16_cadence_sensor_ticks_counter_min = ui16_cadence_sensor_ticks_counter_min_speed_adjusted;
           
@@ -769,6 +814,9 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
               // set the cadence sensor ticks between the two transitions
               ui16_cadence_sensor_ticks = ui16_cadence_sensor_ticks_counter;
               
+              // signal new measurement
+              ++ui8_cadence_sensor_edge_counter;
+              
               // reset ticks counter
               ui16_cadence_sensor_ticks_counter = 0;
               
@@ -789,6 +837,14 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
         if (ui8_cadence_sensor_pin_1_state) { ui16_cadence_sensor_ticks_counter_min = ui16_cadence_sensor_ticks_counter_min_high; }
         else { ui16_cadence_sensor_ticks_counter_min = ui16_cadence_sensor_ticks_counter_min_low; }
         
+        // sample torque sensor at this crank angle, only on LOW to HIGH transitions so samples are equally spaced
+        if (ui8_cadence_sensor_pin_1_state)
+        {
+          ui16_torque_sensor_samples[ui8_torque_sensor_sample_index] = UI16_ADC_10_BIT_TORQUE_SENSOR;
+          if (++ui8_torque_sensor_sample_index >= TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ui8_torque_sensor_sample_index = 0; }
+          if (ui8_torque_sensor_samples_number < TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ++ui8_torque_sensor_samples_number; }
+        }
+        
         // check if first transition
         if (!ui8_cadence_sensor_ticks_counter_started)
         {
@@ -811,6 +867,9 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
             // set the cadence sensor ticks between the two transitions
             ui16_cadence_sensor_ticks = ui16_cadence_sensor_ticks_counter;
             
+            // signal new measurement
+            ++ui8_cadence_sensor_edge_counter;
+            
             // set the pulse state
             ui8_cadence_sensor_pulse_state = ui8_cadence_sensor_pin_1_state;
             
@@ -870,6 +929,9 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
     ui16_cadence_sensor_ticks = 0;
     ui16_cadence_sensor_ticks_counter = 0;
     ui8_cadence_sensor_ticks_counter_started = 0;
+    
+    // pedals stopped, discard torque sensor samples from the last revolution
+    ui8_torque_sensor_samples_number = 0;
   }
   
   
@@ -878,6 +940,15 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
   
   
   
+  // decode both cadence sensor pins as quadrature signals
+  pas_decode((ui8_cadence_sensor_pin_1_state ? 2 : 0) | (ui8_cadence_sensor_pin_2_state ? 1 : 0));
+  
+  
+  
+  /****************************************************************************/
+  
+  
+  
   static uint16_t ui16_wheel_speed_sensor_ticks_counter;
   static uint8_t ui8_wheel_speed_sensor_ticks_counter_started;
   static uint8_t ui8_wheel_speed_sensor_pin_state_old;
@@ -952,6 +1023,16 @@ void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER)
 
 
   /****************************************************************************/
+  
+  
+  // flight recorder, record every ui8_flight_recorder_decimation PWM cycles
+  if (!--ui8_flight_recorder_decimation_counter)
+  {
+    flight_recorder_record(ui8_g_duty_cycle, ui16_adc_battery_current, ui16_motor_speed_erps, ui8_g_foc_angle, ui8_hall_sensors_state);
+  }
+  
+  
+    /****************************************************************************/
 
 
   // clears the TIM1 interrupt TIM1_IT_UPDATE pending bit
@@ -983,6 +1064,12 @@ uint16_t ui16_motor_get_motor_speed_erps(void)
 }
 
 
+uint8_t ui8_motor_get_hall_steps(void)
+{
+  return ui8_motor_hall_steps;
+}
+
+
 void read_battery_voltage(void)
 {
   #define READ_BATTERY_VOLTAGE_FILTER_COEFFICIENT   2
@@ -997,6 +1084,9 @@ void read_battery_voltage(void)
 
   static uint16_t ui16_adc_battery_voltage_accumulated;
   
+  // start the filter from the first reading instead of ramping up from zero after power on
+  if (!ui16_adc_battery_voltage_accumulated) { ui16_adc_battery_voltage_accumulated = ui16_adc_read_battery_voltage_10b() << READ_BATTERY_VOLTAGE_FILTER_COEFFICIENT; }
+  
   // low pass filter the voltage readed value, to avoid possible fast spikes/noise
   ui16_adc_battery_voltage_accumulated -= ui16_adc_battery_voltage_accumulated >> READ_BATTERY_VOLTAGE_FILTER_COEFFICIENT;
   ui16_adc_battery_voltage_accumulated += ui16_adc_read_battery_voltage_10b();
@@ -1020,8 +1110,6 @@ void read_battery_current(void)
     will increase filtering but will also add a bigger delay.
   ---------------------------------------------------------*/
 
-  static uint16_t ui16_adc_battery_current_accumulated;
-  
   // low pass filter the positive battery readed value (no regen current), to avoid possible fast spikes/noise
   ui16_adc_battery_current_accumulated -= ui16_adc_battery_current_accumulated >> READ_BATTERY_CURRENT_FILTER_COEFFICIENT;
   ui16_adc_battery_current_accumulated += ui16_adc_battery_current;
@@ -1123,7 +1211,9 @@ void calc_foc_angle(void)
   static uint16_t ui16_foc_angle_accumulated;
   ui16_foc_angle_accumulated -= ui16_foc_angle_accumulated >> 4;
   ui16_foc_angle_accumulated += ui8_g_foc_angle;
-  ui8_g_foc_angle = ui16_foc_angle_accumulated >> 4;
+  
+  // add learned FOC angle offset
+  ui8_g_foc_angle = foc_angle_tracker_apply(ui16_foc_angle_accumulated >> 4);
 }
 
 // calc asin also converts the final result to degrees
@@ -1148,36 +1238,52 @@ uint8_t asin_table (uint8_t ui8_inverted_angle_x128)
 
 void motor_enable_pwm(void)
 {
-  TIM1_OC1Init(TIM1_OCMODE_PWM1,
-         TIM1_OUTPUTSTATE_ENABLE,
-         TIM1_OUTPUTNSTATE_ENABLE,
-         255, // initial duty_cycle value
-         TIM1_OCPOLARITY_HIGH,
-         TIM1_OCPOLARITY_HIGH,
-         TIM1_OCIDLESTATE_RESET,
-         TIM1_OCIDLESTATE_SET);
-
-  TIM1_OC2Init(TIM1_OCMODE_PWM1,
-         TIM1_OUTPUTSTATE_ENABLE,
-         TIM1_OUTPUTNSTATE_ENABLE,
-         255, // initial duty_cycle value
-         TIM1_OCPOLARITY_HIGH,
-         TIM1_OCPOLARITY_HIGH,
-         TIM1_OCIDLESTATE_RESET,
-         TIM1_OCIDLESTATE_SET);
-
-  TIM1_OC3Init(TIM1_OCMODE_PWM1,
-         TIM1_OUTPUTSTATE_ENABLE,
-         TIM1_OUTPUTNSTATE_ENABLE,
-         255, // initial duty_cycle value
-         TIM1_OCPOLARITY_HIGH,
-         TIM1_OCPOLARITY_HIGH,
-         TIM1_OCIDLESTATE_RESET,
-         TIM1_OCIDLESTATE_SET);
+  // the brake interrupts disable the PWM outputs on brakes: keep them from writing them in the middle of the
+  // initialization and do not enable them again while the brakes are latched, while the cut is not latched yet
+  // only set the PWM output state to restore after a glitch
+  disableInterrupts();
+  
+  if (ui8_g_brake_cut) { brake_cut_set_pwm(1); }
+  else if (!ui8_g_brake_latched)
+  {
+    TIM1_OC1Init(TIM1_OCMODE_PWM1,
+           TIM1_OUTPUTSTATE_ENABLE,
+           TIM1_OUTPUTNSTATE_ENABLE,
+           255, // initial duty_cycle value
+           TIM1_OCPOLARITY_HIGH,
+           TIM1_OCPOLARITY_HIGH,
+           TIM1_OCIDLESTATE_RESET,
+           TIM1_OCIDLESTATE_SET);
+
+    TIM1_OC2Init(TIM1_OCMODE_PWM1,
+           TIM1_OUTPUTSTATE_ENABLE,
+           TIM1_OUTPUTNSTATE_ENABLE,
+           255, // initial duty_cycle value
+           TIM1_OCPOLARITY_HIGH,
+           TIM1_OCPOLARITY_HIGH,
+           TIM1_OCIDLESTATE_RESET,
+           TIM1_OCIDLESTATE_SET);
+
+    TIM1_OC3Init(TIM1_OCMODE_PWM1,
+           TIM1_OUTPUTSTATE_ENABLE,
+           TIM1_OUTPUTNSTATE_ENABLE,
+           255, // initial duty_cycle value
+           TIM1_OCPOLARITY_HIGH,
+           TIM1_OCPOLARITY_HIGH,
+           TIM1_OCIDLESTATE_RESET,
+           TIM1_OCIDLESTATE_SET);
+  }
+  
+  enableInterrupts();
 }
 
 void motor_disable_pwm(void)
 {
+  // the brake interrupts disable the PWM outputs on brakes, keep them from writing them in the middle of the initialization
+  disableInterrupts();
+  
+  if (ui8_g_brake_cut) { brake_cut_set_pwm(0); }
+  
   TIM1_OC1Init(TIM1_OCMODE_PWM1,
          TIM1_OUTPUTSTATE_DISABLE,
          TIM1_OUTPUTNSTATE_DISABLE,
@@ -1204,5 +1310,6 @@ void motor_disable_pwm(void)
          TIM1_OCPOLARITY_HIGH,
          TIM1_OCIDLESTATE_RESET,
          TIM1_OCIDLESTATE_SET);
-
+  
+  enableInterrupts();
 }
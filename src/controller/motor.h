@@ -31,11 +31,19 @@ extern volatile uint8_t ui8_g_foc_angle;
 
 // cadence sensor
 extern volatile uint16_t ui16_cadence_sensor_ticks;
+extern volatile uint16_t ui16_cadence_sensor_ticks_counter;
+extern volatile uint8_t ui8_cadence_sensor_edge_counter;
 extern volatile uint16_t ui16_cadence_sensor_ticks_counter_min_high;
 extern volatile uint16_t ui16_cadence_sensor_ticks_counter_min_low;
 extern volatile uint8_t ui8_cadence_sensor_pulse_state;
 
 
+// torque sensor
+extern volatile uint16_t ui16_torque_sensor_samples[];
+extern volatile uint8_t ui8_torque_sensor_sample_index;
+extern volatile uint8_t ui8_torque_sensor_samples_number;
+
+
 // wheel speed sensor
 extern volatile uint16_t ui16_wheel_speed_sensor_ticks;
 extern volatile uint32_t ui32_wheel_speed_sensor_ticks_total;
@@ -47,6 +55,7 @@ void motor_disable_PWM (void);
 void motor_enable_pwm(void);
 void motor_disable_pwm(void);
 uint16_t ui16_motor_get_motor_speed_erps (void);
+uint8_t ui8_motor_get_hall_steps (void);   // wraps around, forward rotation counts up and backward rotation counts down
 void motor_controller (void);
 
 uint8_t motor_get_adc_battery_current_filtered_10b (void);
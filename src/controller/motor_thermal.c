@@ -0,0 +1,141 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "motor.h"
+#include "ebike_app.h"
+#include "motor_thermal.h"
+
+
+// winding and case temperature in degrees Celsius x65536
+static int32_t i32_motor_winding_temperature_x65536 = (int32_t) MOTOR_THERMAL_AMBIENT_TEMPERATURE << 16;
+static int32_t i32_motor_case_temperature_x65536 = (int32_t) MOTOR_THERMAL_AMBIENT_TEMPERATURE << 16;
+
+
+static uint8_t motor_thermal_restore_temperature (uint8_t ui8_saved_temperature);
+
+
+
+void motor_thermal_init (void)
+{
+  struct_configuration_variables *p_configuration_variables = get_configuration_variables();
+  uint8_t ui8_winding_temperature = p_configuration_variables->ui8_motor_winding_temperature;
+  uint8_t ui8_case_temperature = p_configuration_variables->ui8_motor_case_temperature;
+  
+  // start from the saved temperatures if valid, time since power off is not known so the motor may still be hot
+  if ((ui8_winding_temperature > MOTOR_THERMAL_AMBIENT_TEMPERATURE) && (ui8_winding_temperature <= MOTOR_THERMAL_TEMPERATURE_MAX))
+  {
+    i32_motor_winding_temperature_x65536 = (int32_t) motor_thermal_restore_temperature(ui8_winding_temperature) << 16;
+  }
+  
+  if ((ui8_case_temperature > MOTOR_THERMAL_AMBIENT_TEMPERATURE) && (ui8_case_temperature <= MOTOR_THERMAL_TEMPERATURE_MAX))
+  {
+    i32_motor_case_temperature_x65536 = (int32_t) motor_thermal_restore_temperature(ui8_case_temperature) << 16;
+  }
+}
+
+
+
+// saved temperatures are from the end of the last ride and the motor cooled for an unknown time since, so they are clamped
+static uint8_t motor_thermal_restore_temperature (uint8_t ui8_saved_temperature)
+{
+  if (ui8_saved_temperature > (MOTOR_THERMAL_AMBIENT_TEMPERATURE + MOTOR_THERMAL_RESTORE_MARGIN))
+  {
+    return MOTOR_THERMAL_AMBIENT_TEMPERATURE + MOTOR_THERMAL_RESTORE_MARGIN;
+  }
+  
+  return ui8_saved_temperature;
+}
+
+
+
+// happens every MOTOR_THERMAL_PERIOD_MS
+void motor_thermal_controller (void)
+{
+  #define MOTOR_THERMAL_DUTY_CYCLE_MIN                  10
+  #define MOTOR_THERMAL_PHASE_CURRENT_X10_MAX           1000
+  #define MOTOR_WINDING_HEAT_CAPACITY_PER_PERIOD        ((uint16_t) MOTOR_WINDING_HEAT_CAPACITY * (1000 / MOTOR_THERMAL_PERIOD_MS))
+  #define MOTOR_CASE_HEAT_CAPACITY_PER_PERIOD           ((uint16_t) MOTOR_CASE_HEAT_CAPACITY * (1000 / MOTOR_THERMAL_PERIOD_MS))
+  
+  uint8_t ui8_duty_cycle = ui8_g_duty_cycle;
+  uint32_t ui32_phase_current_x10 = 0;
+  uint32_t ui32_losses_mW;
+  int32_t i32_losses_x256;
+  int32_t i32_winding_to_case_x256;
+  int32_t i32_case_to_ambient_x256;
+  
+  // phase current from battery current and duty cycle
+  if (ui8_duty_cycle > MOTOR_THERMAL_DUTY_CYCLE_MIN)
+  {
+    ui32_phase_current_x10 = ((uint32_t) ui8_adc_battery_current_filtered * BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10 * 255) / ui8_duty_cycle;
+    
+    if (ui32_phase_current_x10 > MOTOR_THERMAL_PHASE_CURRENT_X10_MAX) { ui32_phase_current_x10 = MOTOR_THERMAL_PHASE_CURRENT_X10_MAX; }
+  }
+  
+  // copper losses and speed dependent losses in mW
+  ui32_losses_mW = ((ui32_phase_current_x10 * ui32_phase_current_x10 * MOTOR_WINDING_RESISTANCE_MOHM) / 100) +
+                   ((uint32_t) ui16_motor_get_motor_speed_erps() * MOTOR_IRON_LOSSES_MW_PER_ERPS);
+  
+  // heat flows in W x256
+  i32_losses_x256 = (ui32_losses_mW * 32) / 125;
+  i32_winding_to_case_x256 = (((i32_motor_winding_temperature_x65536 - i32_motor_case_temperature_x65536) >> 8) * MOTOR_WINDING_TO_CASE_CONDUCTANCE_MW_PER_K) / 1000;
+  i32_case_to_ambient_x256 = (((i32_motor_case_temperature_x65536 - ((int32_t) MOTOR_THERMAL_AMBIENT_TEMPERATURE << 16)) >> 8) * MOTOR_CASE_TO_AMBIENT_CONDUCTANCE_MW_PER_K) / 1000;
+  
+  // update temperatures
+  i32_motor_winding_temperature_x65536 += ((i32_losses_x256 - i32_winding_to_case_x256) << 8) / MOTOR_WINDING_HEAT_CAPACITY_PER_PERIOD;
+  i32_motor_case_temperature_x65536 += ((i32_winding_to_case_x256 - i32_case_to_ambient_x256) << 8) / MOTOR_CASE_HEAT_CAPACITY_PER_PERIOD;
+  
+  /*---------------------------------------------------------
+    NOTE: regarding the motor thermal model
+
+    The motor is modeled with two thermal nodes, winding and
+    case. Losses heat the winding, heat flows from winding to
+    case and from case to ambient air:
+
+    winding capacity * dT winding / dt = losses - (T winding - T case) / R winding to case
+    case capacity * dT case / dt = (T winding - T case) / R winding to case - (T case - T ambient) / R case to ambient
+
+    Losses are the copper losses from the phase current plus
+    speed dependent losses. Ambient temperature is not
+    measured and assumed to be MOTOR_THERMAL_AMBIENT_TEMPERATURE.
+
+    Temperatures are saved when the motor stops and restored
+    on next power on, limited to MOTOR_THERMAL_RESTORE_MARGIN
+    over ambient since the motor cooled for an unknown time.
+  ---------------------------------------------------------*/
+}
+
+
+
+uint16_t motor_thermal_get_winding_temperature_x10 (void)
+{
+  if (i32_motor_winding_temperature_x65536 <= 0) { return 0; }
+  
+  return (uint16_t) ((i32_motor_winding_temperature_x65536 * 10) >> 16);
+}
+
+
+
+uint8_t motor_thermal_get_winding_temperature (void)
+{
+  if (i32_motor_winding_temperature_x65536 <= 0) { return 0; }
+  if (i32_motor_winding_temperature_x65536 >= ((int32_t) 255 << 16)) { return 255; }
+  
+  return (uint8_t) (i32_motor_winding_temperature_x65536 >> 16);
+}
+
+
+
+uint8_t motor_thermal_get_case_temperature (void)
+{
+  if (i32_motor_case_temperature_x65536 <= 0) { return 0; }
+  if (i32_motor_case_temperature_x65536 >= ((int32_t) 255 << 16)) { return 255; }
+  
+  return (uint8_t) (i32_motor_case_temperature_x65536 >> 16);
+}
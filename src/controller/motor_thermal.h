@@ -0,0 +1,37 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _MOTOR_THERMAL_H_
+#define _MOTOR_THERMAL_H_
+
+#include <stdint.h>
+#include "main.h"
+
+// motor thermal model parameters
+#define MOTOR_THERMAL_PERIOD_MS                         100   // motor_thermal_controller() runs every EBIKE_APP_HOUSEKEEPING_PERIOD_MS
+#define MOTOR_THERMAL_AMBIENT_TEMPERATURE               25    // degrees Celsius
+#define MOTOR_THERMAL_TEMPERATURE_MAX                   200   // degrees Celsius, max valid saved temperature
+#define MOTOR_THERMAL_RESTORE_MARGIN                    40    // degrees Celsius over ambient, max saved temperature used at power on
+#define MOTOR_WINDING_RESISTANCE_MOHM                   150   // copper losses = phase current^2 * resistance
+#define MOTOR_IRON_LOSSES_MW_PER_ERPS                   40    // speed dependent losses
+#define MOTOR_WINDING_HEAT_CAPACITY                     300   // J/K
+#define MOTOR_CASE_HEAT_CAPACITY                        1200  // J/K
+#define MOTOR_WINDING_TO_CASE_CONDUCTANCE_MW_PER_K      2000  // 0.5 K/W
+#define MOTOR_CASE_TO_AMBIENT_CONDUCTANCE_MW_PER_K      800   // 1.25 K/W
+
+// motor current is limited between these winding temperatures when there is no temperature sensor
+#define MOTOR_THERMAL_TEMPERATURE_MIN_VALUE_TO_LIMIT    100   // degrees Celsius
+#define MOTOR_THERMAL_TEMPERATURE_MAX_VALUE_TO_LIMIT    120   // degrees Celsius
+
+void motor_thermal_init (void);
+void motor_thermal_controller (void);
+uint16_t motor_thermal_get_winding_temperature_x10 (void);
+uint8_t motor_thermal_get_winding_temperature (void);
+uint8_t motor_thermal_get_case_temperature (void);
+
+#endif /* _MOTOR_THERMAL_H_ */
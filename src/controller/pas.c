@@ -9,6 +9,35 @@
 #include <stdint.h>
 #include "stm8s.h"
 #include "pins.h"
+#include "main.h"
+#include "motor.h"
+#include "pas.h"
+
+
+// cadence sensor quadrature decoder, written by pas_decode() in the PWM interrupt
+static volatile int16_t i16_pas_position = 0;
+static volatile uint16_t ui16_pas_position_ticks = 0;
+static volatile uint8_t ui8_pas_backward_counter = 0;
+static volatile uint8_t ui8_pas_error_counter = 0;
+
+// position change indexed by previous and new quadrature state, forward is 0 -> 2 -> 3 -> 1 -> 0
+static const int8_t i8_pas_quadrature_table[16] =
+{
+   0, -1,  1,  0,
+   1,  0,  0, -1,
+  -1,  0,  0,  1,
+   0,  1, -1,  0
+};
+
+static int16_t i16_pas_crank_position = 0;
+static int16_t i16_pas_velocity_RPM_x10 = 0;
+static uint8_t ui8_pas_backpedal_timer = 0;
+
+// cadence estimator state at the last cadence sensor transition
+static int32_t i32_pas_cadence_RPM_x10_x256 = 0;
+static int32_t i32_pas_cadence_RPM_x10_rate_x65536 = 0;   // 0.1 RPM per PWM cycle, x65536
+
+
 
 void pas_init (void)
 {
@@ -17,4 +46,264 @@ void pas_init (void)
 
   //PAS2 pin as external input pin interrupt
   GPIO_Init(PAS2__PORT, PAS2__PIN, GPIO_MODE_IN_PU_NO_IT); // input pull-up, no external interrupt
-}
\ No newline at end of file
+}
+
+
+
+// happens every PWM cycle, called from the PWM interrupt with the quadrature state of both cadence sensor pins
+void pas_decode (uint8_t ui8_pas_state_new)
+{
+  #define PAS_QUADRATURE_FILTER   2   // PWM cycles a new state must be stable, ignores glitches shorter than 128 us
+  
+  static uint8_t ui8_pas_state;
+  static uint8_t ui8_pas_state_filtered;
+  static uint8_t ui8_pas_filter_counter;
+  static uint16_t ui16_pas_ticks;
+  
+  // time base for crank velocity
+  ++ui16_pas_ticks;
+  
+  if (ui8_pas_state_new == ui8_pas_state)
+  {
+    ui8_pas_filter_counter = 0;
+  }
+  else if (ui8_pas_state_new != ui8_pas_state_filtered)
+  {
+    // other new state, a glitch right after a transition must not count as stable
+    ui8_pas_state_filtered = ui8_pas_state_new;
+    ui8_pas_filter_counter = 1;
+  }
+  else if (++ui8_pas_filter_counter >= PAS_QUADRATURE_FILTER)
+  {
+    ui8_pas_filter_counter = 0;
+    
+    switch (i8_pas_quadrature_table[(ui8_pas_state << 2) | ui8_pas_state_new])
+    {
+      case 1:
+        ++i16_pas_position;
+        ui16_pas_position_ticks = ui16_pas_ticks;
+        ui8_pas_backward_counter = 0;
+      break;
+      
+      case -1:
+        --i16_pas_position;
+        ui16_pas_position_ticks = ui16_pas_ticks;
+        if (ui8_pas_backward_counter < 255) { ++ui8_pas_backward_counter; }
+      break;
+      
+      default:
+        // both pins changed, a state was missed
+        if (ui8_pas_error_counter < 255) { ++ui8_pas_error_counter; }
+      break;
+    }
+    
+    ui8_pas_state = ui8_pas_state_new;
+  }
+}
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS
+void pas_controller (void)
+{
+  #define PAS_VELOCITY_FACTOR   (((uint32_t) 600 * PWM_CYCLES_SECOND) / PAS_COUNTS_PER_REVOLUTION)   // RPM x10 = counts * factor / ticks
+  
+  static int16_t i16_position_old;
+  static uint16_t ui16_position_ticks_old;
+  static uint8_t ui8_velocity_timeout_counter;
+  
+  int16_t i16_position;
+  uint16_t ui16_position_ticks;
+  int16_t i16_position_delta;
+  
+  // get position and the time of its last count, read again if the PWM interrupt changed them while reading
+  do
+  {
+    i16_position = i16_pas_position;
+    ui16_position_ticks = ui16_pas_position_ticks;
+  }
+  while (i16_position != i16_pas_position);
+  
+  // backpedaling: set hold time on every run with backward counts
+  if ((ui8_pas_backward_counter >= PAS_BACKPEDAL_COUNTS) && (i16_position != i16_pas_crank_position)) { ui8_pas_backpedal_timer = PAS_BACKPEDAL_HOLD; }
+  else if (ui8_pas_backward_counter < PAS_BACKPEDAL_COUNTS) { ui8_pas_backpedal_timer = 0; }
+  else if (ui8_pas_backpedal_timer) { --ui8_pas_backpedal_timer; }
+  
+  i16_pas_crank_position = i16_position;
+  
+  // crank velocity
+  i16_position_delta = i16_position - i16_position_old;
+  
+  if (ui8_velocity_timeout_counter >= PAS_VELOCITY_TIMEOUT)
+  {
+    // crank was stopped, start measuring from the first count
+    if (i16_position_delta)
+    {
+      i16_position_old = i16_position;
+      ui16_position_ticks_old = ui16_position_ticks;
+      ui8_velocity_timeout_counter = 0;
+    }
+  }
+  else if ((i16_position_delta >= PAS_VELOCITY_COUNTS_MIN) || (i16_position_delta <= -PAS_VELOCITY_COUNTS_MIN))
+  {
+    // signed factor, with the unsigned factor a backward delta would be divided as unsigned
+    i16_pas_velocity_RPM_x10 = ((int32_t) i16_position_delta * (int32_t) PAS_VELOCITY_FACTOR) / (uint16_t) (ui16_position_ticks - ui16_position_ticks_old);
+    
+    i16_position_old = i16_position;
+    ui16_position_ticks_old = ui16_position_ticks;
+    ui8_velocity_timeout_counter = 0;
+  }
+  else if (++ui8_velocity_timeout_counter >= PAS_VELOCITY_TIMEOUT)
+  {
+    i16_pas_velocity_RPM_x10 = 0;
+  }
+}
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS with the cadence sensor values read together with interrupts disabled
+uint16_t pas_cadence_estimator (uint16_t ui16_ticks, uint8_t ui8_new_edges, uint16_t ui16_ticks_since_edge, uint32_t ui32_measured_factor, uint32_t ui32_in_progress_factor)
+{
+  #define CADENCE_ESTIMATOR_ALPHA_X256          128     // 0.5
+  #define CADENCE_ESTIMATOR_BETA_X256           32      // 0.125
+  #define CADENCE_ESTIMATOR_RPM_X10_MAX         1500
+  #define CADENCE_ESTIMATOR_RATE_X65536_MAX     25000   // about 6000 RPM x10 per second, keeps rate * ticks inside int32
+  
+  uint32_t ui32_edge_ticks;
+  int32_t i32_cadence_RPM_x10_measured_x256;
+  int32_t i32_cadence_RPM_x10_predicted_x256;
+  int32_t i32_cadence_RPM_x10_bound_x256;
+  int32_t i32_residual_x256;
+  
+  // no pedal rotation, the ticks counter timed out or the pedals rotate backwards
+  if (!ui16_ticks)
+  {
+    i32_pas_cadence_RPM_x10_x256 = 0;
+    i32_pas_cadence_RPM_x10_rate_x65536 = 0;
+    
+    return 0;
+  }
+  
+  // correct the estimate at the time of the new transition
+  if (ui8_new_edges)
+  {
+    i32_cadence_RPM_x10_measured_x256 = (int32_t) (ui32_measured_factor / ui16_ticks) << 8;
+    
+    if (!i32_pas_cadence_RPM_x10_x256)
+    {
+      // start from the first measurement when pedaling starts
+      i32_pas_cadence_RPM_x10_x256 = i32_cadence_RPM_x10_measured_x256;
+      i32_pas_cadence_RPM_x10_rate_x65536 = 0;
+    }
+    else
+    {
+      // time from the last transition used to the new one, transitions between runs are about equally spaced
+      ui32_edge_ticks = (uint32_t) ui16_ticks * ui8_new_edges;
+      if (ui32_edge_ticks > 65535) { ui32_edge_ticks = 65535; }
+      
+      // predict cadence at the new transition
+      i32_cadence_RPM_x10_predicted_x256 = i32_pas_cadence_RPM_x10_x256 + ((i32_pas_cadence_RPM_x10_rate_x65536 * (int32_t) ui32_edge_ticks) >> 8);
+      
+      // correct cadence and cadence rate with the measurement residual, rate correction is per PWM cycle of the time between transitions
+      i32_residual_x256 = i32_cadence_RPM_x10_measured_x256 - i32_cadence_RPM_x10_predicted_x256;
+      i32_pas_cadence_RPM_x10_x256 = i32_cadence_RPM_x10_predicted_x256 + ((i32_residual_x256 * CADENCE_ESTIMATOR_ALPHA_X256) >> 8);
+      i32_pas_cadence_RPM_x10_rate_x65536 += (i32_residual_x256 * CADENCE_ESTIMATOR_BETA_X256) / (int32_t) ui32_edge_ticks;
+      
+      if (i32_pas_cadence_RPM_x10_rate_x65536 > CADENCE_ESTIMATOR_RATE_X65536_MAX) { i32_pas_cadence_RPM_x10_rate_x65536 = CADENCE_ESTIMATOR_RATE_X65536_MAX; }
+      else if (i32_pas_cadence_RPM_x10_rate_x65536 < -CADENCE_ESTIMATOR_RATE_X65536_MAX) { i32_pas_cadence_RPM_x10_rate_x65536 = -CADENCE_ESTIMATOR_RATE_X65536_MAX; }
+      
+      if (i32_pas_cadence_RPM_x10_x256 < 0) { i32_pas_cadence_RPM_x10_x256 = 0; }
+      else if (i32_pas_cadence_RPM_x10_x256 > ((int32_t) CADENCE_ESTIMATOR_RPM_X10_MAX << 8)) { i32_pas_cadence_RPM_x10_x256 = (int32_t) CADENCE_ESTIMATOR_RPM_X10_MAX << 8; }
+    }
+  }
+  
+  // predict cadence now from the last transition
+  i32_cadence_RPM_x10_predicted_x256 = i32_pas_cadence_RPM_x10_x256 + ((i32_pas_cadence_RPM_x10_rate_x65536 * (int32_t) ui16_ticks_since_edge) >> 8);
+  
+  // predictive decay: if the next transition is overdue the cadence can not be higher than if it happened now
+  if (ui16_ticks_since_edge > ui16_ticks)
+  {
+    i32_cadence_RPM_x10_bound_x256 = (int32_t) (ui32_in_progress_factor / ui16_ticks_since_edge) << 8;
+    
+    if (i32_cadence_RPM_x10_predicted_x256 > i32_cadence_RPM_x10_bound_x256) { i32_cadence_RPM_x10_predicted_x256 = i32_cadence_RPM_x10_bound_x256; }
+  }
+  
+  // limit cadence
+  if (i32_cadence_RPM_x10_predicted_x256 < 0) { return 0; }
+  else if (i32_cadence_RPM_x10_predicted_x256 > ((int32_t) CADENCE_ESTIMATOR_RPM_X10_MAX << 8)) { return CADENCE_ESTIMATOR_RPM_X10_MAX; }
+  else { return (i32_cadence_RPM_x10_predicted_x256 + 128) >> 8; }
+}
+
+
+
+// crank position in quadrature counts, counts down on backward rotation and wraps around
+int16_t pas_get_position (void)
+{
+  return i16_pas_crank_position;
+}
+
+
+
+// crank velocity, negative on backward rotation
+int16_t pas_get_velocity_RPM_x10 (void)
+{
+  return i16_pas_velocity_RPM_x10;
+}
+
+
+
+uint8_t pas_is_backpedaling (void)
+{
+  return ui8_pas_backpedal_timer ? 1 : 0;
+}
+
+
+
+uint8_t pas_get_error_counter (void)
+{
+  return ui8_pas_error_counter;
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the cadence sensor quadrature decoder
+
+  The two cadence sensor pins are decoded by pas_decode()
+  in the PWM interrupt as quadrature signals, every
+  transition of any pin counts the crank position up or
+  down. A new state must be stable for
+  PAS_QUADRATURE_FILTER PWM cycles so short glitches are
+  ignored, and a transition of both pins at once only
+  counts as an error.
+
+  Velocity is measured between counts and not between app
+  runs, at low cadence there is only about one count every
+  run.
+---------------------------------------------------------*/
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the cadence estimator
+
+  Cadence is estimated with an alpha-beta filter. The
+  state is kept at the time of the last cadence sensor
+  transition: on a new transition the cadence is
+  predicted at that transition with the rate times the
+  PWM cycles since the previous one, and corrected with
+  the measurement. Every run the cadence is predicted
+  from the last transition with the PWM cycles since it.
+
+  The rate is in 0.1 RPM per PWM cycle, so the filter
+  gains do not depend on how many runs happen between
+  transitions. With a rate per run the rate would be
+  added on every run but corrected only once per
+  transition, which is unstable at low cadence.
+
+  When the next transition is overdue the cadence is
+  limited to the cadence that would be measured if the
+  transition happened now, so it decays to zero as soon
+  as the rider stops pedaling instead of only after the
+  ticks counter times out.
+---------------------------------------------------------*/
@@ -9,9 +9,28 @@
 #ifndef _PAS_H_
 #define _PAS_H_
 
+#include <stdint.h>
 #include "main.h"
 
+// cadence sensor quadrature counts per crank revolution, every transition of both pins
+#define PAS_COUNTS_PER_REVOLUTION             (CADENCE_SENSOR_NUMBER_MAGNETS * 4)
+
+// crank velocity is measured over at least one magnet, quadrature transitions are not equally spaced
+#define PAS_VELOCITY_COUNTS_MIN               4
+#define PAS_VELOCITY_TIMEOUT                  25    // number of runs without PAS_VELOCITY_COUNTS_MIN counts before velocity is 0, 25 * 20 ms = 500 ms
+
+// backpedaling after consecutive backward counts, ends on forward rotation or after the hold time without backward counts
+#define PAS_BACKPEDAL_COUNTS                  2     // 2 / 80 revolution = 9 degrees
+#define PAS_BACKPEDAL_HOLD                    15    // number of runs, 15 * 20 ms = 300 ms
+
 void pas_init (void);
 void pas2_init (void);
+void pas_decode (uint8_t ui8_pas_state_new);
+void pas_controller (void);
+int16_t pas_get_position (void);
+int16_t pas_get_velocity_RPM_x10 (void);
+uint8_t pas_is_backpedaling (void);
+uint8_t pas_get_error_counter (void);
+uint16_t pas_cadence_estimator (uint16_t ui16_ticks, uint8_t ui8_new_edges, uint16_t ui16_ticks_since_edge, uint32_t ui32_measured_factor, uint32_t ui32_in_progress_factor);
 
 #endif /* _PAS_H_ */
@@ -0,0 +1,80 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "pid.h"
+
+
+void pid_init (struct_pid_controller *p_pid, int16_t i16_error, int16_t i16_output_initial)
+{
+  // limit initial output
+  if (i16_output_initial < p_pid->i16_output_min) { i16_output_initial = p_pid->i16_output_min; }
+  if (i16_output_initial > p_pid->i16_output_max) { i16_output_initial = p_pid->i16_output_max; }
+
+  // feed forward: preload the integral term so the output starts from the initial output (bumpless)
+  p_pid->i32_integral_x256 = ((int32_t) i16_output_initial << PID_GAIN_SHIFT) - ((int32_t) p_pid->ui16_kp_x256 * i16_error);
+
+  // no derivative kick on the first run
+  p_pid->i16_last_error = i16_error;
+}
+
+
+
+int16_t pid_run (struct_pid_controller *p_pid, int16_t i16_error)
+{
+  int32_t i32_output_min_x256 = (int32_t) p_pid->i16_output_min << PID_GAIN_SHIFT;
+  int32_t i32_output_max_x256 = (int32_t) p_pid->i16_output_max << PID_GAIN_SHIFT;
+  int32_t i32_output_x256;
+
+  // proportional and derivative terms
+  int32_t i32_proportional_x256 = (int32_t) p_pid->ui16_kp_x256 * i16_error;
+  int32_t i32_derivative_x256 = (int32_t) p_pid->ui16_kd_x256 * (i16_error - p_pid->i16_last_error);
+  p_pid->i16_last_error = i16_error;
+
+  // output without new integral contribution
+  i32_output_x256 = i32_proportional_x256 + p_pid->i32_integral_x256 + i32_derivative_x256;
+
+  // conditional integration: only integrate if the output is not saturated in the direction of the error (anti-windup)
+  if (!((i32_output_x256 >= i32_output_max_x256) && (i16_error > 0)) &&
+      !((i32_output_x256 <= i32_output_min_x256) && (i16_error < 0)))
+  {
+    p_pid->i32_integral_x256 += (int32_t) p_pid->ui16_ki_x256 * i16_error;
+
+    // the integral term alone must also not wind up outside the output range, only limit it in the direction it integrates
+    // as the feed forward of pid_init() can leave it outside the range
+    if ((i16_error > 0) && (p_pid->i32_integral_x256 > i32_output_max_x256)) { p_pid->i32_integral_x256 = i32_output_max_x256; }
+    else if ((i16_error < 0) && (p_pid->i32_integral_x256 < i32_output_min_x256)) { p_pid->i32_integral_x256 = i32_output_min_x256; }
+
+    i32_output_x256 = i32_proportional_x256 + p_pid->i32_integral_x256 + i32_derivative_x256;
+  }
+
+  // limit output
+  if (i32_output_x256 > i32_output_max_x256) { i32_output_x256 = i32_output_max_x256; }
+  else if (i32_output_x256 < i32_output_min_x256) { i32_output_x256 = i32_output_min_x256; }
+
+  return (int16_t) (i32_output_x256 >> PID_GAIN_SHIFT);
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the PID controller
+
+  The integral is accumulated already multiplied by Ki so
+  gains can be changed while running without a step on the
+  output. It is not accumulated while the output is
+  saturated and the error would push it further into
+  saturation.
+
+  pid_init() preloads the integral with the initial output
+  minus the proportional term, so the first output is the
+  initial output. With a large initial error that preload
+  is outside the output range, so the integral is only
+  limited in the direction it integrates, otherwise the
+  first run would drop the feed forward.
+---------------------------------------------------------*/
@@ -0,0 +1,31 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _PID_H_
+#define _PID_H_
+
+#include <stdint.h>
+
+// gains are in Q8 format, 256 = 1.0
+#define PID_GAIN_SHIFT    8
+
+typedef struct _pid_controller
+{
+  uint16_t ui16_kp_x256;
+  uint16_t ui16_ki_x256;
+  uint16_t ui16_kd_x256;
+  int16_t i16_output_min;
+  int16_t i16_output_max;
+  int16_t i16_last_error;
+  int32_t i32_integral_x256;
+} struct_pid_controller;
+
+void pid_init (struct_pid_controller *p_pid, int16_t i16_error, int16_t i16_output_initial);
+int16_t pid_run (struct_pid_controller *p_pid, int16_t i16_error);
+
+#endif /* _PID_H_ */
@@ -0,0 +1,128 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "stm8s_tim3.h"
+#include "scheduler.h"
+
+
+static struct_scheduler_task *p_scheduler_tasks;
+static uint8_t ui8_scheduler_number_of_tasks = 0;
+
+
+
+void scheduler_init (struct_scheduler_task *p_tasks, uint8_t ui8_number_of_tasks)
+{
+  uint8_t ui8_i;
+  uint16_t ui16_now = TIM3_GetCounter();
+
+  p_scheduler_tasks = p_tasks;
+  ui8_scheduler_number_of_tasks = ui8_number_of_tasks;
+
+  // release all tasks now and reset statistics
+  for (ui8_i = 0; ui8_i < ui8_number_of_tasks; ui8_i++)
+  {
+    p_tasks[ui8_i].ui16_release = ui16_now;
+    p_tasks[ui8_i].ui16_run_counter = 0;
+    p_tasks[ui8_i].ui8_late_counter = 0;
+    p_tasks[ui8_i].ui8_max_overrun = 0;
+  }
+}
+
+
+
+void scheduler_clock (void)
+{
+  struct_scheduler_task *p_task = 0;
+  uint8_t ui8_i;
+  uint16_t ui16_now = TIM3_GetCounter();
+  uint16_t ui16_lateness;
+  uint16_t ui16_execution_time;
+
+  // find the released task with the highest priority, on equal priority the one released first
+  for (ui8_i = 0; ui8_i < ui8_scheduler_number_of_tasks; ui8_i++)
+  {
+    struct_scheduler_task *p_candidate = &p_scheduler_tasks[ui8_i];
+
+    // check if released, time difference is signed so the counter can overflow
+    if ((int16_t) (ui16_now - p_candidate->ui16_release) >= 0)
+    {
+      if ((!p_task) ||
+          (p_candidate->ui8_priority < p_task->ui8_priority) ||
+          ((p_candidate->ui8_priority == p_task->ui8_priority) && ((int16_t) (p_candidate->ui16_release - p_task->ui16_release) < 0)))
+      {
+        p_task = p_candidate;
+      }
+    }
+  }
+
+  // nothing to do, wait for the next interrupt (PWM interrupt happens every 64 us)
+  if (!p_task)
+  {
+    wfi();
+    return;
+  }
+
+  // check if task is late, threshold is relative to the period so a slow task is not late because a fast one ran first
+  ui16_lateness = ui16_now - p_task->ui16_release;
+  if ((ui16_lateness > (p_task->ui8_period >> SCHEDULER_LATE_THRESHOLD_SHIFT)) && (p_task->ui8_late_counter < 255)) { ++p_task->ui8_late_counter; }
+
+  // set next release time, skip missed releases so a late task does not run several times in a row
+  if (ui16_lateness >= p_task->ui8_period) { p_task->ui16_release = ui16_now + p_task->ui8_period; }
+  else { p_task->ui16_release += p_task->ui8_period; }
+
+  // run task
+  p_task->p_task();
+  ++p_task->ui16_run_counter;
+
+  // decay late counter so it shows recent late runs instead of saturating
+  if ((p_task->ui16_run_counter % SCHEDULER_LATE_WINDOW) == 0) { p_task->ui8_late_counter >>= 1; }
+
+  // check execution time against budget
+  ui16_execution_time = TIM3_GetCounter() - ui16_now;
+
+  if (ui16_execution_time > p_task->ui8_budget)
+  {
+    ui16_execution_time -= p_task->ui8_budget;
+
+    if (ui16_execution_time > 255) { ui16_execution_time = 255; }
+    if (ui16_execution_time > p_task->ui8_max_overrun) { p_task->ui8_max_overrun = ui16_execution_time; }
+  }
+}
+
+
+
+struct_scheduler_task* scheduler_get_task (uint8_t ui8_task)
+{
+  return &p_scheduler_tasks[ui8_task];
+}
+
+
+
+uint8_t scheduler_get_number_of_tasks (void)
+{
+  return ui8_scheduler_number_of_tasks;
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the scheduler
+
+  Tasks are cooperative, a task that takes long delays
+  all other tasks. The late counter and max overrun of
+  each task show when that happens. A task is only late
+  when its start is delayed by a part of its period, a
+  delay of one tick is normal for the slower tasks when a
+  faster task is released at the same time. The late
+  counter decays so it shows how often a task is late
+  now, not since power on.
+
+  Periods and budgets are in TIM3 ticks of 1.024 ms.
+---------------------------------------------------------*/
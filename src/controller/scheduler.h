@@ -0,0 +1,37 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdint.h>
+
+// a task is late if it starts more than 1 / 2^SCHEDULER_LATE_THRESHOLD_SHIFT of its period after its release time
+#define SCHEDULER_LATE_THRESHOLD_SHIFT    2
+
+// late counter is halved every SCHEDULER_LATE_WINDOW runs, so it counts about the late runs of the last 2 * SCHEDULER_LATE_WINDOW runs
+#define SCHEDULER_LATE_WINDOW             128
+
+typedef struct _scheduler_task
+{
+  void (*p_task) (void);
+  uint8_t ui8_priority;           // 0 is the highest priority
+  uint8_t ui8_period;             // in TIM3 ticks (~1 ms)
+  uint8_t ui8_budget;             // max expected execution time in TIM3 ticks (~1 ms)
+  uint16_t ui16_release;          // next release time
+  uint16_t ui16_run_counter;
+  uint8_t ui8_late_counter;       // late runs of about the last 256 runs
+  uint8_t ui8_max_overrun;        // max execution time over budget in TIM3 ticks (~1 ms), saturates at 255
+} struct_scheduler_task;
+
+void scheduler_init (struct_scheduler_task *p_tasks, uint8_t ui8_number_of_tasks);
+void scheduler_clock (void);
+struct_scheduler_task* scheduler_get_task (uint8_t ui8_task);
+uint8_t scheduler_get_number_of_tasks (void);
+
+#endif /* _SCHEDULER_H_ */
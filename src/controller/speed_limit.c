@@ -0,0 +1,69 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "common.h"
+#include "speed_limit.h"
+
+
+
+// happens on every new wheel speed sensor measurement after the first one, returns the filtered wheel acceleration in 0.1 km/h per second
+int16_t speed_limit_calc_acceleration (int16_t i16_wheel_acceleration_x10, uint16_t ui16_wheel_speed_x10, uint16_t ui16_wheel_speed_x10_old,
+                                       uint16_t ui16_wheel_speed_sensor_ticks, uint16_t ui16_wheel_speed_sensor_ticks_old)
+{
+  int32_t i32_wheel_acceleration_x10;
+  
+  // speed difference over the time between the middle of the two measured wheel rotations
+  i32_wheel_acceleration_x10 = (((int32_t) ui16_wheel_speed_x10 - (int32_t) ui16_wheel_speed_x10_old) * ((int32_t) PWM_CYCLES_SECOND * 2)) /
+                               ((int32_t) ui16_wheel_speed_sensor_ticks_old + (int32_t) ui16_wheel_speed_sensor_ticks);
+  
+  // limit acceleration
+  if (i32_wheel_acceleration_x10 > SPEED_LIMIT_ACCELERATION_X10_MAX) { i32_wheel_acceleration_x10 = SPEED_LIMIT_ACCELERATION_X10_MAX; }
+  else if (i32_wheel_acceleration_x10 < -SPEED_LIMIT_ACCELERATION_X10_MAX) { i32_wheel_acceleration_x10 = -SPEED_LIMIT_ACCELERATION_X10_MAX; }
+  
+  // low pass filter acceleration
+  return (i16_wheel_acceleration_x10 + (int16_t) i32_wheel_acceleration_x10) / 2;
+}
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS, returns the current limited by the speed limit in km/h, 0 is no limit
+uint8_t speed_limit_apply (uint8_t ui8_adc_battery_current, uint16_t ui16_wheel_speed_x10, int16_t i16_wheel_acceleration_x10, uint8_t ui8_wheel_speed_max)
+{
+  int32_t i32_wheel_speed_predicted_x10;
+  
+  if (!ui8_wheel_speed_max) { return ui8_adc_battery_current; }
+  
+  // predict wheel speed from wheel acceleration
+  i32_wheel_speed_predicted_x10 = (int32_t) ui16_wheel_speed_x10 + (((int32_t) i16_wheel_acceleration_x10 * SPEED_LIMIT_LOOKAHEAD_MS) / 1000);
+  
+  if (i32_wheel_speed_predicted_x10 < 0) { i32_wheel_speed_predicted_x10 = 0; }
+  
+  // current is reduced linearly to 0 over the taper, map() rounds up so the reduction is the full current at the end of the taper
+  return ui8_adc_battery_current - (uint8_t) map(i32_wheel_speed_predicted_x10,
+                                                 ((uint16_t) ui8_wheel_speed_max * 10) - SPEED_LIMIT_TAPER_BELOW_X10,
+                                                 ((uint16_t) ui8_wheel_speed_max * 10) + SPEED_LIMIT_TAPER_ABOVE_X10,
+                                                 0,
+                                                 ui8_adc_battery_current);
+}
+
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the speed limit
+
+  Current is reduced depending on the wheel speed predicted
+  SPEED_LIMIT_LOOKAHEAD_MS ahead from the wheel acceleration,
+  so it is already reduced when the speed limit is about to
+  be crossed instead of after it was crossed. When speed
+  drops after reducing current the predicted speed is lower
+  than the measured speed, this damps oscillation around the
+  speed limit.
+---------------------------------------------------------*/
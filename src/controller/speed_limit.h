@@ -0,0 +1,24 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _SPEED_LIMIT_H_
+#define _SPEED_LIMIT_H_
+
+#include <stdint.h>
+#include "main.h"
+
+#define SPEED_LIMIT_LOOKAHEAD_MS          1000  // time to reduce motor current, about one wheel rotation plus current ramp down
+#define SPEED_LIMIT_TAPER_BELOW_X10       15    // start reducing current 1.5 km/h below the speed limit
+#define SPEED_LIMIT_TAPER_ABOVE_X10       5     // no current 0.5 km/h above the speed limit
+#define SPEED_LIMIT_ACCELERATION_X10_MAX  100   // 10 km/h per second
+
+int16_t speed_limit_calc_acceleration (int16_t i16_wheel_acceleration_x10, uint16_t ui16_wheel_speed_x10, uint16_t ui16_wheel_speed_x10_old,
+                                       uint16_t ui16_wheel_speed_sensor_ticks, uint16_t ui16_wheel_speed_sensor_ticks_old);
+uint8_t speed_limit_apply (uint8_t ui8_adc_battery_current, uint16_t ui16_wheel_speed_x10, int16_t i16_wheel_acceleration_x10, uint8_t ui8_wheel_speed_max);
+
+#endif /* _SPEED_LIMIT_H_ */
@@ -0,0 +1,127 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "main.h"
+#include "common.h"
+#include "motor.h"
+#include "brake.h"
+#include "throttle.h"
+
+
+// throttle custom response curve, throttle values at 0, 32, 64 ... 256
+static const uint8_t ui8_throttle_curve_lut[9] = { 0, 8, 20, 36, 58, 86, 122, 172, 255 };
+
+static uint8_t ui8_throttle = 0;
+static uint8_t ui8_throttle_adc_old = 0;
+static uint8_t ui8_throttle_adc_battery_current_assist = 0;
+static uint8_t ui8_throttle_adc_battery_current_max = 0;
+
+
+
+static uint8_t throttle_apply_curve (uint8_t ui8_value)
+{
+  uint8_t ui8_index;
+  uint8_t ui8_fraction;
+  
+  switch (THROTTLE_RESPONSE_CURVE)
+  {
+    case THROTTLE_CURVE_PROGRESSIVE:
+    
+      // quadratic curve, finer control at low throttle
+      return ((uint16_t) ui8_value * ui8_value) / 255;
+    
+    case THROTTLE_CURVE_LUT:
+    
+      // interpolate between the two nearest points of the custom curve
+      ui8_index = ui8_value >> 5;
+      ui8_fraction = ui8_value & 31;
+      
+      return ui8_throttle_curve_lut[ui8_index] + ((((uint16_t) ui8_throttle_curve_lut[ui8_index + 1] - ui8_throttle_curve_lut[ui8_index]) * ui8_fraction) >> 5);
+    
+    default:
+    
+      return ui8_value;
+  }
+}
+
+
+
+// happens every MOTOR_CONTROLLER_PERIOD_MS with the throttle ADC value
+void throttle_controller (uint8_t ui8_adc_throttle)
+{
+  // deadband: ignore ADC changes smaller than the deadband so ADC noise does not move the motor current
+  if ((ui8_adc_throttle > (uint8_t) (ui8_throttle_adc_old + THROTTLE_DEADBAND)) ||
+      ((uint8_t) (ui8_adc_throttle + THROTTLE_DEADBAND) < ui8_throttle_adc_old) ||
+      (ui8_adc_throttle <= ADC_THROTTLE_MIN_VALUE) ||
+      (ui8_adc_throttle >= ADC_THROTTLE_MAX_VALUE))
+  {
+    ui8_throttle_adc_old = ui8_adc_throttle;
+    
+    // map value from 0 to 255, no throttle in the deadband over the min value
+    ui8_throttle = map((uint8_t) ui8_adc_throttle,
+                       (uint8_t) (ADC_THROTTLE_MIN_VALUE + THROTTLE_DEADBAND),
+                       (uint8_t) ADC_THROTTLE_MAX_VALUE,
+                       (uint8_t) 0,
+                       (uint8_t) 255);
+    
+    ui8_throttle = throttle_apply_curve(ui8_throttle);
+  }
+  
+  // throttle is only allowed to drive the motor when the app set a max current, the brake interrupts can cut power between app runs
+  if ((!ui8_throttle_adc_battery_current_max) || (ui8_g_brake_latched)) { return; }
+  
+  // set target battery current and duty cycle in controller
+  ui8_controller_adc_battery_current_target = throttle_get_adc_battery_current_target();
+  if (ui8_throttle) { ui8_controller_duty_cycle_target = PWM_DUTY_CYCLE_MAX; }
+}
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS, max current is 0 when throttle must not drive the motor
+void throttle_set_adc_battery_current (uint8_t ui8_adc_battery_current_assist, uint8_t ui8_adc_battery_current_max)
+{
+  ui8_throttle_adc_battery_current_assist = ui8_adc_battery_current_assist;
+  ui8_throttle_adc_battery_current_max = ui8_adc_battery_current_max;
+}
+
+
+
+// throttle value from 0 to 255 after deadband and response curve
+uint8_t throttle_get_value (void)
+{
+  return ui8_throttle;
+}
+
+
+
+// throttle current target, never lower than the assist current target
+uint8_t throttle_get_adc_battery_current_target (void)
+{
+  uint8_t ui8_adc_battery_current_target = ((uint16_t) ui8_throttle * ui8_throttle_adc_battery_current_max) / 255;
+  
+  if (ui8_adc_battery_current_target > ui8_throttle_adc_battery_current_assist) { return ui8_adc_battery_current_target; }
+  else { return ui8_throttle_adc_battery_current_assist; }
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the throttle
+
+  Throttle is sampled every MOTOR_CONTROLLER_PERIOD_MS and
+  sets the motor controller current target directly, so it
+  responds without waiting for the next app run.
+
+  The app sets the max throttle current every run with the
+  same limits as the assist current (thermal, speed limit,
+  gear shift dip) and sets it to 0 when the motor is
+  disabled, on brakes or on errors. The assist current is
+  set too so throttle never lowers the assist current.
+---------------------------------------------------------*/
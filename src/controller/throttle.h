@@ -0,0 +1,20 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _THROTTLE_H_
+#define _THROTTLE_H_
+
+#include <stdint.h>
+#include "main.h"
+
+void throttle_controller (uint8_t ui8_adc_throttle);
+void throttle_set_adc_battery_current (uint8_t ui8_adc_battery_current_assist, uint8_t ui8_adc_battery_current_max);
+uint8_t throttle_get_value (void);
+uint8_t throttle_get_adc_battery_current_target (void);
+
+#endif /* _THROTTLE_H_ */
@@ -13,8 +13,6 @@
 // Pulse signal: period of 20us, Ton = 2us, Toff = 18us
 void timer2_init (void)
 {
-  uint16_t ui16_i;
-
   // Timer2 clock = 16MHz; target: 20us period --> 50khz
   // counter period = (1 / (16000000 / prescaler)) * (159 + 1) = 20us
   TIM2_TimeBaseInit(TIM2_PRESCALER_2, 159);
@@ -25,21 +23,20 @@ void timer2_init (void)
 
   TIM2_ARRPreloadConfig(ENABLE);
 
-  TIM2_Cmd(ENABLE);
+  // load prescaler now, it would only be loaded on the next update event
+  TIM2_PrescalerConfig(TIM2_PRESCALER_2, TIM2_PSCRELOADMODE_IMMEDIATE);
 
-  // IMPORTANT: this software delay is needed so timer2 work after this
-  for(ui16_i = 0; ui16_i < (65000); ui16_i++) { ; }
+  TIM2_Cmd(ENABLE);
 }
 
 void timer3_init (void)
 {
-  uint16_t ui16_i;
-
   // TIM3 Peripheral Configuration
   TIM3_DeInit();
   TIM3_TimeBaseInit(TIM3_PRESCALER_16384, 0xffff); // each incremment at every ~1ms
+  
+  // load prescaler now, it would only be loaded on the next update event after the counter overflows at 16 MHz
+  TIM3_PrescalerConfig(TIM3_PRESCALER_16384, TIM3_PSCRELOADMODE_IMMEDIATE);
+  
   TIM3_Cmd(ENABLE); // TIM3 counter enable
-
-  // IMPORTANT: this software delay is needed so timer3 work after this
-  for(ui16_i = 0; ui16_i < (65000); ui16_i++) { ; }
 }
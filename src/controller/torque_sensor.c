@@ -9,9 +9,252 @@
 #include "stm8s.h"
 #include "stm8s_gpio.h"
 #include "pins.h"
+#include "motor.h"
+#include "adc.h"
+#include "ebike_app.h"
 #include "torque_sensor.h"
 
+
+static uint16_t ui16_torque_sensor_adc_mean = 0;
+static uint16_t ui16_torque_sensor_adc_half_stroke_peak = 0;
+static uint16_t ui16_torque_sensor_adc_half_stroke = 0;
+static uint16_t ui16_torque_sensor_adc = 0;
+static uint16_t ui16_torque_sensor_adc_revolution_min = 0;
+static uint16_t ui16_torque_sensor_adc_revolution_max = 0;
+static uint8_t ui8_torque_sensor_revolution_samples = 0;
+
+// torque sensor offset tracking
+static uint16_t ui16_torque_sensor_offset_reference;
+static uint16_t ui16_torque_sensor_offset_adc_min;
+static uint16_t ui16_torque_sensor_offset_adc_max;
+static uint8_t ui8_torque_sensor_offset_stable_counter = 0;
+static uint8_t ui8_torque_sensor_offset_up_counter = 0;
+
+
+
 void torque_sensor_init (void)
 {
   GPIO_Init(TORQUE_SENSOR_EXCITATION__PORT, TORQUE_SENSOR_EXCITATION__PIN, GPIO_MODE_OUT_OD_HIZ_FAST);
-}
\ No newline at end of file
+}
+
+
+
+uint8_t torque_sensor_calc (void)
+{
+  #define TORQUE_SENSOR_HALF_STROKE_MEAN_PER_PEAK_X256    163   // mean of a half sine wave is 2 / pi of its peak
+
+  uint16_t ui16_samples[TORQUE_SENSOR_SAMPLES_PER_REVOLUTION];
+  uint8_t ui8_samples_number;
+  uint8_t ui8_index;
+  uint8_t ui8_i;
+  uint16_t ui16_sample;
+  uint16_t ui16_sum = 0;
+
+  // copy the samples, the PWM interrupt must not add a sample while they are read
+  disableInterrupts();
+  ui8_samples_number = ui8_torque_sensor_samples_number;
+  ui8_index = ui8_torque_sensor_sample_index;
+  for (ui8_i = 0; ui8_i < TORQUE_SENSOR_SAMPLES_PER_REVOLUTION; ui8_i++) { ui16_samples[ui8_i] = ui16_torque_sensor_samples[ui8_i]; }
+  enableInterrupts();
+
+  // no samples, pedals are not rotating
+  ui8_torque_sensor_revolution_samples = ui8_samples_number;
+  if (!ui8_samples_number) { return 0; }
+
+  ui16_torque_sensor_adc_half_stroke_peak = 0;
+  ui16_torque_sensor_adc_revolution_min = 0xFFFF;
+  ui16_torque_sensor_adc_revolution_max = 0;
+
+  // go back from the newest sample, sum the last revolution and find the peak of the last half revolution
+  for (ui8_i = 0; ui8_i < ui8_samples_number; ui8_i++)
+  {
+    if (ui8_index) { --ui8_index; }
+    else { ui8_index = TORQUE_SENSOR_SAMPLES_PER_REVOLUTION - 1; }
+
+    ui16_sample = ui16_samples[ui8_index];
+    ui16_sum += ui16_sample;
+
+    if (ui16_sample < ui16_torque_sensor_adc_revolution_min) { ui16_torque_sensor_adc_revolution_min = ui16_sample; }
+    if (ui16_sample > ui16_torque_sensor_adc_revolution_max) { ui16_torque_sensor_adc_revolution_max = ui16_sample; }
+
+    if ((ui8_i < TORQUE_SENSOR_SAMPLES_PER_HALF_STROKE) && (ui16_sample > ui16_torque_sensor_adc_half_stroke_peak))
+    {
+      ui16_torque_sensor_adc_half_stroke_peak = ui16_sample;
+    }
+  }
+
+  // mean over the last revolution, or over the samples available when pedaling just started
+  ui16_torque_sensor_adc_mean = (ui16_sum + (ui8_samples_number >> 1)) / ui8_samples_number;
+
+  // mean of the last half stroke estimated from its peak, only the part above the offset has the half sine wave shape
+  ui16_torque_sensor_adc_half_stroke = ui16_torque_sensor_adc_half_stroke_peak;
+
+  if (ui16_torque_sensor_adc_half_stroke > ui16_adc_pedal_torque_offset)
+  {
+    ui16_torque_sensor_adc_half_stroke = ui16_adc_pedal_torque_offset + (((uint32_t) (ui16_torque_sensor_adc_half_stroke - ui16_adc_pedal_torque_offset) * TORQUE_SENSOR_HALF_STROKE_MEAN_PER_PEAK_X256) >> 8);
+  }
+
+  // use the last half stroke when the rider pushes harder so assist goes up within half a revolution, else the revolution mean
+  if (ui16_torque_sensor_adc_half_stroke > ui16_torque_sensor_adc_mean) { ui16_torque_sensor_adc = ui16_torque_sensor_adc_half_stroke; }
+  else { ui16_torque_sensor_adc = ui16_torque_sensor_adc_mean; }
+
+  return 1;
+}
+
+
+
+uint16_t torque_sensor_get_adc (void)
+{
+  return ui16_torque_sensor_adc;
+}
+
+
+
+// mean of the last half stroke only, follows the rider easing off within half a revolution
+uint16_t torque_sensor_get_adc_half_stroke (void)
+{
+  return ui16_torque_sensor_adc_half_stroke;
+}
+
+
+
+void torque_sensor_offset_init (void)
+{
+  struct_configuration_variables *p_configuration_variables = get_configuration_variables();
+  uint16_t ui16_saved_offset = p_configuration_variables->ui16_adc_pedal_torque_offset;
+
+  // use the saved offset if valid, unless the offset measured at power on is lower as pedal load can only make it higher
+  if ((ui16_saved_offset >= ADC_TORQUE_SENSOR_OFFSET_MIN) &&
+      (ui16_saved_offset <= ADC_TORQUE_SENSOR_OFFSET_MAX) &&
+      (ui16_saved_offset < ui16_adc_pedal_torque_offset))
+  {
+    ui16_adc_pedal_torque_offset = ui16_saved_offset;
+  }
+
+  // offset tracking is limited around this offset
+  ui16_torque_sensor_offset_reference = ui16_adc_pedal_torque_offset;
+}
+
+
+
+void torque_sensor_offset_track (uint16_t ui16_adc_torque, uint8_t ui8_pedal_cadence_RPM)
+{
+  #define TORQUE_SENSOR_OFFSET_STABLE_TIME          50    // 50 -> 1 second at 20 ms
+  #define TORQUE_SENSOR_OFFSET_STABLE_ADC_RANGE     2     // max torque sensor ADC variation to consider the pedals unloaded when not pedaling
+  #define TORQUE_SENSOR_OFFSET_UNLOADED_ADC_RANGE   3     // max torque sensor ADC variation over a pedal revolution to consider the pedals unloaded
+  #define TORQUE_SENSOR_OFFSET_TRACKING_RANGE       30    // max offset change from the offset at power on
+  #define TORQUE_SENSOR_OFFSET_UP_TIME              10    // 10 -> offset goes up 1 ADC step every 10 unloaded seconds, down 1 ADC step every stable second
+
+  uint16_t ui16_target_offset;
+  uint8_t ui8_up_allowed;
+
+  if (ui8_pedal_cadence_RPM)
+  {
+    // pedals rotate: unloaded only if the last full revolution was flat, a loaded pedal gives a stroke every half revolution
+    if ((ui8_torque_sensor_revolution_samples < TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) ||
+        ((ui16_torque_sensor_adc_revolution_max - ui16_torque_sensor_adc_revolution_min) > TORQUE_SENSOR_OFFSET_UNLOADED_ADC_RANGE))
+    {
+      ui8_torque_sensor_offset_stable_counter = 0;
+      return;
+    }
+
+    ui16_torque_sensor_offset_adc_min = ui16_torque_sensor_adc_revolution_min;
+    ui16_torque_sensor_offset_adc_max = ui16_torque_sensor_adc_revolution_max;
+    ui8_up_allowed = 1;
+  }
+  else
+  {
+    // pedals stopped: check if torque sensor value is stable
+    if (!ui8_torque_sensor_offset_stable_counter)
+    {
+      ui16_torque_sensor_offset_adc_min = ui16_adc_torque;
+      ui16_torque_sensor_offset_adc_max = ui16_adc_torque;
+    }
+    else
+    {
+      if (ui16_adc_torque < ui16_torque_sensor_offset_adc_min) { ui16_torque_sensor_offset_adc_min = ui16_adc_torque; }
+      if (ui16_adc_torque > ui16_torque_sensor_offset_adc_max) { ui16_torque_sensor_offset_adc_max = ui16_adc_torque; }
+
+      if ((ui16_torque_sensor_offset_adc_max - ui16_torque_sensor_offset_adc_min) > TORQUE_SENSOR_OFFSET_STABLE_ADC_RANGE)
+      {
+        // not stable, start again from this value
+        ui16_torque_sensor_offset_adc_min = ui16_adc_torque;
+        ui16_torque_sensor_offset_adc_max = ui16_adc_torque;
+        ui8_torque_sensor_offset_stable_counter = 0;
+      }
+    }
+
+    // a foot resting on a stopped pedal is also stable and can only make the value higher, so only go down
+    ui8_up_allowed = 0;
+  }
+
+  if (++ui8_torque_sensor_offset_stable_counter < TORQUE_SENSOR_OFFSET_STABLE_TIME) { return; }
+
+  ui8_torque_sensor_offset_stable_counter = 0;
+
+  // unloaded value is the new zero, add the same calibration offset as the power on calibration
+  ui16_target_offset = ((ui16_torque_sensor_offset_adc_min + ui16_torque_sensor_offset_adc_max + 1) >> 1) + ADC_TORQUE_SENSOR_CALIBRATION_OFFSET;
+
+  // rate limited move to the target offset, held at the limits of the tracking range
+  if (ui16_target_offset < ui16_adc_pedal_torque_offset)
+  {
+    ui8_torque_sensor_offset_up_counter = 0;
+
+    if ((int16_t) ui16_adc_pedal_torque_offset > ((int16_t) ui16_torque_sensor_offset_reference - TORQUE_SENSOR_OFFSET_TRACKING_RANGE)) { --ui16_adc_pedal_torque_offset; }
+  }
+  else if ((ui16_target_offset > ui16_adc_pedal_torque_offset) && ui8_up_allowed)
+  {
+    if (++ui8_torque_sensor_offset_up_counter >= TORQUE_SENSOR_OFFSET_UP_TIME)
+    {
+      ui8_torque_sensor_offset_up_counter = 0;
+
+      if (ui16_adc_pedal_torque_offset < (ui16_torque_sensor_offset_reference + TORQUE_SENSOR_OFFSET_TRACKING_RANGE)) { ++ui16_adc_pedal_torque_offset; }
+    }
+  }
+  else if (ui16_target_offset == ui16_adc_pedal_torque_offset)
+  {
+    ui8_torque_sensor_offset_up_counter = 0;
+  }
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the torque sensor offset tracking
+
+  The offset is tracked only when the pedals are unloaded
+  for 1 second. When pedaling that is when the torque
+  sensor value over each pedal revolution is flat, as a
+  loaded pedal gives a stroke every half revolution. When
+  not pedaling it is when the value is stable, but a foot
+  resting on a stopped pedal is also stable, so then the
+  offset only goes down as load can only make the value
+  higher. The offset goes down fast and up slow, and it is
+  held at the limits of the tracking range around the
+  offset at power on.
+---------------------------------------------------------*/
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding the torque sensor samples
+
+  Pedal torque goes from near zero to the peak twice per
+  crank revolution so a single sample depends on where the
+  cranks are. The torque sensor is sampled by the PWM
+  interrupt at every cadence sensor LOW to HIGH transition,
+  which happens at fixed crank angles, and the mean of the
+  last revolution is the same at any crank angle.
+
+  The revolution mean lags up to a revolution, so when the
+  rider pushes harder the mean of the last half revolution
+  is used instead. It is estimated from the peak of that
+  half revolution, which always holds one pedal stroke.
+  When the rider pushes less the revolution mean is used,
+  so assist goes up fast and down smooth. The half stroke
+  value alone is used by the gear shift detection, that
+  needs to see the rider easing off within half a
+  revolution.
+
+  The sum of 20 samples of 10 bits fits in 16 bits.
+---------------------------------------------------------*/
@@ -12,6 +12,15 @@
 #include "main.h"
 #include "stm8s_gpio.h"
 
+// torque sensor is sampled at every cadence sensor LOW to HIGH transition
+#define TORQUE_SENSOR_SAMPLES_PER_REVOLUTION      CADENCE_SENSOR_NUMBER_MAGNETS
+#define TORQUE_SENSOR_SAMPLES_PER_HALF_STROKE     (TORQUE_SENSOR_SAMPLES_PER_REVOLUTION / 2)
+
 void torque_sensor_init (void);
+uint8_t torque_sensor_calc (void);
+uint16_t torque_sensor_get_adc (void);
+uint16_t torque_sensor_get_adc_half_stroke (void);
+void torque_sensor_offset_init (void);
+void torque_sensor_offset_track (uint16_t ui16_adc_torque, uint8_t ui8_pedal_cadence_RPM);
 
 #endif /* _TORQUE_SENSOR_H_ */
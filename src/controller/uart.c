@@ -12,6 +12,14 @@
 #include "stm8s.h"
 #include "stm8s_uart2.h"
 #include "main.h"
+#include "interrupts.h"
+#include "uart.h"
+
+// transmit ring buffer, bytes are written by uart_send_frame() and sent by the transmit interrupt
+static volatile uint8_t ui8_uart_tx_buffer[UART_TX_BUFFER_SIZE];
+static volatile uint8_t ui8_uart_tx_head = 0;
+static volatile uint8_t ui8_uart_tx_tail = 0;
+
 
 void uart2_init (void)
 {
@@ -30,6 +38,48 @@ void uart2_init (void)
   UART2_ITConfig(UART2_IT_RXNE_OR, ENABLE);
 }
 
+
+// This is the interrupt that happens when UART2 is ready to send the next byte. It sends the bytes queued in the
+// transmit ring buffer and disables itself when the buffer is empty, so the main loop never waits on UART2
+void UART2_TX_IRQHandler(void) __interrupt(UART2_TX_IRQHANDLER)
+{
+  if (ui8_uart_tx_tail != ui8_uart_tx_head)
+  {
+    UART2->DR = ui8_uart_tx_buffer[ui8_uart_tx_tail];
+    ui8_uart_tx_tail = (ui8_uart_tx_tail + 1) & (UART_TX_BUFFER_SIZE - 1);
+  }
+  else
+  {
+    // nothing more to send, disable transmit interrupt
+    UART2->CR2 &= (uint8_t) ~UART2_CR2_TIEN;
+  }
+}
+
+
+
+// queue a full frame for sending, returns 0 without queuing anything if there is no room for the full frame
+uint8_t uart_send_frame (const uint8_t *p_frame, uint8_t ui8_length)
+{
+  uint8_t ui8_head = ui8_uart_tx_head;
+  
+  // one byte is always kept free so a full buffer is not seen as empty
+  if (ui8_length > (uint8_t) ((ui8_uart_tx_tail - ui8_head - 1) & (UART_TX_BUFFER_SIZE - 1))) { return 0; }
+  
+  while (ui8_length--)
+  {
+    ui8_uart_tx_buffer[ui8_head] = *p_frame++;
+    ui8_head = (ui8_head + 1) & (UART_TX_BUFFER_SIZE - 1);
+  }
+  
+  ui8_uart_tx_head = ui8_head;
+  
+  // enable transmit interrupt, it happens right away when the transmit data register is empty
+  UART2->CR2 |= UART2_CR2_TIEN;
+  
+  return 1;
+}
+
+
 #if __SDCC_REVISION < 9624
 void putchar(char c)
 {
@@ -11,7 +11,11 @@
 
 #include "main.h"
 
+// size of the transmit ring buffer, must be a power of 2 and hold the largest frame
+#define UART_TX_BUFFER_SIZE   64
+
 void uart2_init (void);
+uint8_t uart_send_frame (const uint8_t *p_frame, uint8_t ui8_length);
 
 #if __SDCC_REVISION < 9624
 void putchar(char c);
@@ -0,0 +1,144 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "common.h"
+#include "pid.h"
+#include "walk_assist.h"
+
+
+static uint8_t ui8_walk_assist_PID_initialize = 1;
+static uint8_t ui8_walk_assist_adc_battery_current_target = 0;
+static uint16_t ui16_walk_assist_speed_target_x100 = 0;
+static uint16_t ui16_walk_assist_speed_per_erps_x1024 = 0;
+static struct_pid_controller walk_assist_PID;
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS
+uint16_t walk_assist_calc_speed (uint16_t ui16_wheel_speed_x10, uint8_t ui8_wheel_speed_new_measurement, uint16_t ui16_motor_speed_erps)
+{
+  uint32_t ui32_speed_per_erps_x1024;
+  
+  // learn wheel speed per motor speed on every new wheel speed sensor measurement, it depends on the gear
+  if (ui8_wheel_speed_new_measurement && ui16_motor_speed_erps)
+  {
+    ui32_speed_per_erps_x1024 = ((uint32_t) ui16_wheel_speed_x10 << 10) / ui16_motor_speed_erps;
+    
+    if (ui32_speed_per_erps_x1024 > WALK_ASSIST_SPEED_PER_ERPS_MAX_X1024) { ui32_speed_per_erps_x1024 = WALK_ASSIST_SPEED_PER_ERPS_MAX_X1024; }
+    
+    ui16_walk_assist_speed_per_erps_x1024 = (uint16_t) ui32_speed_per_erps_x1024;
+  }
+  
+  // wheel speed from motor speed, the wheel speed sensor gives one measurement per wheel rotation and that is too slow at walking speed
+  if (ui16_walk_assist_speed_per_erps_x1024)
+  {
+    return ((uint32_t) ui16_motor_speed_erps * ui16_walk_assist_speed_per_erps_x1024) >> 10;
+  }
+  else if (ui16_wheel_speed_x10)
+  {
+    return ui16_wheel_speed_x10;
+  }
+  else
+  {
+    return ((uint32_t) ui16_motor_speed_erps * WALK_ASSIST_SPEED_PER_ERPS_DEFAULT_X1024) >> 10;
+  }
+}
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS while walk assist is on, returns the battery current target
+uint8_t walk_assist_controller (uint8_t ui8_speed_target_x10, uint16_t ui16_speed_x10, uint8_t ui8_adc_battery_current_max)
+{
+  uint16_t ui16_speed_target_received_x100;
+  int16_t i16_error;
+  
+  // get the walk assist target speed, check so that it is not too fast
+  ui16_speed_target_received_x100 = (uint16_t) ui8_min(ui8_speed_target_x10, WALK_ASSIST_SPEED_TARGET_X10_MAX) * 10;
+  
+  // set gains and limit torque with the battery current
+  walk_assist_PID.ui16_kp_x256 = WALK_ASSIST_PID_KP_X256;
+  walk_assist_PID.ui16_ki_x256 = WALK_ASSIST_PID_KI_X256;
+  walk_assist_PID.ui16_kd_x256 = 0;
+  walk_assist_PID.i16_output_min = 0;
+  walk_assist_PID.i16_output_max = ui8_min(WALK_ASSIST_ADC_BATTERY_CURRENT_MAX, ui8_adc_battery_current_max);
+  
+  // initialize walk assist PID controller, start from the current speed and current
+  if (ui8_walk_assist_PID_initialize)
+  {
+    ui8_walk_assist_PID_initialize = 0;
+    
+    ui16_walk_assist_speed_target_x100 = ui16_speed_x10 * 10;
+    
+    pid_init(&walk_assist_PID, 0, ui8_walk_assist_adc_battery_current_target);
+  }
+  
+  // ramp target speed to the received target speed (smooth start)
+  if (ui16_walk_assist_speed_target_x100 + WALK_ASSIST_SPEED_RAMP_X100 < ui16_speed_target_received_x100) { ui16_walk_assist_speed_target_x100 += WALK_ASSIST_SPEED_RAMP_X100; }
+  else if (ui16_walk_assist_speed_target_x100 > ui16_speed_target_received_x100 + WALK_ASSIST_SPEED_RAMP_X100) { ui16_walk_assist_speed_target_x100 -= WALK_ASSIST_SPEED_RAMP_X100; }
+  else { ui16_walk_assist_speed_target_x100 = ui16_speed_target_received_x100; }
+  
+  // calculate error
+  i16_error = (int16_t) (ui16_walk_assist_speed_target_x100 / 10) - (int16_t) ui16_speed_x10;
+  
+  // calculate battery current target from speed error
+  ui8_walk_assist_adc_battery_current_target = pid_run(&walk_assist_PID, i16_error);
+  
+  return ui8_walk_assist_adc_battery_current_target;
+}
+
+
+
+// stop walk assist at once, it restarts from the current speed
+void walk_assist_reset (void)
+{
+  ui8_walk_assist_adc_battery_current_target = 0;
+  ui8_walk_assist_PID_initialize = 1;
+}
+
+
+
+// happens every EBIKE_APP_CONTROLLER_PERIOD_MS while walk assist is off, returns the battery current target
+uint8_t walk_assist_stop (void)
+{
+  ui8_walk_assist_PID_initialize = 1;
+  
+  // ramp down walk assist current (smooth stop)
+  if (ui8_walk_assist_adc_battery_current_target > WALK_ASSIST_STOP_ADC_BATTERY_CURRENT_STEP)
+  {
+    ui8_walk_assist_adc_battery_current_target -= WALK_ASSIST_STOP_ADC_BATTERY_CURRENT_STEP;
+  }
+  else
+  {
+    ui8_walk_assist_adc_battery_current_target = 0;
+    
+    // restart with the default ratio, the gear may change before walk assist is used again
+    ui16_walk_assist_speed_per_erps_x1024 = 0;
+  }
+  
+  return ui8_walk_assist_adc_battery_current_target;
+}
+
+
+
+/*---------------------------------------------------------
+  NOTE: regarding walk assist
+
+  Walk assist is a wheel speed controller. The target
+  speed of each walk assist level is received in 0.1 km/h
+  and a PI controller sets the battery current, so the
+  speed is held on slopes and the motor torque is limited
+  by the battery current.
+
+  Speed is calculated from the motor speed, scaled with
+  the last wheel speed sensor measurement, as the wheel
+  speed sensor is too slow at walking speed. The target
+  speed ramps up from the speed when walk assist starts
+  and the current ramps down when it is released.
+---------------------------------------------------------*/
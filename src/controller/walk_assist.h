@@ -0,0 +1,31 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _WALK_ASSIST_H_
+#define _WALK_ASSIST_H_
+
+#include <stdint.h>
+#include "main.h"
+
+#define WALK_ASSIST_ADC_BATTERY_CURRENT_MAX             80
+#define WALK_ASSIST_SPEED_TARGET_X10_MAX                60    // 6.0 km/h
+#define WALK_ASSIST_SPEED_RAMP_X100                     6     // target speed ramp per run, 6 * 50 / 100 = 3 km/h per second
+#define WALK_ASSIST_PID_KP_X256                         512   // 2 ADC steps of battery current per 0.1 km/h
+#define WALK_ASSIST_PID_KI_X256                         10    // per EBIKE_APP_CONTROLLER_PERIOD_MS
+#define WALK_ASSIST_STOP_ADC_BATTERY_CURRENT_STEP       8     // 8 ADC steps per run, about 200 ms from max walk assist current
+
+// wheel speed per motor speed, 0.1 km/h per ERPS x1024
+#define WALK_ASSIST_SPEED_PER_ERPS_DEFAULT_X1024        230   // about 1:1 gear ratio and 2100 mm wheel perimeter
+#define WALK_ASSIST_SPEED_PER_ERPS_MAX_X1024            2048  // 8 times the default, only a stale wheel speed at a very low motor speed gives more
+
+uint16_t walk_assist_calc_speed (uint16_t ui16_wheel_speed_x10, uint8_t ui8_wheel_speed_new_measurement, uint16_t ui16_motor_speed_erps);
+uint8_t walk_assist_controller (uint8_t ui8_speed_target_x10, uint16_t ui16_speed_x10, uint8_t ui8_adc_battery_current_max);
+void walk_assist_reset (void);
+uint8_t walk_assist_stop (void);
+
+#endif /* _WALK_ASSIST_H_ */
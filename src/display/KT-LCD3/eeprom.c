@@ -140,7 +140,18 @@ static const uint8_t ui8_default_array[EEPROM_BYTES_STORED] =
   DEFAULT_VALUE_LIGHTS_STATE,                                         // 122
   DEFAULT_VALUE_ASSIST_WITHOUT_PEDAL_ROTATION_THRESHOLD,              // 123
   DEFAULT_VALUE_LIGHTS_CONFIGURATION,                                 // 124
-  DEFAULT_VALUE_WALK_ASSIST_BUTTON_BOUNCE_TIME                        // 125
+  DEFAULT_VALUE_WALK_ASSIST_BUTTON_BOUNCE_TIME,                       // 125
+  DEFAULT_VALUE_ASSIST_MAP_FUNCTION_ENABLED,                          // 126
+  ASSIST_MAP_DEFAULT_VALUES,                                          // 127 to (126 + ASSIST_MAP_BYTES)
+  DEFAULT_VALUE_CRUISE_PID_KP_X10,                                    // 127 + ASSIST_MAP_BYTES
+  DEFAULT_VALUE_CRUISE_PID_KI_X100,                                   // 128 + ASSIST_MAP_BYTES
+  DEFAULT_VALUE_CRUISE_PID_KD_X10,                                    // 129 + ASSIST_MAP_BYTES
+  DEFAULT_VALUE_STARTUP_BOOST_FEATURE_ENABLED,                        // 130 + ASSIST_MAP_BYTES
+  DEFAULT_VALUE_STARTUP_BOOST_STATE,                                  // 131 + ASSIST_MAP_BYTES
+  DEFAULT_VALUE_STARTUP_BOOST_LIMIT_TO_MAX_POWER,                     // 132 + ASSIST_MAP_BYTES
+  DEFAULT_VALUE_STARTUP_BOOST_ASSIST_LEVEL,                           // 133 + ASSIST_MAP_BYTES
+  DEFAULT_VALUE_STARTUP_BOOST_TIME,                                   // 134 + ASSIST_MAP_BYTES
+  DEFAULT_VALUE_STARTUP_BOOST_FADE_TIME                               // 135 + ASSIST_MAP_BYTES
 };
 
 
@@ -454,6 +465,22 @@ void EEPROM_controller(uint8_t ui8_operation)
       // walk assist button bounce time
       p_configuration_variables->ui8_walk_assist_button_bounce_time = ui8_array[ADDRESS_WALK_ASSIST_BUTTON_BOUNCE_TIME];
       
+      // assist map
+      p_configuration_variables->ui8_assist_map_function_enabled = ui8_array[ADDRESS_ASSIST_MAP_FUNCTION_ENABLED];
+      for (ui8_i = 0; ui8_i < ASSIST_MAP_BYTES; ui8_i++) { p_configuration_variables->ui8_assist_map[ui8_i] = ui8_array[ADDRESS_ASSIST_MAP + ui8_i]; }
+      
+      // cruise PID gains
+      p_configuration_variables->ui8_cruise_PID_kp_x10 = ui8_array[ADDRESS_CRUISE_PID_KP_X10];
+      p_configuration_variables->ui8_cruise_PID_ki_x100 = ui8_array[ADDRESS_CRUISE_PID_KI_X100];
+      p_configuration_variables->ui8_cruise_PID_kd_x10 = ui8_array[ADDRESS_CRUISE_PID_KD_X10];
+      
+      p_configuration_variables->ui8_startup_motor_power_boost_feature_enabled = ui8_array[ADDRESS_STARTUP_BOOST_FEATURE_ENABLED];
+      p_configuration_variables->ui8_startup_motor_power_boost_state = ui8_array[ADDRESS_STARTUP_BOOST_STATE];
+      p_configuration_variables->ui8_startup_motor_power_boost_limit_to_max_power = ui8_array[ADDRESS_STARTUP_BOOST_LIMIT_TO_MAX_POWER];
+      p_configuration_variables->ui8_startup_motor_power_boost_assist_level = ui8_array[ADDRESS_STARTUP_BOOST_ASSIST_LEVEL];
+      p_configuration_variables->ui8_startup_motor_power_boost_time = ui8_array[ADDRESS_STARTUP_BOOST_TIME];
+      p_configuration_variables->ui8_startup_motor_power_boost_fade_time = ui8_array[ADDRESS_STARTUP_BOOST_FADE_TIME];
+      
     break;
     
     
@@ -637,6 +664,22 @@ void EEPROM_controller(uint8_t ui8_operation)
       // walk assist button bounce time
       ui8_array[ADDRESS_WALK_ASSIST_BUTTON_BOUNCE_TIME] = p_configuration_variables->ui8_walk_assist_button_bounce_time;
       
+      // assist map
+      ui8_array[ADDRESS_ASSIST_MAP_FUNCTION_ENABLED] = p_configuration_variables->ui8_assist_map_function_enabled;
+      for (ui8_i = 0; ui8_i < ASSIST_MAP_BYTES; ui8_i++) { ui8_array[ADDRESS_ASSIST_MAP + ui8_i] = p_configuration_variables->ui8_assist_map[ui8_i]; }
+      
+      // cruise PID gains
+      ui8_array[ADDRESS_CRUISE_PID_KP_X10] = p_configuration_variables->ui8_cruise_PID_kp_x10;
+      ui8_array[ADDRESS_CRUISE_PID_KI_X100] = p_configuration_variables->ui8_cruise_PID_ki_x100;
+      ui8_array[ADDRESS_CRUISE_PID_KD_X10] = p_configuration_variables->ui8_cruise_PID_kd_x10;
+      
+      ui8_array[ADDRESS_STARTUP_BOOST_FEATURE_ENABLED] = p_configuration_variables->ui8_startup_motor_power_boost_feature_enabled;
+      ui8_array[ADDRESS_STARTUP_BOOST_STATE] = p_configuration_variables->ui8_startup_motor_power_boost_state;
+      ui8_array[ADDRESS_STARTUP_BOOST_LIMIT_TO_MAX_POWER] = p_configuration_variables->ui8_startup_motor_power_boost_limit_to_max_power;
+      ui8_array[ADDRESS_STARTUP_BOOST_ASSIST_LEVEL] = p_configuration_variables->ui8_startup_motor_power_boost_assist_level;
+      ui8_array[ADDRESS_STARTUP_BOOST_TIME] = p_configuration_variables->ui8_startup_motor_power_boost_time;
+      ui8_array[ADDRESS_STARTUP_BOOST_FADE_TIME] = p_configuration_variables->ui8_startup_motor_power_boost_fade_time;
+      
       // write array of variables to EEPROM
       for (ui8_i = EEPROM_BYTES_STORED; ui8_i > 0; ui8_i--)
       {
@@ -139,10 +139,21 @@
 #define ADDRESS_ASSIST_WITHOUT_PEDAL_ROTATION_THRESHOLD                     123
 #define ADDRESS_LIGHTS_CONFIGURATION                                        124
 #define ADDRESS_WALK_ASSIST_BUTTON_BOUNCE_TIME                              125
-#define EEPROM_BYTES_STORED                                                 126
+#define ADDRESS_ASSIST_MAP_FUNCTION_ENABLED                                 126
+#define ADDRESS_ASSIST_MAP                                                  127
+#define ADDRESS_CRUISE_PID_KP_X10                                           (127 + ASSIST_MAP_BYTES)
+#define ADDRESS_CRUISE_PID_KI_X100                                          (128 + ASSIST_MAP_BYTES)
+#define ADDRESS_CRUISE_PID_KD_X10                                           (129 + ASSIST_MAP_BYTES)
+#define ADDRESS_STARTUP_BOOST_FEATURE_ENABLED                               (130 + ASSIST_MAP_BYTES)
+#define ADDRESS_STARTUP_BOOST_STATE                                         (131 + ASSIST_MAP_BYTES)
+#define ADDRESS_STARTUP_BOOST_LIMIT_TO_MAX_POWER                            (132 + ASSIST_MAP_BYTES)
+#define ADDRESS_STARTUP_BOOST_ASSIST_LEVEL                                  (133 + ASSIST_MAP_BYTES)
+#define ADDRESS_STARTUP_BOOST_TIME                                          (134 + ASSIST_MAP_BYTES)
+#define ADDRESS_STARTUP_BOOST_FADE_TIME                                     (135 + ASSIST_MAP_BYTES)
+#define EEPROM_BYTES_STORED                                                 (136 + ASSIST_MAP_BYTES)
 
 
-#define DEFAULT_VALUE_KEY     202
+#define DEFAULT_VALUE_KEY     206   // changed when the meaning of stored values changes, so they are set to default values
 #define SET_TO_DEFAULT        0
 #define READ_FROM_MEMORY      1
 #define WRITE_TO_MEMORY       2
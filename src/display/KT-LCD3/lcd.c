@@ -88,7 +88,7 @@ static uint16_t   ui16_pedal_weight_x100 = 0;
 static uint16_t   ui16_pedal_power_filtered_x10 = 0;
 static uint16_t   ui16_pedal_power_step_filtered = 0;
 static uint8_t    ui8_pedal_cadence_RPM_filtered = 0;
-static volatile uint32_t ui32_wh_sum_x10 = 0;
+static uint32_t   ui32_energy_sum_Ws = 0;
 static uint32_t   ui32_wh_x10 = 0;
 static uint8_t    ui8_config_wh_x10_offset;
 static uint16_t   ui16_battery_SOC_percentage;
@@ -154,6 +154,7 @@ void lcd_execute_menu_config_submenu_power_assist(void);
 void lcd_execute_menu_config_submenu_torque_assist(void);
 void lcd_execute_menu_config_submenu_cadence_assist(void);
 void lcd_execute_menu_config_submenu_eMTB_assist(void);
+void lcd_execute_menu_config_submenu_assist_map(void);
 void lcd_execute_menu_config_submenu_walk_assist(void);
 void lcd_execute_menu_config_submenu_cruise(void);
 void lcd_execute_menu_config_main_screen_setup(void);
@@ -223,22 +224,8 @@ void TIM3_UPD_OVF_BRK_IRQHandler(void) __interrupt(TIM3_UPD_OVF_BRK_IRQHANDLER)
 {
   ui16_timer3_counter++;
   
-  static uint8_t ui8_100ms_counter;
   static uint16_t ui16_second_counter;
   
-  // calculate watt-hours every 100 ms
-  if (++ui8_100ms_counter >= 100)
-  {
-    // reset counter
-    ui8_100ms_counter = 0;
-    
-    // measure consumed watt-hours
-    if (ui16_battery_power_filtered_x10 > 0)
-    {
-      ui32_wh_sum_x10 += ui16_battery_power_filtered_x10;
-    }
-  }
-  
   // increment second for time measurement 
   if (++ui16_second_counter >= 1000)
   {
@@ -337,7 +324,7 @@ void lcd_execute_main_screen (void)
 
 void lcd_execute_menu_config (void)
 {
-  #define MAX_NUMBER_OF_SUBMENUS    11
+  #define MAX_NUMBER_OF_SUBMENUS    13
   
   if (ui8_lcd_menu_config_submenu_active)
   {
@@ -391,6 +378,14 @@ void lcd_execute_menu_config (void)
         lcd_execute_menu_config_submenu_technical();
       break;
       
+      case 12:
+        lcd_execute_menu_config_submenu_assist_map();
+      break;
+      
+      case 13:
+        lcd_execute_menu_config_submenu_motor_startup_power_boost();
+      break;
+      
       default:
         ui8_lcd_menu_config_submenu_active = 0;
       break;
@@ -469,6 +464,10 @@ void lcd_execute_menu_config (void)
         case 11:
           lcd_enable_Model_3_symbol(1);
         break;
+        
+        case 13:
+          lcd_enable_motor_symbol(1);
+        break;
       }
     }
   
@@ -931,7 +930,7 @@ void lcd_execute_menu_config_submenu_battery(void)
       }
       
       // keep reseting these values
-      ui32_wh_sum_x10 = 0;
+      ui32_energy_sum_Ws = 0;
       ui32_wh_x10 = 0;
 
       lcd_var_number.p_var_number = &configuration_variables.ui32_wh_x10_offset;
@@ -1234,6 +1233,44 @@ void lcd_execute_menu_config_submenu_eMTB_assist(void)
 
 
 
+void lcd_execute_menu_config_submenu_assist_map(void)
+{
+  var_number_t lcd_var_number;
+  
+  if (ui8_lcd_menu_config_submenu_state == 0)
+  {
+    // enable assist map mode
+    lcd_var_number.p_var_number = &configuration_variables.ui8_assist_map_function_enabled;
+    lcd_var_number.ui32_max_value = 1;
+  }
+  else
+  {
+    // set assist map data: axis type, torque points, cadence or speed points and the target current for each point
+    lcd_var_number.p_var_number = &configuration_variables.ui8_assist_map[ui8_lcd_menu_config_submenu_state - 1];
+    
+    if (ui8_lcd_menu_config_submenu_state == (ASSIST_MAP_AXIS_TYPE_INDEX + 1)) { lcd_var_number.ui32_max_value = ASSIST_MAP_AXIS_WHEEL_SPEED; }
+    else { lcd_var_number.ui32_max_value = 255; }
+  }
+  
+  lcd_var_number.ui8_size = 8;
+  lcd_var_number.ui8_decimal_digit = 0;
+  lcd_var_number.ui32_min_value = 0;
+  lcd_var_number.ui32_increment_step = 1;
+  lcd_var_number.ui8_odometer_field = ODOMETER_FIELD;
+  lcd_configurations_print_number(&lcd_var_number);
+  
+  lcd_enable_assist_symbol(1);
+  
+  if (ui8_lcd_menu_flash_state || ui8_lcd_menu_config_submenu_change_variable_enabled)
+  {
+    lcd_print(ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 0);
+  }
+  
+  submenu_state_controller(ASSIST_MAP_BYTES);
+}
+
+
+
 void lcd_execute_menu_config_submenu_walk_assist(void)
 {
   var_number_t lcd_var_number;
@@ -1280,11 +1317,11 @@ void lcd_execute_menu_config_submenu_walk_assist(void)
   }
   else
   {
-    // value of each walk assist power value
+    // target speed of each walk assist level in 0.1 km/h
     lcd_var_number.p_var_number = &configuration_variables.ui8_walk_assist_level[(ui8_lcd_menu_config_submenu_state - 2)];
     lcd_var_number.ui8_size = 8;
-    lcd_var_number.ui8_decimal_digit = 0;
-    lcd_var_number.ui32_max_value = 100;
+    lcd_var_number.ui8_decimal_digit = 1;
+    lcd_var_number.ui32_max_value = 60;
     lcd_var_number.ui32_min_value = 0;
     lcd_var_number.ui32_increment_step = 1;
     lcd_var_number.ui8_odometer_field = ODOMETER_FIELD;
@@ -1388,6 +1425,48 @@ void lcd_execute_menu_config_submenu_cruise(void)
       lcd_configurations_print_number(&lcd_var_number);
       
     break;
+    
+    case 4:
+    
+      // cruise PID proportional gain, all gains set to 0 uses the default gains for the motor type
+      lcd_var_number.p_var_number = &configuration_variables.ui8_cruise_PID_kp_x10;
+      lcd_var_number.ui8_size = 8;
+      lcd_var_number.ui8_decimal_digit = 1;
+      lcd_var_number.ui32_max_value = 250;
+      lcd_var_number.ui32_min_value = 0;
+      lcd_var_number.ui32_increment_step = 1;
+      lcd_var_number.ui8_odometer_field = ODOMETER_FIELD;
+      lcd_configurations_print_number(&lcd_var_number);
+      
+    break;
+    
+    case 5:
+    
+      // cruise PID integral gain
+      lcd_var_number.p_var_number = &configuration_variables.ui8_cruise_PID_ki_x100;
+      lcd_var_number.ui8_size = 8;
+      lcd_var_number.ui8_decimal_digit = 0; // x100, shown without decimal point
+      lcd_var_number.ui32_max_value = 250;
+      lcd_var_number.ui32_min_value = 0;
+      lcd_var_number.ui32_increment_step = 1;
+      lcd_var_number.ui8_odometer_field = ODOMETER_FIELD;
+      lcd_configurations_print_number(&lcd_var_number);
+      
+    break;
+    
+    case 6:
+    
+      // cruise PID derivative gain
+      lcd_var_number.p_var_number = &configuration_variables.ui8_cruise_PID_kd_x10;
+      lcd_var_number.ui8_size = 8;
+      lcd_var_number.ui8_decimal_digit = 1;
+      lcd_var_number.ui32_max_value = 250;
+      lcd_var_number.ui32_min_value = 0;
+      lcd_var_number.ui32_increment_step = 1;
+      lcd_var_number.ui8_odometer_field = ODOMETER_FIELD;
+      lcd_configurations_print_number(&lcd_var_number);
+      
+    break;
   }
   
   lcd_enable_cruise_symbol(1);
@@ -1397,7 +1476,86 @@ void lcd_execute_menu_config_submenu_cruise(void)
     lcd_print(ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 0);
   }
   
-  submenu_state_controller(3);
+  submenu_state_controller(6);
+}
+
+
+
+void lcd_execute_menu_config_submenu_motor_startup_power_boost(void)
+{
+  var_number_t lcd_var_number;
+  
+  switch (ui8_lcd_menu_config_submenu_state)
+  {
+    case 0:
+      
+      // motor startup power boost enable/disable
+      lcd_var_number.p_var_number = &configuration_variables.ui8_startup_motor_power_boost_feature_enabled;
+      lcd_var_number.ui8_decimal_digit = 0;
+      lcd_var_number.ui32_max_value = 1;
+      
+    break;
+    
+    case 1:
+      
+      // boost again: 0 -> after wheel stops, 1 -> after pedaling stops
+      lcd_var_number.p_var_number = &configuration_variables.ui8_startup_motor_power_boost_state;
+      lcd_var_number.ui8_decimal_digit = 0;
+      lcd_var_number.ui32_max_value = 1;
+      
+    break;
+    
+    case 2:
+      
+      // boost with max power instead of power proportional to pedal torque
+      lcd_var_number.p_var_number = &configuration_variables.ui8_startup_motor_power_boost_limit_to_max_power;
+      lcd_var_number.ui8_decimal_digit = 0;
+      lcd_var_number.ui32_max_value = 1;
+      
+    break;
+    
+    case 3:
+      
+      // boost power in watts per Nm of pedal torque
+      lcd_var_number.p_var_number = &configuration_variables.ui8_startup_motor_power_boost_assist_level;
+      lcd_var_number.ui8_decimal_digit = 0;
+      lcd_var_number.ui32_max_value = 100;
+      
+    break;
+    
+    case 4:
+      
+      // boost time in seconds
+      lcd_var_number.p_var_number = &configuration_variables.ui8_startup_motor_power_boost_time;
+      lcd_var_number.ui8_decimal_digit = 1;
+      lcd_var_number.ui32_max_value = 100;
+      
+    break;
+    
+    case 5:
+      
+      // boost fade time in seconds
+      lcd_var_number.p_var_number = &configuration_variables.ui8_startup_motor_power_boost_fade_time;
+      lcd_var_number.ui8_decimal_digit = 1;
+      lcd_var_number.ui32_max_value = 100;
+      
+    break;
+  }
+  
+  lcd_var_number.ui8_size = 8;
+  lcd_var_number.ui32_min_value = 0;
+  lcd_var_number.ui32_increment_step = 1;
+  lcd_var_number.ui8_odometer_field = ODOMETER_FIELD;
+  lcd_configurations_print_number(&lcd_var_number);
+  
+  lcd_enable_motor_symbol(1);
+  
+  if (ui8_lcd_menu_flash_state || ui8_lcd_menu_config_submenu_change_variable_enabled)
+  {
+    lcd_print(ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 0);
+  }
+  
+  submenu_state_controller(5);
 }
 
 
@@ -1845,7 +2003,7 @@ void lcd_execute_menu_config_submenu_advanced_setup(void)
 
 void lcd_execute_menu_config_submenu_technical (void)
 {
-  #define MAX_NUMBER_OF_SUBMENUS_TECHNICAL_DATA    7
+  #define MAX_NUMBER_OF_SUBMENUS_TECHNICAL_DATA    36
   
   switch (ui8_lcd_menu_config_submenu_state)
   {
@@ -1880,6 +2038,93 @@ void lcd_execute_menu_config_submenu_technical (void)
     case 7:
       lcd_print(configuration_variables.ui16_cadence_sensor_pulse_high_percentage_x10, ODOMETER_FIELD, 1);
     break;
+    
+    // motor controller scheduler late runs of about the last 256 runs of each task: motor control, assist control, housekeeping
+    case 8:
+    case 9:
+    case 10:
+      lcd_print(motor_controller_data.ui8_task_late_counter[ui8_lcd_menu_config_submenu_state - 8], ODOMETER_FIELD, 0);
+    break;
+    
+    // motor controller scheduler max overrun of each task in ms
+    case 11:
+    case 12:
+    case 13:
+      lcd_print(motor_controller_data.ui8_task_max_overrun[ui8_lcd_menu_config_submenu_state - 11], ODOMETER_FIELD, 0);
+    break;
+    
+    // motor controller startup timeline in ms: timers, ADC, sensors, EEPROM, assist available
+    case 14:
+    case 15:
+    case 16:
+    case 17:
+    case 18:
+      lcd_print(motor_controller_data.ui16_startup_timeline[ui8_lcd_menu_config_submenu_state - 14], ODOMETER_FIELD, 0);
+    break;
+    
+    // motor controller estimated battery internal resistance in milliohms
+    case 19:
+      lcd_print(motor_controller_data.ui16_battery_resistance_mohm, ODOMETER_FIELD, 0);
+    break;
+    
+    // motor controller estimated battery open circuit voltage
+    case 20:
+      lcd_print(motor_controller_data.ui16_battery_open_circuit_voltage_x1000 / 100, ODOMETER_FIELD, 1);
+    break;
+    
+    // motor controller number of gear shifts detected since power on
+    case 21:
+      lcd_print(motor_controller_data.ui16_gear_shift_counter, ODOMETER_FIELD, 0);
+    break;
+    
+    // motor controller number of times each motor fault latched since power on: stall, hall sensors, overcurrent, undervoltage
+    case 22:
+    case 23:
+    case 24:
+    case 25:
+      lcd_print(motor_controller_data.ui8_fault_latch_counter[ui8_lcd_menu_config_submenu_state - 22], ODOMETER_FIELD, 0);
+    break;
+    
+    // motor controller UART receive statistics: frames received, CRC errors, bytes lost by UART overruns and frames dropped
+    case 26:
+      lcd_print(motor_controller_data.ui16_uart_rx_frames_ok, ODOMETER_FIELD, 0);
+    break;
+    
+    case 27:
+      lcd_print(motor_controller_data.ui8_uart_rx_crc_errors, ODOMETER_FIELD, 0);
+    break;
+    
+    case 28:
+      lcd_print(motor_controller_data.ui8_uart_rx_overruns, ODOMETER_FIELD, 0);
+    break;
+    
+    case 29:
+      lcd_print(motor_controller_data.ui8_uart_rx_frames_dropped, ODOMETER_FIELD, 0);
+    break;
+    
+    // display UART receive statistics: frames received, CRC errors, bytes lost by UART overruns and frames dropped
+    case 30:
+      lcd_print(ui16_uart_rx_frames_ok, ODOMETER_FIELD, 0);
+    break;
+    
+    case 31:
+      lcd_print(ui8_uart_rx_crc_errors, ODOMETER_FIELD, 0);
+    break;
+    
+    case 32:
+      lcd_print(m_uart_rx.ui8_overruns, ODOMETER_FIELD, 0);
+    break;
+    
+    case 33:
+      lcd_print(m_uart_rx.ui8_frames_dropped, ODOMETER_FIELD, 0);
+    break;
+    
+    // motor controller scheduler run counter of each task, wraps at 65535
+    case 34:
+    case 35:
+    case 36:
+      lcd_print(motor_controller_data.ui16_task_run_counter[ui8_lcd_menu_config_submenu_state - 34], ODOMETER_FIELD, 0);
+    break;
   }
   
   lcd_print(ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 0);
@@ -2131,11 +2376,46 @@ void energy(void)
   }
   
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+  
+  
+  static uint8_t ui8_battery_energy_started;
+  static uint32_t ui32_battery_energy_mWs_old;
+  static uint32_t ui32_battery_energy_mWs_remainder;
+  
+  // add battery energy measured by the motor controller since the last received energy counter
+  if (motor_controller_data.ui8_battery_energy_received)
+  {
+    uint32_t ui32_battery_energy_mWs = motor_controller_data.ui32_battery_energy_mWs;
+    
+    if (!ui8_battery_energy_started)
+    {
+      // first received energy counter, start counting from here
+      ui8_battery_energy_started = 1;
+    }
+    else if (motor_controller_data.ui8_battery_energy_restarted && (ui32_battery_energy_mWs < ui32_battery_energy_mWs_old))
+    {
+      // motor controller restarted, counter started again from zero
+      ui32_battery_energy_mWs_remainder += ui32_battery_energy_mWs;
+    }
+    else
+    {
+      // unsigned difference is also right when the counter wrapped around
+      ui32_battery_energy_mWs_remainder += ui32_battery_energy_mWs - ui32_battery_energy_mWs_old;
+    }
+    
+    ui32_battery_energy_mWs_old = ui32_battery_energy_mWs;
+    
+    ui32_energy_sum_Ws += ui32_battery_energy_mWs_remainder / 1000;
+    ui32_battery_energy_mWs_remainder %= 1000;
+  }
+  
+
   ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
   // calculate watt-hours since power on
-  ui32_wh_since_power_on_x10 = ui32_wh_sum_x10 / 36000;
+  ui32_wh_since_power_on_x10 = ui32_energy_sum_Ws / 360;
   
   // calculate watt-hours since last full charge
   ui32_wh_x10 = configuration_variables.ui32_wh_x10_offset + ui32_wh_since_power_on_x10;
@@ -2340,6 +2620,9 @@ void riding_mode_controller(void)
     
     // set cadence assist riding mode
     if (configuration_variables.ui8_cadence_assist_function_enabled) { motor_controller_data.ui8_riding_mode = CADENCE_ASSIST_MODE; }
+    
+    // set assist map riding mode
+    if (configuration_variables.ui8_assist_map_function_enabled) { motor_controller_data.ui8_riding_mode = ASSIST_MAP_MODE; }
   }
   else if (configuration_variables.ui8_assist_level == configuration_variables.ui8_number_of_assist_levels + 1)
   {
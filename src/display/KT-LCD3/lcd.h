@@ -10,6 +10,7 @@
 #define _LCD_H_
 
 #include "main.h"
+#include "common.h"
 #include "stm8s_gpio.h"
 
 typedef struct _motor_controller_data
@@ -33,6 +34,24 @@ typedef struct _motor_controller_data
   uint32_t ui32_wheel_speed_sensor_tick_counter_offset;
   uint16_t ui16_pedal_torque_x100;
   uint16_t ui16_pedal_power_x10;
+  uint16_t ui16_task_run_counter[3];
+  uint8_t ui8_task_late_counter[3];
+  uint8_t ui8_task_max_overrun[3];
+  uint16_t ui16_startup_timeline[STARTUP_TIMELINE_STEPS];
+  uint32_t ui32_battery_charge_mAs;
+  uint32_t ui32_battery_energy_mWs;
+  uint8_t ui8_battery_energy_received;
+  uint8_t ui8_battery_energy_restarted;
+  uint16_t ui16_battery_resistance_mohm;
+  uint16_t ui16_battery_open_circuit_voltage_x1000;
+  uint16_t ui16_gear_shift_counter;
+  uint8_t ui8_fault_latched[4];
+  uint8_t ui8_fault_latch_counter[4];
+  uint16_t ui16_fault_timestamp_x10[4];
+  uint16_t ui16_uart_rx_frames_ok;
+  uint8_t ui8_uart_rx_crc_errors;
+  uint8_t ui8_uart_rx_overruns;
+  uint8_t ui8_uart_rx_frames_dropped;
 } struct_motor_controller_data;
 
 typedef struct _configuration_variables
@@ -52,6 +71,8 @@ typedef struct _configuration_variables
   uint8_t ui8_cadence_assist_level[9];
   uint8_t ui8_eMTB_assist_function_enabled;
   uint8_t ui8_eMTB_assist_sensitivity;
+  uint8_t ui8_assist_map_function_enabled;
+  uint8_t ui8_assist_map[ASSIST_MAP_BYTES];
   uint8_t ui8_walk_assist_function_enabled;
   uint8_t ui8_walk_assist_button_bounce_time;
   uint8_t ui8_walk_assist_level[9];
@@ -59,6 +80,15 @@ typedef struct _configuration_variables
   uint8_t ui8_cruise_function_set_target_speed_enabled;
   uint8_t ui8_cruise_function_target_speed_kph;
   uint8_t ui8_cruise_function_target_speed_mph;
+  uint8_t ui8_cruise_PID_kp_x10;
+  uint8_t ui8_cruise_PID_ki_x100;
+  uint8_t ui8_cruise_PID_kd_x10;
+  uint8_t ui8_startup_motor_power_boost_feature_enabled;
+  uint8_t ui8_startup_motor_power_boost_state;
+  uint8_t ui8_startup_motor_power_boost_limit_to_max_power;
+  uint8_t ui8_startup_motor_power_boost_assist_level;
+  uint8_t ui8_startup_motor_power_boost_time;
+  uint8_t ui8_startup_motor_power_boost_fade_time;
   uint16_t ui16_wheel_perimeter;
   uint8_t ui8_wheel_max_speed;
   uint8_t ui8_wheel_max_speed_imperial;
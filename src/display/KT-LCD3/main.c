@@ -40,6 +40,8 @@
 //// Functions prototypes
 // UART2 Receive interrupt
 void UART2_IRQHandler(void) __interrupt(UART2_IRQHANDLER);
+// UART2 Transmit interrupt
+void UART2_TX_IRQHandler(void) __interrupt(UART2_TX_IRQHANDLER);
 void TIM3_UPD_OVF_BRK_IRQHandler(void) __interrupt(TIM3_UPD_OVF_BRK_IRQHANDLER);
 
 
@@ -16,6 +16,7 @@
 #define TIM1_CAP_COM_IRQHANDLER                   12
 #define TIM2_UPD_OVF_TRG_BRK_IRQHANDLER           13
 #define TIM3_UPD_OVF_BRK_IRQHANDLER               15
+#define UART2_TX_IRQHANDLER                       20
 #define UART2_IRQHANDLER                          21
 #define ADC1_IRQHANDLER                           22
 
@@ -156,7 +157,7 @@
 // default values for walk assist function
 #define DEFAULT_VALUE_WALK_ASSIST_FUNCTION_ENABLED                  0   // disabled by default
 #define DEFAULT_VALUE_WALK_ASSIST_BUTTON_BOUNCE_TIME                0   // 0 milliseconds
-#define DEFAULT_VALUE_WALK_ASSIST_LEVEL_1                           20
+#define DEFAULT_VALUE_WALK_ASSIST_LEVEL_1                           20  // target speed x10, 20 -> 2.0 km/h
 #define DEFAULT_VALUE_WALK_ASSIST_LEVEL_2                           25
 #define DEFAULT_VALUE_WALK_ASSIST_LEVEL_3                           30
 #define DEFAULT_VALUE_WALK_ASSIST_LEVEL_4                           35
@@ -174,6 +175,17 @@
 #define DEFAULT_VALUE_CRUISE_FUNCTION_TARGET_SPEED_KPH              25  // 25 kph
 #define DEFAULT_VALUE_CRUISE_FUNCTION_TARGET_SPEED_MPH              15  // 15 mph
 #define DEFAULT_VALUE_SHOW_CRUISE_FUNCTION_SET_TARGET_SPEED         0   // disabled by default
+#define DEFAULT_VALUE_CRUISE_PID_KP_X10                             0   // 0 for all gains to use the default gains for the motor type
+#define DEFAULT_VALUE_CRUISE_PID_KI_X100                            0
+#define DEFAULT_VALUE_CRUISE_PID_KD_X10                             0
+
+// default values for motor startup power boost
+#define DEFAULT_VALUE_STARTUP_BOOST_FEATURE_ENABLED                 0   // disabled by default
+#define DEFAULT_VALUE_STARTUP_BOOST_STATE                           0   // 0 -> boost again after wheel stops, 1 -> boost again after pedaling stops
+#define DEFAULT_VALUE_STARTUP_BOOST_LIMIT_TO_MAX_POWER              0   // 0 -> boost proportional to pedal torque, 1 -> boost with max power
+#define DEFAULT_VALUE_STARTUP_BOOST_ASSIST_LEVEL                    10  // boost power in watts per Nm of pedal torque
+#define DEFAULT_VALUE_STARTUP_BOOST_TIME                            20  // 2.0 seconds
+#define DEFAULT_VALUE_STARTUP_BOOST_FADE_TIME                       20  // 2.0 seconds
 
 
 
@@ -245,6 +257,11 @@
 
 
 
+// default value for assist map, see ASSIST_MAP_DEFAULT_VALUES in common.h for the map
+#define DEFAULT_VALUE_ASSIST_MAP_FUNCTION_ENABLED                   0
+
+
+
 // default value assist without pedal rotation threshold
 #define DEFAULT_VALUE_ASSIST_WITHOUT_PEDAL_ROTATION_THRESHOLD       0
 
@@ -14,23 +14,30 @@
 #include "main.h"
 #include "lcd.h"
 #include "common.h"
+#include "uart.h"
 
-#define UART_NUMBER_DATA_BYTES_TO_RECEIVE   26  // change this value depending on how many data bytes there are to receive ( Package = one start byte + data bytes + two bytes 16 bit CRC )
+#define UART_NUMBER_DATA_BYTES_TO_RECEIVE   31  // change this value depending on how many data bytes there are to receive ( Package = one start byte + data bytes + two bytes 16 bit CRC )
 #define UART_NUMBER_DATA_BYTES_TO_SEND      7   // change this value depending on how many data bytes there are to send ( Package = one start byte + data bytes + two bytes 16 bit CRC )
-#define UART_MAX_NUMBER_MESSAGE_ID          6   // change this value depending on how many different packages there are to send
+#define UART_MAX_NUMBER_MESSAGE_ID          9   // change this value depending on how many different packages there are to send
+#define UART_RX_START_BYTE                  67
 
-volatile uint8_t  ui8_received_package_flag = 0;
-volatile uint8_t  ui8_rx_buffer[UART_NUMBER_DATA_BYTES_TO_RECEIVE + 3];
-volatile uint8_t  ui8_rx_counter = 0;
-volatile uint8_t  ui8_tx_buffer[UART_NUMBER_DATA_BYTES_TO_SEND + 3];
+volatile uint8_t  ui8_rx_buffer[2][UART_NUMBER_DATA_BYTES_TO_RECEIVE + 3];   // ping-pong buffers, the UART receive interrupt writes one while the other is processed
+struct_uart_rx    m_uart_rx = { UART_RX_START_BYTE, UART_NUMBER_DATA_BYTES_TO_RECEIVE + 3, { ui8_rx_buffer[0], ui8_rx_buffer[1] } };
+uint8_t           ui8_tx_buffer[UART_NUMBER_DATA_BYTES_TO_SEND + 3];
 volatile uint8_t  ui8_i;
-volatile uint8_t  ui8_byte_received;
-volatile uint8_t  ui8_state_machine = 0;
 static uint16_t   ui16_crc_rx;
 static uint16_t   ui16_crc_tx;
 static uint8_t    ui8_message_ID = 0;
+static uint8_t    ui8_assist_map_chunk = 0;
 
 volatile uint8_t  ui8_received_first_package = 0;
+uint16_t          ui16_uart_rx_frames_ok = 0;
+uint8_t           ui8_uart_rx_crc_errors = 0;
+
+// transmit ring buffer, bytes are written by uart_send_frame() and sent by the transmit interrupt
+static volatile uint8_t ui8_uart_tx_buffer[UART_TX_BUFFER_SIZE];
+static volatile uint8_t ui8_uart_tx_head = 0;
+static volatile uint8_t ui8_uart_tx_tail = 0;
 
 
 void uart2_init (void)
@@ -46,52 +53,63 @@ void uart2_init (void)
   UART2_ITConfig(UART2_IT_RXNE_OR, ENABLE);
 }
 
-// This is the interrupt that happens when UART2 receives data. We need it to be the fastest possible and so
-// we do: receive every byte and assembly as a package, finally, signal that we have a package to process (on main slow loop)
-// and disable the interrupt. The interrupt should be enable again on main loop, after the package being processed
-void UART2_IRQHandler(void) __interrupt(UART2_IRQHANDLER)
+
+// This is the interrupt that happens when UART2 is ready to send the next byte. It sends the bytes queued in the
+// transmit ring buffer and disables itself when the buffer is empty, so the main loop never waits on UART2
+void UART2_TX_IRQHandler(void) __interrupt(UART2_TX_IRQHANDLER)
 {
-  if(UART2_GetFlagStatus(UART2_FLAG_RXNE) == SET)
+  if (ui8_uart_tx_tail != ui8_uart_tx_head)
   {
-    UART2->SR &= (uint8_t)~(UART2_FLAG_RXNE); // this may be redundant
+    UART2->DR = ui8_uart_tx_buffer[ui8_uart_tx_tail];
+    ui8_uart_tx_tail = (ui8_uart_tx_tail + 1) & (UART_TX_BUFFER_SIZE - 1);
+  }
+  else
+  {
+    // nothing more to send, disable transmit interrupt
+    UART2->CR2 &= (uint8_t) ~UART2_CR2_TIEN;
+  }
+}
 
-    ui8_byte_received = UART2_ReceiveData8 ();
 
-    switch (ui8_state_machine)
-    {
-      case 0:
-      if (ui8_byte_received == 67) // see if we get start package byte
-      {
-        ui8_rx_buffer[ui8_rx_counter] = ui8_byte_received;
-        ui8_rx_counter++;
-        ui8_state_machine = 1;
-      }
-      else
-      {
-        ui8_rx_counter = 0;
-        ui8_state_machine = 0;
-      }
-      break;
 
-      case 1:
-      ui8_rx_buffer[ui8_rx_counter] = ui8_byte_received;
-      
-      // increment index for next byte
-      ui8_rx_counter++;
+// queue a full frame for sending, returns 0 without queuing anything if there is no room for the full frame
+uint8_t uart_send_frame (const uint8_t *p_frame, uint8_t ui8_length)
+{
+  uint8_t ui8_head = ui8_uart_tx_head;
+  
+  // one byte is always kept free so a full buffer is not seen as empty
+  if (ui8_length > (uint8_t) ((ui8_uart_tx_tail - ui8_head - 1) & (UART_TX_BUFFER_SIZE - 1))) { return 0; }
+  
+  while (ui8_length--)
+  {
+    ui8_uart_tx_buffer[ui8_head] = *p_frame++;
+    ui8_head = (ui8_head + 1) & (UART_TX_BUFFER_SIZE - 1);
+  }
+  
+  ui8_uart_tx_head = ui8_head;
+  
+  // enable transmit interrupt, it happens right away when the transmit data register is empty
+  UART2->CR2 |= UART2_CR2_TIEN;
+  
+  return 1;
+}
 
-      // reset if it is the last byte of the package and index is out of bounds
-      if (ui8_rx_counter >= UART_NUMBER_DATA_BYTES_TO_RECEIVE + 3)
-      {
-        ui8_rx_counter = 0;
-        ui8_state_machine = 0;
-        ui8_received_package_flag = 1; // signal that we have a full package to be processed
-        UART2->CR2 &= ~(1 << 5); // disable UART2 receive interrupt
-      }
-      break;
 
-      default:
-      break;
-    }
+// This is the interrupt that happens when UART2 receives data. We need it to be the fastest possible and so
+// we do: receive every byte and assembly as a package in one of two buffers with uart_rx_byte(), that signals
+// the package to the main slow loop and continues receiving in the other buffer, so the interrupt is never disabled
+void UART2_IRQHandler(void) __interrupt(UART2_IRQHANDLER)
+{
+  uint8_t ui8_overrun;
+  
+  if(UART2_GetFlagStatus(UART2_FLAG_RXNE) == SET)
+  {
+    // bytes lost by the UART2 receiver, the overrun flag is cleared by reading the data register
+    ui8_overrun = (UART2->SR & UART2_SR_OR) ? 1 : 0;
+    
+    UART2->SR &= (uint8_t)~(UART2_FLAG_RXNE); // this may be redundant
+    
+    uart_rx_byte(&m_uart_rx, UART2_ReceiveData8(), ui8_overrun);
   }
 }
 
@@ -100,37 +118,37 @@ void uart_data_clock (void)
 {
   struct_motor_controller_data *p_motor_controller_data;
   struct_configuration_variables *p_configuration_variables;
+  uint8_t ui8_temp;
+  uint8_t ui8_telemetry_ID;
+  volatile uint8_t *p_rx_buffer = uart_rx_get_frame(&m_uart_rx);
 
-  if (ui8_received_package_flag)
+  if (p_rx_buffer)
   {
     // validation of the package data
-    ui16_crc_rx = 0xffff;
-    
-    for (ui8_i = 0; ui8_i <= UART_NUMBER_DATA_BYTES_TO_RECEIVE; ui8_i++)
-    {
-      crc16 (ui8_rx_buffer[ui8_i], &ui16_crc_rx);
-    }
+    ui16_crc_rx = crc16_buf((const uint8_t *) p_rx_buffer, UART_NUMBER_DATA_BYTES_TO_RECEIVE + 1);
     
     // if CRC is ok read the package
-    if (((((uint16_t) ui8_rx_buffer [UART_NUMBER_DATA_BYTES_TO_RECEIVE + 2]) << 8) + ((uint16_t) ui8_rx_buffer [UART_NUMBER_DATA_BYTES_TO_RECEIVE + 1])) == ui16_crc_rx)
+    if (((((uint16_t) p_rx_buffer [UART_NUMBER_DATA_BYTES_TO_RECEIVE + 2]) << 8) + ((uint16_t) p_rx_buffer [UART_NUMBER_DATA_BYTES_TO_RECEIVE + 1])) == ui16_crc_rx)
     {
+      ++ui16_uart_rx_frames_ok;
+      
       p_motor_controller_data = lcd_get_motor_controller_data();
       p_configuration_variables = get_configuration_variables();
       
       // battery voltage x1000
-      p_motor_controller_data->ui16_battery_voltage_x1000 = (((uint16_t) ui8_rx_buffer [2]) << 8) + ((uint16_t) ui8_rx_buffer [1]);
+      p_motor_controller_data->ui16_battery_voltage_x1000 = (((uint16_t) p_rx_buffer [2]) << 8) + ((uint16_t) p_rx_buffer [1]);
       
       // battery current x10
-      p_motor_controller_data->ui8_battery_current_x10 = ui8_rx_buffer[3];
+      p_motor_controller_data->ui8_battery_current_x10 = p_rx_buffer[3];
       
       // wheel speed
-      p_motor_controller_data->ui16_wheel_speed_x10 = (((uint16_t) ui8_rx_buffer [5]) << 8) + ((uint16_t) ui8_rx_buffer [4]);
+      p_motor_controller_data->ui16_wheel_speed_x10 = (((uint16_t) p_rx_buffer [5]) << 8) + ((uint16_t) p_rx_buffer [4]);
       
       // brake state
-      p_motor_controller_data->ui8_braking = ui8_rx_buffer[6] & 1;
+      p_motor_controller_data->ui8_braking = p_rx_buffer[6] & 1;
       
       // value from optional ADC channel
-      p_motor_controller_data->ui8_adc_throttle = ui8_rx_buffer[7];
+      p_motor_controller_data->ui8_adc_throttle = p_rx_buffer[7];
       
       // throttle or temperature control
       switch (p_configuration_variables->ui8_optional_ADC_function)
@@ -138,52 +156,144 @@ void uart_data_clock (void)
         case THROTTLE_CONTROL:
         
           // throttle value with offset applied and mapped from 0 to 255
-          p_motor_controller_data->ui8_throttle = ui8_rx_buffer[8];
+          p_motor_controller_data->ui8_throttle = p_rx_buffer[8];
         
         break;
         
         case TEMPERATURE_CONTROL:
         
           // current limiting mapped from 0 to 255
-          p_motor_controller_data->ui8_temperature_current_limiting_value = ui8_rx_buffer[8];
+          p_motor_controller_data->ui8_temperature_current_limiting_value = p_rx_buffer[8];
         
         break;
       }
       
       // ADC pedal torque
-      p_motor_controller_data->ui16_adc_pedal_torque_sensor = (((uint16_t) ui8_rx_buffer [10]) << 8) + ((uint16_t) ui8_rx_buffer [9]);
+      p_motor_controller_data->ui16_adc_pedal_torque_sensor = (((uint16_t) p_rx_buffer [10]) << 8) + ((uint16_t) p_rx_buffer [9]);
       
       // pedal cadence
-      p_motor_controller_data->ui8_pedal_cadence_RPM = ui8_rx_buffer[11];
+      p_motor_controller_data->ui8_pedal_cadence_RPM = p_rx_buffer[11];
       
       // PWM duty_cycle
-      p_motor_controller_data->ui8_duty_cycle = ui8_rx_buffer[12];
+      p_motor_controller_data->ui8_duty_cycle = p_rx_buffer[12];
       
       // motor speed in ERPS
-      p_motor_controller_data->ui16_motor_speed_erps = (((uint16_t) ui8_rx_buffer [14]) << 8) + ((uint16_t) ui8_rx_buffer [13]);
+      p_motor_controller_data->ui16_motor_speed_erps = (((uint16_t) p_rx_buffer [14]) << 8) + ((uint16_t) p_rx_buffer [13]);
       
       // FOC angle
-      p_motor_controller_data->ui8_foc_angle = ui8_rx_buffer[15];
+      p_motor_controller_data->ui8_foc_angle = p_rx_buffer[15];
       
       // controller system state
-      p_motor_controller_data->ui8_controller_system_state = ui8_rx_buffer[16];
+      p_motor_controller_data->ui8_controller_system_state = p_rx_buffer[16];
       
       // motor temperature
-      p_motor_controller_data->ui8_motor_temperature = ui8_rx_buffer[17];
+      p_motor_controller_data->ui8_motor_temperature = p_rx_buffer[17];
       
       // wheel_speed_sensor_tick_counter
-      p_motor_controller_data->ui32_wheel_speed_sensor_tick_counter = (((uint32_t) ui8_rx_buffer[20]) << 16) + (((uint32_t) ui8_rx_buffer[19]) << 8) + ((uint32_t) ui8_rx_buffer[18]);
+      p_motor_controller_data->ui32_wheel_speed_sensor_tick_counter = (((uint32_t) p_rx_buffer[20]) << 16) + (((uint32_t) p_rx_buffer[19]) << 8) + ((uint32_t) p_rx_buffer[18]);
 
       // pedal torque x100
-      p_motor_controller_data->ui16_pedal_torque_x100 = (((uint16_t) ui8_rx_buffer [22]) << 8) + ((uint16_t) ui8_rx_buffer [21]);
+      p_motor_controller_data->ui16_pedal_torque_x100 = (((uint16_t) p_rx_buffer [22]) << 8) + ((uint16_t) p_rx_buffer [21]);
       
       // human power x10
-      p_motor_controller_data->ui16_pedal_power_x10 = (((uint16_t) ui8_rx_buffer [24]) << 8) + ((uint16_t) ui8_rx_buffer [23]);
+      p_motor_controller_data->ui16_pedal_power_x10 = (((uint16_t) p_rx_buffer [24]) << 8) + ((uint16_t) p_rx_buffer [23]);
       
       // cadence sensor pulse high percentage
       if (p_configuration_variables->ui8_cadence_sensor_mode == CALIBRATION_MODE)
       {
-        p_configuration_variables->ui16_cadence_sensor_pulse_high_percentage_x10 = (((uint16_t) ui8_rx_buffer [26]) << 8) + ((uint16_t) ui8_rx_buffer [25]);        
+        p_configuration_variables->ui16_cadence_sensor_pulse_high_percentage_x10 = (((uint16_t) p_rx_buffer [26]) << 8) + ((uint16_t) p_rx_buffer [25]);        
+      }
+      
+      // telemetry data set
+      ui8_telemetry_ID = p_rx_buffer[27] & ~TELEMETRY_RESTARTED;
+      
+      switch (ui8_telemetry_ID)
+      {
+        case TELEMETRY_SCHEDULER_TASK_0:
+        case TELEMETRY_SCHEDULER_TASK_1:
+        case TELEMETRY_SCHEDULER_TASK_2:
+        
+          ui8_temp = ui8_telemetry_ID - TELEMETRY_SCHEDULER_TASK_0;
+          
+          // scheduler task run counter, late counter and max overrun
+          p_motor_controller_data->ui16_task_run_counter[ui8_temp] = (((uint16_t) p_rx_buffer [29]) << 8) + ((uint16_t) p_rx_buffer [28]);
+          p_motor_controller_data->ui8_task_late_counter[ui8_temp] = p_rx_buffer[30];
+          p_motor_controller_data->ui8_task_max_overrun[ui8_temp] = p_rx_buffer[31];
+          
+        break;
+        
+        case TELEMETRY_STARTUP_TIMELINE_0:
+        case TELEMETRY_STARTUP_TIMELINE_1:
+        case TELEMETRY_STARTUP_TIMELINE_2:
+        
+          ui8_temp = (ui8_telemetry_ID - TELEMETRY_STARTUP_TIMELINE_0) << 1;
+          
+          // motor controller startup timeline, two steps in each data set
+          p_motor_controller_data->ui16_startup_timeline[ui8_temp] = (((uint16_t) p_rx_buffer [29]) << 8) + ((uint16_t) p_rx_buffer [28]);
+          if ((ui8_temp + 1) < STARTUP_TIMELINE_STEPS) { p_motor_controller_data->ui16_startup_timeline[ui8_temp + 1] = (((uint16_t) p_rx_buffer [31]) << 8) + ((uint16_t) p_rx_buffer [30]); }
+          
+        break;
+        
+        case TELEMETRY_BATTERY_CHARGE:
+        
+          // battery charge since motor controller power on
+          p_motor_controller_data->ui32_battery_charge_mAs = (((uint32_t) p_rx_buffer[31]) << 24) + (((uint32_t) p_rx_buffer[30]) << 16) + (((uint32_t) p_rx_buffer[29]) << 8) + ((uint32_t) p_rx_buffer[28]);
+          
+        break;
+        
+        case TELEMETRY_BATTERY_ENERGY:
+        
+          // battery energy since motor controller power on and if the motor controller was just powered on
+          p_motor_controller_data->ui32_battery_energy_mWs = (((uint32_t) p_rx_buffer[31]) << 24) + (((uint32_t) p_rx_buffer[30]) << 16) + (((uint32_t) p_rx_buffer[29]) << 8) + ((uint32_t) p_rx_buffer[28]);
+          p_motor_controller_data->ui8_battery_energy_restarted = (p_rx_buffer[27] & TELEMETRY_RESTARTED) ? 1 : 0;
+          p_motor_controller_data->ui8_battery_energy_received = 1;
+          
+        break;
+        
+        case TELEMETRY_BATTERY_MODEL:
+        
+          // estimated battery internal resistance and open circuit voltage
+          p_motor_controller_data->ui16_battery_resistance_mohm = (((uint16_t) p_rx_buffer [29]) << 8) + ((uint16_t) p_rx_buffer [28]);
+          p_motor_controller_data->ui16_battery_open_circuit_voltage_x1000 = (((uint16_t) p_rx_buffer [31]) << 8) + ((uint16_t) p_rx_buffer [30]);
+          
+        break;
+        
+        case TELEMETRY_GEAR_SHIFTS:
+        
+          // number of gear shifts detected by the motor controller since power on
+          p_motor_controller_data->ui16_gear_shift_counter = (((uint16_t) p_rx_buffer [29]) << 8) + ((uint16_t) p_rx_buffer [28]);
+          
+        break;
+        
+        case TELEMETRY_UART_RX:
+        
+          // motor controller UART receive statistics
+          p_motor_controller_data->ui16_uart_rx_frames_ok = (((uint16_t) p_rx_buffer [29]) << 8) + ((uint16_t) p_rx_buffer [28]);
+          p_motor_controller_data->ui8_uart_rx_crc_errors = p_rx_buffer[30];
+          p_motor_controller_data->ui8_uart_rx_overruns = p_rx_buffer[31];
+          
+        break;
+        
+        case TELEMETRY_UART_RX_DROPPED:
+        
+          // UART receive frames dropped
+          p_motor_controller_data->ui8_uart_rx_frames_dropped = p_rx_buffer[28];
+          
+        break;
+        
+        case TELEMETRY_FAULT_0:
+        case TELEMETRY_FAULT_1:
+        case TELEMETRY_FAULT_2:
+        case TELEMETRY_FAULT_3:
+        
+          ui8_temp = ui8_telemetry_ID - TELEMETRY_FAULT_0;
+          
+          // motor fault: latched state, number of times latched and time in 0.1 s it was last latched
+          p_motor_controller_data->ui8_fault_latched[ui8_temp] = p_rx_buffer[28];
+          p_motor_controller_data->ui8_fault_latch_counter[ui8_temp] = p_rx_buffer[29];
+          p_motor_controller_data->ui16_fault_timestamp_x10[ui8_temp] = (((uint16_t) p_rx_buffer [31]) << 8) + ((uint16_t) p_rx_buffer [30]);
+          
+        break;
       }
 
       // flag that the first communication package is received from the motor controller
@@ -250,6 +360,20 @@ void uart_data_clock (void)
           
         break;
         
+        case ASSIST_MAP_MODE:
+        
+          // assist map scale in percentage of the assist level over the number of assist levels
+          if (p_configuration_variables->ui8_number_of_assist_levels > 0)
+          {
+            ui8_tx_buffer[3] = ((uint16_t) p_configuration_variables->ui8_assist_level * 100) / p_configuration_variables->ui8_number_of_assist_levels;
+          }
+          else
+          {
+            ui8_tx_buffer[3] = 0;
+          }
+          
+        break;
+        
         case WALK_ASSIST_MODE:
         
           if (p_configuration_variables->ui8_assist_level > 0)
@@ -339,11 +463,23 @@ void uart_data_clock (void)
 
         case 3:
         
-          ui8_tx_buffer[5] = 0;
+          // assist map chunk index
+          ui8_tx_buffer[5] = ui8_assist_map_chunk;
+          
+          // assist map chunk data, last chunk may be only partially used
+          ui8_tx_buffer[6] = p_configuration_variables->ui8_assist_map[ui8_assist_map_chunk * ASSIST_MAP_CHUNK_BYTES];
           
-          ui8_tx_buffer[6] = 0;
+          if (((ui8_assist_map_chunk * ASSIST_MAP_CHUNK_BYTES) + 1) < ASSIST_MAP_BYTES)
+          {
+            ui8_tx_buffer[7] = p_configuration_variables->ui8_assist_map[(ui8_assist_map_chunk * ASSIST_MAP_CHUNK_BYTES) + 1];
+          }
+          else
+          {
+            ui8_tx_buffer[7] = 0;
+          }
           
-          ui8_tx_buffer[7] = 0;
+          // send next chunk on next package, map is sent continuously so changes are applied
+          if (++ui8_assist_map_chunk >= ASSIST_MAP_CHUNKS) { ui8_assist_map_chunk = 0; }
           
         break;
 
@@ -392,6 +528,33 @@ void uart_data_clock (void)
           
         break;
         
+        case 7:
+          
+          // cruise PID gains
+          ui8_tx_buffer[5] = p_configuration_variables->ui8_cruise_PID_kp_x10;
+          ui8_tx_buffer[6] = p_configuration_variables->ui8_cruise_PID_ki_x100;
+          ui8_tx_buffer[7] = p_configuration_variables->ui8_cruise_PID_kd_x10;
+          
+        break;
+        
+        case 8:
+          
+          // motor startup power boost enabled, restart state and limit to max power
+          ui8_tx_buffer[5] = p_configuration_variables->ui8_startup_motor_power_boost_feature_enabled;
+          ui8_tx_buffer[6] = p_configuration_variables->ui8_startup_motor_power_boost_state;
+          ui8_tx_buffer[7] = p_configuration_variables->ui8_startup_motor_power_boost_limit_to_max_power;
+          
+        break;
+        
+        case 9:
+          
+          // motor startup power boost assist level, boost time and fade time
+          ui8_tx_buffer[5] = p_configuration_variables->ui8_startup_motor_power_boost_assist_level;
+          ui8_tx_buffer[6] = p_configuration_variables->ui8_startup_motor_power_boost_time;
+          ui8_tx_buffer[7] = p_configuration_variables->ui8_startup_motor_power_boost_fade_time;
+          
+        break;
+        
         default:
           
           ui8_message_ID = 0;
@@ -400,31 +563,24 @@ void uart_data_clock (void)
       }
 
       // prepare crc of the package
-      ui16_crc_tx = 0xffff;
-      
-      for (ui8_i = 0; ui8_i <= UART_NUMBER_DATA_BYTES_TO_SEND; ui8_i++)
-      {
-        crc16 (ui8_tx_buffer[ui8_i], &ui16_crc_tx);
-      }
+      ui16_crc_tx = crc16_buf(ui8_tx_buffer, UART_NUMBER_DATA_BYTES_TO_SEND + 1);
       
       ui8_tx_buffer[UART_NUMBER_DATA_BYTES_TO_SEND + 1] = (uint8_t) (ui16_crc_tx & 0xff);
       ui8_tx_buffer[UART_NUMBER_DATA_BYTES_TO_SEND + 2] = (uint8_t) (ui16_crc_tx >> 8) & 0xff;
 
       // send the full package to UART
-      for (ui8_i = 0; ui8_i <= UART_NUMBER_DATA_BYTES_TO_SEND + 2; ui8_i++)
-      {
-        putchar (ui8_tx_buffer[ui8_i]);
-      }
+      uart_send_frame(ui8_tx_buffer, UART_NUMBER_DATA_BYTES_TO_SEND + 3);
       
       // increment message ID for next package
       if (++ui8_message_ID > UART_MAX_NUMBER_MESSAGE_ID) { ui8_message_ID = 0; }
     }
+    else if (ui8_uart_rx_crc_errors < 255)
+    {
+      ++ui8_uart_rx_crc_errors;
+    }
     
     // flag that we processed the full package
-    ui8_received_package_flag = 0;
-
-    // enable UART2 receive interrupt as we are now ready to receive a new package
-    UART2->CR2 |= (1 << 5);
+    uart_rx_frame_done(&m_uart_rx);
   }
 }
 
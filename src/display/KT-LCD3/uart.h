@@ -10,10 +10,20 @@
 #define _UART_H
 
 #include "main.h"
+#include "uart_rx.h"
 
 extern volatile uint8_t ui8_received_first_package;
 
+// UART receive statistics
+extern uint16_t ui16_uart_rx_frames_ok;
+extern uint8_t ui8_uart_rx_crc_errors;
+extern struct_uart_rx m_uart_rx;   // overruns and frames dropped
+
+// size of the transmit ring buffer, must be a power of 2 and hold the largest frame
+#define UART_TX_BUFFER_SIZE   16
+
 void uart2_init (void);
+uint8_t uart_send_frame (const uint8_t *p_frame, uint8_t ui8_length);
 void uart_data_clock (void);
 
 #if __SDCC_REVISION < 9624
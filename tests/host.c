@@ -0,0 +1,64 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "host.h"
+#include "test.h"
+
+uint8_t ui8_host_interrupts_enabled = 1;
+uint16_t ui16_host_interrupts_disabled_counter = 0;
+void (*p_host_wfi_hook) (void) = 0;
+
+uint32_t ui32_test_checks = 0;
+uint32_t ui32_test_failures = 0;
+
+
+
+void host_enable_interrupts (void)
+{
+  ui8_host_interrupts_enabled = 1;
+}
+
+
+
+void host_disable_interrupts (void)
+{
+  ui8_host_interrupts_enabled = 0;
+  ui16_host_interrupts_disabled_counter++;
+}
+
+
+
+void host_wfi (void)
+{
+  if (p_host_wfi_hook) { p_host_wfi_hook(); }
+}
+
+
+
+int test_end (const char *p_name)
+{
+  printf("%s: %lu checks, %lu failed\n", p_name, (unsigned long) ui32_test_checks, (unsigned long) ui32_test_failures);
+
+  return ui32_test_failures ? 1 : 0;
+}
+
+
+
+uint32_t test_random (void)
+{
+  static uint32_t ui32_state = 2463534242UL;
+
+  // xorshift, same sequence on every run
+  ui32_state ^= ui32_state << 13;
+  ui32_state ^= ui32_state >> 17;
+  ui32_state ^= ui32_state << 5;
+
+  return ui32_state;
+}
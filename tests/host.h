@@ -0,0 +1,47 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _HOST_H_
+#define _HOST_H_
+
+// included before every source file of a host build, replaces the STM8 instructions with host functions
+#include <stdint.h>
+#include "stm8s.h"
+
+#undef enableInterrupts
+#undef disableInterrupts
+#undef rim
+#undef sim
+#undef nop
+#undef trap
+#undef wfi
+#undef halt
+
+void host_enable_interrupts (void);
+void host_disable_interrupts (void);
+void host_wfi (void);
+
+#define enableInterrupts()    host_enable_interrupts()
+#define disableInterrupts()   host_disable_interrupts()
+#define rim()                 host_enable_interrupts()
+#define sim()                 host_disable_interrupts()
+#define nop()
+#define trap()
+#define wfi()                 host_wfi()
+#define halt()
+
+// interrupts state, 1 when enabled
+extern uint8_t ui8_host_interrupts_enabled;
+
+// number of nested disableInterrupts() calls seen while interrupts were disabled
+extern uint16_t ui16_host_interrupts_disabled_counter;
+
+// called on wfi(), tests use it to advance time
+extern void (*p_host_wfi_hook) (void);
+
+#endif /* _HOST_H_ */
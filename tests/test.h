@@ -0,0 +1,47 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+extern uint32_t ui32_test_checks;
+extern uint32_t ui32_test_failures;
+
+#define CHECK(condition) \
+  do { \
+    ui32_test_checks++; \
+    if (!(condition)) { ui32_test_failures++; printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); } \
+  } while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+  do { \
+    long l_actual = (long) (actual); \
+    long l_expected = (long) (expected); \
+    ui32_test_checks++; \
+    if (l_actual != l_expected) { ui32_test_failures++; printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, l_actual, l_expected); } \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+  do { \
+    long l_actual = (long) (actual); \
+    long l_expected = (long) (expected); \
+    ui32_test_checks++; \
+    if ((l_actual > (l_expected + (tolerance))) || (l_actual < (l_expected - (tolerance)))) \
+    { ui32_test_failures++; printf("%s:%d: %s is %ld, expected %ld +/- %ld\n", __FILE__, __LINE__, #actual, l_actual, l_expected, (long) (tolerance)); } \
+  } while (0)
+
+// print the result, returns the exit code of the test program
+int test_end (const char *p_name);
+
+// pseudo random numbers, same sequence on every run
+uint32_t test_random (void);
+
+#endif /* _TEST_H_ */
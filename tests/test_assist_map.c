@@ -0,0 +1,168 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "assist_map.h"
+
+static const uint8_t ui8_default_map[ASSIST_MAP_BYTES] = { ASSIST_MAP_DEFAULT_VALUES };
+
+
+
+// bilinear interpolation of the map in floating point
+static double reference_target (const uint8_t *ui8_p_map, uint16_t ui16_torque, uint8_t ui8_cadence, uint16_t ui16_speed_x10)
+{
+  const uint8_t *ui8_p_torque = &ui8_p_map[ASSIST_MAP_TORQUE_INDEX];
+  const uint8_t *ui8_p_axis = &ui8_p_map[ASSIST_MAP_AXIS_INDEX];
+  const uint8_t *ui8_p_current = &ui8_p_map[ASSIST_MAP_CURRENT_INDEX];
+  double d_torque = ui16_torque;
+  double d_axis = (ui8_p_map[ASSIST_MAP_AXIS_TYPE_INDEX] == ASSIST_MAP_AXIS_WHEEL_SPEED) ? (double) (ui16_speed_x10 / 10) : (double) ui8_cadence;
+  double d_row[2];
+  double d_fraction;
+  int i_t = 0;
+  int i_a = 0;
+  int i_row;
+  int i;
+
+  if (d_torque < ui8_p_torque[0]) { d_torque = ui8_p_torque[0]; }
+  if (d_torque > ui8_p_torque[ASSIST_MAP_TORQUE_POINTS - 1]) { d_torque = ui8_p_torque[ASSIST_MAP_TORQUE_POINTS - 1]; }
+  if (d_axis < ui8_p_axis[0]) { d_axis = ui8_p_axis[0]; }
+  if (d_axis > ui8_p_axis[ASSIST_MAP_AXIS_POINTS - 1]) { d_axis = ui8_p_axis[ASSIST_MAP_AXIS_POINTS - 1]; }
+
+  for (i = 1; i < (ASSIST_MAP_TORQUE_POINTS - 1); i++) { if (d_torque >= ui8_p_torque[i]) { i_t = i; } }
+  for (i = 1; i < (ASSIST_MAP_AXIS_POINTS - 1); i++) { if (d_axis >= ui8_p_axis[i]) { i_a = i; } }
+
+  d_fraction = (d_torque - ui8_p_torque[i_t]) / (ui8_p_torque[i_t + 1] - ui8_p_torque[i_t]);
+
+  for (i_row = 0; i_row < 2; i_row++)
+  {
+    const uint8_t *ui8_p_row = &ui8_p_current[(i_a + i_row) * ASSIST_MAP_TORQUE_POINTS];
+    d_row[i_row] = ui8_p_row[i_t] + ((ui8_p_row[i_t + 1] - ui8_p_row[i_t]) * d_fraction);
+  }
+
+  d_fraction = (d_axis - ui8_p_axis[i_a]) / (ui8_p_axis[i_a + 1] - ui8_p_axis[i_a]);
+
+  return d_row[0] + ((d_row[1] - d_row[0]) * d_fraction);
+}
+
+
+
+static uint8_t send_map (const uint8_t *ui8_p_map)
+{
+  uint8_t ui8_chunk;
+  uint8_t ui8_changed = 0;
+
+  for (ui8_chunk = 0; ui8_chunk < ASSIST_MAP_CHUNKS; ui8_chunk++)
+  {
+    uint8_t ui8_index = ui8_chunk * ASSIST_MAP_CHUNK_BYTES;
+    uint8_t ui8_data_1 = ((ui8_index + 1) < ASSIST_MAP_BYTES) ? ui8_p_map[ui8_index + 1] : 0;
+
+    ui8_changed = assist_map_receive_chunk(ui8_chunk, ui8_p_map[ui8_index], ui8_data_1);
+  }
+
+  return ui8_changed;
+}
+
+
+
+static void random_map (uint8_t *ui8_p_map, uint8_t ui8_axis_type)
+{
+  uint8_t ui8_i;
+
+  ui8_p_map[ASSIST_MAP_AXIS_TYPE_INDEX] = ui8_axis_type;
+
+  // strictly increasing breakpoints, first one anywhere in the low part of the range
+  ui8_p_map[ASSIST_MAP_TORQUE_INDEX] = test_random() % 40;
+  for (ui8_i = 1; ui8_i < ASSIST_MAP_TORQUE_POINTS; ui8_i++) { ui8_p_map[ASSIST_MAP_TORQUE_INDEX + ui8_i] = ui8_p_map[ASSIST_MAP_TORQUE_INDEX + ui8_i - 1] + 1 + (test_random() % 43); }
+
+  ui8_p_map[ASSIST_MAP_AXIS_INDEX] = test_random() % 40;
+  for (ui8_i = 1; ui8_i < ASSIST_MAP_AXIS_POINTS; ui8_i++) { ui8_p_map[ASSIST_MAP_AXIS_INDEX + ui8_i] = ui8_p_map[ASSIST_MAP_AXIS_INDEX + ui8_i - 1] + 1 + (test_random() % 70); }
+
+  // any current, also decreasing along both axis
+  for (ui8_i = 0; ui8_i < (ASSIST_MAP_TORQUE_POINTS * ASSIST_MAP_AXIS_POINTS); ui8_i++) { ui8_p_map[ASSIST_MAP_CURRENT_INDEX + ui8_i] = test_random() & 0xFF; }
+}
+
+
+
+static void check_map (const uint8_t *ui8_p_map)
+{
+  uint16_t ui16_torque;
+  uint16_t ui16_axis;
+  uint8_t ui8_t;
+  uint8_t ui8_a;
+
+  // whole input range, also out of the map range
+  for (ui16_torque = 0; ui16_torque <= 300; ui16_torque++)
+  {
+    for (ui16_axis = 0; ui16_axis <= 255; ui16_axis++)
+    {
+      double d_expected = reference_target(ui8_p_map, ui16_torque, ui16_axis, ui16_axis * 10);
+      uint8_t ui8_target = assist_map_get_target(ui16_torque, ui16_axis, ui16_axis * 10);
+
+      CHECK_NEAR(ui8_target, (long) (d_expected + 0.5), 1);
+    }
+  }
+
+  // exact on the breakpoints
+  for (ui8_t = 0; ui8_t < ASSIST_MAP_TORQUE_POINTS; ui8_t++)
+  {
+    for (ui8_a = 0; ui8_a < ASSIST_MAP_AXIS_POINTS; ui8_a++)
+    {
+      uint8_t ui8_axis = ui8_p_map[ASSIST_MAP_AXIS_INDEX + ui8_a];
+
+      CHECK_EQUAL(assist_map_get_target(ui8_p_map[ASSIST_MAP_TORQUE_INDEX + ui8_t], ui8_axis, (uint16_t) ui8_axis * 10),
+                  ui8_p_map[ASSIST_MAP_CURRENT_INDEX + (ui8_a * ASSIST_MAP_TORQUE_POINTS) + ui8_t]);
+    }
+  }
+}
+
+
+
+int main (void)
+{
+  uint8_t ui8_map[ASSIST_MAP_BYTES];
+  uint8_t ui8_invalid_map[ASSIST_MAP_BYTES];
+  uint16_t ui16_i;
+
+  // EEPROM data is not valid so the default map is used
+  assist_map_init();
+  check_map(ui8_default_map);
+
+  // same map again is not a change, so it is not saved
+  CHECK_EQUAL(send_map(ui8_default_map), 0);
+
+  // random maps along cadence and wheel speed
+  for (ui16_i = 0; ui16_i < 200; ui16_i++)
+  {
+    random_map(ui8_map, ui16_i & 1);
+    CHECK_EQUAL(send_map(ui8_map), 1);
+    check_map(ui8_map);
+  }
+
+  // maps with breakpoints that are not increasing are discarded and the active map is kept
+  for (ui16_i = 0; ui16_i < ASSIST_MAP_BYTES; ui16_i++) { ui8_invalid_map[ui16_i] = ui8_map[ui16_i]; }
+  ui8_invalid_map[ASSIST_MAP_TORQUE_INDEX + 3] = ui8_invalid_map[ASSIST_MAP_TORQUE_INDEX + 2];
+  CHECK_EQUAL(send_map(ui8_invalid_map), 0);
+  check_map(ui8_map);
+
+  for (ui16_i = 0; ui16_i < ASSIST_MAP_BYTES; ui16_i++) { ui8_invalid_map[ui16_i] = ui8_map[ui16_i]; }
+  ui8_invalid_map[ASSIST_MAP_AXIS_INDEX + 1] = ui8_invalid_map[ASSIST_MAP_AXIS_INDEX] - 1;
+  CHECK_EQUAL(send_map(ui8_invalid_map), 0);
+
+  ui8_invalid_map[ASSIST_MAP_AXIS_INDEX + 1] = ui8_map[ASSIST_MAP_AXIS_INDEX + 1];
+  ui8_invalid_map[ASSIST_MAP_AXIS_TYPE_INDEX] = ASSIST_MAP_AXIS_WHEEL_SPEED + 1;
+  CHECK_EQUAL(send_map(ui8_invalid_map), 0);
+  check_map(ui8_map);
+
+  // a map is only applied when all chunks were received
+  CHECK_EQUAL(assist_map_receive_chunk(0, ASSIST_MAP_AXIS_CADENCE, 0), 0);
+  CHECK_EQUAL(assist_map_receive_chunk(ASSIST_MAP_CHUNKS, 0, 0), 0);
+  check_map(ui8_map);
+
+  return test_end("test_assist_map");
+}
@@ -0,0 +1,77 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "main.h"
+#include "battery.h"
+
+#define POWER_MAX_DIV25       20    // 500 W
+#define VOLTAGE_CUT_OFF_X10   300   // 30.0 V
+
+// battery voltage and current in 10 bit ADC steps, current x4 as read_battery_current()
+static uint16_t adc_voltage (uint32_t ui32_voltage_x1000) { return ((ui32_voltage_x1000 * 10) + (BATTERY_VOLTAGE_PER_10_BIT_ADC_STEP_X10000 / 2)) / BATTERY_VOLTAGE_PER_10_BIT_ADC_STEP_X10000; }
+static uint16_t adc_current_x4 (uint32_t ui32_current_x1000) { return (ui32_current_x1000 * 2048) / (BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X512 * 1000); }
+
+// runs the model as the firmware does: update every 4 ms and calc every 20 ms
+static void run (uint32_t ui32_open_circuit_voltage_x1000, uint32_t ui32_resistance_mohm, uint32_t ui32_current_x1000, uint16_t ui16_updates)
+{
+  uint32_t ui32_voltage_x1000 = ui32_open_circuit_voltage_x1000 - ((ui32_current_x1000 * ui32_resistance_mohm) / 1000);
+  uint16_t ui16_i;
+  
+  for (ui16_i = 0; ui16_i < ui16_updates; ui16_i++)
+  {
+    battery_model_update(adc_voltage(ui32_voltage_x1000), adc_current_x4(ui32_current_x1000));
+    if ((ui16_i % 5) == 4) { battery_model_calc(); }
+  }
+}
+
+int main (void)
+{
+  uint16_t ui16_i;
+  
+  // no voltage reading yet: no current
+  battery_model_update(0, 0);
+  battery_model_calc();
+  CHECK_EQUAL(battery_get_open_circuit_voltage_x1000(), 0);
+  CHECK_EQUAL(battery_get_adc_current_max(POWER_MAX_DIV25, VOLTAGE_CUT_OFF_X10), 0);
+  
+  // first voltage reading sets the open circuit voltage, current is available from the first calc
+  battery_model_update(adc_voltage(36000), 0);
+  CHECK_NEAR(battery_get_open_circuit_voltage_x1000(), 36000, 50);
+  battery_model_calc();
+  CHECK_NEAR(battery_get_open_circuit_voltage_x1000(), 36000, 50);
+  
+  // 500 W at 36 V with the default 200 mohm is about 14.7 A: 73 ADC steps
+  CHECK_NEAR(battery_get_adc_current_max(POWER_MAX_DIV25, VOLTAGE_CUT_OFF_X10), 73, 2);
+  
+  // no resistance estimate at constant current, it keeps the default
+  run(36000, 300, 0, 1000);
+  CHECK_EQUAL(battery_get_resistance_mohm(), BATTERY_RESISTANCE_MOHM_DEFAULT);
+  
+  // current steps between 5 A and 15 A, every 0.4 s: resistance is estimated
+  for (ui16_i = 0; ui16_i < 50; ui16_i++)
+  {
+    run(36000, 300, (ui16_i & 1) ? 15000 : 5000, 100);
+  }
+  CHECK_NEAR(battery_get_resistance_mohm(), 300, 40);
+  CHECK_NEAR(battery_get_open_circuit_voltage_x1000(), 36000, 300);
+  
+  // close to the cut off, current is limited so the loaded voltage stays above cut off plus margin
+  for (ui16_i = 0; ui16_i < 50; ui16_i++)
+  {
+    run(31500, 300, (ui16_i & 1) ? 15000 : 5000, 100);
+  }
+  CHECK_NEAR(battery_get_adc_current_max(POWER_MAX_DIV25, VOLTAGE_CUT_OFF_X10), (((31500 - 30500) * 10) / 300) / BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10, 3);
+  
+  // below cut off plus margin there is no current
+  run(30200, 300, 0, 500);
+  CHECK_EQUAL(battery_get_adc_current_max(POWER_MAX_DIV25, VOLTAGE_CUT_OFF_X10), 0);
+  
+  return test_end("test_battery");
+}
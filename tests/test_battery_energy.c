@@ -0,0 +1,130 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "test.h"
+#include "main.h"
+#include "common.h"
+#include "battery.h"
+
+#define TICK_S                    0.001024  // TIM3 tick
+#define RIDE_TICKS                3515625   // one hour
+#define OPEN_CIRCUIT_VOLTAGE      40.0
+#define RESISTANCE_OHM            0.2
+#define CURRENT_FILTER_COEFFICIENT  2       // as read_battery_current()
+
+// true battery current: a new riding current every 10 s with the pedal strokes at 60 RPM, no regen
+static double current (double d_t, double d_base)
+{
+  double d_current = d_base * (1 + (0.6 * sin(2 * M_PI * 2 * d_t)));
+  
+  return (d_current > 0) ? d_current : 0;
+}
+
+// a one hour ride, returns the energy in Ws counted by the motor controller, by the display as before and the true energy, and the charge in As
+// counted by the motor controller and the true charge
+static void ride (uint8_t ui8_current_max, double *p_energy_Ws, double *p_energy_display_Ws, double *p_energy_true_Ws, double *p_charge_As, double *p_charge_true_As)
+{
+  uint32_t ui32_tick;
+  uint32_t ui32_energy_mWs_start = battery_get_energy_mWs();
+  uint32_t ui32_charge_mAs_start = battery_get_charge_mAs();
+  uint16_t ui16_adc_battery_current = 0;
+  uint16_t ui16_adc_battery_current_accumulated = 0;
+  uint16_t ui16_adc_battery_voltage = 0;
+  uint16_t ui16_ticks = 0;
+  uint16_t ui16_run_ticks = 4;
+  uint16_t ui16_display_ticks = 0;
+  uint16_t ui16_power_filtered_x10 = 0;
+  uint32_t ui32_wh_sum_x10 = 0;
+  double d_base = 0;
+  double d_current;
+  double d_voltage;
+  
+  *p_energy_true_Ws = 0;
+  *p_charge_true_As = 0;
+  
+  for (ui32_tick = 0; ui32_tick < RIDE_TICKS; ui32_tick++)
+  {
+    if ((ui32_tick % 9766) == 0) { d_base = (test_random() % (ui8_current_max + 1)); }
+    
+    d_current = current(ui32_tick * TICK_S, d_base);
+    d_voltage = OPEN_CIRCUIT_VOLTAGE - (d_current * RESISTANCE_OHM);
+    *p_energy_true_Ws += d_voltage * d_current * TICK_S;
+    *p_charge_true_As += d_current * TICK_S;
+    
+    // motor_controller() about every 4 ms, late from time to time: ADC readings with 1 step of noise
+    if (++ui16_ticks >= ui16_run_ticks)
+    {
+      ui16_adc_battery_voltage = (uint16_t) ((d_voltage * 10000 / BATTERY_VOLTAGE_PER_10_BIT_ADC_STEP_X10000) + ((test_random() % 100) / 100.0));
+      ui16_adc_battery_current_accumulated -= ui16_adc_battery_current_accumulated >> CURRENT_FILTER_COEFFICIENT;
+      ui16_adc_battery_current = (uint16_t) ((d_current * 512 / BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X512) + ((test_random() % 100) / 100.0));
+      ui16_adc_battery_current_accumulated += ui16_adc_battery_current;
+      
+      battery_calc_charge_and_energy(ui16_adc_battery_voltage, ui16_adc_battery_current, ui16_ticks);
+      
+      ui16_ticks = 0;
+      ui16_run_ticks = ((test_random() % 8) == 0) ? 6 : 4;
+    }
+    
+    // display before the motor controller counted energy: battery voltage and 8 bit battery current received every 100 ms,
+    // power filtered and added every 100 ms
+    if (++ui16_display_ticks >= 98)
+    {
+      uint16_t ui16_battery_voltage_x1000 = ui16_adc_battery_voltage * BATTERY_VOLTAGE_PER_10_BIT_ADC_STEP_X1000;
+      uint8_t ui8_battery_current_x10 = (ui16_adc_battery_current_accumulated >> CURRENT_FILTER_COEFFICIENT) * BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10;
+      
+      ui16_power_filtered_x10 = filter(((uint32_t) ui16_battery_voltage_x1000 * ui8_battery_current_x10) / 1000, ui16_power_filtered_x10, 72);
+      ui32_wh_sum_x10 += ui16_power_filtered_x10;
+      ui16_display_ticks = 0;
+    }
+  }
+  
+  *p_energy_Ws = (battery_get_energy_mWs() - ui32_energy_mWs_start) / 1000.0;
+  *p_charge_As = (battery_get_charge_mAs() - ui32_charge_mAs_start) / 1000.0;
+  *p_energy_display_Ws = ui32_wh_sum_x10 / 100.0;
+}
+
+int main (void)
+{
+  double d_energy_Ws;
+  double d_energy_display_Ws;
+  double d_energy_true_Ws;
+  double d_charge_As;
+  double d_charge_true_As;
+  uint32_t ui32_energy_mWs;
+  
+  // nothing counted without current
+  battery_calc_charge_and_energy(450, 0, 4);
+  CHECK_EQUAL(battery_get_charge_mAs(), 0);
+  CHECK_EQUAL(battery_get_energy_mWs(), 0);
+  
+  // 9.96 A at 38.8 V for 1000 ticks: 10.2 As and 396 Ws
+  for (ui32_energy_mWs = 0; ui32_energy_mWs < 250; ui32_energy_mWs++) { battery_calc_charge_and_energy(450, 50, 4); }
+  CHECK_NEAR(battery_get_charge_mAs(), 10199, 10);
+  CHECK_NEAR(battery_get_energy_mWs(), 396100, 400);
+  
+  // time since the last run is limited
+  ui32_energy_mWs = battery_get_energy_mWs();
+  battery_calc_charge_and_energy(450, 50, 1000);
+  CHECK_NEAR(battery_get_energy_mWs() - ui32_energy_mWs, 396100 / 50, 10);
+  
+  // one hour rides at up to 15 A and at up to 3 A, where the 0.2 A steps of the 8 bit current are large
+  // counted energy and charge are within 0.1 %, the display counted 0.4 % and 0.6 % less
+  ride(15, &d_energy_Ws, &d_energy_display_Ws, &d_energy_true_Ws, &d_charge_As, &d_charge_true_As);
+  CHECK(fabs(d_energy_Ws - d_energy_true_Ws) < (d_energy_true_Ws * 0.001));
+  CHECK(fabs(d_charge_As - d_charge_true_As) < (d_charge_true_As * 0.001));
+  CHECK(fabs(d_energy_display_Ws - d_energy_true_Ws) > (fabs(d_energy_Ws - d_energy_true_Ws) * 10));
+  
+  ride(3, &d_energy_Ws, &d_energy_display_Ws, &d_energy_true_Ws, &d_charge_As, &d_charge_true_As);
+  CHECK(fabs(d_energy_Ws - d_energy_true_Ws) < (d_energy_true_Ws * 0.001));
+  CHECK(fabs(d_charge_As - d_charge_true_As) < (d_charge_true_As * 0.001));
+  CHECK(fabs(d_energy_display_Ws - d_energy_true_Ws) > (fabs(d_energy_Ws - d_energy_true_Ws) * 5));
+  
+  return test_end("test_battery_energy");
+}
@@ -0,0 +1,232 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "main.h"
+#include "boost.h"
+
+#define BOOST_TIME_X10          20    // 2 s
+#define FADE_TIME_X10           10    // 1 s
+#define RIDING_MODE_CURRENT     20    // current target of the riding mode, ADC steps
+#define RIDING_MODE_DUTY_CYCLE  100
+#define TORQUE_ADC_DELTA        100   // pedal torque applied
+#define PEDAL_TORQUE_X100       4000  // 40 Nm
+#define BATTERY_VOLTAGE_X1000   36000
+
+static struct_boost_inputs m_inputs;
+static uint8_t ui8_current_target;
+static uint8_t ui8_duty_cycle_target;
+
+static void init (uint8_t ui8_restart_mode)
+{
+  m_inputs.ui8_feature_enabled = 1;
+  m_inputs.ui8_restart_mode = ui8_restart_mode;
+  m_inputs.ui8_limit_to_max_power = 0;
+  m_inputs.ui8_assist_level = 20;
+  m_inputs.ui8_time_x10 = BOOST_TIME_X10;
+  m_inputs.ui8_fade_time_x10 = FADE_TIME_X10;
+  m_inputs.ui8_assist_enabled = 1;
+  m_inputs.ui16_adc_pedal_torque_delta = 0;
+  m_inputs.ui16_pedal_torque_x100 = PEDAL_TORQUE_X100;
+  m_inputs.ui8_pedal_cadence_RPM = 0;
+  m_inputs.ui8_brakes_enabled = 0;
+  m_inputs.ui16_wheel_speed_x10 = 0;
+  m_inputs.ui16_battery_voltage_x1000 = BATTERY_VOLTAGE_X1000;
+  m_inputs.ui8_adc_battery_current_max = ADC_10_BIT_BATTERY_CURRENT_MAX;
+  
+  // back to the disabled state
+  m_inputs.ui8_feature_enabled = 0;
+  boost_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  m_inputs.ui8_feature_enabled = 1;
+}
+
+// one app run, the riding mode set its targets before boost
+static void step (void)
+{
+  ui8_current_target = RIDING_MODE_CURRENT;
+  ui8_duty_cycle_target = RIDING_MODE_DUTY_CYCLE;
+  boost_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+}
+
+static void pedal (uint8_t ui8_cadence_RPM, uint16_t ui16_torque_adc_delta, uint16_t ui16_wheel_speed_x10)
+{
+  m_inputs.ui8_pedal_cadence_RPM = ui8_cadence_RPM;
+  m_inputs.ui16_adc_pedal_torque_delta = ui16_torque_adc_delta;
+  m_inputs.ui16_wheel_speed_x10 = ui16_wheel_speed_x10;
+}
+
+// pedal from stop through boost and fade, returns the boost current target
+static uint8_t boost_and_fade (void)
+{
+  uint16_t ui16_i;
+  uint8_t ui8_boost_current;
+  uint8_t ui8_current_last;
+  
+  // standing on the pedals at stop does not start boost
+  pedal(0, TORQUE_ADC_DELTA, 0);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_DISABLED);
+  CHECK_EQUAL(ui8_current_target, RIDING_MODE_CURRENT);
+  
+  // pedaling with torque starts boost on the same run
+  pedal(60, TORQUE_ADC_DELTA, 50);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST);
+  
+  // boost current: 40 Nm * 20 W/Nm = 800 W at 36 V = 22.2 A, 111 ADC steps of 0.2 A, duty cycle target to max
+  ui8_boost_current = ui8_current_target;
+  CHECK_EQUAL(ui8_boost_current, 111);
+  CHECK_EQUAL(ui8_duty_cycle_target, PWM_DUTY_CYCLE_MAX);
+  
+  // boost for the boost time
+  for (ui16_i = 1; ui16_i < (BOOST_TIME_X10 * BOOST_TIME_STEPS_PER_UNIT); ui16_i++)
+  {
+    step();
+    CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST);
+    CHECK_EQUAL(ui8_current_target, ui8_boost_current);
+  }
+  
+  // fade: current decreases from the boost current to the riding mode current over the fade time
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_FADE);
+  
+  ui8_current_last = ui8_boost_current;
+  for (ui16_i = 1; ui16_i < (FADE_TIME_X10 * BOOST_TIME_STEPS_PER_UNIT); ui16_i++)
+  {
+    step();
+    CHECK_EQUAL(boost_get_state(), BOOST_STATE_FADE);
+    CHECK(ui8_current_target <= ui8_current_last);
+    CHECK(ui8_current_target > RIDING_MODE_CURRENT);
+    CHECK_EQUAL(ui8_duty_cycle_target, PWM_DUTY_CYCLE_MAX);
+    ui8_current_last = ui8_current_target;
+  }
+  
+  // fade over, riding mode current
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_WAIT_TO_RESTART);
+  CHECK_EQUAL(ui8_current_target, RIDING_MODE_CURRENT);
+  CHECK_EQUAL(ui8_duty_cycle_target, RIDING_MODE_DUTY_CYCLE);
+  
+  return ui8_boost_current;
+}
+
+int main (void)
+{
+  uint16_t ui16_i;
+  
+  // restart after the wheel stops: disabled, boost, fade, wait to restart, boost
+  init(0);
+  boost_and_fade();
+  
+  // pedaling stops with the bike rolling: no restart
+  pedal(0, 0, 150);
+  for (ui16_i = 0; ui16_i < 100; ui16_i++) { step(); }
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_WAIT_TO_RESTART);
+  pedal(60, TORQUE_ADC_DELTA, 150);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_WAIT_TO_RESTART);
+  CHECK_EQUAL(ui8_current_target, RIDING_MODE_CURRENT);
+  
+  // wheel stopped with torque on the pedals: no restart
+  pedal(0, TORQUE_ADC_DELTA, 0);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_WAIT_TO_RESTART);
+  
+  // wheel stopped without torque: restart, boost again
+  pedal(0, 0, 0);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_DISABLED);
+  boost_and_fade();
+  
+  // restart after pedaling stops: disabled, boost, fade, wait to restart, boost
+  init(1);
+  boost_and_fade();
+  
+  // pedaling on: no restart
+  for (ui16_i = 0; ui16_i < 100; ui16_i++) { step(); }
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_WAIT_TO_RESTART);
+  
+  // pedaling stops with the bike rolling: restart, boost again without stopping the wheel
+  pedal(0, 0, 150);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_DISABLED);
+  boost_and_fade();
+  
+  // pedal torque released during boost: wait to restart without fade
+  init(1);
+  pedal(60, TORQUE_ADC_DELTA, 50);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST);
+  pedal(60, BOOST_PEDAL_TORQUE_ADC_DELTA_MIN, 50);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_WAIT_TO_RESTART);
+  CHECK_EQUAL(ui8_current_target, RIDING_MODE_CURRENT);
+  
+  // braking during boost and fade resets boost
+  init(0);
+  pedal(60, TORQUE_ADC_DELTA, 50);
+  step();
+  m_inputs.ui8_brakes_enabled = 1;
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_DISABLED);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_DISABLED);
+  CHECK_EQUAL(ui8_current_target, RIDING_MODE_CURRENT);
+  m_inputs.ui8_brakes_enabled = 0;
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST);
+  for (ui16_i = 0; ui16_i < (BOOST_TIME_X10 * BOOST_TIME_STEPS_PER_UNIT); ui16_i++) { step(); }
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_FADE);
+  m_inputs.ui8_brakes_enabled = 1;
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_DISABLED);
+  m_inputs.ui8_brakes_enabled = 0;
+  
+  // no fade time: wait to restart at the end of boost
+  init(0);
+  m_inputs.ui8_fade_time_x10 = 0;
+  pedal(60, TORQUE_ADC_DELTA, 50);
+  for (ui16_i = 0; ui16_i < (BOOST_TIME_X10 * BOOST_TIME_STEPS_PER_UNIT); ui16_i++) { step(); }
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_WAIT_TO_RESTART);
+  
+  // boost limited to max power: max current
+  init(0);
+  m_inputs.ui8_limit_to_max_power = 1;
+  pedal(60, TORQUE_ADC_DELTA, 50);
+  step();
+  CHECK_EQUAL(ui8_current_target, ADC_10_BIT_BATTERY_CURRENT_MAX);
+  
+  // riding mode without torque assist: state machine runs, targets are not changed
+  init(0);
+  m_inputs.ui8_assist_enabled = 0;
+  pedal(60, TORQUE_ADC_DELTA, 50);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST);
+  CHECK_EQUAL(ui8_current_target, RIDING_MODE_CURRENT);
+  CHECK_EQUAL(ui8_duty_cycle_target, RIDING_MODE_DUTY_CYCLE);
+  
+  // riding mode current over the boost current is kept
+  m_inputs.ui8_assist_enabled = 1;
+  m_inputs.ui16_pedal_torque_x100 = 500;
+  step();
+  CHECK_EQUAL(ui8_current_target, RIDING_MODE_CURRENT);
+  CHECK_EQUAL(ui8_duty_cycle_target, RIDING_MODE_DUTY_CYCLE);
+  
+  // feature disabled or no boost time
+  init(0);
+  m_inputs.ui8_time_x10 = 0;
+  pedal(60, TORQUE_ADC_DELTA, 50);
+  step();
+  CHECK_EQUAL(boost_get_state(), BOOST_STATE_BOOST_DISABLED);
+  CHECK_EQUAL(ui8_current_target, RIDING_MODE_CURRENT);
+  
+  return test_end("test_boost");
+}
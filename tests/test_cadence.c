@@ -0,0 +1,161 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "main.h"
+#include "stm8s_gpio.h"
+#include "pas.h"
+
+void GPIO_Init (GPIO_TypeDef* GPIOx, GPIO_Pin_TypeDef GPIO_Pin, GPIO_Mode_TypeDef GPIO_Mode) { }
+
+#define TICKS_PER_RUN_X10     3125    // 20 ms in PWM cycles x10
+
+// simulated cadence sensor in standard mode, as in the PWM interrupt
+static double d_crank_magnets = 0;
+static uint16_t ui16_ticks = 0;
+static uint16_t ui16_ticks_counter = 0;
+static uint8_t ui8_edge_counter = 0;
+static uint8_t ui8_edge_counter_old = 0;
+static uint32_t ui32_time_x10 = 0;
+static uint32_t ui32_tick = 0;
+
+
+
+static void reset (void)
+{
+  d_crank_magnets = 0;
+  ui16_ticks = 0;
+  ui16_ticks_counter = 0;
+  ui8_edge_counter = 0;
+  ui8_edge_counter_old = 0;
+  pas_cadence_estimator(0, 0, 0, 468750, 468750);
+}
+
+
+
+// advance the crank one PWM cycle at a cadence in RPM x10
+static void pwm_cycle (double d_cadence_RPM_x10)
+{
+  double d_magnets = d_crank_magnets + ((d_cadence_RPM_x10 / 600.0) * CADENCE_SENSOR_NUMBER_MAGNETS / PWM_CYCLES_SECOND);
+
+  if (ui16_ticks_counter < CADENCE_SENSOR_TICKS_COUNTER_MIN) { ++ui16_ticks_counter; }
+  else { ui16_ticks = 0; }
+
+  // new magnet
+  if ((long) d_magnets != (long) d_crank_magnets)
+  {
+    ui16_ticks = ui16_ticks_counter;
+    ui16_ticks_counter = 0;
+    ++ui8_edge_counter;
+  }
+
+  d_crank_magnets = d_magnets;
+}
+
+
+
+// run 20 ms of PWM cycles and then the estimator, returns estimated cadence
+static uint16_t run (double d_cadence_RPM_x10)
+{
+  uint16_t ui16_cadence;
+
+  ui32_time_x10 += TICKS_PER_RUN_X10;
+  while ((ui32_tick * 10) < ui32_time_x10) { pwm_cycle(d_cadence_RPM_x10); ui32_tick++; }
+
+  ui16_cadence = pas_cadence_estimator(ui16_ticks, ui8_edge_counter - ui8_edge_counter_old, ui16_ticks_counter, 468750, 468750);
+  ui8_edge_counter_old = ui8_edge_counter;
+
+  return ui16_cadence;
+}
+
+
+
+// constant cadence, after settling the estimate is within tolerance and the error does not grow
+static void check_constant (double d_cadence_RPM_x10, uint16_t ui16_tolerance)
+{
+  uint16_t ui16_i;
+  uint16_t ui16_cadence;
+
+  reset();
+  for (ui16_i = 0; ui16_i < 500; ui16_i++) { run(d_cadence_RPM_x10); }
+
+  for (ui16_i = 0; ui16_i < 1000; ui16_i++)
+  {
+    ui16_cadence = run(d_cadence_RPM_x10);
+    CHECK_NEAR(ui16_cadence, (long) d_cadence_RPM_x10, ui16_tolerance);
+  }
+}
+
+
+
+// cadence changes linearly, estimate follows without growing oscillation
+static void check_ramp (double d_from_RPM_x10, double d_to_RPM_x10, double d_seconds, uint16_t ui16_tolerance)
+{
+  uint16_t ui16_runs = d_seconds * 50;
+  uint16_t ui16_i;
+  double d_cadence;
+
+  reset();
+  for (ui16_i = 0; ui16_i < 250; ui16_i++) { run(d_from_RPM_x10); }
+
+  for (ui16_i = 0; ui16_i < ui16_runs; ui16_i++)
+  {
+    d_cadence = d_from_RPM_x10 + ((d_to_RPM_x10 - d_from_RPM_x10) * ui16_i / ui16_runs);
+
+    // skip the start of the ramp while the rate is being learned
+    if (ui16_i < 100) { run(d_cadence); }
+    else { CHECK_NEAR(run(d_cadence), (long) d_cadence, ui16_tolerance); }
+  }
+}
+
+
+
+int main (void)
+{
+  uint16_t ui16_i;
+  uint16_t ui16_cadence;
+  uint16_t ui16_cadence_old;
+
+  // low cadence with up to 30 runs between transitions, the rate must not make the estimate oscillate
+  check_constant(50, 2);
+  check_constant(80, 2);
+  check_constant(150, 2);
+
+  // normal and high cadence, several transitions between runs
+  check_constant(600, 2);
+  check_constant(900, 3);
+  check_constant(1400, 5);
+
+  // low cadence changing slowly and normal cadence changing fast
+  check_ramp(60, 200, 20, 5);
+  check_ramp(200, 60, 20, 5);
+  check_ramp(500, 1000, 4, 30);
+  check_ramp(1000, 500, 4, 30);
+
+  // rider stops pedaling, estimate decays and never goes up
+  reset();
+  for (ui16_i = 0; ui16_i < 250; ui16_i++) { run(700); }
+
+  ui16_cadence_old = run(0);
+  for (ui16_i = 0; ui16_i < 50; ui16_i++)
+  {
+    ui16_cadence = run(0);
+    CHECK(ui16_cadence <= ui16_cadence_old);
+    ui16_cadence_old = ui16_cadence;
+  }
+
+  CHECK_EQUAL(ui16_cadence, 0);
+
+  // starts from the first measurement
+  reset();
+  for (ui16_i = 0; ui16_i < 10; ui16_i++) { ui16_cadence = run(600); }
+  CHECK_NEAR(ui16_cadence, 600, 10);
+
+  return test_end("test_cadence");
+}
@@ -0,0 +1,77 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "common.h"
+
+#define RANDOM_FRAMES   200000
+
+// CRC-16 shifting 8 bits one by one, as crc16() did before the 4 bit table
+static void crc16_bitwise (uint8_t ui8_data, uint16_t *ui16_crc)
+{
+  uint8_t ui8_i;
+  
+  *ui16_crc ^= (uint16_t) ui8_data;
+  
+  for (ui8_i = 8; ui8_i > 0; ui8_i--)
+  {
+    if (*ui16_crc & 0x0001) { *ui16_crc = (*ui16_crc >> 1) ^ 0xA001; }
+    else { *ui16_crc >>= 1; }
+  }
+}
+
+int main (void)
+{
+  static const uint8_t ui8_check[9] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+  uint8_t ui8_frame[255];
+  uint16_t ui16_crc_bitwise;
+  uint16_t ui16_crc;
+  uint32_t ui32_i;
+  uint16_t ui16_length;
+  uint16_t ui16_j;
+  
+  // CRC-16/MODBUS check value
+  CHECK_EQUAL(crc16_buf(ui8_check, 9), 0x4B37);
+  
+  // empty frame is the initial value
+  CHECK_EQUAL(crc16_buf(ui8_check, 0), 0xffff);
+  
+  // every byte value from every CRC value: crc16() is the same as the bit by bit CRC
+  for (ui32_i = 0; ui32_i < 0x10000; ui32_i += 7)
+  {
+    for (ui16_j = 0; ui16_j < 256; ui16_j++)
+    {
+      ui16_crc_bitwise = ui32_i;
+      ui16_crc = ui32_i;
+      crc16_bitwise(ui16_j, &ui16_crc_bitwise);
+      crc16(ui16_j, &ui16_crc);
+      CHECK_EQUAL(ui16_crc, ui16_crc_bitwise);
+    }
+  }
+  
+  // random frames of every length, the frame lengths of the firmware included: crc16_buf() and crc16() for each byte are the same as the bit by bit CRC
+  for (ui32_i = 0; ui32_i < RANDOM_FRAMES; ui32_i++)
+  {
+    ui16_length = (ui32_i < 256) ? ui32_i : (test_random() % 256);
+    for (ui16_j = 0; ui16_j < ui16_length; ui16_j++) { ui8_frame[ui16_j] = test_random(); }
+    
+    ui16_crc_bitwise = 0xffff;
+    ui16_crc = 0xffff;
+    for (ui16_j = 0; ui16_j < ui16_length; ui16_j++)
+    {
+      crc16_bitwise(ui8_frame[ui16_j], &ui16_crc_bitwise);
+      crc16(ui8_frame[ui16_j], &ui16_crc);
+    }
+    
+    CHECK_EQUAL(crc16_buf(ui8_frame, ui16_length), ui16_crc_bitwise);
+    CHECK_EQUAL(ui16_crc, ui16_crc_bitwise);
+  }
+  
+  return test_end("test_crc");
+}
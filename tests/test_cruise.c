@@ -0,0 +1,220 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "test.h"
+#include "main.h"
+#include "pid.h"
+#include "cruise.h"
+
+#define MASS_KG                   100.0   // bike and rider
+#define CDA_M2                    0.5
+#define ROLLING_RESISTANCE        0.008
+#define MOTOR_RESISTANCE          0.5     // wheel referred
+#define MOTOR_SPEED_MAX_M_S       10.0    // 36 km/h at the nominal voltage of the motor, no load
+#define BATTERY_CURRENT_MAX       (ADC_10_BIT_BATTERY_CURRENT_MAX * (BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10 / 10.0))
+#define DUTY_CYCLE_RAMP_UP        ((EBIKE_APP_CONTROLLER_PERIOD_MS * 1000.0) / (CRUISE_DUTY_CYCLE_RAMP_UP_INVERSE_STEP * 64.0))
+#define DUTY_CYCLE_RAMP_DOWN      ((EBIKE_APP_CONTROLLER_PERIOD_MS * 1000.0) / (PWM_DUTY_CYCLE_RAMP_DOWN_INVERSE_STEP_DEFAULT * 64.0))
+#define DT_S                      (EBIKE_APP_CONTROLLER_PERIOD_MS / 1000.0)
+#define RUNS_PER_SECOND           (1000 / EBIKE_APP_CONTROLLER_PERIOD_MS)
+
+// simulated bike with the motor driving the wheel through a freewheel, one step per EBIKE_APP_CONTROLLER_PERIOD_MS
+static struct_cruise_inputs m_inputs;
+static double d_speed_m_s;
+static double d_duty_cycle;
+static double d_battery_voltage;
+static double d_motor_speed_per_volt;     // wheel speed per volt
+static double d_grade;
+
+static double force_resistance (double d_speed) { return (0.6 * CDA_M2 * d_speed * d_speed) + (MASS_KG * 9.81 * (ROLLING_RESISTANCE + d_grade)); }
+
+// motor force at the duty cycle and speed, battery current limited, the freewheel does not brake
+static double force_motor (double d_duty, double d_speed)
+{
+  double d_voltage = (d_duty / PWM_DUTY_CYCLE_MAX) * d_battery_voltage;
+  double d_current = (d_voltage - (d_speed / d_motor_speed_per_volt)) / MOTOR_RESISTANCE;
+  
+  if (d_current < 0) { return 0; }
+  if ((d_current * (d_duty / PWM_DUTY_CYCLE_MAX)) > BATTERY_CURRENT_MAX) { d_current = (BATTERY_CURRENT_MAX * PWM_DUTY_CYCLE_MAX) / d_duty; }
+  
+  return d_current / d_motor_speed_per_volt;
+}
+
+static void init (uint8_t ui8_motor_type, double d_voltage, double d_speed_kmh)
+{
+  m_inputs.ui8_kp_x10 = 0;
+  m_inputs.ui8_ki_x100 = 0;
+  m_inputs.ui8_kd_x10 = 0;
+  m_inputs.ui8_motor_type = ui8_motor_type;
+  m_inputs.ui8_speed_target = 0;
+  
+  d_battery_voltage = d_voltage;
+  d_motor_speed_per_volt = MOTOR_SPEED_MAX_M_S / ((ui8_motor_type & 1) ? 36.0 : 48.0);
+  d_speed_m_s = d_speed_kmh / 3.6;
+  d_grade = 0;
+  
+  // duty cycle the rider left the motor at, it holds the speed on the flat
+  d_duty_cycle = 0;
+  while (force_motor(d_duty_cycle, d_speed_m_s) < force_resistance(d_speed_m_s)) { d_duty_cycle += 0.01; }
+  
+  cruise_reset();
+}
+
+static uint16_t speed_x10 (void) { return (uint16_t) ((d_speed_m_s * 36.0) + 0.5); }
+
+// one app run: cruise sets the duty cycle target, the PWM interrupt ramps the duty cycle to it
+static uint8_t step (void)
+{
+  uint8_t ui8_duty_cycle_target;
+  
+  m_inputs.ui16_wheel_speed_x10 = speed_x10();
+  m_inputs.ui16_battery_voltage_x1000 = (uint16_t) (d_battery_voltage * 1000.0);
+  m_inputs.ui8_duty_cycle = (uint8_t) d_duty_cycle;
+  ui8_duty_cycle_target = cruise_controller(&m_inputs);
+  
+  if (ui8_duty_cycle_target > d_duty_cycle) { d_duty_cycle = fmin(ui8_duty_cycle_target, d_duty_cycle + DUTY_CYCLE_RAMP_UP); }
+  else { d_duty_cycle = fmax(ui8_duty_cycle_target, d_duty_cycle - DUTY_CYCLE_RAMP_DOWN); }
+  
+  d_speed_m_s += ((force_motor(d_duty_cycle, d_speed_m_s) - force_resistance(d_speed_m_s)) / MASS_KG) * DT_S;
+  
+  return ui8_duty_cycle_target;
+}
+
+// cruise at the speed when it starts, a 4 % slope starts and ends: speed dip and recovery, returns the max speed error in 0.1 km/h
+static uint16_t grade_step (uint8_t ui8_motor_type, double d_voltage)
+{
+  uint16_t ui16_target_x10;
+  uint16_t ui16_error_max = 0;
+  uint16_t ui16_i;
+  uint8_t ui8_duty_cycle_start;
+  
+  init(ui8_motor_type, d_voltage, 25.0);
+  ui16_target_x10 = speed_x10();
+  ui8_duty_cycle_start = (uint8_t) d_duty_cycle;
+  
+  // feed forward: cruise starts at the duty cycle of the motor, speed does not change
+  CHECK_NEAR(step(), ui8_duty_cycle_start, 1);
+  for (ui16_i = 0; ui16_i < (5 * RUNS_PER_SECOND); ui16_i++) { step(); CHECK_NEAR(speed_x10(), ui16_target_x10, 3); }
+  
+  // slope: speed drops, then comes back within 0.5 km/h and stays there
+  d_grade = 0.04;
+  for (ui16_i = 0; ui16_i < (15 * RUNS_PER_SECOND); ui16_i++)
+  {
+    step();
+    if (abs(speed_x10() - ui16_target_x10) > ui16_error_max) { ui16_error_max = abs(speed_x10() - ui16_target_x10); }
+    if (ui16_i >= (8 * RUNS_PER_SECOND)) { CHECK_NEAR(speed_x10(), ui16_target_x10, 5); }
+  }
+  
+  // no steady state error
+  CHECK_NEAR(speed_x10(), ui16_target_x10, 1);
+  
+  // flat again: speed overshoots, then comes back
+  d_grade = 0;
+  for (ui16_i = 0; ui16_i < (15 * RUNS_PER_SECOND); ui16_i++)
+  {
+    step();
+    if (abs(speed_x10() - ui16_target_x10) > ui16_error_max) { ui16_error_max = abs(speed_x10() - ui16_target_x10); }
+    if (ui16_i >= (8 * RUNS_PER_SECOND)) { CHECK_NEAR(speed_x10(), ui16_target_x10, 5); }
+  }
+  
+  return ui16_error_max;
+}
+
+int main (void)
+{
+  struct_pid_controller m_pid;
+  uint16_t ui16_i;
+  uint8_t ui8_duty_cycle_start;
+  
+  // gain schedule: gain table of the motor type, 48 V gains on 48 V, 36 V gains on 36 V, integral gain per run
+  init(0, 48.0, 25.0);
+  m_inputs.ui16_battery_voltage_x1000 = 48000;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (120 * 256) / 10);
+  CHECK_EQUAL(m_pid.ui16_ki_x256, (100 * 256 * EBIKE_APP_CONTROLLER_PERIOD_MS) / (100 * 100));
+  CHECK_EQUAL(m_pid.ui16_kd_x256, 0);
+  CHECK_EQUAL(m_pid.i16_output_min, 0);
+  CHECK_EQUAL(m_pid.i16_output_max, CRUISE_PID_OUTPUT_MAX);
+  
+  m_inputs.ui8_motor_type = 1;
+  m_inputs.ui16_battery_voltage_x1000 = 36000;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (140 * 256) / 10);
+  CHECK_EQUAL(m_pid.ui16_ki_x256, (70 * 256 * EBIKE_APP_CONTROLLER_PERIOD_MS) / (100 * 100));
+  
+  // experimental high cadence modes use the gains of their motor, unknown motor types the 48 V gains
+  m_inputs.ui8_motor_type = 3;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (140 * 256) / 10);
+  m_inputs.ui8_motor_type = 2;
+  m_inputs.ui16_battery_voltage_x1000 = 48000;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (120 * 256) / 10);
+  m_inputs.ui8_motor_type = 7;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (120 * 256) / 10);
+  
+  // gains received from the display replace the table when any of them is set, derivative gain per run
+  m_inputs.ui8_motor_type = 0;
+  m_inputs.ui8_kd_x10 = 5;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, 0);
+  CHECK_EQUAL(m_pid.ui16_ki_x256, 0);
+  CHECK_EQUAL(m_pid.ui16_kd_x256, (5 * 256 * 100) / (10 * EBIKE_APP_CONTROLLER_PERIOD_MS));
+  m_inputs.ui8_kd_x10 = 0;
+  
+  // voltage scaling: nominal over battery voltage, so the loop gain in speed per duty cycle stays the same
+  m_inputs.ui16_battery_voltage_x1000 = 36000;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (120 * ((480 * 25600) / 36000)) / 10);
+  m_inputs.ui16_battery_voltage_x1000 = 58800;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (120 * ((480 * 25600) / 58800)) / 10);
+  
+  // voltage scale limited to 2, 1 without battery voltage, the 0.5 limit is over the max battery voltage of 65.5 V
+  m_inputs.ui16_battery_voltage_x1000 = 20000;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (120 * CRUISE_PID_VOLTAGE_SCALE_MAX_X256) / 10);
+  m_inputs.ui16_battery_voltage_x1000 = 65000;
+  m_inputs.ui8_motor_type = 1;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (140 * ((360 * 25600) / 65000)) / 10);
+  m_inputs.ui16_battery_voltage_x1000 = 0;
+  cruise_set_gains(&m_pid, &m_inputs);
+  CHECK_EQUAL(m_pid.ui16_kp_x256, (140 * 256) / 10);
+  
+  // 4 % slope at 25 km/h: both motors at their nominal voltage and with lower and higher battery voltages, the speed
+  // error stays under 1 km/h and within 0.3 km/h for each motor as the gains are scaled with the voltage
+  CHECK(grade_step(0, 48.0) <= 10);
+  CHECK(grade_step(0, 42.0) <= 10);
+  CHECK(grade_step(0, 54.6) <= 10);
+  CHECK(grade_step(1, 36.0) <= 10);
+  CHECK(grade_step(1, 42.0) <= 10);
+  CHECK(grade_step(1, 48.0) <= 10);
+  CHECK_NEAR(grade_step(0, 42.0), grade_step(0, 54.6), 3);
+  CHECK_NEAR(grade_step(1, 36.0), grade_step(1, 48.0), 3);
+  
+  // speed target received from the display: cruise starts at the duty cycle of the motor and accelerates to the target
+  init(0, 48.0, 20.0);
+  m_inputs.ui8_speed_target = 25;
+  ui8_duty_cycle_start = (uint8_t) d_duty_cycle;
+  CHECK(step() >= ui8_duty_cycle_start);
+  CHECK(d_duty_cycle <= (ui8_duty_cycle_start + DUTY_CYCLE_RAMP_UP));
+  for (ui16_i = 0; ui16_i < (15 * RUNS_PER_SECOND); ui16_i++) { step(); }
+  CHECK_NEAR(speed_x10(), 250, 5);
+  
+  // without feed forward the PID output would start at 0: the first duty cycle target is not below the duty cycle
+  init(1, 36.0, 30.0);
+  ui8_duty_cycle_start = (uint8_t) d_duty_cycle;
+  CHECK(ui8_duty_cycle_start > 100);
+  CHECK_NEAR(step(), ui8_duty_cycle_start, 1);
+  
+  return test_end("test_cruise");
+}
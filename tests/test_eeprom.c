@@ -0,0 +1,218 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "stm8s.h"
+#include "stm8s_flash.h"
+#include "eeprom.h"
+#include "ebike_app.h"
+#include "assist_map.h"
+#include "foc_angle_tracker.h"
+
+#define POWER_CUTS          20000
+#define PROGRAMMING_POLLS   3       // end of programming flag is set on the third read after a byte is programmed
+
+// configuration and data stored in EEPROM
+static struct_configuration_variables configuration_variables;
+static uint8_t ui8_assist_map[ASSIST_MAP_BYTES];
+static uint8_t ui8_foc_angle_offsets[FOC_ANGLE_TRACKER_BINS];
+
+struct_configuration_variables* get_configuration_variables (void) { return &configuration_variables; }
+uint8_t* assist_map_get_data (void) { return ui8_assist_map; }
+uint8_t* foc_angle_tracker_get_offsets (void) { return ui8_foc_angle_offsets; }
+
+// simulated data EEPROM, a byte being programmed has its new value when the end of programming flag is set
+static uint8_t ui8_eeprom[EEPROM_BYTES_STORED];
+static int16_t i16_programming_index = -1;
+static uint8_t ui8_programming_value;
+static uint8_t ui8_programming_polls;
+static uint32_t ui32_programmed_bytes = 0;
+
+void FLASH_DeInit (void) { }
+void FLASH_SetProgrammingTime (FLASH_ProgramTime_TypeDef FLASH_ProgTime) { }
+void FLASH_Unlock (FLASH_MemType_TypeDef FLASH_MemType) { }
+void FLASH_Lock (FLASH_MemType_TypeDef FLASH_MemType) { }
+uint8_t FLASH_ReadByte (uint32_t Address) { return ui8_eeprom[Address - EEPROM_BASE_ADDRESS]; }
+
+void FLASH_ProgramByte (uint32_t Address, uint8_t Data)
+{
+  CHECK_EQUAL(i16_programming_index, -1);
+  i16_programming_index = Address - EEPROM_BASE_ADDRESS;
+  ui8_programming_value = Data;
+  ui8_programming_polls = 0;
+  ui32_programmed_bytes++;
+}
+
+FlagStatus FLASH_GetFlagStatus (FLASH_Flag_TypeDef FLASH_FLAG)
+{
+  if (FLASH_FLAG != FLASH_FLAG_EOP) { return SET; }
+  if ((i16_programming_index >= 0) && (++ui8_programming_polls < PROGRAMMING_POLLS)) { return RESET; }
+  
+  if (i16_programming_index >= 0) { ui8_eeprom[i16_programming_index] = ui8_programming_value; }
+  i16_programming_index = -1;
+  
+  return SET;
+}
+
+// power is lost: a byte being programmed keeps its old value or gets a random value
+static void power_cut (void)
+{
+  if (i16_programming_index >= 0)
+  {
+    if (test_random() & 1) { ui8_eeprom[i16_programming_index] = test_random(); }
+    i16_programming_index = -1;
+  }
+}
+
+// configuration as EEPROM_init() sets it
+typedef struct _stored
+{
+  struct_configuration_variables configuration;
+  uint8_t ui8_assist_map[ASSIST_MAP_BYTES];
+  uint8_t ui8_foc_angle_offsets[FOC_ANGLE_TRACKER_BINS];
+} struct_stored;
+
+static void get_stored (struct_stored *p_stored)
+{
+  p_stored->configuration = configuration_variables;
+  memcpy(p_stored->ui8_assist_map, ui8_assist_map, ASSIST_MAP_BYTES);
+  memcpy(p_stored->ui8_foc_angle_offsets, ui8_foc_angle_offsets, FOC_ANGLE_TRACKER_BINS);
+}
+
+static uint8_t stored_equal (const struct_stored *p_stored)
+{
+  const struct_configuration_variables *p_configuration = &p_stored->configuration;
+  
+  return (p_configuration->ui8_motor_power_x10 == configuration_variables.ui8_motor_power_x10) &&
+         (p_configuration->ui16_battery_low_voltage_cut_off_x10 == configuration_variables.ui16_battery_low_voltage_cut_off_x10) &&
+         (p_configuration->ui16_wheel_perimeter == configuration_variables.ui16_wheel_perimeter) &&
+         (p_configuration->ui8_wheel_speed_max == configuration_variables.ui8_wheel_speed_max) &&
+         (p_configuration->ui8_motor_type == configuration_variables.ui8_motor_type) &&
+         (p_configuration->ui8_pedal_torque_per_10_bit_ADC_step_x100 == configuration_variables.ui8_pedal_torque_per_10_bit_ADC_step_x100) &&
+         (p_configuration->ui16_adc_pedal_torque_offset == configuration_variables.ui16_adc_pedal_torque_offset) &&
+         (p_configuration->ui8_motor_winding_temperature == configuration_variables.ui8_motor_winding_temperature) &&
+         (p_configuration->ui8_motor_case_temperature == configuration_variables.ui8_motor_case_temperature) &&
+         !memcmp(p_stored->ui8_assist_map, ui8_assist_map, ASSIST_MAP_BYTES) &&
+         !memcmp(p_stored->ui8_foc_angle_offsets, ui8_foc_angle_offsets, FOC_ANGLE_TRACKER_BINS);
+}
+
+// changes some stored values, as the motor controller does at the end of a ride
+static void change_configuration (void)
+{
+  switch (test_random() % 4)
+  {
+    case 0:
+      configuration_variables.ui16_adc_pedal_torque_offset += 1 + (test_random() % 300);
+    break;
+    
+    case 1:
+      configuration_variables.ui8_motor_winding_temperature = test_random();
+      configuration_variables.ui8_motor_case_temperature = test_random();
+    break;
+    
+    case 2:
+      ui8_foc_angle_offsets[test_random() % FOC_ANGLE_TRACKER_BINS] += 1 + (test_random() % 10);
+    break;
+    
+    default:
+      configuration_variables.ui16_wheel_perimeter ^= test_random() | 0x101;
+      configuration_variables.ui16_battery_low_voltage_cut_off_x10 ^= test_random();
+      ui8_assist_map[test_random() % ASSIST_MAP_BYTES] ^= 0x80;
+    break;
+  }
+}
+
+// housekeeping runs until the write is finished, returns the number of runs
+static uint16_t write_finish (void)
+{
+  uint16_t ui16_runs = 0;
+  
+  while (EEPROM_write_step()) { ui16_runs++; }
+  
+  return ui16_runs;
+}
+
+int main (void)
+{
+  struct_stored m_defaults;
+  struct_stored m_old;
+  struct_stored m_new;
+  uint32_t ui32_i;
+  uint16_t ui16_runs;
+  uint16_t ui16_j;
+  uint32_t ui32_old = 0;
+  uint32_t ui32_new = 0;
+  uint32_t ui32_default = 0;
+  
+  // empty EEPROM: default values are used right away without programming any byte, they are written on the next housekeeping runs, key last
+  EEPROM_init();
+  CHECK_EQUAL(ui32_programmed_bytes, 0);
+  get_stored(&m_defaults);
+  CHECK_EQUAL(configuration_variables.ui16_wheel_perimeter, DEFAULT_VALUE_WHEEL_PERIMETER_0 + (DEFAULT_VALUE_WHEEL_PERIMETER_1 << 8));
+  CHECK_EQUAL(ui8_eeprom[0], 0);
+  ui16_runs = write_finish();
+  CHECK(ui16_runs <= (EEPROM_BYTES_STORED * PROGRAMMING_POLLS));
+  CHECK_EQUAL(ui8_eeprom[0], DEFAULT_VALUE_KEY);
+  EEPROM_init();
+  CHECK(stored_equal(&m_defaults));
+  
+  // writing an unchanged configuration programs nothing, the key is kept
+  ui32_programmed_bytes = 0;
+  EEPROM_controller(WRITE_TO_MEMORY);
+  write_finish();
+  CHECK_EQUAL(ui32_programmed_bytes, 0);
+  
+  // a changed byte: the key is invalidated, the byte is written and then the key
+  configuration_variables.ui8_motor_case_temperature++;
+  get_stored(&m_new);
+  EEPROM_controller(WRITE_TO_MEMORY);
+  CHECK_EQUAL(EEPROM_write_step(), 1);
+  for (ui16_j = 0; ui16_j < PROGRAMMING_POLLS; ui16_j++) { EEPROM_write_step(); }
+  CHECK_EQUAL(ui8_eeprom[0], INVALID_VALUE_KEY);
+  write_finish();
+  CHECK_EQUAL(ui32_programmed_bytes, 3);
+  CHECK_EQUAL(ui8_eeprom[0], DEFAULT_VALUE_KEY);
+  EEPROM_init();
+  CHECK(stored_equal(&m_new));
+  
+  // power is lost at a random time of a write: at next power on the configuration is the old one, the new one or the default one,
+  // never a mix of them
+  for (ui32_i = 0; ui32_i < POWER_CUTS; ui32_i++)
+  {
+    get_stored(&m_old);
+    change_configuration();
+    get_stored(&m_new);
+    EEPROM_controller(WRITE_TO_MEMORY);
+    
+    ui16_runs = test_random() % (4 * 8 * PROGRAMMING_POLLS);
+    for (ui16_j = 0; ui16_j < ui16_runs; ui16_j++) { EEPROM_write_step(); }
+    power_cut();
+    
+    EEPROM_init();
+    
+    if (stored_equal(&m_new)) { ui32_new++; }
+    else if (stored_equal(&m_old)) { ui32_old++; }
+    else if (stored_equal(&m_defaults)) { ui32_default++; }
+    else { CHECK(0); }
+    
+    // the write started at power on finishes and is read back at the next power on
+    get_stored(&m_new);
+    write_finish();
+    EEPROM_init();
+    CHECK(stored_equal(&m_new));
+  }
+  
+  // all cases happened
+  CHECK(ui32_old > 0);
+  CHECK(ui32_new > 0);
+  CHECK(ui32_default > 0);
+  
+  return test_end("test_eeprom");
+}
@@ -0,0 +1,240 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "main.h"
+#include "common.h"
+#include "fault.h"
+
+#define PWM_CYCLES_PER_CONTROLLER_RUN   ((EBIKE_APP_CONTROLLER_PERIOD_MS * 1000L) / 64)   // PWM cycle of 64 us
+#define HILL_HOLD_ADC_BATTERY_CURRENT   30    // 6 A, hill hold max in ebike_app.c
+#define ADC_BATTERY_VOLTAGE             150
+#define HALL_SENSORS_STATE              4
+
+// PWM interrupt runs with the same inputs, returns the first cycle a fault is detected, 0 if none
+static uint32_t pwm (uint32_t ui32_cycles, uint8_t ui8_hall_sensors_state, uint16_t ui16_adc_battery_current, uint8_t ui8_adc_battery_voltage, uint8_t ui8_fault)
+{
+  uint32_t ui32_i;
+  
+  for (ui32_i = 1; ui32_i <= ui32_cycles; ui32_i++)
+  {
+    fault_detect(ui8_hall_sensors_state, ui16_adc_battery_current, ui8_adc_battery_voltage);
+    if (ui8_g_fault_detected[ui8_fault]) { return ui32_i; }
+  }
+  
+  return 0;
+}
+
+// motor runs with a hall sensors transition every ui16_hall_period PWM cycles
+static uint8_t rotate (uint32_t ui32_cycles, uint16_t ui16_hall_period, uint16_t ui16_adc_battery_current)
+{
+  static const uint8_t ui8_hall_sequence[6] = { 4, 6, 2, 3, 1, 5 };
+  uint32_t ui32_i;
+  
+  for (ui32_i = 0; ui32_i < ui32_cycles; ui32_i++)
+  {
+    fault_detect(ui8_hall_sequence[(ui32_i / ui16_hall_period) % 6], ui16_adc_battery_current, ADC_BATTERY_VOLTAGE);
+  }
+  
+  return ui8_g_fault_detected[FAULT_STALL];
+}
+
+// clears the detected flags and the debounce counters
+static void reset (void)
+{
+  uint8_t ui8_i;
+  
+  fault_detect(HALL_SENSORS_STATE, 0, 255);
+  for (ui8_i = 0; ui8_i < FAULT_NUMBER; ui8_i++) { ui8_g_fault_detected[ui8_i] = 0; }
+}
+
+// runs the fault controller for ui16_time_x10 in 0.1 s with the PWM interrupt inputs
+static void run (uint16_t ui16_time_x10, uint8_t ui8_hall_sensors_state, uint16_t ui16_adc_battery_current)
+{
+  uint16_t ui16_i;
+  uint16_t ui16_j;
+  
+  for (ui16_i = 0; ui16_i < (ui16_time_x10 * (100 / EBIKE_APP_CONTROLLER_PERIOD_MS)); ui16_i++)
+  {
+    for (ui16_j = 0; ui16_j < PWM_CYCLES_PER_CONTROLLER_RUN; ui16_j++) { fault_detect(ui8_hall_sensors_state, ui16_adc_battery_current, ADC_BATTERY_VOLTAGE); }
+    fault_controller();
+  }
+}
+
+int main (void)
+{
+  uint16_t ui16_i;
+  uint32_t ui32_cycle;
+  
+  // no faults on normal inputs
+  reset();
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, 10, ADC_BATTERY_VOLTAGE, FAULT_STALL), 0);
+  for (ui16_i = 0; ui16_i < FAULT_NUMBER; ui16_i++) { CHECK_EQUAL(ui8_g_fault_detected[ui16_i], 0); }
+  
+  // stall: detected after the debounce, current at the threshold is not a stall
+  reset();
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, FAULT_STALL_ADC_BATTERY_CURRENT, ADC_BATTERY_VOLTAGE, FAULT_STALL), 0);
+  reset();
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, FAULT_STALL_ADC_BATTERY_CURRENT + 1, ADC_BATTERY_VOLTAGE, FAULT_STALL), FAULT_STALL_DEBOUNCE + 1);
+  
+  // stall: a current dip restarts the debounce
+  reset();
+  CHECK_EQUAL(pwm(FAULT_STALL_DEBOUNCE, HALL_SENSORS_STATE, 40, ADC_BATTERY_VOLTAGE, FAULT_STALL), 0);
+  CHECK_EQUAL(pwm(1, HALL_SENSORS_STATE, 0, ADC_BATTERY_VOLTAGE, FAULT_STALL), 0);
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, 40, ADC_BATTERY_VOLTAGE, FAULT_STALL), FAULT_STALL_DEBOUNCE + 1);
+  
+  // stall: not detected while the motor rotates, even slowly, detected when it stops
+  reset();
+  CHECK_EQUAL(rotate(100000, FAULT_STALL_DEBOUNCE - 1, 60), 0);
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, 60, ADC_BATTERY_VOLTAGE, FAULT_STALL), FAULT_STALL_DEBOUNCE + 1);
+  reset();
+  CHECK_EQUAL(rotate(100000, FAULT_STALL_DEBOUNCE + 10, 60), 1);
+  
+  // stall: not detected during hill hold with its max current for the 3 s timeout, detected again after
+  reset();
+  ui8_g_fault_stall_inhibit = 1;
+  CHECK_EQUAL(pwm(3000000L / 64, HALL_SENSORS_STATE, HILL_HOLD_ADC_BATTERY_CURRENT, ADC_BATTERY_VOLTAGE, FAULT_STALL), 0);
+  ui8_g_fault_stall_inhibit = 0;
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, HILL_HOLD_ADC_BATTERY_CURRENT, ADC_BATTERY_VOLTAGE, FAULT_STALL), FAULT_STALL_DEBOUNCE + 1);
+  
+  // stall inhibit does not inhibit the other faults
+  reset();
+  ui8_g_fault_stall_inhibit = 1;
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, FAULT_OVERCURRENT_ADC_BATTERY_CURRENT + 1, ADC_BATTERY_VOLTAGE, FAULT_OVERCURRENT), FAULT_OVERCURRENT_DEBOUNCE + 1);
+  reset();
+  CHECK_EQUAL(pwm(100000, 0, 0, ADC_BATTERY_VOLTAGE, FAULT_HALL_SENSORS), FAULT_HALL_SENSORS_DEBOUNCE + 1);
+  ui8_g_fault_stall_inhibit = 0;
+  
+  // hall sensors: both invalid states, a glitch shorter than the debounce is ignored
+  reset();
+  CHECK_EQUAL(pwm(100000, 7, 0, ADC_BATTERY_VOLTAGE, FAULT_HALL_SENSORS), FAULT_HALL_SENSORS_DEBOUNCE + 1);
+  reset();
+  for (ui16_i = 0; ui16_i < 1000; ui16_i++)
+  {
+    CHECK_EQUAL(pwm(FAULT_HALL_SENSORS_DEBOUNCE, 0, 0, ADC_BATTERY_VOLTAGE, FAULT_HALL_SENSORS), 0);
+    CHECK_EQUAL(pwm(1, HALL_SENSORS_STATE, 0, ADC_BATTERY_VOLTAGE, FAULT_HALL_SENSORS), 0);
+  }
+  
+  // hall sensors: an invalid state does not reset the stall debounce
+  reset();
+  CHECK_EQUAL(pwm(FAULT_STALL_DEBOUNCE - 5, HALL_SENSORS_STATE, 40, ADC_BATTERY_VOLTAGE, FAULT_STALL), 0);
+  CHECK_EQUAL(pwm(2, 0, 40, ADC_BATTERY_VOLTAGE, FAULT_STALL), 0);
+  CHECK_EQUAL(pwm(100, HALL_SENSORS_STATE, 40, ADC_BATTERY_VOLTAGE, FAULT_STALL), 4);
+  
+  // overcurrent: short peaks are ignored
+  reset();
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, FAULT_OVERCURRENT_ADC_BATTERY_CURRENT, ADC_BATTERY_VOLTAGE, FAULT_OVERCURRENT), 0);
+  reset();
+  for (ui16_i = 0; ui16_i < 1000; ui16_i++)
+  {
+    fault_detect(HALL_SENSORS_STATE + (ui16_i & 1), 0, ADC_BATTERY_VOLTAGE);
+    CHECK_EQUAL(pwm(FAULT_OVERCURRENT_DEBOUNCE, HALL_SENSORS_STATE, 1023, ADC_BATTERY_VOLTAGE, FAULT_OVERCURRENT), 0);
+  }
+  
+  // undervoltage: not detected until the low voltage cut off is set, then after the debounce
+  reset();
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, 0, 0, FAULT_UNDERVOLTAGE), 0);
+  ui8_g_fault_adc_battery_voltage_min = 100;
+  reset();
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, 0, 100, FAULT_UNDERVOLTAGE), 0);
+  CHECK_EQUAL(pwm(100000, HALL_SENSORS_STATE, 0, 99, FAULT_UNDERVOLTAGE), FAULT_UNDERVOLTAGE_DEBOUNCE + 1);
+  ui8_g_fault_adc_battery_voltage_min = 0;
+  
+  // random inputs: each fault is only detected after its debounce with the fault input on every cycle
+  reset();
+  ui8_g_fault_adc_battery_voltage_min = 100;
+  {
+    uint16_t ui16_stall = 0, ui16_hall = 0, ui16_overcurrent = 0, ui16_undervoltage = 0;
+    uint8_t ui8_hall_old = HALL_SENSORS_STATE;
+    uint8_t ui8_hall = HALL_SENSORS_STATE;
+    uint16_t ui16_current = 0;
+    uint8_t ui8_voltage = 120;
+    uint32_t ui32_detected[FAULT_NUMBER] = { 0, 0, 0, 0 };
+    
+    for (ui32_cycle = 0; ui32_cycle < 1000000; ui32_cycle++)
+    {
+      uint32_t ui32_random = test_random();
+      
+      // inputs hold for a random time, from a few PWM cycles to about a stall debounce
+      if ((ui32_random & 0xfff) < 2) { ui8_hall = (ui32_random >> 28) & 7; }
+      if (((ui32_random >> 11) & 0x3ff) < 1) { ui16_current = (ui32_random >> 21) & 0x7f; }
+      if (((ui32_random >> 11) & 0x3ff) == 1) { ui8_voltage = (ui32_random & 0x1000000) ? 90 : 120; }
+      if ((((ui32_random >> 4) & 0xf) == 0) && (ui16_current > FAULT_OVERCURRENT_ADC_BATTERY_CURRENT)) { ui16_current = 0; }
+      
+      if ((ui8_hall == 0) || (ui8_hall == 7)) { ++ui16_hall; }
+      else { ui16_hall = 0; if (ui8_hall != ui8_hall_old) { ui16_stall = 0; } ui8_hall_old = ui8_hall; }
+      if (ui16_current > FAULT_STALL_ADC_BATTERY_CURRENT) { ++ui16_stall; } else { ui16_stall = 0; }
+      if (ui16_current > FAULT_OVERCURRENT_ADC_BATTERY_CURRENT) { ++ui16_overcurrent; } else { ui16_overcurrent = 0; }
+      if (ui8_voltage < 100) { ++ui16_undervoltage; } else { ui16_undervoltage = 0; }
+      
+      fault_detect(ui8_hall, ui16_current, ui8_voltage);
+      CHECK_EQUAL(ui8_g_fault_detected[FAULT_STALL], ui16_stall > FAULT_STALL_DEBOUNCE);
+      CHECK_EQUAL(ui8_g_fault_detected[FAULT_HALL_SENSORS], ui16_hall > FAULT_HALL_SENSORS_DEBOUNCE);
+      CHECK_EQUAL(ui8_g_fault_detected[FAULT_OVERCURRENT], ui16_overcurrent > FAULT_OVERCURRENT_DEBOUNCE);
+      CHECK_EQUAL(ui8_g_fault_detected[FAULT_UNDERVOLTAGE], ui16_undervoltage > FAULT_UNDERVOLTAGE_DEBOUNCE);
+      for (ui16_i = 0; ui16_i < FAULT_NUMBER; ui16_i++) { ui32_detected[ui16_i] += ui8_g_fault_detected[ui16_i]; ui8_g_fault_detected[ui16_i] = 0; }
+    }
+    
+    // every fault was injected and detected
+    for (ui16_i = 0; ui16_i < FAULT_NUMBER; ui16_i++) { CHECK(ui32_detected[ui16_i] > 0); }
+  }
+  ui8_g_fault_adc_battery_voltage_min = 0;
+  
+  // latched stall: error code, latch counter and timestamp, cleared after its clear time
+  reset();
+  run(20, HALL_SENSORS_STATE, 0);
+  CHECK_EQUAL(fault_get_latched(), 0);
+  CHECK_EQUAL(fault_get_error_code(), NO_ERROR);
+  run(2, HALL_SENSORS_STATE, 40);
+  CHECK_EQUAL(fault_get_latched(), 1 << FAULT_STALL);
+  CHECK_EQUAL(fault_get_error_code(), ERROR_MOTOR_BLOCKED);
+  CHECK_EQUAL(fault_get_latch_counter(FAULT_STALL), 1);
+  CHECK_NEAR(fault_get_timestamp_x10(FAULT_STALL), 21, 1);
+  
+  // still stalled: stays latched, counted once
+  run(50, HALL_SENSORS_STATE, 40);
+  CHECK_EQUAL(fault_get_error_code(), ERROR_MOTOR_BLOCKED);
+  CHECK_EQUAL(fault_get_latch_counter(FAULT_STALL), 1);
+  
+  // motor current off: cleared after FAULT_STALL_CLEAR_TIME_X10
+  run(FAULT_STALL_CLEAR_TIME_X10 - 2, HALL_SENSORS_STATE, 0);
+  CHECK_EQUAL(fault_get_error_code(), ERROR_MOTOR_BLOCKED);
+  run(3, HALL_SENSORS_STATE, 0);
+  CHECK_EQUAL(fault_get_latched(), 0);
+  CHECK_EQUAL(fault_get_error_code(), NO_ERROR);
+  
+  // latched again: counted again
+  run(2, HALL_SENSORS_STATE, 40);
+  CHECK_EQUAL(fault_get_latch_counter(FAULT_STALL), 2);
+  run(FAULT_STALL_CLEAR_TIME_X10 + 1, HALL_SENSORS_STATE, 0);
+  CHECK_EQUAL(fault_get_latched(), 0);
+  
+  // hill hold for 3 s: no fault latched
+  ui8_g_fault_stall_inhibit = 1;
+  run(30, HALL_SENSORS_STATE, HILL_HOLD_ADC_BATTERY_CURRENT);
+  ui8_g_fault_stall_inhibit = 0;
+  CHECK_EQUAL(fault_get_latched(), 0);
+  CHECK_EQUAL(fault_get_latch_counter(FAULT_STALL), 2);
+  
+  // two faults: error code of the lowest index, each cleared after its own clear time
+  run(2, 0, 40);
+  CHECK_EQUAL(fault_get_latched(), (1 << FAULT_STALL) | (1 << FAULT_HALL_SENSORS));
+  CHECK_EQUAL(fault_get_error_code(), ERROR_MOTOR_BLOCKED);
+  run(FAULT_HALL_SENSORS_CLEAR_TIME_X10 + 1, HALL_SENSORS_STATE, 0);
+  CHECK_EQUAL(fault_get_latched(), 1 << FAULT_STALL);
+  run(FAULT_STALL_CLEAR_TIME_X10, HALL_SENSORS_STATE, 0);
+  CHECK_EQUAL(fault_get_latched(), 0);
+  
+  // hall sensors fault alone: its own error code
+  run(1, 7, 0);
+  CHECK_EQUAL(fault_get_error_code(), ERROR_HALL_SENSORS);
+  CHECK_EQUAL(fault_get_latch_counter(FAULT_HALL_SENSORS), 2);
+  
+  return test_end("test_fault");
+}
@@ -0,0 +1,288 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "main.h"
+#include "common.h"
+#include "uart.h"
+#include "flight_recorder.h"
+
+#define DUMP_FRAME_BYTES    (FLIGHT_RECORDER_DUMP_HEADER_BYTES + (FLIGHT_RECORDER_RECORDS_PER_CHUNK * FLIGHT_RECORDER_RECORD_BYTES) + 2)
+
+// record as it is in the dump
+typedef struct _record
+{
+  uint8_t ui8_duty_cycle;
+  uint8_t ui8_foc_angle;
+  uint16_t ui16_adc_battery_current;
+  uint16_t ui16_motor_speed_erps;
+  uint8_t ui8_hall_sensors_state;
+  uint8_t ui8_system_state;
+} struct_record;
+
+// dump put together from the chunks
+typedef struct _dump
+{
+  uint8_t ui8_decimation;
+  uint8_t ui8_records_number;
+  uint8_t ui8_trigger_index;
+  struct_record records[FLIGHT_RECORDER_RECORDS];
+} struct_dump;
+
+// UART transmit buffer, full for the next ui8_uart_busy frames
+static uint8_t ui8_frame[UART_TX_BUFFER_SIZE];
+static uint8_t ui8_frame_length;
+static uint8_t ui8_uart_busy = 0;
+
+uint8_t uart_send_frame (const uint8_t *p_frame, uint8_t ui8_length)
+{
+  if (ui8_uart_busy) { ui8_uart_busy--; return 0; }
+  
+  memcpy(ui8_frame, p_frame, ui8_length);
+  ui8_frame_length = ui8_length;
+  return 1;
+}
+
+// signals of record number ui16_n, the battery current is below the hardware limit
+static void record (uint16_t ui16_n)
+{
+  flight_recorder_record(ui16_n & 0xff, ui16_n % ADC_10_BIT_BATTERY_CURRENT_MAX, ui16_n, ui16_n >> 8, (ui16_n % 6) + 1);
+}
+
+static uint8_t record_equal (const struct_record *p_record, uint16_t ui16_n, uint8_t ui8_system_state)
+{
+  return (p_record->ui8_duty_cycle == (ui16_n & 0xff)) &&
+         (p_record->ui8_foc_angle == (ui16_n >> 8)) &&
+         (p_record->ui16_adc_battery_current == (ui16_n % ADC_10_BIT_BATTERY_CURRENT_MAX)) &&
+         (p_record->ui16_motor_speed_erps == ui16_n) &&
+         (p_record->ui8_hall_sensors_state == ((ui16_n % 6) + 1)) &&
+         (p_record->ui8_system_state == ui8_system_state);
+}
+
+// dump command and housekeeping runs until every chunk is sent, checks the frames
+static void dump (struct_dump *p_dump)
+{
+  uint8_t ui8_chunk;
+  uint8_t ui8_i;
+  uint8_t *p_data;
+  struct_record *p_record;
+  
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_DUMP, 0, 0);
+  memset(p_dump, 0, sizeof(struct_dump));
+  
+  for (ui8_chunk = 0; ui8_chunk < FLIGHT_RECORDER_CHUNKS; ui8_chunk++)
+  {
+    ui8_frame_length = 0;
+    CHECK_EQUAL(flight_recorder_send_dump(), 1);
+    CHECK_EQUAL(ui8_frame_length, DUMP_FRAME_BYTES);
+    
+    // header and CRC
+    CHECK_EQUAL(ui8_frame[0], FLIGHT_RECORDER_DUMP_START_BYTE);
+    CHECK_EQUAL(ui8_frame[1], ui8_chunk);
+    CHECK_EQUAL(ui8_frame[2], FLIGHT_RECORDER_CHUNKS);
+    CHECK_EQUAL(crc16_buf(ui8_frame, DUMP_FRAME_BYTES - 2), ui8_frame[DUMP_FRAME_BYTES - 2] + (ui8_frame[DUMP_FRAME_BYTES - 1] << 8));
+    
+    // header is the same on every chunk
+    if (ui8_chunk == 0)
+    {
+      p_dump->ui8_decimation = ui8_frame[3];
+      p_dump->ui8_records_number = ui8_frame[4];
+      p_dump->ui8_trigger_index = ui8_frame[5];
+    }
+    CHECK_EQUAL(ui8_frame[3], p_dump->ui8_decimation);
+    CHECK_EQUAL(ui8_frame[4], p_dump->ui8_records_number);
+    CHECK_EQUAL(ui8_frame[5], p_dump->ui8_trigger_index);
+    
+    for (ui8_i = 0; ui8_i < FLIGHT_RECORDER_RECORDS_PER_CHUNK; ui8_i++)
+    {
+      p_data = &ui8_frame[FLIGHT_RECORDER_DUMP_HEADER_BYTES + (ui8_i * FLIGHT_RECORDER_RECORD_BYTES)];
+      p_record = &p_dump->records[(ui8_chunk * FLIGHT_RECORDER_RECORDS_PER_CHUNK) + ui8_i];
+      
+      p_record->ui8_duty_cycle = p_data[0];
+      p_record->ui8_foc_angle = p_data[1];
+      p_record->ui16_adc_battery_current = p_data[2] + (p_data[3] << 8);
+      p_record->ui16_motor_speed_erps = p_data[4] + (p_data[5] << 8);
+      p_record->ui8_hall_sensors_state = p_data[6];
+      p_record->ui8_system_state = p_data[7];
+    }
+  }
+  
+  // nothing more to send, the package to the display is sent again
+  CHECK_EQUAL(flight_recorder_send_dump(), 0);
+}
+
+// the dump holds records ui16_first to ui16_first + number - 1, from the oldest to the newest
+static void check_records (const struct_dump *p_dump, uint16_t ui16_first, uint8_t ui8_records_number)
+{
+  uint8_t ui8_i;
+  
+  CHECK_EQUAL(p_dump->ui8_records_number, ui8_records_number);
+  
+  for (ui8_i = 0; ui8_i < ui8_records_number; ui8_i++)
+  {
+    CHECK(record_equal(&p_dump->records[ui8_i], ui16_first + ui8_i, NO_ERROR));
+  }
+}
+
+int main (void)
+{
+  struct_dump m_dump;
+  uint16_t ui16_n;
+  uint16_t ui16_trigger;
+  uint8_t ui8_chunk;
+  
+  // nothing is sent before a dump command
+  CHECK_EQUAL(flight_recorder_send_dump(), 0);
+  
+  // records from power on with the default decimation, before the buffer is full the oldest record is the first one
+  for (ui16_n = 0; ui16_n < 10; ui16_n++) { record(ui16_n); }
+  CHECK_EQUAL(ui8_flight_recorder_decimation_counter, FLIGHT_RECORDER_DECIMATION_DEFAULT);
+  dump(&m_dump);
+  CHECK_EQUAL(m_dump.ui8_decimation, FLIGHT_RECORDER_DECIMATION_DEFAULT);
+  CHECK_EQUAL(m_dump.ui8_trigger_index, FLIGHT_RECORDER_NO_TRIGGER);
+  check_records(&m_dump, 0, 10);
+  
+  // the dump froze the records
+  for (ui16_n = 10; ui16_n < 20; ui16_n++) { record(ui16_n); }
+  dump(&m_dump);
+  check_records(&m_dump, 0, 10);
+  
+  // arm: records are cleared, decimation 0 is 1 and the decimation counter is reloaded on every record
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_ARM, 0, FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR);
+  CHECK_EQUAL(ui8_flight_recorder_decimation_counter, 1);
+  ui8_flight_recorder_decimation_counter = 0;
+  record(0);
+  CHECK_EQUAL(ui8_flight_recorder_decimation_counter, 1);
+  dump(&m_dump);
+  CHECK_EQUAL(m_dump.ui8_decimation, 1);
+  check_records(&m_dump, 0, 1);
+  
+  // ring buffer wraps: the last FLIGHT_RECORDER_RECORDS records from the oldest to the newest, for every index the buffer can end at
+  for (ui16_trigger = FLIGHT_RECORDER_RECORDS; ui16_trigger < (3 * FLIGHT_RECORDER_RECORDS); ui16_trigger++)
+  {
+    flight_recorder_command(FLIGHT_RECORDER_COMMAND_ARM, 4, FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR);
+    for (ui16_n = 0; ui16_n < ui16_trigger; ui16_n++) { record(ui16_n); }
+    dump(&m_dump);
+    CHECK_EQUAL(m_dump.ui8_decimation, 4);
+    CHECK_EQUAL(m_dump.ui8_trigger_index, FLIGHT_RECORDER_NO_TRIGGER);
+    check_records(&m_dump, ui16_trigger - FLIGHT_RECORDER_RECORDS, FLIGHT_RECORDER_RECORDS);
+  }
+  
+  // manual trigger: FLIGHT_RECORDER_POST_TRIGGER_RECORDS more records and then frozen, the trigger index is the last record before the command,
+  // the commands come at least one communications period apart so there is always a record between arm and trigger
+  for (ui16_trigger = 1; ui16_trigger < (3 * FLIGHT_RECORDER_RECORDS); ui16_trigger++)
+  {
+    flight_recorder_command(FLIGHT_RECORDER_COMMAND_ARM, 16, FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR);
+    for (ui16_n = 0; ui16_n < ui16_trigger; ui16_n++) { record(ui16_n); }
+    flight_recorder_command(FLIGHT_RECORDER_COMMAND_TRIGGER, 0, 0);
+    
+    // a trigger while triggered does not restart the post trigger records
+    for (; ui16_n < (ui16_trigger + FLIGHT_RECORDER_POST_TRIGGER_RECORDS + 20); ui16_n++)
+    {
+      record(ui16_n);
+      if (ui16_n == (ui16_trigger + 4)) { flight_recorder_command(FLIGHT_RECORDER_COMMAND_TRIGGER, 0, 0); }
+    }
+    
+    dump(&m_dump);
+    ui16_n = ui16_trigger + FLIGHT_RECORDER_POST_TRIGGER_RECORDS;
+    if (ui16_n > FLIGHT_RECORDER_RECORDS)
+    {
+      check_records(&m_dump, ui16_n - FLIGHT_RECORDER_RECORDS, FLIGHT_RECORDER_RECORDS);
+      CHECK_EQUAL(m_dump.ui8_trigger_index, FLIGHT_RECORDER_RECORDS - FLIGHT_RECORDER_POST_TRIGGER_RECORDS - 1);
+    }
+    else
+    {
+      check_records(&m_dump, 0, ui16_n);
+      CHECK_EQUAL(m_dump.ui8_trigger_index, ui16_trigger - 1);
+    }
+  }
+  
+  // system error trigger: the trigger index is the first record with the error
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_ARM, 16, FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR);
+  for (ui16_n = 0; ui16_n < 100; ui16_n++)
+  {
+    if (ui16_n == 70) { flight_recorder_set_system_state(ERROR_MOTOR_BLOCKED); }
+    record(ui16_n);
+  }
+  flight_recorder_set_system_state(NO_ERROR);
+  dump(&m_dump);
+  CHECK_EQUAL(m_dump.ui8_records_number, FLIGHT_RECORDER_RECORDS);
+  CHECK_EQUAL(m_dump.ui8_trigger_index, FLIGHT_RECORDER_RECORDS - FLIGHT_RECORDER_POST_TRIGGER_RECORDS - 1);
+  CHECK(record_equal(&m_dump.records[m_dump.ui8_trigger_index - 1], 69, NO_ERROR));
+  CHECK(record_equal(&m_dump.records[m_dump.ui8_trigger_index], 70, ERROR_MOTOR_BLOCKED));
+  CHECK(record_equal(&m_dump.records[FLIGHT_RECORDER_RECORDS - 1], 70 + FLIGHT_RECORDER_POST_TRIGGER_RECORDS, ERROR_MOTOR_BLOCKED));
+  
+  // system error not in the trigger mask: no trigger
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_ARM, 16, 0);
+  flight_recorder_set_system_state(ERROR_MOTOR_BLOCKED);
+  for (ui16_n = 0; ui16_n < 100; ui16_n++) { record(ui16_n); }
+  flight_recorder_set_system_state(NO_ERROR);
+  dump(&m_dump);
+  CHECK_EQUAL(m_dump.ui8_trigger_index, FLIGHT_RECORDER_NO_TRIGGER);
+  CHECK(record_equal(&m_dump.records[FLIGHT_RECORDER_RECORDS - 1], 99, ERROR_MOTOR_BLOCKED));
+  
+  // battery current trigger: one step below the hardware limit does not trigger, the limit does
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_ARM, 16, FLIGHT_RECORDER_TRIGGER_BATTERY_CURRENT);
+  for (ui16_n = 0; ui16_n < 40; ui16_n++) { flight_recorder_record(0, ADC_10_BIT_BATTERY_CURRENT_MAX - 1, ui16_n, 0, 1); }
+  flight_recorder_record(0, ADC_10_BIT_BATTERY_CURRENT_MAX, 40, 0, 1);
+  for (ui16_n = 41; ui16_n < 100; ui16_n++) { flight_recorder_record(0, 0, ui16_n, 0, 1); }
+  dump(&m_dump);
+  CHECK_EQUAL(m_dump.ui8_trigger_index, FLIGHT_RECORDER_RECORDS - FLIGHT_RECORDER_POST_TRIGGER_RECORDS - 1);
+  CHECK_EQUAL(m_dump.records[m_dump.ui8_trigger_index].ui16_adc_battery_current, ADC_10_BIT_BATTERY_CURRENT_MAX);
+  CHECK_EQUAL(m_dump.records[m_dump.ui8_trigger_index].ui16_motor_speed_erps, 40);
+  CHECK_EQUAL(m_dump.records[FLIGHT_RECORDER_RECORDS - 1].ui16_motor_speed_erps, 40 + FLIGHT_RECORDER_POST_TRIGGER_RECORDS);
+  
+  // battery current not in the trigger mask: no trigger
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_ARM, 16, FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR);
+  for (ui16_n = 0; ui16_n < 100; ui16_n++) { flight_recorder_record(0, 1023, ui16_n, 0, 1); }
+  dump(&m_dump);
+  CHECK_EQUAL(m_dump.ui8_trigger_index, FLIGHT_RECORDER_NO_TRIGGER);
+  
+  // UART transmit buffer full: the same chunk is sent again on the next run, no chunk is skipped
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_ARM, 16, FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR);
+  for (ui16_n = 0; ui16_n < 50; ui16_n++) { record(ui16_n); }
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_DUMP, 0, 0);
+  for (ui8_chunk = 0; ui8_chunk < FLIGHT_RECORDER_CHUNKS; ui8_chunk++)
+  {
+    ui8_uart_busy = 2;
+    ui8_frame_length = 0;
+    CHECK_EQUAL(flight_recorder_send_dump(), 1);
+    CHECK_EQUAL(flight_recorder_send_dump(), 1);
+    CHECK_EQUAL(ui8_frame_length, 0);
+    CHECK_EQUAL(flight_recorder_send_dump(), 1);
+    CHECK_EQUAL(ui8_frame_length, DUMP_FRAME_BYTES);
+    CHECK_EQUAL(ui8_frame[1], ui8_chunk);
+    CHECK_EQUAL(ui8_frame[FLIGHT_RECORDER_DUMP_HEADER_BYTES + 4] + (ui8_frame[FLIGHT_RECORDER_DUMP_HEADER_BYTES + 5] << 8), 50 - FLIGHT_RECORDER_RECORDS + (ui8_chunk * FLIGHT_RECORDER_RECORDS_PER_CHUNK));
+  }
+  CHECK_EQUAL(flight_recorder_send_dump(), 0);
+  
+  // arm while a dump is sent stops the dump
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_DUMP, 0, 0);
+  CHECK_EQUAL(flight_recorder_send_dump(), 1);
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_ARM, 16, FLIGHT_RECORDER_TRIGGER_SYSTEM_ERROR);
+  CHECK_EQUAL(flight_recorder_send_dump(), 0);
+  
+  // a dump command while a dump is sent starts again from the first chunk
+  for (ui16_n = 0; ui16_n < 50; ui16_n++) { record(ui16_n); }
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_DUMP, 0, 0);
+  flight_recorder_send_dump();
+  flight_recorder_send_dump();
+  dump(&m_dump);
+  check_records(&m_dump, 50 - FLIGHT_RECORDER_RECORDS, FLIGHT_RECORDER_RECORDS);
+  
+  // a trigger command while frozen does nothing
+  flight_recorder_command(FLIGHT_RECORDER_COMMAND_TRIGGER, 0, 0);
+  for (ui16_n = 50; ui16_n < 100; ui16_n++) { record(ui16_n); }
+  dump(&m_dump);
+  CHECK_EQUAL(m_dump.ui8_trigger_index, FLIGHT_RECORDER_NO_TRIGGER);
+  check_records(&m_dump, 50 - FLIGHT_RECORDER_RECORDS, FLIGHT_RECORDER_RECORDS);
+  
+  return test_end("test_flight_recorder");
+}
@@ -0,0 +1,120 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "main.h"
+#include "foc_angle_tracker.h"
+
+#define FOC_ANGLE           100
+#define ADC_CURRENT         40      // 8 A, current bin 1
+#define ERPS                300     // motor speed bin 2
+#define BIN                 ((2 * FOC_ANGLE_TRACKER_CURRENT_BINS) + 1)
+#define RUNS_PER_MINUTE     3000
+
+// simulated motor under current control, one step per EBIKE_APP_CONTROLLER_PERIOD_MS: torque per battery current falls
+// with the square of the FOC angle error, the load rises with motor speed and slowly brings it back to ERPS, as a
+// rider keeping a steady speed. The motor speed responds to a torque change within a measurement window, as with a
+// light load: this checks the tracker logic, not the bike dynamics
+static double d_erps;
+static double d_load;
+static double d_load_drift;
+static int8_t i8_optimum_offset;
+
+static int8_t offset (void) { return (int8_t) foc_angle_tracker_get_offsets()[BIN]; }
+
+static double torque (int16_t i16_error) { return ADC_CURRENT * (1.0 - (0.002 * i16_error * i16_error)); }
+
+static void step (void)
+{
+  d_erps += 0.5 * (torque((int16_t) foc_angle_tracker_apply(FOC_ANGLE) - (FOC_ANGLE + i8_optimum_offset)) - d_load - (0.05 * (d_erps - ERPS)));
+  d_load += d_load_drift + (0.002 * (d_erps - ERPS));
+  
+  foc_angle_tracker_controller((uint16_t) (d_erps + 0.5), ADC_CURRENT, 1);
+}
+
+// start at steady speed with the learned offset
+static void start (int8_t i8_optimum, double d_drift)
+{
+  i8_optimum_offset = i8_optimum;
+  d_erps = ERPS;
+  d_load = torque(offset() - i8_optimum);
+  d_load_drift = d_drift;
+}
+
+int main (void)
+{
+  uint16_t ui16_i;
+  int8_t i8_applied;
+  uint8_t ui8_dither_minus = 0;
+  uint8_t ui8_dither_plus = 0;
+  
+  // not enabled: no dither and no learning
+  for (ui16_i = 0; ui16_i < 200; ui16_i++) { foc_angle_tracker_controller(ERPS, ADC_CURRENT, 0); }
+  CHECK_EQUAL(foc_angle_tracker_apply(FOC_ANGLE), FOC_ANGLE);
+  CHECK_EQUAL(offset(), 0);
+  CHECK_EQUAL(foc_angle_tracker_save_needed(), 0);
+  
+  // dither order is minus, plus, plus, minus with 12 runs per window
+  for (ui16_i = 0; ui16_i < 49; ui16_i++)
+  {
+    foc_angle_tracker_controller(ERPS, ADC_CURRENT, 1);
+    i8_applied = (int8_t) (foc_angle_tracker_apply(FOC_ANGLE) - FOC_ANGLE);
+    
+    if (ui16_i < 48) { CHECK_EQUAL(i8_applied, ((ui16_i / 12) == 1 || (ui16_i / 12) == 2) ? 1 : -1); }
+    else { CHECK_EQUAL(i8_applied, 0); }
+  }
+  
+  // same motor speed with both offsets: no change
+  CHECK_EQUAL(offset(), 0);
+  CHECK_EQUAL(foc_angle_tracker_save_needed(), 0);
+  
+  // converges to the optimum offset
+  start(5, 0);
+  for (ui16_i = 0; ui16_i < RUNS_PER_MINUTE; ui16_i++) { step(); }
+  CHECK_NEAR(offset(), 5, 1);
+  CHECK_EQUAL(foc_angle_tracker_save_needed(), 1);
+  
+  start(-6, 0);
+  for (ui16_i = 0; ui16_i < RUNS_PER_MINUTE; ui16_i++) { step(); }
+  CHECK_NEAR(offset(), -6, 1);
+  
+  // stays at the optimum while the load changes slowly, the change adds the same to both sides
+  start(-6, 0.0005);
+  for (ui16_i = 0; ui16_i < RUNS_PER_MINUTE; ui16_i++)
+  {
+    step();
+    CHECK_NEAR(offset(), -6, 1);
+  }
+  
+  // learned offset is limited
+  start(12, 0);
+  for (ui16_i = 0; ui16_i < (2 * RUNS_PER_MINUTE); ui16_i++)
+  {
+    step();
+    i8_applied = (int8_t) (foc_angle_tracker_apply(FOC_ANGLE) - FOC_ANGLE);
+    if (i8_applied < offset()) { ui8_dither_minus = 1; }
+    if (i8_applied > offset()) { ui8_dither_plus = 1; }
+  }
+  CHECK_EQUAL(offset(), FOC_ANGLE_TRACKER_OFFSET_MAX);
+  CHECK(ui8_dither_minus && ui8_dither_plus);
+  
+  // measurement is dropped when the motor speed is not steady
+  start(-FOC_ANGLE_TRACKER_OFFSET_MAX, 0);
+  for (ui16_i = 0; ui16_i < RUNS_PER_MINUTE; ui16_i++)
+  {
+    foc_angle_tracker_controller((ui16_i & 16) ? ERPS : ERPS + 30, ADC_CURRENT, 1);
+  }
+  CHECK_EQUAL(offset(), FOC_ANGLE_TRACKER_OFFSET_MAX);
+  
+  // other bins are not changed
+  CHECK_EQUAL(foc_angle_tracker_get_offsets()[BIN - 1], 0);
+  CHECK_EQUAL(foc_angle_tracker_get_offsets()[BIN + 1], 0);
+  
+  return test_end("test_foc_angle_tracker");
+}
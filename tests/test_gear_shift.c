@@ -0,0 +1,149 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "main.h"
+#include "gear_shift.h"
+
+typedef struct
+{
+  uint16_t ui16_pedal_cadence_RPM_x10;
+  uint16_t ui16_wheel_speed_x10;
+  uint16_t ui16_pedal_torque_x100;    // half stroke pedal torque
+} struct_gear_shift_trace;
+
+// upshift at 20 km/h and 70 RPM, one row per 20 ms: the rider eases off, the chain moves to a smaller sprocket so
+// cadence drops over a few cadence sensor transitions, then the rider pushes again
+static const struct_gear_shift_trace m_upshift_trace[] =
+{
+  { 702, 200, 3020 }, { 698, 201, 2980 }, { 700, 200, 3010 }, { 701, 200, 2990 }, { 699, 199, 3000 },
+  { 700, 200, 2890 }, { 698, 200, 2610 }, { 697, 200, 2240 }, { 699, 200, 1870 }, { 700, 200, 1590 },
+  { 698, 199, 1420 }, { 696, 199, 1350 }, { 694, 199, 1310 }, { 695, 199, 1300 }, { 693, 199, 1290 },
+  { 671, 199, 1300 }, { 634, 199, 1330 }, { 598, 199, 1400 }, { 589, 200, 1560 }, { 588, 200, 1800 },
+  { 590, 200, 2120 }, { 591, 200, 2470 }, { 590, 201, 2780 }, { 592, 201, 2950 }, { 591, 201, 3010 },
+  { 590, 201, 3000 }, { 592, 201, 3020 }, { 591, 201, 2990 }, { 590, 201, 3000 }, { 591, 201, 3010 },
+};
+
+#define UPSHIFT_TRACE_ROWS    (sizeof(m_upshift_trace) / sizeof(m_upshift_trace[0]))
+#define UPSHIFT_ROW_DETECTED  17
+#define REVOLUTION_RUNS       43    // runs of 20 ms per pedal revolution at 70 RPM
+
+static uint16_t ui16_cadence_RPM_x10;
+static uint16_t ui16_wheel_speed_x10;
+static uint16_t ui16_torque_x100;
+
+// steady riding, returns the number of runs with a current dip
+static uint16_t run_steady (uint16_t ui16_runs)
+{
+  uint16_t ui16_dip_runs = 0;
+  
+  while (ui16_runs--)
+  {
+    gear_shift_update(ui16_cadence_RPM_x10, ui16_wheel_speed_x10, ui16_torque_x100);
+    if (gear_shift_apply_dip(100) != 100) { ++ui16_dip_runs; }
+  }
+  
+  return ui16_dip_runs;
+}
+
+static void run_trace (void)
+{
+  uint8_t ui8_i;
+  
+  for (ui8_i = 0; ui8_i < UPSHIFT_TRACE_ROWS; ui8_i++)
+  {
+    gear_shift_update(m_upshift_trace[ui8_i].ui16_pedal_cadence_RPM_x10, m_upshift_trace[ui8_i].ui16_wheel_speed_x10, m_upshift_trace[ui8_i].ui16_pedal_torque_x100);
+  }
+}
+
+static void set_riding (uint16_t ui16_cadence, uint16_t ui16_speed, uint16_t ui16_torque)
+{
+  ui16_cadence_RPM_x10 = ui16_cadence;
+  ui16_wheel_speed_x10 = ui16_speed;
+  ui16_torque_x100 = ui16_torque;
+}
+
+int main (void)
+{
+  uint8_t ui8_i;
+  uint16_t ui16_shifts;
+  
+  // steady riding, no shift and no dip
+  set_riding(700, 200, 3000);
+  CHECK_EQUAL(run_steady(250), 0);
+  CHECK_EQUAL(gear_shift_get_counter(), 0);
+  
+  // upshift trace: detected when cadence dropped enough, not before
+  for (ui8_i = 0; ui8_i < UPSHIFT_TRACE_ROWS; ui8_i++)
+  {
+    gear_shift_update(m_upshift_trace[ui8_i].ui16_pedal_cadence_RPM_x10, m_upshift_trace[ui8_i].ui16_wheel_speed_x10, m_upshift_trace[ui8_i].ui16_pedal_torque_x100);
+    
+    if (ui8_i < UPSHIFT_ROW_DETECTED) { CHECK_EQUAL(gear_shift_get_counter(), 0); }
+    else { CHECK_EQUAL(gear_shift_get_counter(), 1); }
+    
+    // current dip is held and then ramped back
+    if ((ui8_i >= UPSHIFT_ROW_DETECTED) && (ui8_i < UPSHIFT_ROW_DETECTED + GEAR_SHIFT_DIP_HOLD)) { CHECK_EQUAL(gear_shift_apply_dip(100), GEAR_SHIFT_DIP_CURRENT_PERCENT); }
+  }
+  
+  // back to full current after the ramp
+  set_riding(591, 201, 3000);
+  run_steady(GEAR_SHIFT_DIP_RAMP);
+  CHECK_EQUAL(gear_shift_apply_dip(100), 100);
+  CHECK_EQUAL(gear_shift_apply_dip(0), 0);
+  
+  // cadence jump on a bump without easing off is not a shift
+  set_riding(700, 200, 3000);
+  run_steady(250);
+  ui16_shifts = gear_shift_get_counter();
+  set_riding(600, 200, 3000);
+  CHECK_EQUAL(run_steady(50), 0);
+  CHECK_EQUAL(gear_shift_get_counter(), ui16_shifts);
+  
+  // easing off without a ratio change is not a shift
+  set_riding(700, 200, 3000);
+  run_steady(250);
+  set_riding(700, 200, 1000);
+  CHECK_EQUAL(run_steady(50), 0);
+  CHECK_EQUAL(gear_shift_get_counter(), ui16_shifts);
+  
+  // the same shift with the pedal torque mean of the full revolution is missed: it drops too late for the torque drop window
+  set_riding(700, 200, 3000);
+  run_steady(250);
+  for (ui8_i = 0; ui8_i < UPSHIFT_TRACE_ROWS; ui8_i++)
+  {
+    // revolution mean at 70 RPM is the mean of the last 43 runs, before the trace the torque was steady
+    uint32_t ui32_torque_sum_x100 = (uint32_t) 3000 * (REVOLUTION_RUNS - 1 - ui8_i);
+    uint8_t ui8_j;
+    
+    for (ui8_j = 0; ui8_j <= ui8_i; ui8_j++) { ui32_torque_sum_x100 += m_upshift_trace[ui8_j].ui16_pedal_torque_x100; }
+    
+    gear_shift_update(m_upshift_trace[ui8_i].ui16_pedal_cadence_RPM_x10, m_upshift_trace[ui8_i].ui16_wheel_speed_x10, ui32_torque_sum_x100 / REVOLUTION_RUNS);
+  }
+  CHECK_EQUAL(gear_shift_get_counter(), ui16_shifts);
+  
+  // the half stroke torque detects it
+  set_riding(700, 200, 3000);
+  run_steady(250);
+  run_trace();
+  CHECK_EQUAL(gear_shift_get_counter(), ui16_shifts + 1);
+  
+  // a second jump within the lockout is not detected
+  set_riding(700, 200, 1000);
+  CHECK(run_steady(5) > 0);
+  CHECK_EQUAL(gear_shift_get_counter(), ui16_shifts + 1);
+  
+  // no detection at low cadence
+  set_riding(250, 200, 3000);
+  run_steady(250);
+  set_riding(200, 200, 1000);
+  CHECK_EQUAL(run_steady(50), 0);
+  CHECK_EQUAL(gear_shift_get_counter(), ui16_shifts + 1);
+  
+  return test_end("test_gear_shift");
+}
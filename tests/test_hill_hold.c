@@ -0,0 +1,211 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "test.h"
+#include "main.h"
+#include "hill_hold.h"
+
+#define MASS_KG                     100.0   // bike and rider
+#define MOTOR_FORCE_PER_AMP         30.0    // wheel force per battery amp at stall
+#define WHEEL_PER_CRANK_REV_M       1.9     // 2100 mm wheel perimeter, 38 / 42 teeth
+#define CRANK_COUNTS_PER_REV        80      // PAS_COUNTS_PER_REVOLUTION
+#define HALL_STEPS_PER_CRANK_REV    2000    // motor hall sensor steps per chainring revolution, about
+#define DT_S                        (EBIKE_APP_CONTROLLER_PERIOD_MS / 1000.0)
+
+// simulated bike standing on a slope, one step per EBIKE_APP_CONTROLLER_PERIOD_MS
+static struct_hill_hold_inputs m_inputs;
+static double d_position_m;
+static double d_speed_m_s;
+static double d_crank_m;            // wheel distance of the crank position, the cranks only follow the chainring backwards
+static int32_t i32_crank_counts;
+static int32_t i32_hall_steps;
+static uint8_t ui8_current_target;
+static uint8_t ui8_duty_cycle_target;
+
+static void init (void)
+{
+  m_inputs.ui8_assist_enabled = 1;
+  m_inputs.ui8_brakes_enabled = 1;
+  m_inputs.ui8_pedal_cadence_RPM = 0;
+  m_inputs.ui16_wheel_speed_x10 = 0;
+  m_inputs.ui8_error = 0;
+  m_inputs.i8_crank_counts_delta = 0;
+  m_inputs.i8_motor_hall_steps_delta = 0;
+  m_inputs.ui8_adc_battery_current_max = ADC_10_BIT_BATTERY_CURRENT_MAX;
+  
+  // braking rearms hill hold
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  m_inputs.ui8_brakes_enabled = 0;
+  
+  // cranks in the middle of a cadence sensor count
+  d_position_m = (0.5 * WHEEL_PER_CRANK_REV_M) / CRANK_COUNTS_PER_REV;
+  d_speed_m_s = 0;
+  d_crank_m = d_position_m;
+  i32_crank_counts = 0;
+  i32_hall_steps = 0;
+}
+
+// one app run, the bike is released on the slope with the motor driving the chainring only while hill hold current is set
+static void step (double d_grade)
+{
+  int32_t i32_counts;
+  int32_t i32_steps;
+  double d_force;
+  double d_speed_old = d_speed_m_s;
+  
+  ui8_current_target = 0;
+  ui8_duty_cycle_target = 0;
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  
+  // motor pushes forward, the slope pulls back, static friction holds the bike when the motor is over the slope force
+  d_force = (ui8_current_target * (BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10 / 10.0) * MOTOR_FORCE_PER_AMP) - (MASS_KG * 9.81 * d_grade);
+  d_speed_m_s += (d_force / MASS_KG) * DT_S;
+  if ((d_speed_old == 0) && (ui8_current_target) && (d_speed_m_s > 0) && (d_force < (MASS_KG * 9.81 * 0.01))) { d_speed_m_s = 0; }
+  d_position_m += d_speed_m_s * DT_S;
+  
+  // freewheels: the chainring pulls the cranks backwards but not forwards, the motor rotor turns only while it drives
+  if (d_position_m < d_crank_m) { d_crank_m = d_position_m; }
+  i32_counts = (int32_t) floor((d_crank_m * CRANK_COUNTS_PER_REV) / WHEEL_PER_CRANK_REV_M);
+  m_inputs.i8_crank_counts_delta = i32_counts - i32_crank_counts;
+  i32_crank_counts = i32_counts;
+  
+  i32_steps = (int32_t) floor((d_position_m * HALL_STEPS_PER_CRANK_REV) / WHEEL_PER_CRANK_REV_M);
+  m_inputs.i8_motor_hall_steps_delta = ui8_current_target ? (i32_steps - i32_hall_steps) : 0;
+  i32_hall_steps = i32_steps;
+}
+
+// runs from release on the slope to rollback detection
+static uint16_t rollback_detection_runs (double d_grade)
+{
+  uint16_t ui16_runs = 0;
+  
+  init();
+  while ((!hill_hold_is_active()) && (ui16_runs < 1000)) { step(d_grade); ui16_runs++; }
+  
+  return ui16_runs;
+}
+
+int main (void)
+{
+  double d_grade;
+  double d_expected_s;
+  double d_rollback_max_m;
+  uint16_t ui16_runs;
+  uint16_t ui16_i;
+  
+  // rollback detection latency: the bike accelerates back from rest, detection after HILL_HOLD_ROLLBACK_STEPS crank counts
+  // from the middle of a count, x = a t^2 / 2, plus the run in which the counts are seen
+  for (d_grade = 0.04; d_grade <= 0.201; d_grade += 0.04)
+  {
+    ui16_runs = rollback_detection_runs(d_grade);
+    d_expected_s = sqrt((2.0 * (((HILL_HOLD_ROLLBACK_STEPS - 0.5) * WHEEL_PER_CRANK_REV_M) / CRANK_COUNTS_PER_REV)) / (9.81 * d_grade));
+    CHECK_NEAR(ui16_runs, ceil(d_expected_s / DT_S), 1);
+    
+    // under half a second on an 8 % slope and steeper, the bike rolled back less than 10 cm
+    if (d_grade >= 0.08) { CHECK(ui16_runs * EBIKE_APP_CONTROLLER_PERIOD_MS <= 500); }
+    CHECK(d_position_m > -0.1);
+  }
+  
+  // holding: current increases until the bike stops, then it moves slowly back and forth as the current follows the motion,
+  // under 0.3 m/s, and creeps back as forward motion is only seen while the motor drives, less than 0.3 m over the hold time
+  for (d_grade = 0.04; d_grade <= 0.121; d_grade += 0.04)
+  {
+    rollback_detection_runs(d_grade);
+    d_rollback_max_m = 0;
+    for (ui16_i = 0; ui16_i < (HILL_HOLD_TIMEOUT - 2); ui16_i++)
+    {
+      step(d_grade);
+      CHECK(hill_hold_is_active());
+      CHECK(ui8_current_target <= HILL_HOLD_ADC_BATTERY_CURRENT_MAX);
+      CHECK(ui8_duty_cycle_target <= HILL_HOLD_DUTY_CYCLE_MAX);
+      if (d_position_m < d_rollback_max_m) { d_rollback_max_m = d_position_m; }
+      if (ui16_i >= 50) { CHECK(fabs(d_speed_m_s) < 0.3); }
+    }
+    
+    CHECK(d_rollback_max_m > -0.3);
+    
+    // timeout, then no hold again until the rider brakes or pedals
+    step(d_grade);
+    step(d_grade);
+    CHECK(!hill_hold_is_active());
+    for (ui16_i = 0; ui16_i < 50; ui16_i++) { step(d_grade); }
+    CHECK(!hill_hold_is_active());
+    CHECK_EQUAL(ui8_current_target, 0);
+  }
+  
+  // backward hall sensor steps also detect rollback, when the motor is coupled to the chainring
+  init();
+  m_inputs.i8_motor_hall_steps_delta = -HILL_HOLD_ROLLBACK_STEPS;
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  CHECK(hill_hold_is_active());
+  
+  // backward counts spread over runs are added within the rollback window and cleared after it
+  init();
+  m_inputs.i8_motor_hall_steps_delta = 0;
+  m_inputs.i8_crank_counts_delta = -1;
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  m_inputs.i8_crank_counts_delta = 0;
+  for (ui16_i = 0; ui16_i < HILL_HOLD_ROLLBACK_WINDOW; ui16_i++) { hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target); }
+  m_inputs.i8_crank_counts_delta = -(HILL_HOLD_ROLLBACK_STEPS - 1);
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  CHECK(hill_hold_is_active());
+  
+  init();
+  m_inputs.i8_crank_counts_delta = -1;
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  m_inputs.i8_crank_counts_delta = 0;
+  for (ui16_i = 0; ui16_i <= HILL_HOLD_ROLLBACK_WINDOW; ui16_i++) { hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target); }
+  m_inputs.i8_crank_counts_delta = -(HILL_HOLD_ROLLBACK_STEPS - 1);
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  CHECK(!hill_hold_is_active());
+  
+  // no hold with the brakes applied, while pedaling, over 2 km/h, on errors or without pedal assist
+  for (ui16_i = 0; ui16_i < 5; ui16_i++)
+  {
+    init();
+    m_inputs.ui8_brakes_enabled = (ui16_i == 0);
+    m_inputs.ui8_pedal_cadence_RPM = (ui16_i == 1) ? 20 : 0;
+    m_inputs.ui16_wheel_speed_x10 = (ui16_i == 2) ? HILL_HOLD_WHEEL_SPEED_X10_MAX : 0;
+    m_inputs.ui8_error = (ui16_i == 3);
+    m_inputs.ui8_assist_enabled = (ui16_i != 4);
+    m_inputs.i8_crank_counts_delta = -10;
+    hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+    CHECK(!hill_hold_is_active());
+  }
+  
+  // pedaling stops holding and rearms
+  init();
+  m_inputs.i8_crank_counts_delta = -HILL_HOLD_ROLLBACK_STEPS;
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  CHECK(hill_hold_is_active());
+  m_inputs.i8_crank_counts_delta = 0;
+  m_inputs.ui8_pedal_cadence_RPM = 20;
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  CHECK(!hill_hold_is_active());
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  m_inputs.ui8_pedal_cadence_RPM = 0;
+  m_inputs.i8_crank_counts_delta = -HILL_HOLD_ROLLBACK_STEPS;
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  CHECK(hill_hold_is_active());
+  
+  // holding current is limited by the battery current max
+  init();
+  m_inputs.ui8_adc_battery_current_max = 4;
+  m_inputs.i8_crank_counts_delta = -HILL_HOLD_ROLLBACK_STEPS;
+  ui8_current_target = 0;
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  m_inputs.i8_crank_counts_delta = -20;
+  ui8_current_target = 0;
+  hill_hold_controller(&m_inputs, &ui8_current_target, &ui8_duty_cycle_target);
+  CHECK_EQUAL(ui8_current_target, 4);
+  
+  return test_end("test_hill_hold");
+}
@@ -0,0 +1,141 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "test.h"
+#include "main.h"
+#include "motor.h"
+#include "ebike_app.h"
+#include "motor_thermal.h"
+
+#define RUNS_PER_MINUTE   (60000 / MOTOR_THERMAL_PERIOD_MS)
+#define STEP_MINUTES      180
+#define DUTY_CYCLE_MIN    10    // no losses at lower duty cycle
+
+// motor variables used by motor_thermal.c
+volatile uint8_t ui8_adc_battery_current_filtered = 0;
+volatile uint8_t ui8_g_duty_cycle = 0;
+
+static struct_configuration_variables configuration_variables;
+
+struct_configuration_variables* get_configuration_variables (void) { return &configuration_variables; }
+uint16_t ui16_motor_get_motor_speed_erps (void) { return 0; }
+
+// analytic two node RC response: winding and case temperature over ambient at t seconds, from the temperatures at t = 0 with constant losses
+static void rc_response (double d_losses_w, double d_winding_0, double d_case_0, double d_t, double *p_winding, double *p_case)
+{
+  double d_g1 = MOTOR_WINDING_TO_CASE_CONDUCTANCE_MW_PER_K / 1000.0;
+  double d_g2 = MOTOR_CASE_TO_AMBIENT_CONDUCTANCE_MW_PER_K / 1000.0;
+  double d_a11 = -d_g1 / MOTOR_WINDING_HEAT_CAPACITY;
+  double d_a12 = d_g1 / MOTOR_WINDING_HEAT_CAPACITY;
+  double d_a21 = d_g1 / MOTOR_CASE_HEAT_CAPACITY;
+  double d_a22 = -(d_g1 + d_g2) / MOTOR_CASE_HEAT_CAPACITY;
+  double d_trace = d_a11 + d_a22;
+  double d_root = sqrt((d_trace * d_trace) - (4 * ((d_a11 * d_a22) - (d_a12 * d_a21))));
+  double d_l1 = (d_trace + d_root) / 2;
+  double d_l2 = (d_trace - d_root) / 2;
+  double d_e1 = exp(d_l1 * d_t);
+  double d_e2 = exp(d_l2 * d_t);
+  
+  // e^(A t) = c0 I + c1 A for the two real eigenvalues of A
+  double d_c0 = ((d_l1 * d_e2) - (d_l2 * d_e1)) / (d_l1 - d_l2);
+  double d_c1 = (d_e1 - d_e2) / (d_l1 - d_l2);
+  
+  // steady state and the decay of the difference to it
+  double d_case_end = d_losses_w / d_g2;
+  double d_winding_end = d_case_end + (d_losses_w / d_g1);
+  double d_winding_delta = d_winding_0 - d_winding_end;
+  double d_case_delta = d_case_0 - d_case_end;
+  
+  *p_winding = d_winding_end + (d_c0 * d_winding_delta) + (d_c1 * ((d_a11 * d_winding_delta) + (d_a12 * d_case_delta)));
+  *p_case = d_case_end + (d_c0 * d_case_delta) + (d_c1 * ((d_a21 * d_winding_delta) + (d_a22 * d_case_delta)));
+}
+
+// constant battery current and duty cycle for STEP_MINUTES, the model temperatures are compared to the analytic response every minute,
+// returns the max error of the winding temperature in 0.1 degrees Celsius
+static uint16_t step (uint8_t ui8_battery_current, uint8_t ui8_duty_cycle, double *p_winding, double *p_case)
+{
+  // phase current in 0.1 A as the firmware calculates it
+  double d_phase_current = (ui8_duty_cycle > DUTY_CYCLE_MIN) ? (((uint16_t) ui8_battery_current * BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10 * 255) / ui8_duty_cycle) / 10.0 : 0;
+  double d_losses_w = (d_phase_current * d_phase_current * MOTOR_WINDING_RESISTANCE_MOHM) / 1000.0;
+  double d_winding;
+  double d_case;
+  uint16_t ui16_minute;
+  uint16_t ui16_i;
+  uint16_t ui16_error_x10;
+  uint16_t ui16_error_x10_max = 0;
+  
+  ui8_adc_battery_current_filtered = ui8_battery_current;
+  ui8_g_duty_cycle = ui8_duty_cycle;
+  
+  for (ui16_minute = 1; ui16_minute <= STEP_MINUTES; ui16_minute++)
+  {
+    for (ui16_i = 0; ui16_i < RUNS_PER_MINUTE; ui16_i++) { motor_thermal_controller(); }
+    
+    rc_response(d_losses_w, *p_winding, *p_case, ui16_minute * 60.0, &d_winding, &d_case);
+    
+    ui16_error_x10 = abs((int) motor_thermal_get_winding_temperature_x10() - (int) (((d_winding + MOTOR_THERMAL_AMBIENT_TEMPERATURE) * 10) + 0.5));
+    if (ui16_error_x10 > ui16_error_x10_max) { ui16_error_x10_max = ui16_error_x10; }
+    
+    // case temperature is in degrees Celsius, truncated
+    CHECK_NEAR(motor_thermal_get_case_temperature(), (int) (d_case + MOTOR_THERMAL_AMBIENT_TEMPERATURE), 1);
+  }
+  
+  *p_winding = d_winding;
+  *p_case = d_case;
+  
+  return ui16_error_x10_max;
+}
+
+int main (void)
+{
+  double d_winding = 0;
+  double d_case = 0;
+  
+  // starts at ambient temperature
+  CHECK_EQUAL(motor_thermal_get_winding_temperature_x10(), MOTOR_THERMAL_AMBIENT_TEMPERATURE * 10);
+  CHECK_EQUAL(motor_thermal_get_case_temperature(), MOTOR_THERMAL_AMBIENT_TEMPERATURE);
+  
+  // no losses below the min duty cycle
+  CHECK_EQUAL(step(50, 5, &d_winding, &d_case), 0);
+  d_winding = 0;
+  d_case = 0;
+  
+  // 10 A at full duty cycle, 15 W: steady state is 18.75 degrees over ambient on the case and 7.5 more on the winding
+  CHECK(step(50, 255, &d_winding, &d_case) <= 5);
+  CHECK_NEAR(d_case, 18.75, 1.5);
+  CHECK_NEAR(motor_thermal_get_winding_temperature_x10(), (MOTOR_THERMAL_AMBIENT_TEMPERATURE + 18.75 + 7.5) * 10, 20);
+  
+  // the same 10 A phase current with half the battery current at half duty cycle
+  CHECK(step(25, 127, &d_winding, &d_case) <= 5);
+  
+  // 20 A, 60 W: the winding goes over the temperatures where current is limited
+  CHECK(step(100, 255, &d_winding, &d_case) <= 5);
+  CHECK(motor_thermal_get_winding_temperature() > MOTOR_THERMAL_TEMPERATURE_MAX_VALUE_TO_LIMIT);
+  
+  // motor stopped: cools down to ambient
+  CHECK(step(0, 0, &d_winding, &d_case) <= 5);
+  CHECK(motor_thermal_get_winding_temperature() < (MOTOR_THERMAL_AMBIENT_TEMPERATURE + 25));
+  
+  // saved temperatures at power on: used up to the restore margin over ambient, invalid ones are ignored
+  configuration_variables.ui8_motor_winding_temperature = MOTOR_THERMAL_AMBIENT_TEMPERATURE + 20;
+  configuration_variables.ui8_motor_case_temperature = MOTOR_THERMAL_AMBIENT_TEMPERATURE + 10;
+  motor_thermal_init();
+  CHECK_EQUAL(motor_thermal_get_winding_temperature(), MOTOR_THERMAL_AMBIENT_TEMPERATURE + 20);
+  CHECK_EQUAL(motor_thermal_get_case_temperature(), MOTOR_THERMAL_AMBIENT_TEMPERATURE + 10);
+  
+  configuration_variables.ui8_motor_winding_temperature = 150;
+  configuration_variables.ui8_motor_case_temperature = 255;
+  motor_thermal_init();
+  CHECK_EQUAL(motor_thermal_get_winding_temperature(), MOTOR_THERMAL_AMBIENT_TEMPERATURE + MOTOR_THERMAL_RESTORE_MARGIN);
+  CHECK_EQUAL(motor_thermal_get_case_temperature(), MOTOR_THERMAL_AMBIENT_TEMPERATURE + 10);
+  
+  return test_end("test_motor_thermal");
+}
@@ -0,0 +1,206 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "main.h"
+#include "stm8s_gpio.h"
+#include "pas.h"
+
+void GPIO_Init (GPIO_TypeDef* GPIOx, GPIO_Pin_TypeDef GPIO_Pin, GPIO_Mode_TypeDef GPIO_Mode) { }
+
+#define TICKS_PER_RUN_X10     3125    // 20 ms in PWM cycles x10
+#define HOLD_CYCLES           4       // PWM cycles each state is held on single steps, more than the decoder filter
+
+// quadrature state at each crank position count with forward rotation
+static const uint8_t ui8_sequence[4] = { 0, 2, 3, 1 };
+
+// position of a quadrature state in the forward sequence
+static uint8_t sequence_index (uint8_t ui8_pas_state)
+{
+  uint8_t ui8_i;
+  
+  for (ui8_i = 0; ui8_sequence[ui8_i] != ui8_pas_state; ui8_i++);
+  
+  return ui8_i;
+}
+
+// simulated crank position in quadrature counts, the decoder state follows it
+static double d_crank_counts = 0;
+static uint8_t ui8_state = 0;
+static uint32_t ui32_time_x10 = 0;
+static uint32_t ui32_tick = 0;
+
+
+
+// one PWM cycle, the app runs every 20 ms
+static void pwm_cycle (uint8_t ui8_pas_state)
+{
+  pas_decode(ui8_pas_state);
+  
+  ui32_tick++;
+  if ((ui32_tick * 10) >= (ui32_time_x10 + TICKS_PER_RUN_X10))
+  {
+    ui32_time_x10 += TICKS_PER_RUN_X10;
+    pas_controller();
+  }
+}
+
+
+
+static void hold (uint8_t ui8_pas_state, uint16_t ui16_cycles)
+{
+  while (ui16_cycles--) { pwm_cycle(ui8_pas_state); }
+}
+
+
+
+// single counts forward or backward, each state held for HOLD_CYCLES
+static void step (int16_t i16_counts)
+{
+  while (i16_counts)
+  {
+    d_crank_counts += (i16_counts > 0) ? 1 : -1;
+    i16_counts += (i16_counts > 0) ? -1 : 1;
+    ui8_state = ui8_sequence[(long) (d_crank_counts + 4096) & 3];
+    hold(ui8_state, HOLD_CYCLES);
+  }
+}
+
+
+
+// pedal at a cadence in RPM, negative backwards, with a glitch on one of the pins every glitch period PWM cycles (0 for none)
+static void pedal (double d_cadence_RPM, uint32_t ui32_cycles, uint16_t ui16_glitch_period)
+{
+  uint32_t ui32_i;
+  
+  for (ui32_i = 1; ui32_i <= ui32_cycles; ui32_i++)
+  {
+    d_crank_counts += (d_cadence_RPM * PAS_COUNTS_PER_REVOLUTION) / (60.0 * PWM_CYCLES_SECOND);
+    ui8_state = ui8_sequence[(long) (d_crank_counts + 4096) & 3];
+    
+    if ((ui16_glitch_period) && ((ui32_i % ui16_glitch_period) == 0)) { pwm_cycle(ui8_state ^ (1 << (test_random() & 1))); }
+    else { pwm_cycle(ui8_state); }
+  }
+}
+
+
+
+// position after the app run
+static int16_t position (void)
+{
+  hold(ui8_state, TICKS_PER_RUN_X10 / 10 + 1);
+  return pas_get_position();
+}
+
+
+
+int main (void)
+{
+  uint8_t ui8_old;
+  uint8_t ui8_new;
+  uint8_t ui8_errors;
+  int16_t i16_position;
+  int16_t i16_expected;
+  uint16_t ui16_i;
+  
+  // decode table: every transition from every state
+  for (ui8_old = 0; ui8_old < 4; ui8_old++)
+  {
+    for (ui8_new = 0; ui8_new < 4; ui8_new++)
+    {
+      // move forward to the old state
+      while (ui8_state != ui8_old) { step(1); }
+      i16_position = position();
+      ui8_errors = pas_get_error_counter();
+      
+      hold(ui8_new, HOLD_CYCLES);
+      
+      // next state forward counts up, previous state counts down
+      if (ui8_sequence[(sequence_index(ui8_old) + 1) & 3] == ui8_new) { i16_expected = 1; }
+      else if (ui8_sequence[(sequence_index(ui8_old) + 3) & 3] == ui8_new) { i16_expected = -1; }
+      else { i16_expected = 0; }
+      
+      ui8_state = ui8_new;
+      d_crank_counts += i16_expected;
+      if ((i16_expected == 0) && (ui8_new != ui8_old))
+      {
+        // invalid transition, both pins changed: error and no count, the decoder continues from the new state
+        CHECK_EQUAL(pas_get_error_counter(), ui8_errors + 1);
+        d_crank_counts += 2;
+      }
+      else
+      {
+        CHECK_EQUAL(pas_get_error_counter(), ui8_errors);
+      }
+      
+      CHECK_EQUAL(position(), (int16_t) (i16_position + i16_expected));
+    }
+  }
+  
+  // valid forward sequence: 10 revolutions at 60 RPM, exact count, velocity and no errors
+  ui8_errors = pas_get_error_counter();
+  i16_position = position();
+  pedal(60, 10 * PWM_CYCLES_SECOND, 0);
+  CHECK_EQUAL(position() - i16_position, 10 * PAS_COUNTS_PER_REVOLUTION);
+  CHECK_NEAR(pas_get_velocity_RPM_x10(), 600, 15);
+  CHECK_EQUAL(pas_get_error_counter(), ui8_errors);
+  CHECK_EQUAL(pas_is_backpedaling(), 0);
+  
+  // glitches shorter than the filter on one pin every 37 PWM cycles: same count, no errors
+  i16_position = position();
+  pedal(60, 10 * PWM_CYCLES_SECOND, 37);
+  CHECK_EQUAL(position() - i16_position, 10 * PAS_COUNTS_PER_REVOLUTION);
+  CHECK_EQUAL(pas_get_error_counter(), ui8_errors);
+  
+  // glitches while stopped: no count
+  i16_position = position();
+  pedal(0, 2 * PWM_CYCLES_SECOND, 5);
+  CHECK_EQUAL(position(), i16_position);
+  CHECK_EQUAL(pas_get_error_counter(), ui8_errors);
+  
+  // a single backward count is not backpedaling
+  step(-1);
+  CHECK_EQUAL(position(), i16_position - 1);
+  CHECK_EQUAL(pas_is_backpedaling(), 0);
+  step(1);
+  
+  // reversal: backward rotation counts down, velocity is negative and it is backpedaling
+  i16_position = position();
+  pedal(-30, 2 * PWM_CYCLES_SECOND, 0);
+  CHECK_EQUAL(position() - i16_position, -PAS_COUNTS_PER_REVOLUTION);
+  CHECK_NEAR(pas_get_velocity_RPM_x10(), -300, 15);
+  CHECK_EQUAL(pas_is_backpedaling(), 1);
+  CHECK_EQUAL(pas_get_error_counter(), ui8_errors);
+  
+  // backpedaling holds after stopping and ends after the hold time
+  for (ui16_i = 0; ui16_i < PAS_BACKPEDAL_HOLD - 2; ui16_i++) { position(); }
+  CHECK_EQUAL(pas_is_backpedaling(), 1);
+  for (ui16_i = 0; ui16_i < 3; ui16_i++) { position(); }
+  CHECK_EQUAL(pas_is_backpedaling(), 0);
+  
+  // backpedaling ends at once on forward rotation
+  step(-3);
+  position();
+  CHECK_EQUAL(pas_is_backpedaling(), 1);
+  step(1);
+  position();
+  CHECK_EQUAL(pas_is_backpedaling(), 0);
+  
+  // reversal from forward to backward and back without stopping
+  i16_position = position();
+  pedal(60, PWM_CYCLES_SECOND, 0);
+  pedal(-60, PWM_CYCLES_SECOND / 2, 0);
+  CHECK_EQUAL(pas_is_backpedaling(), 1);
+  pedal(60, PWM_CYCLES_SECOND, 0);
+  CHECK_EQUAL(pas_is_backpedaling(), 0);
+  CHECK_EQUAL(position() - i16_position, (3 * PAS_COUNTS_PER_REVOLUTION) / 2);
+  CHECK_EQUAL(pas_get_error_counter(), ui8_errors);
+  
+  return test_end("test_pas");
+}
@@ -0,0 +1,175 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "main.h"
+#include "stm8s_gpio.h"
+#include "ebike_app.h"
+#include "scheduler.h"
+#include "torque_sensor.h"
+
+#define OFFSET                    150
+#define TORQUE_STEP               100     // ADC steps over the offset
+#define CADENCE_SAMPLE_PERIOD     50      // TIM3 ticks between torque samples, 60 RPM with 20 magnets
+#define TRIALS                    1000
+#define OLD_APP_PERIOD_MS         100     // assist path ran in the 100 ms task
+#define OLD_APP_EXECUTION_MS      (EBIKE_APP_CONTROLLER_BUDGET_MS + EBIKE_APP_HOUSEKEEPING_BUDGET_MS)
+
+// PWM interrupt and ADC variables used by torque_sensor.c
+volatile uint16_t ui16_torque_sensor_samples[TORQUE_SENSOR_SAMPLES_PER_REVOLUTION];
+volatile uint8_t ui8_torque_sensor_sample_index = 0;
+volatile uint8_t ui8_torque_sensor_samples_number = 0;
+volatile uint16_t ui16_adc_pedal_torque_offset = OFFSET;
+
+static struct_configuration_variables configuration_variables;
+
+struct_configuration_variables* get_configuration_variables (void) { return &configuration_variables; }
+void GPIO_Init (GPIO_TypeDef* GPIOx, GPIO_Pin_TypeDef GPIO_Pin, GPIO_Mode_TypeDef GPIO_Mode) { }
+
+// simulated time in TIM3 ticks, pedal torque and the time of the first torque sample after the torque step
+static uint32_t ui32_time;
+static uint32_t ui32_cadence_phase;
+static uint16_t ui16_torque;
+static uint32_t ui32_torque_step_time;
+static uint32_t ui32_torque_sample_time;
+static uint32_t ui32_current_target_time;
+static uint8_t ui8_app_execution_time;
+
+static struct_scheduler_task tasks[3];
+
+
+
+uint16_t TIM3_GetCounter (void)
+{
+  return (uint16_t) ui32_time;
+}
+
+
+
+// TIM3 tick with the PWM interrupt: pedal torque and torque sample at the cadence sensor transitions
+static void tick (void)
+{
+  ui32_time++;
+  
+  if (ui32_time == ui32_torque_step_time) { ui16_torque = OFFSET + TORQUE_STEP; }
+  
+  if (((ui32_time + ui32_cadence_phase) % CADENCE_SAMPLE_PERIOD) == 0)
+  {
+    ui16_torque_sensor_samples[ui8_torque_sensor_sample_index] = ui16_torque;
+    if (++ui8_torque_sensor_sample_index >= TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ui8_torque_sensor_sample_index = 0; }
+    if (ui8_torque_sensor_samples_number < TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ++ui8_torque_sensor_samples_number; }
+    
+    if ((ui16_torque > OFFSET) && !ui32_torque_sample_time) { ui32_torque_sample_time = ui32_time; }
+  }
+}
+
+
+
+static void execute (uint8_t ui8_ticks)
+{
+  while (ui8_ticks--) { tick(); }
+}
+
+static void task_motor (void) { execute(MOTOR_CONTROLLER_BUDGET_MS); }
+static void task_housekeeping (void) { execute(EBIKE_APP_HOUSEKEEPING_BUDGET_MS); }
+
+
+
+// pedal torque as get_pedal_torque(), the current target follows the torque over the offset, time when it first reaches half the torque step
+static void task_assist (void)
+{
+  uint16_t ui16_adc_pedal_torque = OFFSET;
+  
+  if (torque_sensor_calc()) { ui16_adc_pedal_torque = torque_sensor_get_adc(); }
+  
+  // the PWM interrupt keeps running while the assist path is calculated
+  execute(ui8_app_execution_time);
+  
+  if (((ui16_adc_pedal_torque - OFFSET) >= (TORQUE_STEP / 2)) && !ui32_current_target_time) { ui32_current_target_time = ui32_time; }
+}
+
+
+
+// torque steps at random times while pedaling, returns the max and sum of the latencies from the torque sample and from the torque step
+// to the current target
+static void run (uint8_t ui8_app_period, uint8_t ui8_housekeeping, uint32_t *p_sample_max, uint32_t *p_sample_sum, uint32_t *p_step_max, uint32_t *p_step_sum)
+{
+  struct_scheduler_task init[3] =
+  {
+    { task_motor, 0, MOTOR_CONTROLLER_PERIOD_MS, MOTOR_CONTROLLER_BUDGET_MS },
+    { task_assist, 1, EBIKE_APP_CONTROLLER_PERIOD_MS, EBIKE_APP_CONTROLLER_BUDGET_MS },
+    { task_housekeeping, 2, EBIKE_APP_HOUSEKEEPING_PERIOD_MS, EBIKE_APP_HOUSEKEEPING_BUDGET_MS }
+  };
+  uint16_t ui16_trial;
+  uint8_t ui8_i;
+  
+  *p_sample_max = 0;
+  *p_sample_sum = 0;
+  *p_step_max = 0;
+  *p_step_sum = 0;
+  
+  for (ui16_trial = 0; ui16_trial < TRIALS; ui16_trial++)
+  {
+    // before the assist path had its own task it ran with the housekeeping in the 100 ms task
+    for (ui8_i = 0; ui8_i < 3; ui8_i++) { tasks[ui8_i] = init[ui8_i]; }
+    tasks[1].ui8_period = ui8_app_period;
+    ui8_app_execution_time = ui8_housekeeping ? EBIKE_APP_CONTROLLER_BUDGET_MS : OLD_APP_EXECUTION_MS;
+    
+    // pedaling without torque for a revolution, then a torque step at a random time
+    ui32_time = test_random() & 0xffff;
+    ui32_cadence_phase = test_random() % CADENCE_SAMPLE_PERIOD;
+    ui16_torque = OFFSET;
+    for (ui8_i = 0; ui8_i < TORQUE_SENSOR_SAMPLES_PER_REVOLUTION; ui8_i++) { ui16_torque_sensor_samples[ui8_i] = OFFSET; }
+    ui8_torque_sensor_samples_number = TORQUE_SENSOR_SAMPLES_PER_REVOLUTION;
+    ui32_torque_step_time = ui32_time + 200 + (test_random() % 200);
+    ui32_torque_sample_time = 0;
+    ui32_current_target_time = 0;
+    
+    scheduler_init(tasks, ui8_housekeeping ? 3 : 2);
+    
+    while (!ui32_current_target_time) { scheduler_clock(); }
+    
+    if ((ui32_current_target_time - ui32_torque_sample_time) > *p_sample_max) { *p_sample_max = ui32_current_target_time - ui32_torque_sample_time; }
+    if ((ui32_current_target_time - ui32_torque_step_time) > *p_step_max) { *p_step_max = ui32_current_target_time - ui32_torque_step_time; }
+    *p_sample_sum += ui32_current_target_time - ui32_torque_sample_time;
+    *p_step_sum += ui32_current_target_time - ui32_torque_step_time;
+  }
+}
+
+int main (void)
+{
+  uint32_t ui32_sample_max;
+  uint32_t ui32_sample_sum;
+  uint32_t ui32_step_max;
+  uint32_t ui32_step_sum;
+  uint32_t ui32_old_sample_max;
+  uint32_t ui32_old_sample_sum;
+  uint32_t ui32_old_step_max;
+  uint32_t ui32_old_step_sum;
+  
+  p_host_wfi_hook = tick;
+  
+  // assist path in the 100 ms task as before: up to 100 ms from the torque sample to the current target, 50 ms on average
+  run(OLD_APP_PERIOD_MS, 0, &ui32_old_sample_max, &ui32_old_sample_sum, &ui32_old_step_max, &ui32_old_step_sum);
+  CHECK(ui32_old_sample_max > (OLD_APP_PERIOD_MS - 5));
+  CHECK(ui32_old_sample_max <= (OLD_APP_PERIOD_MS + OLD_APP_EXECUTION_MS));
+  CHECK_NEAR(ui32_old_sample_sum / TRIALS, (OLD_APP_PERIOD_MS / 2) + OLD_APP_EXECUTION_MS, 5);
+  
+  // assist path in its own 20 ms task, housekeeping in the 100 ms task: up to 20 ms plus the execution time, 10 ms on average
+  run(EBIKE_APP_CONTROLLER_PERIOD_MS, 1, &ui32_sample_max, &ui32_sample_sum, &ui32_step_max, &ui32_step_sum);
+  CHECK(ui32_sample_max <= (EBIKE_APP_CONTROLLER_PERIOD_MS + EBIKE_APP_CONTROLLER_BUDGET_MS));
+  CHECK_NEAR(ui32_sample_sum / TRIALS, (EBIKE_APP_CONTROLLER_PERIOD_MS / 2) + EBIKE_APP_CONTROLLER_BUDGET_MS, 2);
+  
+  // from the torque step, the wait for the next torque sample at the cadence sensor is added
+  CHECK(ui32_step_max <= (CADENCE_SAMPLE_PERIOD + EBIKE_APP_CONTROLLER_PERIOD_MS + EBIKE_APP_CONTROLLER_BUDGET_MS));
+  CHECK(ui32_old_step_max > (CADENCE_SAMPLE_PERIOD + OLD_APP_PERIOD_MS - 5));
+  CHECK((ui32_step_sum * 2) < ui32_old_step_sum);
+  
+  return test_end("test_pedal_latency");
+}
@@ -0,0 +1,142 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "scheduler.h"
+
+// simulated time, TIM3 counter is the low 16 bits, wfi() waits for the next tick
+static uint32_t ui32_time = 0;
+
+// execution time of each task in ticks and log of the tasks run
+static uint8_t ui8_execution_time[3];
+static uint8_t ui8_log[64];
+static uint8_t ui8_log_size = 0;
+
+static struct_scheduler_task tasks[3];
+
+
+
+uint16_t TIM3_GetCounter (void)
+{
+  return (uint16_t) ui32_time;
+}
+
+
+
+static void tick (void)
+{
+  ui32_time++;
+}
+
+
+
+static void run_task (uint8_t ui8_task)
+{
+  if (ui8_log_size < sizeof(ui8_log)) { ui8_log[ui8_log_size++] = ui8_task; }
+  ui32_time += ui8_execution_time[ui8_task];
+}
+
+static void task_0 (void) { run_task(0); }
+static void task_1 (void) { run_task(1); }
+static void task_2 (void) { run_task(2); }
+
+
+
+static void setup (uint32_t ui32_start_time, uint8_t ui8_time_0, uint8_t ui8_time_1, uint8_t ui8_time_2)
+{
+  // same tasks as the motor controller
+  struct_scheduler_task init[3] =
+  {
+    { task_0, 0, 4, 1 },
+    { task_1, 1, 20, 3 },
+    { task_2, 2, 100, 5 }
+  };
+  uint8_t ui8_i;
+
+  for (ui8_i = 0; ui8_i < 3; ui8_i++) { tasks[ui8_i] = init[ui8_i]; }
+
+  ui8_execution_time[0] = ui8_time_0;
+  ui8_execution_time[1] = ui8_time_1;
+  ui8_execution_time[2] = ui8_time_2;
+  ui8_log_size = 0;
+  ui32_time = ui32_start_time;
+
+  scheduler_init(tasks, 3);
+}
+
+
+
+static void run_until (uint32_t ui32_end_time)
+{
+  while (ui32_time < ui32_end_time) { scheduler_clock(); }
+}
+
+
+
+int main (void)
+{
+  p_host_wfi_hook = tick;
+
+  // tasks that take no time run at their period, in priority order when released together, and are never late
+  setup(0, 0, 0, 0);
+  run_until(1000);
+  CHECK_EQUAL(tasks[0].ui16_run_counter, 250);
+  CHECK_EQUAL(tasks[1].ui16_run_counter, 50);
+  CHECK_EQUAL(tasks[2].ui16_run_counter, 10);
+  CHECK_EQUAL(ui8_log[0], 0);
+  CHECK_EQUAL(ui8_log[1], 1);
+  CHECK_EQUAL(ui8_log[2], 2);
+  CHECK_EQUAL(tasks[0].ui8_late_counter, 0);
+  CHECK_EQUAL(tasks[1].ui8_late_counter, 0);
+  CHECK_EQUAL(tasks[2].ui8_late_counter, 0);
+
+  // same across the TIM3 counter overflow
+  setup(65000, 0, 0, 0);
+  run_until(65000 + 1000);
+  CHECK_EQUAL(tasks[0].ui16_run_counter, 250);
+  CHECK_EQUAL(tasks[1].ui16_run_counter, 50);
+  CHECK_EQUAL(tasks[2].ui16_run_counter, 10);
+
+  // short tasks delay the slower tasks by a tick, that is not late and there is no overrun
+  setup(0, 1, 2, 2);
+  run_until(60000);
+  CHECK_EQUAL(tasks[0].ui8_late_counter, 0);
+  CHECK_EQUAL(tasks[1].ui8_late_counter, 0);
+  CHECK_EQUAL(tasks[2].ui8_late_counter, 0);
+  CHECK_EQUAL(tasks[0].ui8_max_overrun, 0);
+  CHECK_EQUAL(tasks[1].ui8_max_overrun, 0);
+  CHECK_EQUAL(tasks[2].ui8_max_overrun, 0);
+  CHECK_EQUAL(tasks[0].ui16_run_counter, 15000);
+  CHECK_EQUAL(tasks[2].ui16_run_counter, 600);
+
+  // housekeeping task that takes 12 ticks makes the motor control task late once every 100 ticks, counter does not saturate,
+  // the assist control task is delayed less than a quarter of its period so it is not late
+  setup(0, 1, 3, 12);
+  run_until(60000);
+  CHECK(tasks[0].ui8_late_counter > 0);
+  CHECK(tasks[0].ui8_late_counter < 32);
+  CHECK_EQUAL(tasks[1].ui8_late_counter, 0);
+  CHECK_EQUAL(tasks[2].ui8_late_counter, 0);
+  CHECK_EQUAL(tasks[2].ui8_max_overrun, 7);
+
+  // late counter decays when the task is not late anymore
+  ui8_execution_time[2] = 0;
+  run_until(60000 + 10000);
+  CHECK_EQUAL(tasks[0].ui8_late_counter, 0);
+  CHECK_EQUAL(tasks[1].ui8_late_counter, 0);
+
+  // a task that always overruns its period makes the others always late, missed releases are skipped
+  setup(0, 10, 0, 0);
+  run_until(2000);
+  CHECK_EQUAL(tasks[0].ui16_run_counter, 200);
+  CHECK(tasks[0].ui8_late_counter >= 128);
+  CHECK_EQUAL(tasks[0].ui8_max_overrun, 9);
+
+  return test_end("test_scheduler");
+}
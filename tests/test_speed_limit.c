@@ -0,0 +1,169 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "test.h"
+#include "main.h"
+#include "speed_limit.h"
+
+#define SPEED_MAX               25      // km/h
+#define MASS_KG                 100.0   // bike and rider
+#define CDA_M2                  0.5
+#define ROLLING_RESISTANCE      0.008
+#define BATTERY_VOLTAGE         36.0
+#define MOTOR_EFFICIENCY        0.8
+#define WHEEL_PERIMETER_MM      2100
+#define ASSIST_ADC_CURRENT      ADC_10_BIT_BATTERY_CURRENT_MAX   // the riding mode asks for max current
+#define CURRENT_RAMP_DOWN       4       // ADC steps per run the motor current follows a lower target
+#define DT_S                    (EBIKE_APP_CONTROLLER_PERIOD_MS / 1000.0)
+#define RUNS_PER_SECOND         (1000 / EBIKE_APP_CONTROLLER_PERIOD_MS)
+
+// simulated bike, the wheel speed sensor gives one measurement per wheel rotation, one step per EBIKE_APP_CONTROLLER_PERIOD_MS
+static double d_speed_m_s;
+static double d_wheel_distance_m;
+static double d_wheel_time_s;
+static double d_current;
+static uint8_t ui8_wheel_pulses;
+static uint16_t ui16_wheel_speed_x10;
+static uint16_t ui16_wheel_speed_x10_old;
+static uint16_t ui16_ticks_old;
+static int16_t i16_acceleration_x10;
+
+static void init (double d_speed_kmh)
+{
+  d_speed_m_s = d_speed_kmh / 3.6;
+  d_wheel_distance_m = 0;
+  d_wheel_time_s = 0;
+  d_current = 0;
+  ui8_wheel_pulses = 0;
+  ui16_wheel_speed_x10 = 0;
+  ui16_wheel_speed_x10_old = 0;
+  ui16_ticks_old = 0;
+  i16_acceleration_x10 = 0;
+}
+
+// one app run with the rider power on the grade, returns the battery current target after the speed limit
+static uint8_t step (double d_rider_power_w, double d_grade)
+{
+  uint16_t ui16_ticks;
+  uint8_t ui8_current_target;
+  double d_force;
+  
+  // wheel speed sensor and the acceleration of calc_wheel_speed()
+  d_wheel_distance_m += d_speed_m_s * DT_S;
+  d_wheel_time_s += DT_S;
+  if (d_wheel_distance_m >= (WHEEL_PERIMETER_MM / 1000.0))
+  {
+    // time of the pulse inside the run, the firmware measures it in PWM cycles
+    d_wheel_distance_m -= WHEEL_PERIMETER_MM / 1000.0;
+    d_wheel_time_s -= d_wheel_distance_m / d_speed_m_s;
+    ui16_ticks = (uint16_t) ((d_wheel_time_s * PWM_CYCLES_SECOND) + 0.5);
+    
+    if (ui8_wheel_pulses++)
+    {
+      ui16_wheel_speed_x10 = ((uint32_t) WHEEL_PERIMETER_MM * ((uint32_t) PWM_CYCLES_SECOND * 36)) / ((uint32_t) ui16_ticks * 1000);
+      if (ui16_ticks_old) { i16_acceleration_x10 = speed_limit_calc_acceleration(i16_acceleration_x10, ui16_wheel_speed_x10, ui16_wheel_speed_x10_old, ui16_ticks, ui16_ticks_old); }
+      ui16_wheel_speed_x10_old = ui16_wheel_speed_x10;
+      ui16_ticks_old = ui16_ticks;
+    }
+    
+    d_wheel_time_s = d_wheel_distance_m / d_speed_m_s;
+  }
+  
+  ui8_current_target = speed_limit_apply(ASSIST_ADC_CURRENT, ui16_wheel_speed_x10, i16_acceleration_x10, SPEED_MAX);
+  
+  // motor current ramps down, battery power to the wheel
+  if (ui8_current_target < d_current) { d_current = fmax(ui8_current_target, d_current - CURRENT_RAMP_DOWN); }
+  else { d_current = ui8_current_target; }
+  
+  d_force = ((d_current * (BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10 / 10.0) * BATTERY_VOLTAGE * MOTOR_EFFICIENCY) + d_rider_power_w) / fmax(d_speed_m_s, 1.0);
+  d_force -= (0.6 * CDA_M2 * d_speed_m_s * d_speed_m_s) + (MASS_KG * 9.81 * (ROLLING_RESISTANCE + d_grade));
+  d_speed_m_s += (d_force / MASS_KG) * DT_S;
+  if (d_speed_m_s < 0) { d_speed_m_s = 0; }
+  
+  return ui8_current_target;
+}
+
+static uint16_t speed_x10 (void) { return (uint16_t) ((d_speed_m_s * 36.0) + 0.5); }
+
+int main (void)
+{
+  uint16_t ui16_i;
+  uint16_t ui16_speed_min_x10;
+  uint16_t ui16_speed_max_x10;
+  uint16_t ui16_speed_reduced_x10;
+  uint8_t ui8_current;
+  
+  // no speed limit
+  CHECK_EQUAL(speed_limit_apply(90, 400, 100, 0), 90);
+  
+  // taper: full current up to 1.5 km/h below the limit, none over 0.5 km/h above it
+  CHECK_EQUAL(speed_limit_apply(90, (SPEED_MAX * 10) - SPEED_LIMIT_TAPER_BELOW_X10 - 1, 0, SPEED_MAX), 90);
+  CHECK_NEAR(speed_limit_apply(90, (SPEED_MAX * 10) - 5, 0, SPEED_MAX), 45, 5);
+  CHECK_EQUAL(speed_limit_apply(90, (SPEED_MAX * 10) + SPEED_LIMIT_TAPER_ABOVE_X10, 0, SPEED_MAX), 0);
+  CHECK_EQUAL(speed_limit_apply(90, (SPEED_MAX * 10) + SPEED_LIMIT_TAPER_ABOVE_X10 + 1, 0, SPEED_MAX), 0);
+  for (ui16_i = 0; ui16_i < 400; ui16_i++)
+  {
+    ui8_current = speed_limit_apply(90, ui16_i, 0, SPEED_MAX);
+    if (ui16_i > 0) { CHECK(ui8_current <= speed_limit_apply(90, ui16_i - 1, 0, SPEED_MAX)); }
+  }
+  
+  // 1000 ms prediction: speed plus acceleration times 1 s, same current as that speed without acceleration
+  for (ui16_i = 200; ui16_i < 300; ui16_i++)
+  {
+    CHECK_EQUAL(speed_limit_apply(90, ui16_i, 10, SPEED_MAX), speed_limit_apply(90, ui16_i + 10, 0, SPEED_MAX));
+    CHECK_EQUAL(speed_limit_apply(90, ui16_i, -25, SPEED_MAX), speed_limit_apply(90, ui16_i - 25, 0, SPEED_MAX));
+    CHECK_EQUAL(speed_limit_apply(90, ui16_i, 100, SPEED_MAX), speed_limit_apply(90, ui16_i + 100, 0, SPEED_MAX));
+  }
+  CHECK_EQUAL(speed_limit_apply(90, 10, -100, SPEED_MAX), 90);
+  
+  // acceleration from two wheel rotations: 20 to 22 km/h, 0.378 s and 0.344 s per rotation, 2 km/h over 0.361 s, filtered
+  CHECK_EQUAL(speed_limit_calc_acceleration(0, 220, 200, 5369, 5906), 27);
+  CHECK_EQUAL(speed_limit_calc_acceleration(55, 220, 200, 5369, 5906), 55);
+  CHECK_EQUAL(speed_limit_calc_acceleration(0, 400, 100, 3000, 3000), SPEED_LIMIT_ACCELERATION_X10_MAX / 2);
+  CHECK_EQUAL(speed_limit_calc_acceleration(0, 100, 400, 3000, 3000), -SPEED_LIMIT_ACCELERATION_X10_MAX / 2);
+  
+  // hard pedaling on the flat with full assist, accelerating at about 3 km/h/s: current is reduced before the taper is reached, without
+  // overshoot over the taper, and then speed is held within 0.5 km/h of the limit
+  init(15.0);
+  ui16_speed_min_x10 = 0xffff;
+  ui16_speed_max_x10 = 0;
+  ui16_speed_reduced_x10 = 0;
+  for (ui16_i = 0; ui16_i < (60 * RUNS_PER_SECOND); ui16_i++)
+  {
+    ui8_current = step(100.0, 0);
+    if (!ui16_speed_reduced_x10 && (ui8_current < ASSIST_ADC_CURRENT)) { ui16_speed_reduced_x10 = ui16_wheel_speed_x10; }
+    if (ui16_i >= (20 * RUNS_PER_SECOND))
+    {
+      if (ui16_wheel_speed_x10 < ui16_speed_min_x10) { ui16_speed_min_x10 = ui16_wheel_speed_x10; }
+    }
+    if (ui16_wheel_speed_x10 > ui16_speed_max_x10) { ui16_speed_max_x10 = ui16_wheel_speed_x10; }
+    CHECK(speed_x10() <= ((SPEED_MAX * 10) + SPEED_LIMIT_TAPER_ABOVE_X10 + 1));
+  }
+  CHECK(ui16_speed_reduced_x10 < ((SPEED_MAX * 10) - SPEED_LIMIT_TAPER_BELOW_X10 - 5));
+  CHECK(ui16_speed_min_x10 >= ((SPEED_MAX * 10) - 5));
+  CHECK(ui16_speed_max_x10 <= ((SPEED_MAX * 10) + 5));
+  
+  // hard pedaling on a 10 % climb: the motor can not reach the limit, full current
+  init(15.0);
+  for (ui16_i = 0; ui16_i < (30 * RUNS_PER_SECOND); ui16_i++) { ui8_current = step(150.0, 0.1); }
+  CHECK(ui16_wheel_speed_x10 < ((SPEED_MAX * 10) - SPEED_LIMIT_TAPER_BELOW_X10));
+  CHECK_EQUAL(ui8_current, ASSIST_ADC_CURRENT);
+  
+  // downhill: the bike goes over the limit without the motor, no current over the taper
+  init(15.0);
+  for (ui16_i = 0; ui16_i < (60 * RUNS_PER_SECOND); ui16_i++)
+  {
+    ui8_current = step(50.0, -0.04);
+    if (ui16_wheel_speed_x10 > ((SPEED_MAX * 10) + SPEED_LIMIT_TAPER_ABOVE_X10)) { CHECK_EQUAL(ui8_current, 0); }
+  }
+  CHECK(ui16_wheel_speed_x10 > ((SPEED_MAX * 10) + 50));
+  
+  return test_end("test_speed_limit");
+}
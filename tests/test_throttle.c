@@ -0,0 +1,129 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "test.h"
+#include "main.h"
+#include "motor.h"
+#include "brake.h"
+#include "throttle.h"
+
+#define CURRENT_ASSIST    10
+#define CURRENT_MAX       50
+
+// motor controller and brake variables used by throttle.c
+volatile uint8_t ui8_controller_adc_battery_current_target = 0;
+volatile uint8_t ui8_controller_duty_cycle_target = 0;
+volatile uint8_t ui8_g_brake_latched = 0;
+
+// throttle value after some runs with the same ADC value
+static uint8_t throttle (uint8_t ui8_adc_throttle)
+{
+  uint8_t ui8_i;
+  
+  for (ui8_i = 0; ui8_i < 5; ui8_i++) { throttle_controller(ui8_adc_throttle); }
+  
+  return throttle_get_value();
+}
+
+int main (void)
+{
+  uint16_t ui16_i;
+  uint8_t ui8_value;
+  uint8_t ui8_old;
+  
+  // range: 0 up to the min value and in the deadband over it, 255 from the max value
+  CHECK_EQUAL(throttle(0), 0);
+  CHECK_EQUAL(throttle(ADC_THROTTLE_MIN_VALUE), 0);
+  CHECK_EQUAL(throttle(ADC_THROTTLE_MIN_VALUE + THROTTLE_DEADBAND), 0);
+  CHECK(throttle(ADC_THROTTLE_MIN_VALUE + THROTTLE_DEADBAND + 2) > 0);
+  CHECK_EQUAL(throttle(ADC_THROTTLE_MAX_VALUE), 255);
+  CHECK_EQUAL(throttle(255), 255);
+  CHECK_EQUAL(throttle(ADC_THROTTLE_MIN_VALUE), 0);
+  
+  // linear response over the whole range, jumps larger than the deadband are applied at once
+  for (ui16_i = ADC_THROTTLE_MIN_VALUE + THROTTLE_DEADBAND; ui16_i <= ADC_THROTTLE_MAX_VALUE; ui16_i++)
+  {
+    throttle(0);
+    CHECK_NEAR(throttle(ui16_i), ((ui16_i - (ADC_THROTTLE_MIN_VALUE + THROTTLE_DEADBAND)) * 255) / (ADC_THROTTLE_MAX_VALUE - (ADC_THROTTLE_MIN_VALUE + THROTTLE_DEADBAND)), 2);
+  }
+  
+  // slow sweeps: never moves back, steps of at most the deadband, ends at 0 and 255
+  ui8_old = throttle(0);
+  for (ui16_i = 0; ui16_i <= 255; ui16_i++)
+  {
+    throttle_controller(ui16_i);
+    ui8_value = throttle_get_value();
+    CHECK(ui8_value >= ui8_old);
+    CHECK(ui8_value - ui8_old <= ((THROTTLE_DEADBAND + 1) * 255) / (ADC_THROTTLE_MAX_VALUE - ADC_THROTTLE_MIN_VALUE) + 2);
+    ui8_old = ui8_value;
+  }
+  CHECK_EQUAL(ui8_old, 255);
+  
+  for (ui16_i = 255; ui16_i > 0; ui16_i--)
+  {
+    throttle_controller(ui16_i);
+    ui8_value = throttle_get_value();
+    CHECK(ui8_value <= ui8_old);
+    ui8_old = ui8_value;
+  }
+  CHECK_EQUAL(ui8_old, 0);
+  
+  // ADC noise inside the deadband does not move the throttle value
+  ui8_old = throttle(100);
+  for (ui16_i = 0; ui16_i < 1000; ui16_i++)
+  {
+    throttle_controller(100 + (int8_t) ((test_random() % ((2 * THROTTLE_DEADBAND) + 1)) - THROTTLE_DEADBAND));
+    CHECK_EQUAL(throttle_get_value(), ui8_old);
+  }
+  CHECK(throttle(100 + THROTTLE_DEADBAND + 1) > ui8_old);
+  
+  // no max current set by the app: motor controller targets are not changed
+  ui8_controller_adc_battery_current_target = 77;
+  ui8_controller_duty_cycle_target = 77;
+  throttle(ADC_THROTTLE_MAX_VALUE);
+  CHECK_EQUAL(ui8_controller_adc_battery_current_target, 77);
+  CHECK_EQUAL(ui8_controller_duty_cycle_target, 77);
+  
+  // current target follows the throttle up to the max current
+  throttle_set_adc_battery_current(0, CURRENT_MAX);
+  throttle(ADC_THROTTLE_MAX_VALUE);
+  CHECK_EQUAL(ui8_controller_adc_battery_current_target, CURRENT_MAX);
+  CHECK_EQUAL(ui8_controller_duty_cycle_target, PWM_DUTY_CYCLE_MAX);
+  throttle((ADC_THROTTLE_MIN_VALUE + THROTTLE_DEADBAND + ADC_THROTTLE_MAX_VALUE) / 2);
+  CHECK_NEAR(ui8_controller_adc_battery_current_target, CURRENT_MAX / 2, 1);
+  
+  // never lower than the assist current, duty cycle target is left to the app without throttle
+  throttle_set_adc_battery_current(CURRENT_ASSIST, CURRENT_MAX);
+  ui8_controller_duty_cycle_target = 77;
+  throttle(0);
+  CHECK_EQUAL(ui8_controller_adc_battery_current_target, CURRENT_ASSIST);
+  CHECK_EQUAL(ui8_controller_duty_cycle_target, 77);
+  
+  for (ui16_i = 0; ui16_i <= 255; ui16_i++)
+  {
+    throttle_controller(ui16_i);
+    CHECK(ui8_controller_adc_battery_current_target >= CURRENT_ASSIST);
+    CHECK(ui8_controller_adc_battery_current_target <= CURRENT_MAX);
+    CHECK_EQUAL(ui8_controller_adc_battery_current_target, throttle_get_adc_battery_current_target());
+  }
+  
+  // brakes latched by the PWM interrupt: targets are not changed until the app sets the max current to 0
+  ui8_controller_adc_battery_current_target = 0;
+  ui8_controller_duty_cycle_target = 0;
+  ui8_g_brake_latched = 1;
+  throttle(ADC_THROTTLE_MAX_VALUE);
+  CHECK_EQUAL(ui8_controller_adc_battery_current_target, 0);
+  CHECK_EQUAL(ui8_controller_duty_cycle_target, 0);
+  throttle_set_adc_battery_current(0, 0);
+  ui8_g_brake_latched = 0;
+  throttle(ADC_THROTTLE_MAX_VALUE);
+  CHECK_EQUAL(ui8_controller_adc_battery_current_target, 0);
+  
+  return test_end("test_throttle");
+}
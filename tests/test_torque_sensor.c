@@ -0,0 +1,189 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "test.h"
+#include "main.h"
+#include "stm8s_gpio.h"
+#include "ebike_app.h"
+#include "adc.h"
+#include "torque_sensor.h"
+
+#define OFFSET    150
+
+// PWM interrupt and ADC variables used by torque_sensor.c
+volatile uint16_t ui16_torque_sensor_samples[TORQUE_SENSOR_SAMPLES_PER_REVOLUTION];
+volatile uint8_t ui8_torque_sensor_sample_index = 0;
+volatile uint8_t ui8_torque_sensor_samples_number = 0;
+volatile uint16_t ui16_adc_pedal_torque_offset = OFFSET;
+
+static struct_configuration_variables configuration_variables;
+
+struct_configuration_variables* get_configuration_variables (void) { return &configuration_variables; }
+void GPIO_Init (GPIO_TypeDef* GPIOx, GPIO_Pin_TypeDef GPIO_Pin, GPIO_Mode_TypeDef GPIO_Mode) { }
+
+static uint16_t ui16_sample_number = 0;
+
+
+
+// torque sample at the next cadence sensor transition, as in the PWM interrupt, torque of each stroke is a half sine wave
+static void add_sample (double d_stroke_peak)
+{
+  double d_angle = (M_PI * ui16_sample_number++) / TORQUE_SENSOR_SAMPLES_PER_HALF_STROKE;
+
+  ui16_torque_sensor_samples[ui8_torque_sensor_sample_index] = OFFSET + (uint16_t) ((d_stroke_peak * fabs(sin(d_angle))) + 0.5);
+  if (++ui8_torque_sensor_sample_index >= TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ui8_torque_sensor_sample_index = 0; }
+  if (ui8_torque_sensor_samples_number < TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ++ui8_torque_sensor_samples_number; }
+}
+
+
+
+static void check_calc (void)
+{
+  uint8_t ui8_i;
+  uint16_t ui16_calls;
+
+  // no samples, no torque
+  ui8_torque_sensor_samples_number = 0;
+  CHECK_EQUAL(torque_sensor_calc(), 0);
+
+  // constant effort, same value at any crank angle and about the mean of the strokes
+  for (ui8_i = 0; ui8_i < 60; ui8_i++)
+  {
+    add_sample(100);
+    CHECK_EQUAL(torque_sensor_calc(), 1);
+
+    if (ui8_i >= TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { CHECK_NEAR(torque_sensor_get_adc(), OFFSET + 64, 2); }
+  }
+
+  // rider pushes harder, within half a revolution the value is near the new mean
+  for (ui8_i = 0; ui8_i < TORQUE_SENSOR_SAMPLES_PER_HALF_STROKE; ui8_i++) { add_sample(200); torque_sensor_calc(); }
+  CHECK_NEAR(torque_sensor_get_adc(), OFFSET + 127, 3);
+
+  // rider pushes less, value follows the revolution mean, one revolution later it is at the new mean
+  for (ui8_i = 0; ui8_i < 30; ui8_i++) { add_sample(200); torque_sensor_calc(); }
+
+  // the half stroke value alone follows within half a revolution while the revolution mean lags
+  for (ui8_i = 0; ui8_i < TORQUE_SENSOR_SAMPLES_PER_HALF_STROKE; ui8_i++) { add_sample(50); torque_sensor_calc(); }
+  CHECK_NEAR(torque_sensor_get_adc_half_stroke(), OFFSET + 32, 2);
+  CHECK(torque_sensor_get_adc() > OFFSET + 64);
+
+  for (ui8_i = 0; ui8_i < TORQUE_SENSOR_SAMPLES_PER_REVOLUTION; ui8_i++)
+  {
+    uint16_t ui16_old = torque_sensor_get_adc();
+
+    add_sample(50);
+    torque_sensor_calc();
+    CHECK(torque_sensor_get_adc() <= ui16_old);
+  }
+  CHECK_NEAR(torque_sensor_get_adc(), OFFSET + 32, 2);
+
+  // samples are read with interrupts disabled
+  ui16_calls = ui16_host_interrupts_disabled_counter;
+  torque_sensor_calc();
+  CHECK_EQUAL(ui16_host_interrupts_disabled_counter, ui16_calls + 1);
+  CHECK_EQUAL(ui8_host_interrupts_enabled, 1);
+}
+
+
+
+// run the app for a number of 20 ms runs with the pedals stopped and a torque sensor value
+static void run_stopped (uint16_t ui16_runs, uint16_t ui16_adc_torque)
+{
+  ui8_torque_sensor_samples_number = 0;
+
+  while (ui16_runs--)
+  {
+    torque_sensor_calc();
+    torque_sensor_offset_track(ui16_adc_torque, 0);
+  }
+}
+
+
+
+// run the app for a number of 20 ms runs while pedaling, torque sensor value over each revolution goes from min to max
+static void run_pedaling (uint16_t ui16_runs, uint16_t ui16_adc_torque_min, uint16_t ui16_adc_torque_max)
+{
+  while (ui16_runs--)
+  {
+    // one sample per run, 20 samples per revolution is 60 RPM
+    ui16_torque_sensor_samples[ui8_torque_sensor_sample_index] = (ui16_sample_number++ % TORQUE_SENSOR_SAMPLES_PER_HALF_STROKE) ? ui16_adc_torque_min : ui16_adc_torque_max;
+    if (++ui8_torque_sensor_sample_index >= TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ui8_torque_sensor_sample_index = 0; }
+    if (ui8_torque_sensor_samples_number < TORQUE_SENSOR_SAMPLES_PER_REVOLUTION) { ++ui8_torque_sensor_samples_number; }
+
+    torque_sensor_calc();
+    torque_sensor_offset_track(ui16_torque_sensor_samples[0], 60);
+  }
+}
+
+
+
+static void check_offset_tracking (void)
+{
+  #define UNLOADED    (OFFSET - ADC_TORQUE_SENSOR_CALIBRATION_OFFSET)
+  #define MINUTE      3000
+
+  // saved offset is not valid, offset measured at power on is used
+  configuration_variables.ui16_adc_pedal_torque_offset = 0;
+  ui16_adc_pedal_torque_offset = OFFSET;
+  torque_sensor_offset_init();
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET);
+
+  // unloaded and stopped, offset does not move
+  run_stopped(MINUTE, UNLOADED);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET);
+
+  // foot resting on a stopped pedal for 10 minutes, offset does not go up
+  run_stopped(10 * MINUTE, UNLOADED + 20);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET);
+
+  // stopped and lower, offset goes down 1 ADC step per second
+  run_stopped(50 * 5, UNLOADED - 5);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET - 5);
+
+  // and back to the power on value only when pedaling unloaded, 1 ADC step every 10 seconds
+  run_stopped(MINUTE, UNLOADED);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET - 5);
+
+  run_pedaling(50 * 25, UNLOADED - 1, UNLOADED + 1);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET - 3);
+
+  run_pedaling(MINUTE, UNLOADED - 1, UNLOADED + 1);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET);
+
+  // pedaling with load, offset does not move
+  run_pedaling(10 * MINUTE, UNLOADED, UNLOADED + 40);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET);
+
+  run_pedaling(10 * MINUTE, UNLOADED + 20, UNLOADED + 24);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET);
+
+  // low constant load over the revolution is flat too, offset is held at the tracking range
+  run_pedaling(65000, UNLOADED + 100, UNLOADED + 100);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET + 30);
+
+  run_stopped(MINUTE, UNLOADED - 100);
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET - 30);
+
+  // saved offset is used when lower than the offset measured at power on
+  configuration_variables.ui16_adc_pedal_torque_offset = OFFSET - 10;
+  ui16_adc_pedal_torque_offset = OFFSET;
+  torque_sensor_offset_init();
+  CHECK_EQUAL(ui16_adc_pedal_torque_offset, OFFSET - 10);
+}
+
+
+
+int main (void)
+{
+  check_calc();
+  check_offset_tracking();
+
+  return test_end("test_torque_sensor");
+}
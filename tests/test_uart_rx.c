@@ -0,0 +1,223 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "test.h"
+#include "uart_rx.h"
+
+#define FRAME_LENGTH_MAX    34    // display frame, the motor controller frame has 10 bytes
+#define FUZZ_BYTES          1000000
+
+static volatile uint8_t ui8_buffer[2][FRAME_LENGTH_MAX];
+static struct_uart_rx m_uart_rx;
+
+// reference receiver: frame being received and the frame waiting for the main loop
+static uint8_t ui8_ref_frame[FRAME_LENGTH_MAX];
+static uint8_t ui8_ref_counter;
+static uint8_t ui8_ref_ready_frame[FRAME_LENGTH_MAX];
+static uint8_t ui8_ref_ready;
+static uint32_t ui32_ref_overruns;
+static uint32_t ui32_ref_frames_dropped;
+
+static void init (uint8_t ui8_start_byte, uint8_t ui8_frame_length)
+{
+  struct_uart_rx m_uart_rx_init = { ui8_start_byte, ui8_frame_length, { ui8_buffer[0], ui8_buffer[1] } };
+  
+  m_uart_rx = m_uart_rx_init;
+  ui8_ref_counter = 0;
+  ui8_ref_ready = 0;
+  ui32_ref_overruns = 0;
+  ui32_ref_frames_dropped = 0;
+}
+
+// receive interrupt with the reference receiver
+static void receive (uint8_t ui8_byte, uint8_t ui8_overrun)
+{
+  uart_rx_byte(&m_uart_rx, ui8_byte, ui8_overrun);
+  
+  if (ui8_overrun) { ui32_ref_overruns++; ui8_ref_counter = 0; }
+  if ((ui8_ref_counter == 0) && (ui8_byte != m_uart_rx.ui8_start_byte)) { return; }
+  
+  ui8_ref_frame[ui8_ref_counter++] = ui8_byte;
+  if (ui8_ref_counter < m_uart_rx.ui8_frame_length) { return; }
+  
+  ui8_ref_counter = 0;
+  if (ui8_ref_ready) { ui32_ref_frames_dropped++; }
+  else { memcpy(ui8_ref_ready_frame, ui8_ref_frame, sizeof(ui8_ref_frame)); ui8_ref_ready = 1; }
+}
+
+// a full frame with random data, optionally without the start byte in the data
+static void send_frame (uint8_t ui8_no_start_byte_in_data)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_byte;
+  
+  receive(m_uart_rx.ui8_start_byte, 0);
+  
+  for (ui8_i = 1; ui8_i < m_uart_rx.ui8_frame_length; ui8_i++)
+  {
+    do { ui8_byte = test_random(); } while (ui8_no_start_byte_in_data && (ui8_byte == m_uart_rx.ui8_start_byte));
+    receive(ui8_byte, 0);
+  }
+}
+
+static uint8_t frame_equal (volatile uint8_t *p_frame, const uint8_t *p_expected)
+{
+  uint8_t ui8_i;
+  
+  for (ui8_i = 0; ui8_i < m_uart_rx.ui8_frame_length; ui8_i++)
+  {
+    if (p_frame[ui8_i] != p_expected[ui8_i]) { return 0; }
+  }
+  
+  return 1;
+}
+
+// random bytes, frames, overruns and main loop timing against the reference receiver
+static void fuzz (uint8_t ui8_start_byte, uint8_t ui8_frame_length)
+{
+  volatile uint8_t *p_frame = 0;
+  uint8_t ui8_frame[FRAME_LENGTH_MAX];
+  uint32_t ui32_i;
+  uint32_t ui32_random;
+  uint16_t ui16_processing = 0;
+  uint8_t ui8_overrun_rate = 0;
+  uint8_t ui8_main_loop_rate = 0;
+  
+  init(ui8_start_byte, ui8_frame_length);
+  
+  for (ui32_i = 0; ui32_i < FUZZ_BYTES; ui32_i++)
+  {
+    ui32_random = test_random();
+    
+    // change the rates of overruns and main loop runs from time to time, from none to every byte
+    if ((ui32_i & 0xffff) == 0)
+    {
+      ui8_overrun_rate = (ui32_random >> 8) & 7;
+      ui8_main_loop_rate = (ui32_random >> 16) & 7;
+      continue;
+    }
+    
+    // input: frames, start bytes or random bytes
+    switch (ui32_random & 3)
+    {
+      case 0: send_frame(0); break;
+      case 1: receive(ui8_start_byte, 0); break;
+      default: receive(ui32_random >> 24, ui8_overrun_rate && (((ui32_random >> 8) & 0xff) < ui8_overrun_rate)); break;
+    }
+    
+    // parser state is always inside the frame
+    CHECK(m_uart_rx.ui8_counter < ui8_frame_length);
+    
+    // main loop: gets the frame, processes it while bytes are received and then sets it done
+    if (p_frame)
+    {
+      if (ui16_processing) { ui16_processing--; continue; }
+      
+      // the frame was not written while it was processed
+      CHECK(frame_equal(p_frame, ui8_frame));
+      
+      uart_rx_frame_done(&m_uart_rx);
+      ui8_ref_ready = 0;
+      p_frame = 0;
+    }
+    else if (((ui32_random >> 12) & 7) < ui8_main_loop_rate)
+    {
+      p_frame = uart_rx_get_frame(&m_uart_rx);
+      CHECK_EQUAL(p_frame != 0, ui8_ref_ready);
+      
+      if (p_frame)
+      {
+        // same frame as the reference, always with the start byte
+        CHECK_EQUAL(p_frame[0], ui8_start_byte);
+        CHECK(frame_equal(p_frame, ui8_ref_ready_frame));
+        memcpy(ui8_frame, (const uint8_t *) p_frame, ui8_frame_length);
+        ui16_processing = (ui32_random >> 16) & 0x3f;
+      }
+    }
+    
+    CHECK_EQUAL(m_uart_rx.ui8_overruns, (ui32_ref_overruns < 255) ? ui32_ref_overruns : 255);
+    CHECK_EQUAL(m_uart_rx.ui8_frames_dropped, (ui32_ref_frames_dropped < 255) ? ui32_ref_frames_dropped : 255);
+    
+    // restart the counters before they saturate, so they are checked on the whole run
+    if ((ui32_ref_overruns > 250) || (ui32_ref_frames_dropped > 250))
+    {
+      m_uart_rx.ui8_overruns = 0;
+      m_uart_rx.ui8_frames_dropped = 0;
+      ui32_ref_overruns = 0;
+      ui32_ref_frames_dropped = 0;
+    }
+  }
+}
+
+int main (void)
+{
+  volatile uint8_t *p_frame;
+  uint8_t ui8_frame[FRAME_LENGTH_MAX];
+  uint16_t ui16_i;
+  uint8_t ui8_i;
+  
+  // motor controller frames: every frame is received with noise without start bytes in between, nothing lost
+  init(0x59, 10);
+  for (ui16_i = 0; ui16_i < 1000; ui16_i++)
+  {
+    for (ui8_i = 0; ui8_i < (test_random() & 7); ui8_i++) { receive(0x58, 0); }
+    send_frame(0);
+    p_frame = uart_rx_get_frame(&m_uart_rx);
+    CHECK(p_frame != 0);
+    if (p_frame) { CHECK(frame_equal(p_frame, ui8_ref_ready_frame)); }
+    uart_rx_frame_done(&m_uart_rx);
+    ui8_ref_ready = 0;
+    CHECK_EQUAL(uart_rx_get_frame(&m_uart_rx) == 0, 1);
+  }
+  CHECK_EQUAL(m_uart_rx.ui8_overruns, 0);
+  CHECK_EQUAL(m_uart_rx.ui8_frames_dropped, 0);
+  
+  // frames received while the last one is processed: the next one is kept in the other buffer, later ones are dropped
+  init(0x59, 10);
+  send_frame(0);
+  p_frame = uart_rx_get_frame(&m_uart_rx);
+  memcpy(ui8_frame, (const uint8_t *) p_frame, 10);
+  send_frame(0);
+  send_frame(0);
+  send_frame(0);
+  CHECK(frame_equal(p_frame, ui8_frame));
+  CHECK_EQUAL(m_uart_rx.ui8_frames_dropped, 3);
+  CHECK_EQUAL(m_uart_rx.ui8_overruns, 0);
+  uart_rx_frame_done(&m_uart_rx);
+  CHECK_EQUAL(uart_rx_get_frame(&m_uart_rx) == 0, 1);
+  
+  // a byte lost by the UART: the frame is dropped, it is counted as an overrun and not as a frame dropped
+  init(0x59, 10);
+  receive(0x59, 0);
+  for (ui8_i = 0; ui8_i < 5; ui8_i++) { receive(ui8_i, 0); }
+  receive(0x10, 1);
+  for (ui8_i = 0; ui8_i < 10; ui8_i++) { receive(ui8_i, 0); }
+  CHECK_EQUAL(uart_rx_get_frame(&m_uart_rx) == 0, 1);
+  CHECK_EQUAL(m_uart_rx.ui8_overruns, 1);
+  CHECK_EQUAL(m_uart_rx.ui8_frames_dropped, 0);
+  
+  // the byte received with the overrun can start the next frame
+  receive(0x59, 1);
+  for (ui8_i = 1; ui8_i < 10; ui8_i++) { receive(ui8_i, 0); }
+  CHECK(uart_rx_get_frame(&m_uart_rx) != 0);
+  CHECK_EQUAL(m_uart_rx.ui8_overruns, 2);
+  
+  // counters saturate at 255
+  init(0x59, 10);
+  for (ui16_i = 0; ui16_i < 300; ui16_i++) { receive(0, 1); send_frame(0); }
+  CHECK_EQUAL(m_uart_rx.ui8_overruns, 255);
+  CHECK_EQUAL(m_uart_rx.ui8_frames_dropped, 255);
+  
+  // fuzz the motor controller and the display receivers
+  fuzz(0x59, 10);
+  fuzz(67, 34);
+  
+  return test_end("test_uart_rx");
+}
@@ -0,0 +1,152 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "test.h"
+#include "main.h"
+#include "walk_assist.h"
+
+#define SPEED_TARGET_X10        40      // 4.0 km/h
+#define BIKE_MASS_KG            25.0
+#define BATTERY_VOLTAGE         36.0
+#define MOTOR_EFFICIENCY        0.7
+#define MOTOR_FORCE_PER_AMP     30.0    // wheel force per battery amp at stall, limits force at low speed
+#define WHEEL_PERIMETER_M       2.1
+
+// simulated bike pushed with walk assist, one step per EBIKE_APP_CONTROLLER_PERIOD_MS
+static double d_speed_m_s;
+static double d_wheel_distance_m;
+static double d_wheel_time_s;
+static uint8_t ui8_wheel_pulses;
+static uint16_t ui16_wheel_speed_x10;
+static uint16_t ui16_speed_per_erps_x1024;    // of the gear in use
+
+static uint16_t ui16_motor_erps (void) { return (uint16_t) (((d_speed_m_s * 36.0) * 1024.0) / ui16_speed_per_erps_x1024); }
+
+static uint8_t step (uint8_t ui8_adc_battery_current_max, double d_grade)
+{
+  double d_dt = EBIKE_APP_CONTROLLER_PERIOD_MS / 1000.0;
+  uint8_t ui8_new_measurement = 0;
+  uint16_t ui16_speed_x10;
+  uint8_t ui8_adc_current;
+  double d_current;
+  double d_force;
+  
+  // wheel speed sensor: one pulse per wheel rotation, a measurement is the mean speed between two pulses
+  d_wheel_distance_m += d_speed_m_s * d_dt;
+  d_wheel_time_s += d_dt;
+  if (d_wheel_distance_m >= WHEEL_PERIMETER_M)
+  {
+    if (ui8_wheel_pulses++)
+    {
+      ui16_wheel_speed_x10 = (uint16_t) (((WHEEL_PERIMETER_M / d_wheel_time_s) * 36.0) + 0.5);
+      ui8_new_measurement = 1;
+    }
+    
+    d_wheel_distance_m -= WHEEL_PERIMETER_M;
+    d_wheel_time_s = 0;
+  }
+  
+  ui16_speed_x10 = walk_assist_calc_speed(ui16_wheel_speed_x10, ui8_new_measurement, ui16_motor_erps());
+  ui8_adc_current = walk_assist_controller(SPEED_TARGET_X10, ui16_speed_x10, ui8_adc_battery_current_max);
+  
+  // motor force from battery power, limited at low speed
+  d_current = ui8_adc_current * (BATTERY_CURRENT_PER_10_BIT_ADC_STEP_X10 / 10.0);
+  d_force = d_current * MOTOR_FORCE_PER_AMP;
+  if (d_speed_m_s > 0.01) { d_force = fmin(d_force, (BATTERY_VOLTAGE * d_current * MOTOR_EFFICIENCY) / d_speed_m_s); }
+  
+  // slope and rolling resistance, the bike does not roll back
+  d_force -= BIKE_MASS_KG * 9.81 * (d_grade + 0.01);
+  d_speed_m_s += (d_force / BIKE_MASS_KG) * d_dt;
+  if (d_speed_m_s < 0) { d_speed_m_s = 0; }
+  
+  return ui8_adc_current;
+}
+
+static void start (uint16_t ui16_gear_speed_per_erps_x1024)
+{
+  walk_assist_reset();
+  while (walk_assist_stop()) { }
+  ui16_speed_per_erps_x1024 = ui16_gear_speed_per_erps_x1024;
+  d_speed_m_s = 0;
+  d_wheel_distance_m = WHEEL_PERIMETER_M / 2;
+  d_wheel_time_s = 0;
+  ui8_wheel_pulses = 0;
+  ui16_wheel_speed_x10 = 0;
+}
+
+static uint16_t speed_x10 (void) { return (uint16_t) ((d_speed_m_s * 36.0) + 0.5); }
+
+static void check_grade (double d_grade, uint16_t ui16_gear_speed_per_erps_x1024)
+{
+  uint16_t ui16_i;
+  
+  start(ui16_gear_speed_per_erps_x1024);
+  
+  // smooth start: target speed ramps at 3 km/h per second
+  for (ui16_i = 0; ui16_i < 25; ui16_i++) { step(255, d_grade); }
+  CHECK(speed_x10() <= 20);
+  
+  // settles after the speed per ERPS is learned from the wheel speed sensor and holds the target speed
+  for (ui16_i = 0; ui16_i < 750; ui16_i++)
+  {
+    step(255, d_grade);
+    if (ui16_i >= 600) { CHECK_NEAR(speed_x10(), SPEED_TARGET_X10, 2); }
+  }
+}
+
+
+
+int main (void)
+{
+  uint8_t ui8_current;
+  uint8_t ui8_old;
+  uint16_t ui16_i;
+  
+  // speed per ERPS from a stale wheel speed at a very low motor speed is limited, it does not overflow
+  start(WALK_ASSIST_SPEED_PER_ERPS_DEFAULT_X1024);
+  CHECK_EQUAL(walk_assist_calc_speed(80, 1, 1), (WALK_ASSIST_SPEED_PER_ERPS_MAX_X1024 >> 10));
+  CHECK_EQUAL(walk_assist_calc_speed(80, 0, 100), (100 * WALK_ASSIST_SPEED_PER_ERPS_MAX_X1024) >> 10);
+  
+  // speed per ERPS is learned from the wheel speed sensor
+  CHECK_EQUAL(walk_assist_calc_speed(40, 1, 137), 39);
+  CHECK_EQUAL(walk_assist_calc_speed(40, 0, 274), 79);
+  
+  // default speed per ERPS after a stop, until the first wheel speed measurement
+  while (walk_assist_stop()) { }
+  CHECK_EQUAL(walk_assist_calc_speed(0, 0, 1024), WALK_ASSIST_SPEED_PER_ERPS_DEFAULT_X1024);
+  
+  // flat and slopes up to 15 %, in the gear of the default speed per ERPS and in lower and higher gears
+  for (ui16_i = 0; ui16_i <= 15; ui16_i += 5)
+  {
+    check_grade(ui16_i / 100.0, WALK_ASSIST_SPEED_PER_ERPS_DEFAULT_X1024);
+    check_grade(ui16_i / 100.0, 150);
+    check_grade(ui16_i / 100.0, 300);
+  }
+  
+  // current is limited by the battery current max
+  start(WALK_ASSIST_SPEED_PER_ERPS_DEFAULT_X1024);
+  for (ui16_i = 0; ui16_i < 100; ui16_i++) { CHECK(step(4, 0.15) <= 4); }
+  CHECK(speed_x10() < SPEED_TARGET_X10);
+  
+  // smooth stop: current ramps down
+  start(WALK_ASSIST_SPEED_PER_ERPS_DEFAULT_X1024);
+  for (ui16_i = 0; ui16_i < 500; ui16_i++) { ui8_current = step(255, 0.15); }
+  CHECK(ui8_current > WALK_ASSIST_STOP_ADC_BATTERY_CURRENT_STEP);
+  
+  for (ui16_i = 0; ui8_current; ui16_i++)
+  {
+    ui8_old = ui8_current;
+    ui8_current = walk_assist_stop();
+    CHECK((ui8_current == 0) || (ui8_current == ui8_old - WALK_ASSIST_STOP_ADC_BATTERY_CURRENT_STEP));
+  }
+  CHECK(ui16_i <= (WALK_ASSIST_ADC_BATTERY_CURRENT_MAX / WALK_ASSIST_STOP_ADC_BATTERY_CURRENT_STEP) + 1);
+  
+  return test_end("test_walk_assist");
+}
@@ -0,0 +1,13 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "bench.h"
+
+// kept in their own file so the compiler can not inline them and the breakpoints are always hit
+void bench_start (void) { }
+void bench_stop (void) { }
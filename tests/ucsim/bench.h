@@ -0,0 +1,20 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+
+#define BENCH_RUNS    32    // measured runs of each benchmark, bench.sh prints the clocks of each one
+
+// markers, bench.sh sets simulator breakpoints on them and reads the CPU clocks in between
+void bench_start (void);
+void bench_stop (void);
+
+#endif /* _BENCH_H_ */
@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# Runs a benchmark in the ucsim STM8 simulator and prints the CPU clocks
+# between each bench_start() and bench_stop() call, then the min and max
+# of each group of runs, for benchmarks that measure several functions
+# one after the other.
+#
+# usage: bench.sh build/<benchmark>.ihx [runs per group] [groups]
+
+IHX=$1
+RUNS=${2:-32}
+GROUPS=${3:-1}
+MAP=${IHX%.ihx}.map
+SSTM8=${SSTM8:-sstm8}
+
+if [ ! -f "$IHX" ] || [ ! -f "$MAP" ]; then
+  echo "usage: $0 build/<benchmark>.ihx [runs per group] [groups]" >&2
+  exit 1
+fi
+
+# marker addresses from the linker map
+symbol_address () {
+  awk -v s="_$1" '$2 == s { print "0x" $1; exit }' "$MAP"
+}
+
+START=$(symbol_address bench_start)
+STOP=$(symbol_address bench_stop)
+
+if [ -z "$START" ] || [ -z "$STOP" ]; then
+  echo "$0: bench_start or bench_stop not found in $MAP" >&2
+  exit 1
+fi
+
+# break on both markers, read the clocks at each one
+{
+  echo "break $START"
+  echo "break $STOP"
+  i=0
+  while [ $i -lt $((RUNS * GROUPS)) ]; do
+    echo "run"
+    echo "state"
+    echo "run"
+    echo "state"
+    i=$((i + 1))
+  done
+  echo "kill"
+} | "$SSTM8" -t STM8S105 -X 16M -b "$IHX" 2>&1 | \
+awk -v name="$(basename "$IHX" .ihx)" -v runs="$RUNS" '
+  function summary () {
+    printf "%s group %d: %d runs, min %d clks, max %d clks (%.3f ms at 16 MHz)\n", name, group, count, min, max, max / 16000
+  }
+  /clks\)/ {
+    match($0, /\([0-9]+ clks\)/)
+    clks = substr($0, RSTART + 1, RLENGTH - 7) + 0
+    if (n % 2) {
+      run = clks - start
+      printf "%s run %d: %d clks\n", name, (n + 1) / 2, run
+      if ((count == 0) || (run < min)) { min = run }
+      if ((count == 0) || (run > max)) { max = run }
+      if (++count == runs) { group++; summary(); count = 0 }
+    }
+    else { start = clks }
+    n++
+  }
+  END {
+    if (n < 2) { print name ": no runs measured" > "/dev/stderr"; exit 1 }
+    if (count) { group++; summary() }
+  }'
@@ -0,0 +1,109 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "interrupts.h"
+#include "stm8s.h"
+#include "main.h"
+#include "pins.h"
+#include "pwm.h"
+#include "motor.h"
+#include "brake.h"
+#include "bench.h"
+
+// vectors of the firmware, see main.c, interrupts stay disabled and the brake interrupt is entered by brake_interrupt()
+void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER);
+void EXTI_PORTC_IRQHandler(void) __interrupt(EXTI_PORTC_IRQHANDLER);
+void UART2_TX_IRQHandler(void) __interrupt(UART2_TX_IRQHANDLER);
+void UART2_IRQHandler(void) __interrupt(UART2_IRQHANDLER);
+
+// startup timeline, defined in main.c
+uint16_t ui16_startup_timeline[STARTUP_TIMELINE_STEPS];
+
+// enters the brake interrupt as the CPU does: pushes PC, Y, X, A and CC then jumps to the handler, which returns with iret
+static void brake_interrupt (void)
+{
+  __asm
+    push #<00001$
+    push #>00001$
+    push #0
+    pushw y
+    pushw x
+    push a
+    push cc
+    jp _EXTI_PORTC_IRQHandler
+  00001$:
+  __endasm;
+}
+
+static void brake_set (uint8_t ui8_applied)
+{
+  if (ui8_applied) { GPIO_WriteLow(BRAKE__PORT, BRAKE__PIN); }
+  else { GPIO_WriteHigh(BRAKE__PORT, BRAKE__PIN); }
+}
+
+int main (void)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_j;
+  
+  CLK_HSIPrescalerConfig(CLK_PRESCALER_HSIDIV1);
+  
+  // brake pin as output, the input data register reads the level the bench sets
+  GPIO_Init(BRAKE__PORT, BRAKE__PIN, GPIO_MODE_OUT_PP_HIGH_FAST);
+  pwm_init_bipolar_4q();
+  
+  // group 1: brake edge to PWM outputs and duty cycle off, add the 9 clocks of the CPU interrupt entry to get the latency
+  for (ui8_i = 0; ui8_i < BENCH_RUNS; ui8_i++)
+  {
+    brake_set(0);
+    ui8_g_brake_cut = 0;
+    ui8_g_brake_latched = 0;
+    ui8_g_duty_cycle = 200;
+    motor_enable_pwm();
+    brake_set(1);
+    
+    bench_start();
+    brake_interrupt();
+    bench_stop();
+  }
+  
+  // group 2: PWM interrupt latching the cut
+  for (ui8_i = 0; ui8_i < BENCH_RUNS; ui8_i++)
+  {
+    brake_set(1);
+    ui8_g_brake_cut = 0;
+    ui8_g_brake_latched = 0;
+    brake_interrupt();
+    for (ui8_j = 1; ui8_j < BRAKE_CUT_PWM_CYCLES; ui8_j++) { brake_qualify(); }
+    
+    bench_start();
+    brake_qualify();
+    bench_stop();
+  }
+  
+  // group 3: PWM interrupt restoring power after a glitch
+  for (ui8_i = 0; ui8_i < BENCH_RUNS; ui8_i++)
+  {
+    brake_set(1);
+    ui8_g_brake_cut = 0;
+    ui8_g_brake_latched = 0;
+    ui8_g_duty_cycle = 200;
+    motor_enable_pwm();
+    brake_interrupt();
+    brake_set(0);
+    
+    bench_start();
+    brake_qualify();
+    bench_stop();
+  }
+  
+  while (1) { }
+  
+  return 0;
+}
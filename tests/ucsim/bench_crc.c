@@ -0,0 +1,82 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "common.h"
+#include "bench.h"
+
+#define FRAME_LENGTH    32    // CRC of the largest frame, motor controller to display: start byte and 31 data bytes
+
+static uint8_t ui8_frame[FRAME_LENGTH];
+volatile uint16_t ui16_crc;   // volatile so the CRC is not optimized away
+
+// CRC-16 shifting 8 bits one by one, as crc16() did before the 4 bit table
+static uint16_t crc16_bitwise (const uint8_t *p_data, uint8_t ui8_length)
+{
+  uint16_t ui16_crc_temp = 0xffff;
+  uint8_t ui8_i;
+  
+  while (ui8_length--)
+  {
+    ui16_crc_temp ^= (uint16_t) *p_data++;
+    
+    for (ui8_i = 8; ui8_i > 0; ui8_i--)
+    {
+      if (ui16_crc_temp & 0x0001) { ui16_crc_temp = (ui16_crc_temp >> 1) ^ 0xA001; }
+      else { ui16_crc_temp >>= 1; }
+    }
+  }
+  
+  return ui16_crc_temp;
+}
+
+int main (void)
+{
+  uint16_t ui16_seed = 1;
+  uint8_t ui8_i;
+  
+  CLK_HSIPrescalerConfig(CLK_PRESCALER_HSIDIV1);
+  
+  for (ui8_i = 0; ui8_i < FRAME_LENGTH; ui8_i++)
+  {
+    ui16_seed = (ui16_seed * 25173) + 13849;
+    ui8_frame[ui8_i] = ui16_seed >> 8;
+  }
+  
+  // group 1: bit by bit
+  for (ui8_i = 0; ui8_i < BENCH_RUNS; ui8_i++)
+  {
+    bench_start();
+    ui16_crc = crc16_bitwise(ui8_frame, FRAME_LENGTH);
+    bench_stop();
+  }
+  
+  // group 2: crc16() called for each byte, as the firmware did before crc16_buf()
+  for (ui8_i = 0; ui8_i < BENCH_RUNS; ui8_i++)
+  {
+    uint8_t ui8_j;
+    
+    bench_start();
+    ui16_crc = 0xffff;
+    for (ui8_j = 0; ui8_j < FRAME_LENGTH; ui8_j++) { crc16(ui8_frame[ui8_j], (uint16_t *) &ui16_crc); }
+    bench_stop();
+  }
+  
+  // group 3: crc16_buf(), 4 bit table
+  for (ui8_i = 0; ui8_i < BENCH_RUNS; ui8_i++)
+  {
+    bench_start();
+    ui16_crc = crc16_buf(ui8_frame, FRAME_LENGTH);
+    bench_stop();
+  }
+  
+  while (1) { }
+  
+  return 0;
+}
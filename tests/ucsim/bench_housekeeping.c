@@ -0,0 +1,65 @@
+/*
+ * TongSheng TSDZ2 motor controller firmware/
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "interrupts.h"
+#include "stm8s.h"
+#include "main.h"
+#include "uart.h"
+#include "adc.h"
+#include "timers.h"
+#include "ebike_app.h"
+#include "torque_sensor.h"
+#include "motor_thermal.h"
+#include "eeprom.h"
+#include "assist_map.h"
+#include "bench.h"
+
+// vectors of the firmware, see main.c, the PWM is not started so the motor interrupt does not run
+void TIM1_CAP_COM_IRQHandler(void) __interrupt(TIM1_CAP_COM_IRQHANDLER);
+void EXTI_PORTC_IRQHandler(void) __interrupt(EXTI_PORTC_IRQHANDLER);
+void UART2_TX_IRQHandler(void) __interrupt(UART2_TX_IRQHANDLER);
+void UART2_IRQHandler(void) __interrupt(UART2_IRQHANDLER);
+
+// startup timeline, defined in main.c
+uint16_t ui16_startup_timeline[STARTUP_TIMELINE_STEPS];
+
+int main (void)
+{
+  struct_configuration_variables *p_configuration_variables;
+  uint8_t ui8_i;
+  
+  CLK_HSIPrescalerConfig(CLK_PRESCALER_HSIDIV1);
+  
+  timer3_init();
+  uart2_init();
+  adc_init();
+  EEPROM_init();
+  assist_map_init();
+  torque_sensor_offset_init();
+  motor_thermal_init();
+  enableInterrupts();
+  
+  // change every stored configuration byte so the runs include the EEPROM write, the motor is stopped
+  p_configuration_variables = get_configuration_variables();
+  p_configuration_variables->ui16_wheel_perimeter ^= 0xffff;
+  p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 ^= 0xffff;
+  EEPROM_controller(WRITE_TO_MEMORY);
+  
+  // housekeeping task, worst case against EBIKE_APP_HOUSEKEEPING_BUDGET_MS
+  for (ui8_i = 0; ui8_i < BENCH_RUNS; ui8_i++)
+  {
+    bench_start();
+    ebike_app_housekeeping();
+    bench_stop();
+  }
+  
+  while (1) { }
+  
+  return 0;
+}
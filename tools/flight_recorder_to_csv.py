@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+#
+# TongSheng TSDZ2 motor controller firmware flight recorder tool
+#
+# Released under the GPL License, Version 3
+#
+# Converts a flight recorder dump, captured from the motor controller UART TX line,
+# to CSV. With --port the dump is also requested and captured from a serial port.
+#
+# Usage:
+#   flight_recorder_to_csv.py capture.bin > records.csv
+#   flight_recorder_to_csv.py --port /dev/ttyUSB0 --capture capture.bin > records.csv
+#   flight_recorder_to_csv.py --port /dev/ttyUSB0 --arm --decimation 16 --trigger-mask 1
+
+import argparse
+import sys
+import time
+
+UART_BAUD_RATE = 9600
+PWM_CYCLE_MS = 0.064
+
+# must match flight_recorder.h
+MESSAGE_ID = 10
+COMMAND_ARM = 1
+COMMAND_TRIGGER = 2
+COMMAND_DUMP = 3
+DUMP_START_BYTE = 0x44
+DUMP_HEADER_BYTES = 6
+RECORD_BYTES = 8
+RECORDS_PER_CHUNK = 4
+NO_TRIGGER = 0xff
+DUMP_PACKAGE_BYTES = DUMP_HEADER_BYTES + (RECORDS_PER_CHUNK * RECORD_BYTES) + 2
+
+# must match the display to motor controller package
+DISPLAY_START_BYTE = 0x59
+DISPLAY_PACKAGE_BYTES = 10
+
+
+def crc16(data):
+    crc = 0xffff
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            if crc & 1:
+                crc = (crc >> 1) ^ 0xa001
+            else:
+                crc >>= 1
+    return crc
+
+
+def find_chunks(data):
+    """Returns the last received chunk for each chunk index, packages with a wrong CRC are skipped."""
+    chunks = {}
+    header = None
+    i = 0
+    while i + DUMP_PACKAGE_BYTES <= len(data):
+        package = data[i:i + DUMP_PACKAGE_BYTES]
+        crc = package[-2] | (package[-1] << 8)
+        if package[0] != DUMP_START_BYTE or crc16(package[:-2]) != crc:
+            i += 1
+            continue
+        chunk_index, chunks_number, decimation, records_number, trigger_index = package[1:DUMP_HEADER_BYTES]
+        if chunk_index == 0:
+            chunks = {}
+        header = (chunks_number, decimation, records_number, trigger_index)
+        chunks[chunk_index] = package[DUMP_HEADER_BYTES:-2]
+        i += DUMP_PACKAGE_BYTES
+    return header, chunks
+
+
+def write_csv(header, chunks, out):
+    chunks_number, decimation, records_number, trigger_index = header
+    missing = [c for c in range(chunks_number) if c not in chunks]
+    if missing:
+        sys.exit("missing chunks: %s" % ", ".join(str(c) for c in missing))
+
+    records = b"".join(chunks[c] for c in range(chunks_number))
+    out.write("time_ms,duty_cycle,battery_current_adc,motor_speed_erps,foc_angle,hall_state,system_state,trigger\n")
+    for n in range(records_number):
+        r = records[n * RECORD_BYTES:(n + 1) * RECORD_BYTES]
+        # time relative to the trigger record, or to the first record if not triggered
+        reference = trigger_index if trigger_index != NO_TRIGGER else 0
+        time_ms = (n - reference) * decimation * PWM_CYCLE_MS
+        out.write("%.3f,%d,%d,%d,%d,%d,%d,%d\n" % (
+            time_ms,
+            r[0],
+            r[2] | (r[3] << 8),
+            r[4] | (r[5] << 8),
+            r[1],
+            r[6],
+            r[7],
+            1 if n == trigger_index else 0))
+
+
+def send_command(port, command, decimation, trigger_mask):
+    package = bytes([DISPLAY_START_BYTE, MESSAGE_ID, 0, 0, 0, command, decimation, trigger_mask])
+    crc = crc16(package)
+    port.write(package + bytes([crc & 0xff, crc >> 8]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="TSDZ2 flight recorder dump to CSV")
+    parser.add_argument("capture", nargs="?", help="raw capture of the motor controller UART TX")
+    parser.add_argument("--port", help="serial port connected to the motor controller")
+    parser.add_argument("--capture", dest="capture_out", help="save the raw capture from --port to this file")
+    parser.add_argument("--arm", action="store_true", help="clear records and start recording, do not dump")
+    parser.add_argument("--trigger", action="store_true", help="trigger now, then dump")
+    parser.add_argument("--decimation", type=int, default=16, help="record every N PWM cycles of 64 us (1-255)")
+    parser.add_argument("--trigger-mask", type=int, default=1, help="1: system error, 2: battery current at max")
+    parser.add_argument("--timeout", type=float, default=3.0, help="seconds to capture the dump")
+    args = parser.parse_args()
+
+    if args.port:
+        import serial
+
+        with serial.Serial(args.port, UART_BAUD_RATE, timeout=0.1) as port:
+            if args.arm:
+                send_command(port, COMMAND_ARM, args.decimation, args.trigger_mask)
+                return
+            if args.trigger:
+                send_command(port, COMMAND_TRIGGER, 0, 0)
+                time.sleep(0.2)
+            port.reset_input_buffer()
+            send_command(port, COMMAND_DUMP, 0, 0)
+            data = b""
+            end = time.time() + args.timeout
+            while time.time() < end:
+                data += port.read(256)
+        if args.capture_out:
+            with open(args.capture_out, "wb") as f:
+                f.write(data)
+    elif args.capture:
+        with open(args.capture, "rb") as f:
+            data = f.read()
+    else:
+        parser.error("a capture file or --port is needed")
+
+    header, chunks = find_chunks(data)
+    if header is None:
+        sys.exit("no flight recorder dump found")
+    write_csv(header, chunks, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()